@@ -1,10 +1,13 @@
 #pragma once
 
 #include "platform/m256.h"
+#include "platform/memory.h"
 #include "platform/concurrency.h"
+#include "platform/sequence_lock.h"
 #include "platform/uefi.h"
 #include "platform/file_io.h"
 #include "platform/time_stamp_counter.h"
+#include "platform/parallel_job.h"
 
 #include "network_messages/assets.h"
 
@@ -13,6 +16,7 @@
 #include "kangaroo_twelve.h"
 #include "four_q.h"
 #include "common_buffers.h"
+#include "probe_tags.h"
 
 
 
@@ -23,54 +27,217 @@ static constexpr unsigned long long assetDigestsSizeInBytes = (ASSETS_CAPACITY *
 static unsigned long long* assetChangeFlags = NULL;
 static char CONTRACT_ASSET_UNIT_OF_MEASUREMENT[7] = { 0, 0, 0, 0, 0, 0, 0 };
 
+// Index of the universe by public key, used for answering requests without probing the universe hash map. The records
+// whose public key falls into the same hash bucket (publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1)) form a linked list
+// starting with assetIndexFirst[bucket] and continued with assetIndexNext[universeIndex]. Records are only added
+// during the epoch, the index is rebuilt after reorganizing or loading the universe.
+#define NO_ASSET_INDEX 0xFFFFFFFF
+static unsigned int* assetIndexFirst = NULL;
+static unsigned int* assetIndexNext = NULL;
+static unsigned long long assetIndexGeneration = 0; // Number of rebuilds of the index, positions in lists are only valid within one generation
+
+// Tags of the public keys of the universe records for probing the universe hash map, maintained with the index above.
+// The public key is at the same offset in all record types.
+static ProbeTags<ASSETS_CAPACITY> assetProbeTags;
+
+// Index of the possession records by (issuer, asset name, owner, possessor, ownership managing contract, possession
+// managing contract), so the shares possessed in a specific way can be looked up without walking the issuance, ownership,
+// and possession probe sequences. Like the index by public key, the possession records of each hash bucket form a linked
+// list (assetPossessionIndexFirst[bucket], assetPossessionIndexNext[universeIndex]) that is extended during the epoch and
+// rebuilt after reorganizing or loading the universe.
+#define ASSET_POSSESSION_INDEX_BUCKETS (ASSETS_CAPACITY / 4)
+static unsigned int* assetPossessionIndexFirst = NULL;
+static unsigned int* assetPossessionIndexNext = NULL;
+
+// Number of parts of the parallel jobs of assetsEndEpoch() and getUniverseDigest() (each a range of the universe).
+// Each range covers whole words of assetChangeFlags, so parts never write the same flag word.
+static constexpr unsigned int UNIVERSE_JOB_PARTS = 256;
+static constexpr unsigned int UNIVERSE_JOB_RECORDS_PER_PART = ASSETS_CAPACITY / UNIVERSE_JOB_PARTS;
+static_assert(UNIVERSE_JOB_RECORDS_PER_PART % 64 == 0, "Parts must cover whole flag words");
+
+// Execution time of the stages of the last assetsEndEpoch()
+static unsigned long long universeReorgClearExecutionTicks = 0;     // clearing reorg buffer
+static unsigned long long universeReorgCompactExecutionTicks = 0;   // reinserting records with shares into reorg buffer
+static unsigned long long universeReorgCommitExecutionTicks = 0;    // copying changed records back, flagging them
+static unsigned long long universeReorgIndexExecutionTicks = 0;     // rebuilding indices
+static unsigned long long numberOfRecordsChangedByUniverseReorg = 0;
+
+// For reading the universe without universeLock. Writers change the universe while holding universeLock.
+static SequenceLock universeSeqLock;
+
 static bool initAssets()
 {
-    EFI_STATUS status;
-    if ((status = bs->AllocatePool(EfiRuntimeServicesData, ASSETS_CAPACITY * sizeof(Asset), (void**)&assets))
-        || (status = bs->AllocatePool(EfiRuntimeServicesData, assetDigestsSizeInBytes, (void**)&assetDigests))
-        || (status = bs->AllocatePool(EfiRuntimeServicesData, ASSETS_CAPACITY / 8, (void**)&assetChangeFlags)))
+    if (!allocatePool(ASSETS_CAPACITY * sizeof(Asset), (void**)&assets)
+        || !allocatePool(assetDigestsSizeInBytes, (void**)&assetDigests)
+        || !allocatePool(ASSETS_CAPACITY / 8, (void**)&assetChangeFlags)
+        || !allocatePool(ASSETS_CAPACITY * sizeof(unsigned int), (void**)&assetIndexFirst)
+        || !allocatePool(ASSETS_CAPACITY * sizeof(unsigned int), (void**)&assetIndexNext)
+        || !allocatePool(ASSET_POSSESSION_INDEX_BUCKETS * sizeof(unsigned int), (void**)&assetPossessionIndexFirst)
+        || !allocatePool(ASSETS_CAPACITY * sizeof(unsigned int), (void**)&assetPossessionIndexNext))
+    {
+        logToConsole(L"Failed to allocate universe memory!");
+
+        return false;
+    }
+    if (!assetProbeTags.init())
     {
-        logStatusToConsole(L"EFI_BOOT_SERVICES.AllocatePool() fails", status, __LINE__);
+        logToConsole(L"Failed to allocate universe probe tags!");
 
         return false;
     }
-    bs->SetMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0xFF);
+    setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0xFF);
+    setMem(assetIndexFirst, ASSETS_CAPACITY * sizeof(unsigned int), 0xFF);
+    setMem(assetPossessionIndexFirst, ASSET_POSSESSION_INDEX_BUCKETS * sizeof(unsigned int), 0xFF);
     return true;
 }
 
 static void deinitAssets()
 {
+    assetProbeTags.deinit();
+    if (assetPossessionIndexNext)
+    {
+        freePool(assetPossessionIndexNext);
+    }
+    if (assetPossessionIndexFirst)
+    {
+        freePool(assetPossessionIndexFirst);
+    }
+    if (assetIndexNext)
+    {
+        freePool(assetIndexNext);
+    }
+    if (assetIndexFirst)
+    {
+        freePool(assetIndexFirst);
+    }
     if (assetChangeFlags)
     {
-        bs->FreePool(assetChangeFlags);
+        freePool(assetChangeFlags);
     }
     if (assetDigests)
     {
-        bs->FreePool(assetDigests);
+        freePool(assetDigests);
     }
     if (assets)
     {
-        bs->FreePool(assets);
+        freePool(assets);
+    }
+}
+
+// Add non-empty record to the index (requires universeLock and universeSeqLock.beginWrite())
+static void addAssetToIndex(unsigned int universeIndex)
+{
+    const unsigned int bucket = assets[universeIndex].varStruct.issuance.publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
+    assetIndexNext[universeIndex] = assetIndexFirst[bucket];
+    assetIndexFirst[bucket] = universeIndex;
+    assetProbeTags.set(universeIndex, assets[universeIndex].varStruct.issuance.publicKey);
+}
+
+static unsigned int assetPossessionIndexBucket(unsigned long long assetName, const m256i& issuer, const m256i& owner, const m256i& possessor,
+    unsigned short ownershipManagingContractIndex, unsigned short possessionManagingContractIndex)
+{
+    // Multiplying after each step, so equal keys (owner == possessor == issuer is common) do not cancel out
+    constexpr unsigned long long multiplier = 0x9E3779B97F4A7C15ULL;
+    unsigned long long hash = (issuer.m256i_u64[0] ^ assetName) * multiplier;
+    hash = (hash ^ owner.m256i_u64[0]) * multiplier;
+    hash = (hash ^ possessor.m256i_u64[0]) * multiplier;
+    hash = (hash ^ ((unsigned long long)ownershipManagingContractIndex << 16) ^ possessionManagingContractIndex) * multiplier;
+    return (unsigned int)(hash >> 32) & (ASSET_POSSESSION_INDEX_BUCKETS - 1);
+}
+
+// Return universe index of the possession record matching all parameters or -1 if there is none (requires universeLock
+// or a read section of universeSeqLock).
+static int findAssetPossession(unsigned long long assetName, const m256i& issuer, const m256i& owner, const m256i& possessor,
+    unsigned short ownershipManagingContractIndex, unsigned short possessionManagingContractIndex)
+{
+    const unsigned int bucket = assetPossessionIndexBucket(assetName, issuer, owner, possessor, ownershipManagingContractIndex, possessionManagingContractIndex);
+    for (unsigned int possessionIndex = assetPossessionIndexFirst[bucket]; possessionIndex != NO_ASSET_INDEX; possessionIndex = assetPossessionIndexNext[possessionIndex])
+    {
+        const auto& possession = assets[possessionIndex].varStruct.possession;
+        if (possession.publicKey == possessor && possession.managingContractIndex == possessionManagingContractIndex)
+        {
+            const auto& ownership = assets[possession.ownershipIndex].varStruct.ownership;
+            if (ownership.publicKey == owner && ownership.managingContractIndex == ownershipManagingContractIndex)
+            {
+                const auto& issuance = assets[ownership.issuanceIndex].varStruct.issuance;
+                if (issuance.publicKey == issuer && ((*((unsigned long long*)issuance.name)) & 0xFFFFFFFFFFFFFF) == assetName)
+                {
+                    return possessionIndex;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+// Add possession record to the possession index (requires universeLock and universeSeqLock.beginWrite()). Its ownership
+// and issuance records have to be set already.
+static void addAssetPossessionToIndex(unsigned int possessionIndex)
+{
+    const auto& possession = assets[possessionIndex].varStruct.possession;
+    const auto& ownership = assets[possession.ownershipIndex].varStruct.ownership;
+    const auto& issuance = assets[ownership.issuanceIndex].varStruct.issuance;
+    const unsigned long long assetName = *((unsigned long long*)issuance.name) & 0xFFFFFFFFFFFFFF;
+
+    // Transfers add shares to the existing record, so there is at most one record per key and the first match found
+    // by findAssetPossession() is the only one
+    ASSERT(findAssetPossession(assetName, issuance.publicKey, ownership.publicKey, possession.publicKey,
+        ownership.managingContractIndex, possession.managingContractIndex) < 0);
+
+    const unsigned int bucket = assetPossessionIndexBucket(assetName, issuance.publicKey, ownership.publicKey, possession.publicKey,
+        ownership.managingContractIndex, possession.managingContractIndex);
+    assetPossessionIndexNext[possessionIndex] = assetPossessionIndexFirst[bucket];
+    assetPossessionIndexFirst[bucket] = possessionIndex;
+}
+
+// Rebuild the indices from all records of the universe (requires universeLock and universeSeqLock.beginWrite())
+static void rebuildAssetIndex()
+{
+    setMem(assetIndexFirst, ASSETS_CAPACITY * sizeof(unsigned int), 0xFF);
+    setMem(assetPossessionIndexFirst, ASSET_POSSESSION_INDEX_BUCKETS * sizeof(unsigned int), 0xFF);
+    assetProbeTags.clear(0, ASSETS_CAPACITY);
+    assetIndexGeneration++;
+
+    // Going backwards, so each list is ordered by universe index
+    for (unsigned int universeIndex = ASSETS_CAPACITY; universeIndex-- > 0; )
+    {
+        if (assets[universeIndex].varStruct.issuance.type != EMPTY)
+        {
+            addAssetToIndex(universeIndex);
+            if (assets[universeIndex].varStruct.possession.type == POSSESSION)
+            {
+                addAssetPossessionToIndex(universeIndex);
+            }
+        }
     }
 }
 
 static long long issueAsset(const m256i& issuerPublicKey, char name[7], char numberOfDecimalPlaces, char unitOfMeasurement[7], long long numberOfShares, unsigned short managingContractIndex,
     int* issuanceIndex, int* ownershipIndex, int* possessionIndex)
 {
-    *issuanceIndex = issuerPublicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
+    const unsigned int homeIndex = issuerPublicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
+    const unsigned char tag = assetProbeTags.tagOf(issuerPublicKey);
+    unsigned int keyComparisons = 1;
 
     ACQUIRE(universeLock);
 
+    // Only records of the issuer and empty slots need to be checked
+    *issuanceIndex = assetProbeTags.nextCandidate(homeIndex, tag);
 iteration:
     if (assets[*issuanceIndex].varStruct.issuance.type == EMPTY)
     {
+        universeSeqLock.beginWrite();
+
         assets[*issuanceIndex].varStruct.issuance.publicKey = issuerPublicKey;
         assets[*issuanceIndex].varStruct.issuance.type = ISSUANCE;
-        bs->CopyMem(assets[*issuanceIndex].varStruct.issuance.name, name, sizeof(assets[*issuanceIndex].varStruct.issuance.name));
+        copyMem(assets[*issuanceIndex].varStruct.issuance.name, name, sizeof(assets[*issuanceIndex].varStruct.issuance.name));
         assets[*issuanceIndex].varStruct.issuance.numberOfDecimalPlaces = numberOfDecimalPlaces;
-        bs->CopyMem(assets[*issuanceIndex].varStruct.issuance.unitOfMeasurement, unitOfMeasurement, sizeof(assets[*issuanceIndex].varStruct.issuance.unitOfMeasurement));
+        copyMem(assets[*issuanceIndex].varStruct.issuance.unitOfMeasurement, unitOfMeasurement, sizeof(assets[*issuanceIndex].varStruct.issuance.unitOfMeasurement));
 
-        *ownershipIndex = (*issuanceIndex + 1) & (ASSETS_CAPACITY - 1);
+        addAssetToIndex(*issuanceIndex);
+        assetProbeTags.countProbe(homeIndex, *issuanceIndex, keyComparisons);
+
+        *ownershipIndex = assetProbeTags.nextCandidate((*issuanceIndex + 1) & (ASSETS_CAPACITY - 1), 0);
     iteration2:
         if (assets[*ownershipIndex].varStruct.ownership.type == EMPTY)
         {
@@ -79,8 +246,9 @@ iteration:
             assets[*ownershipIndex].varStruct.ownership.managingContractIndex = managingContractIndex;
             assets[*ownershipIndex].varStruct.ownership.issuanceIndex = *issuanceIndex;
             assets[*ownershipIndex].varStruct.ownership.numberOfShares = numberOfShares;
+            addAssetToIndex(*ownershipIndex);
 
-            *possessionIndex = (*ownershipIndex + 1) & (ASSETS_CAPACITY - 1);
+            *possessionIndex = assetProbeTags.nextCandidate((*ownershipIndex + 1) & (ASSETS_CAPACITY - 1), 0);
         iteration3:
             if (assets[*possessionIndex].varStruct.possession.type == EMPTY)
             {
@@ -89,11 +257,15 @@ iteration:
                 assets[*possessionIndex].varStruct.possession.managingContractIndex = managingContractIndex;
                 assets[*possessionIndex].varStruct.possession.ownershipIndex = *ownershipIndex;
                 assets[*possessionIndex].varStruct.possession.numberOfShares = numberOfShares;
+                addAssetToIndex(*possessionIndex);
+                addAssetPossessionToIndex(*possessionIndex);
 
                 assetChangeFlags[*issuanceIndex >> 6] |= (1ULL << (*issuanceIndex & 63));
                 assetChangeFlags[*ownershipIndex >> 6] |= (1ULL << (*ownershipIndex & 63));
                 assetChangeFlags[*possessionIndex >> 6] |= (1ULL << (*possessionIndex & 63));
 
+                universeSeqLock.endWrite();
+
                 RELEASE(universeLock);
 
                 AssetIssuance assetIssuance;
@@ -126,11 +298,13 @@ iteration:
             && ((*((unsigned long long*)assets[*issuanceIndex].varStruct.issuance.name)) & 0xFFFFFFFFFFFFFF) == ((*((unsigned long long*)name)) & 0xFFFFFFFFFFFFFF)
             && assets[*issuanceIndex].varStruct.issuance.publicKey == issuerPublicKey)
         {
+            assetProbeTags.countProbe(homeIndex, *issuanceIndex, keyComparisons);
             RELEASE(universeLock);
             return 0;
         }
 
-        *issuanceIndex = (*issuanceIndex + 1) & (ASSETS_CAPACITY - 1);
+        *issuanceIndex = assetProbeTags.nextCandidate((*issuanceIndex + 1) & (ASSETS_CAPACITY - 1), tag);
+        keyComparisons++;
 
         goto iteration;
     }
@@ -162,7 +336,11 @@ static bool transferShareOwnershipAndPossession(int sourceOwnershipIndex, int so
         return false;
     }
 
-    *destinationOwnershipIndex = destinationPublicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
+    // Only records of the destination and empty slots need to be checked
+    const unsigned int homeIndex = destinationPublicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
+    const unsigned char tag = assetProbeTags.tagOf(destinationPublicKey);
+    unsigned int keyComparisons = 1;
+    *destinationOwnershipIndex = assetProbeTags.nextCandidate(homeIndex, tag);
 iteration:
     if (assets[*destinationOwnershipIndex].varStruct.ownership.type == EMPTY
         || (assets[*destinationOwnershipIndex].varStruct.ownership.type == OWNERSHIP
@@ -170,6 +348,8 @@ iteration:
             && assets[*destinationOwnershipIndex].varStruct.ownership.issuanceIndex == assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex
             && assets[*destinationOwnershipIndex].varStruct.ownership.publicKey == destinationPublicKey))
     {
+        universeSeqLock.beginWrite();
+
         assets[sourceOwnershipIndex].varStruct.ownership.numberOfShares -= numberOfShares;
 
         if (assets[*destinationOwnershipIndex].varStruct.ownership.type == EMPTY)
@@ -178,10 +358,13 @@ iteration:
             assets[*destinationOwnershipIndex].varStruct.ownership.type = OWNERSHIP;
             assets[*destinationOwnershipIndex].varStruct.ownership.managingContractIndex = assets[sourceOwnershipIndex].varStruct.ownership.managingContractIndex;
             assets[*destinationOwnershipIndex].varStruct.ownership.issuanceIndex = assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex;
+            addAssetToIndex(*destinationOwnershipIndex);
         }
         assets[*destinationOwnershipIndex].varStruct.ownership.numberOfShares += numberOfShares;
+        assetProbeTags.countProbe(homeIndex, *destinationOwnershipIndex, keyComparisons);
 
-        *destinationPossessionIndex = destinationPublicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
+        keyComparisons = 1;
+        *destinationPossessionIndex = assetProbeTags.nextCandidate(homeIndex, tag);
     iteration2:
         if (assets[*destinationPossessionIndex].varStruct.possession.type == EMPTY
             || (assets[*destinationPossessionIndex].varStruct.possession.type == POSSESSION
@@ -197,14 +380,19 @@ iteration:
                 assets[*destinationPossessionIndex].varStruct.possession.type = POSSESSION;
                 assets[*destinationPossessionIndex].varStruct.possession.managingContractIndex = assets[sourcePossessionIndex].varStruct.possession.managingContractIndex;
                 assets[*destinationPossessionIndex].varStruct.possession.ownershipIndex = *destinationOwnershipIndex;
+                addAssetToIndex(*destinationPossessionIndex);
+                addAssetPossessionToIndex(*destinationPossessionIndex);
             }
             assets[*destinationPossessionIndex].varStruct.possession.numberOfShares += numberOfShares;
+            assetProbeTags.countProbe(homeIndex, *destinationPossessionIndex, keyComparisons);
 
             assetChangeFlags[sourceOwnershipIndex >> 6] |= (1ULL << (sourceOwnershipIndex & 63));
             assetChangeFlags[sourcePossessionIndex >> 6] |= (1ULL << (sourcePossessionIndex & 63));
             assetChangeFlags[*destinationOwnershipIndex >> 6] |= (1ULL << (*destinationOwnershipIndex & 63));
             assetChangeFlags[*destinationPossessionIndex >> 6] |= (1ULL << (*destinationPossessionIndex & 63));
 
+            universeSeqLock.endWrite();
+
             if (lock)
             {
                 RELEASE(universeLock);
@@ -234,30 +422,48 @@ iteration:
         }
         else
         {
-            *destinationPossessionIndex = (*destinationPossessionIndex + 1) & (ASSETS_CAPACITY - 1);
+            *destinationPossessionIndex = assetProbeTags.nextCandidate((*destinationPossessionIndex + 1) & (ASSETS_CAPACITY - 1), tag);
+            keyComparisons++;
 
             goto iteration2;
         }
     }
     else
     {
-        *destinationOwnershipIndex = (*destinationOwnershipIndex + 1) & (ASSETS_CAPACITY - 1);
+        *destinationOwnershipIndex = assetProbeTags.nextCandidate((*destinationOwnershipIndex + 1) & (ASSETS_CAPACITY - 1), tag);
+        keyComparisons++;
 
         goto iteration;
     }
 }
 
-// Should only be called from tick processor to avoid concurrent asset state changes, which may cause race conditions
-static void getUniverseDigest(m256i& digest)
+static void hashChangedUniverseLeavesPart(void* context, unsigned int partIndex)
 {
-    unsigned int digestIndex;
-    for (digestIndex = 0; digestIndex < ASSETS_CAPACITY; digestIndex++)
+    const unsigned int beginWord = partIndex * (UNIVERSE_JOB_RECORDS_PER_PART / 64);
+    for (unsigned int w = beginWord; w < beginWord + UNIVERSE_JOB_RECORDS_PER_PART / 64; w++)
     {
-        if (assetChangeFlags[digestIndex >> 6] & (1ULL << (digestIndex & 63)))
+        unsigned long long flags = assetChangeFlags[w];
+        while (flags)
         {
-            KangarooTwelve(&assets[digestIndex], sizeof(Asset), &assetDigests[digestIndex], 32);
+            const unsigned int universeIndex = w * 64 + (unsigned int)_tzcnt_u64(flags);
+            flags &= flags - 1;
+            KangarooTwelve(&assets[universeIndex], sizeof(Asset), &assetDigests[universeIndex], 32);
         }
     }
+}
+
+// Should only be called from tick processor to avoid concurrent asset state changes, which may cause race conditions.
+// The digests are changed like the universe (holding universeLock in a write section of universeSeqLock), so readers
+// get records and siblings of the same state.
+static void getUniverseDigest(m256i& digest)
+{
+    ACQUIRE(universeLock);
+    universeSeqLock.beginWrite();
+
+    // Changed leaves are independent, so they are hashed by all idle processors
+    parallelJob.run(hashChangedUniverseLeavesPart, nullptr, UNIVERSE_JOB_PARTS);
+
+    unsigned int digestIndex = ASSETS_CAPACITY;
     unsigned int previousLevelBeginning = 0;
     unsigned int numberOfLeafs = ASSETS_CAPACITY;
     while (numberOfLeafs > 1)
@@ -278,44 +484,115 @@ static void getUniverseDigest(m256i& digest)
     assetChangeFlags[0] = 0;
 
     digest = assetDigests[(ASSETS_CAPACITY * 2 - 1) - 1];
+
+    universeSeqLock.endWrite();
+    RELEASE(universeLock);
 }
 
 
+// Maximum number of universe indices collected by collectAssetRecords()
+#define ASSET_RECORD_BATCH_SIZE 64
+
+// Position in the index list of a public key, for collecting its records in batches with collectAssetRecords()
+struct AssetRecordCursor
+{
+    unsigned int nextUniverseIndex; // Next list element to visit or NO_ASSET_INDEX at the end of the list
+    unsigned long long indexGeneration;
+};
+
+// Set cursor to the beginning of the index list of publicKey.
+static void beginAssetRecords(const m256i& publicKey, AssetRecordCursor& cursor)
+{
+    long long sequence;
+    do
+    {
+        sequence = universeSeqLock.beginRead();
+        cursor.nextUniverseIndex = assetIndexFirst[publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1)];
+        cursor.indexGeneration = assetIndexGeneration;
+    } while (!universeSeqLock.endRead(sequence));
+}
+
+// Collect the universe indices of the next records with type and publicKey in the order of the index list, continuing
+// the walk at cursor, which is advanced behind the last collected record. So the list is only traversed once for all
+// batches. Each batch is collected in one read section of universeSeqLock, which is repeated if the universe is changed
+// meanwhile. Records added to the list after beginAssetRecords() are not collected (they are added at the beginning).
+// If the index has been rebuilt since (after reorganizing or loading the universe), the positions are not valid
+// anymore and no more records are collected. Returns the number of indices written to universeIndices, which is
+// ASSET_RECORD_BATCH_SIZE if there may be more records.
+static unsigned int collectAssetRecords(const m256i& publicKey, unsigned char type, AssetRecordCursor& cursor,
+    unsigned int universeIndices[ASSET_RECORD_BATCH_SIZE])
+{
+    unsigned int numberOfRecords;
+    unsigned int universeIndex;
+    long long sequence;
+    do
+    {
+        sequence = universeSeqLock.beginRead();
+        numberOfRecords = 0;
+        universeIndex = (assetIndexGeneration == cursor.indexGeneration) ? cursor.nextUniverseIndex : NO_ASSET_INDEX;
+
+        // The list may be changed while it is traversed, so the length is limited and the indices are bound-checked
+        for (unsigned int i = 0; i < ASSETS_CAPACITY && universeIndex < ASSETS_CAPACITY && numberOfRecords < ASSET_RECORD_BATCH_SIZE; i++)
+        {
+            // Type and public key are at the same offset in all record types
+            if (assets[universeIndex].varStruct.issuance.type == type
+                && assets[universeIndex].varStruct.issuance.publicKey == publicKey)
+            {
+                universeIndices[numberOfRecords++] = universeIndex;
+            }
+            universeIndex = assetIndexNext[universeIndex];
+        }
+    } while (!universeSeqLock.endRead(sequence));
+
+    cursor.nextUniverseIndex = (universeIndex < ASSETS_CAPACITY) ? universeIndex : NO_ASSET_INDEX;
+    return numberOfRecords;
+}
+
+// The asset request handlers respond with the records in the order of the index list of the public key: the records
+// added during the epoch (newest first), followed by the records present at the last rebuild of the index (start of the
+// epoch) in ascending universe index. This is not the order of the universe hash map's probe sequence.
 static void processRequestIssuedAssets(Peer* peer, RequestResponseHeader* header)
 {
     RespondIssuedAssets response;
 
     RequestIssuedAssets* request = header->getPayload<RequestIssuedAssets>();
 
-    unsigned int universeIndex = request->publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-
-    ACQUIRE(universeLock);
-
-iteration:
-    if (universeIndex >= ASSETS_CAPACITY
-        || assets[universeIndex].varStruct.issuance.type == EMPTY)
-    {
-        enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
-    }
-    else
+    // Read universe without universeLock, so the request processors never block the tick processor
+    unsigned int universeIndices[ASSET_RECORD_BATCH_SIZE];
+    unsigned int numberOfRecords;
+    AssetRecordCursor cursor;
+    beginAssetRecords(request->publicKey, cursor);
+    do
     {
-        if (assets[universeIndex].varStruct.issuance.type == ISSUANCE
-            && assets[universeIndex].varStruct.issuance.publicKey == request->publicKey)
+        numberOfRecords = collectAssetRecords(request->publicKey, ISSUANCE, cursor, universeIndices);
+        for (unsigned int i = 0; i < numberOfRecords; i++)
         {
-            bs->CopyMem(&response.asset, &assets[universeIndex], sizeof(Asset));
-            response.tick = system.tick;
-            response.universeIndex = universeIndex;
-            getSiblings<ASSETS_DEPTH>(response.universeIndex, assetDigests, response.siblings);
-
-            enqueueResponse(peer, sizeof(response), RespondIssuedAssets::type, header->dejavu(), &response);
-        }
+            // The record may have been moved by reorganizing the universe since it has been collected
+            bool found;
+            long long sequence;
+            do
+            {
+                sequence = universeSeqLock.beginRead();
+                found = assets[universeIndices[i]].varStruct.issuance.type == ISSUANCE
+                    && assets[universeIndices[i]].varStruct.issuance.publicKey == request->publicKey;
+                if (found)
+                {
+                    copyMem(&response.asset, &assets[universeIndices[i]], sizeof(Asset));
+                    getSiblings<ASSETS_DEPTH>(universeIndices[i], assetDigests, response.siblings);
+                }
+            } while (!universeSeqLock.endRead(sequence));
 
-        universeIndex = (universeIndex + 1) & (ASSETS_CAPACITY - 1);
+            if (found)
+            {
+                response.tick = system.tick;
+                response.universeIndex = universeIndices[i];
 
-        goto iteration;
-    }
+                enqueueResponse(peer, sizeof(response), RespondIssuedAssets::type, header->dejavu(), &response);
+            }
+        }
+    } while (numberOfRecords == ASSET_RECORD_BATCH_SIZE);
 
-    RELEASE(universeLock);
+    enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
 }
 
 static void processRequestOwnedAssets(Peer* peer, RequestResponseHeader* header)
@@ -324,36 +601,44 @@ static void processRequestOwnedAssets(Peer* peer, RequestResponseHeader* header)
 
     RequestOwnedAssets* request = header->getPayload<RequestOwnedAssets>();
 
-    unsigned int universeIndex = request->publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-
-    ACQUIRE(universeLock);
-
-iteration:
-    if (universeIndex >= ASSETS_CAPACITY
-        || assets[universeIndex].varStruct.issuance.type == EMPTY)
+    // Read universe without universeLock, so the request processors never block the tick processor
+    unsigned int universeIndices[ASSET_RECORD_BATCH_SIZE];
+    unsigned int numberOfRecords;
+    AssetRecordCursor cursor;
+    beginAssetRecords(request->publicKey, cursor);
+    do
     {
-        enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
-    }
-    else
-    {
-        if (assets[universeIndex].varStruct.issuance.type == OWNERSHIP
-            && assets[universeIndex].varStruct.issuance.publicKey == request->publicKey)
+        numberOfRecords = collectAssetRecords(request->publicKey, OWNERSHIP, cursor, universeIndices);
+        for (unsigned int i = 0; i < numberOfRecords; i++)
         {
-            bs->CopyMem(&response.asset, &assets[universeIndex], sizeof(Asset));
-            bs->CopyMem(&response.issuanceAsset, &assets[assets[universeIndex].varStruct.ownership.issuanceIndex], sizeof(Asset));
-            response.tick = system.tick;
-            response.universeIndex = universeIndex;
-            getSiblings<ASSETS_DEPTH>(response.universeIndex, assetDigests, response.siblings);
-
-            enqueueResponse(peer, sizeof(response), RespondOwnedAssets::type, header->dejavu(), &response);
-        }
+            // The record may have been moved by reorganizing the universe since it has been collected
+            bool found;
+            long long sequence;
+            do
+            {
+                sequence = universeSeqLock.beginRead();
+                found = assets[universeIndices[i]].varStruct.ownership.type == OWNERSHIP
+                    && assets[universeIndices[i]].varStruct.ownership.publicKey == request->publicKey;
+                if (found)
+                {
+                    copyMem(&response.asset, &assets[universeIndices[i]], sizeof(Asset));
+                    const unsigned int issuanceIndex = response.asset.varStruct.ownership.issuanceIndex & (ASSETS_CAPACITY - 1);
+                    copyMem(&response.issuanceAsset, &assets[issuanceIndex], sizeof(Asset));
+                    getSiblings<ASSETS_DEPTH>(universeIndices[i], assetDigests, response.siblings);
+                }
+            } while (!universeSeqLock.endRead(sequence));
 
-        universeIndex = (universeIndex + 1) & (ASSETS_CAPACITY - 1);
+            if (found)
+            {
+                response.tick = system.tick;
+                response.universeIndex = universeIndices[i];
 
-        goto iteration;
-    }
+                enqueueResponse(peer, sizeof(response), RespondOwnedAssets::type, header->dejavu(), &response);
+            }
+        }
+    } while (numberOfRecords == ASSET_RECORD_BATCH_SIZE);
 
-    RELEASE(universeLock);
+    enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
 }
 
 static void processRequestPossessedAssets(Peer* peer, RequestResponseHeader* header)
@@ -362,37 +647,46 @@ static void processRequestPossessedAssets(Peer* peer, RequestResponseHeader* hea
 
     RequestPossessedAssets* request = header->getPayload<RequestPossessedAssets>();
 
-    unsigned int universeIndex = request->publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-
-    ACQUIRE(universeLock);
-
-iteration:
-    if (universeIndex >= ASSETS_CAPACITY
-        || assets[universeIndex].varStruct.issuance.type == EMPTY)
+    // Read universe without universeLock, so the request processors never block the tick processor
+    unsigned int universeIndices[ASSET_RECORD_BATCH_SIZE];
+    unsigned int numberOfRecords;
+    AssetRecordCursor cursor;
+    beginAssetRecords(request->publicKey, cursor);
+    do
     {
-        enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
-    }
-    else
-    {
-        if (assets[universeIndex].varStruct.issuance.type == POSSESSION
-            && assets[universeIndex].varStruct.issuance.publicKey == request->publicKey)
+        numberOfRecords = collectAssetRecords(request->publicKey, POSSESSION, cursor, universeIndices);
+        for (unsigned int i = 0; i < numberOfRecords; i++)
         {
-            bs->CopyMem(&response.asset, &assets[universeIndex], sizeof(Asset));
-            bs->CopyMem(&response.ownershipAsset, &assets[assets[universeIndex].varStruct.possession.ownershipIndex], sizeof(Asset));
-            bs->CopyMem(&response.issuanceAsset, &assets[assets[assets[universeIndex].varStruct.possession.ownershipIndex].varStruct.ownership.issuanceIndex], sizeof(Asset));
-            response.tick = system.tick;
-            response.universeIndex = universeIndex;
-            getSiblings<ASSETS_DEPTH>(response.universeIndex, assetDigests, response.siblings);
-
-            enqueueResponse(peer, sizeof(response), RespondPossessedAssets::type, header->dejavu(), &response);
-        }
+            // The record may have been moved by reorganizing the universe since it has been collected
+            bool found;
+            long long sequence;
+            do
+            {
+                sequence = universeSeqLock.beginRead();
+                found = assets[universeIndices[i]].varStruct.possession.type == POSSESSION
+                    && assets[universeIndices[i]].varStruct.possession.publicKey == request->publicKey;
+                if (found)
+                {
+                    copyMem(&response.asset, &assets[universeIndices[i]], sizeof(Asset));
+                    const unsigned int ownershipIndex = response.asset.varStruct.possession.ownershipIndex & (ASSETS_CAPACITY - 1);
+                    copyMem(&response.ownershipAsset, &assets[ownershipIndex], sizeof(Asset));
+                    const unsigned int issuanceIndex = response.ownershipAsset.varStruct.ownership.issuanceIndex & (ASSETS_CAPACITY - 1);
+                    copyMem(&response.issuanceAsset, &assets[issuanceIndex], sizeof(Asset));
+                    getSiblings<ASSETS_DEPTH>(universeIndices[i], assetDigests, response.siblings);
+                }
+            } while (!universeSeqLock.endRead(sequence));
 
-        universeIndex = (universeIndex + 1) & (ASSETS_CAPACITY - 1);
+            if (found)
+            {
+                response.tick = system.tick;
+                response.universeIndex = universeIndices[i];
 
-        goto iteration;
-    }
+                enqueueResponse(peer, sizeof(response), RespondPossessedAssets::type, header->dejavu(), &response);
+            }
+        }
+    } while (numberOfRecords == ASSET_RECORD_BATCH_SIZE);
 
-    RELEASE(universeLock);
+    enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
 }
 
 static bool saveUniverse(CHAR16* directory = NULL)
@@ -419,25 +713,93 @@ static bool saveUniverse(CHAR16* directory = NULL)
 
 static bool loadUniverse(CHAR16* directory = NULL)
 {
+    ACQUIRE(universeLock);
+    universeSeqLock.beginWrite();
+
     long long loadedSize = load(UNIVERSE_FILE_NAME, ASSETS_CAPACITY * sizeof(Asset), (unsigned char*)assets, directory);
     if (loadedSize != ASSETS_CAPACITY * sizeof(Asset))
     {
+        universeSeqLock.endWrite();
+        RELEASE(universeLock);
+
         logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() reads invalid number of bytes", loadedSize, __LINE__);
 
         return false;
     }
+    rebuildAssetIndex();
+
+    universeSeqLock.endWrite();
+    RELEASE(universeLock);
+
     return true;
 }
 
+static void clearUniverseReorgBufferPart(void* context, unsigned int partIndex)
+{
+    Asset* reorgAssets = (Asset*)context;
+    setMem(&reorgAssets[partIndex * UNIVERSE_JOB_RECORDS_PER_PART], UNIVERSE_JOB_RECORDS_PER_PART * sizeof(Asset), 0);
+}
+
+// Copy the records of the part that differ from the reorganized ones and flag them for getUniverseDigest()
+static void commitUniverseReorgPart(void* context, unsigned int partIndex)
+{
+    const Asset* reorgAssets = (const Asset*)context;
+    const unsigned int beginIndex = partIndex * UNIVERSE_JOB_RECORDS_PER_PART;
+    unsigned long long numberOfChangedRecords = 0;
+    for (unsigned int universeIndex = beginIndex; universeIndex < beginIndex + UNIVERSE_JOB_RECORDS_PER_PART; universeIndex++)
+    {
+        const unsigned long long* oldRecord = (const unsigned long long*)&assets[universeIndex];
+        const unsigned long long* newRecord = (const unsigned long long*)&reorgAssets[universeIndex];
+        unsigned long long difference = 0;
+        for (unsigned int i = 0; i < sizeof(Asset) / sizeof(unsigned long long); i++)
+        {
+            difference |= oldRecord[i] ^ newRecord[i];
+        }
+        if (difference)
+        {
+            copyMem(&assets[universeIndex], &reorgAssets[universeIndex], sizeof(Asset));
+            assetChangeFlags[universeIndex >> 6] |= (1ULL << (universeIndex & 63));
+            numberOfChangedRecords++;
+        }
+    }
+    _InterlockedExchangeAdd64((volatile long long*)&numberOfRecordsChangedByUniverseReorg, numberOfChangedRecords);
+}
+
+// Number of possession records ahead of the current one whose records are prefetched while compacting the universe
+static constexpr unsigned int UNIVERSE_REORG_PREFETCH_DISTANCE = 8;
+
 void assetsEndEpoch()
 {
     ACQUIRE(universeLock);
-
-    // TODO: comment what is done here
+    universeSeqLock.beginWrite();
+
+    // Rebuild the universe without records of zero shares: each possession record with shares is inserted into an empty
+    // universe in index order together with its ownership and issuance records (merging equal records). Clearing the
+    // buffer and copying the result back are distributed to idle processors. Only records that are changed are flagged
+    // for rehashing.
+    //
+    // The insertion (compaction) is not partitioned, although it is the most expensive stage. The universe layout is
+    // part of the consensus (universe digest), so it has to be exactly the one of inserting in index order: a record
+    // takes the first free slot of its linear probe sequence, which depends on all records inserted before, and probe
+    // sequences of any home slot can cross any partition boundary (or wrap around the end). Ownership and possession
+    // records also refer to the new indices of the issuance and ownership records inserted before them. Partitioning by
+    // source range or by home slot would thus need a serial fixup pass over the same random accesses. Instead, the loop
+    // overlaps the cache misses of consecutive insertions by prefetching.
+    const unsigned long long clearStartTick = __rdtsc();
     Asset* reorgAssets = (Asset*)reorgBuffer;
-    bs->SetMem(reorgAssets, ASSETS_CAPACITY * sizeof(Asset), 0);
+    parallelJob.run(clearUniverseReorgBufferPart, reorgAssets, UNIVERSE_JOB_PARTS);
+
+    const unsigned long long compactStartTick = __rdtsc();
     for (unsigned int i = 0; i < ASSETS_CAPACITY; i++)
     {
+        // The records of the next possessions are independent random accesses, so their cache misses can overlap
+        const unsigned int prefetchIndex = (i + UNIVERSE_REORG_PREFETCH_DISTANCE) & (ASSETS_CAPACITY - 1);
+        if (assets[prefetchIndex].varStruct.possession.type == POSSESSION)
+        {
+            _mm_prefetch((const char*)&assets[assets[prefetchIndex].varStruct.possession.ownershipIndex], _MM_HINT_T0);
+            _mm_prefetch((const char*)&reorgAssets[assets[prefetchIndex].varStruct.possession.publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1)], _MM_HINT_T0);
+        }
+
         if (assets[i].varStruct.possession.type == POSSESSION
             && assets[i].varStruct.possession.numberOfShares > 0)
         {
@@ -454,7 +816,7 @@ void assetsEndEpoch()
             {
                 if (reorgAssets[issuanceIndex].varStruct.issuance.type == EMPTY)
                 {
-                    bs->CopyMem(&reorgAssets[issuanceIndex], &assets[oldIssuanceIndex], sizeof(Asset));
+                    copyMem(&reorgAssets[issuanceIndex], &assets[oldIssuanceIndex], sizeof(Asset));
                 }
 
                 const m256i& ownerPublicKey = assets[oldOwnershipIndex].varStruct.ownership.publicKey;
@@ -514,9 +876,20 @@ void assetsEndEpoch()
             }
         }
     }
-    bs->CopyMem(assets, reorgAssets, ASSETS_CAPACITY * sizeof(Asset));
 
-    bs->SetMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0xFF);
+    const unsigned long long commitStartTick = __rdtsc();
+    numberOfRecordsChangedByUniverseReorg = 0;
+    parallelJob.run(commitUniverseReorgPart, reorgAssets, UNIVERSE_JOB_PARTS);
+
+    const unsigned long long indexStartTick = __rdtsc();
+    rebuildAssetIndex();
+
+    const unsigned long long endTick = __rdtsc();
+    universeReorgClearExecutionTicks = compactStartTick - clearStartTick;
+    universeReorgCompactExecutionTicks = commitStartTick - compactStartTick;
+    universeReorgCommitExecutionTicks = indexStartTick - commitStartTick;
+    universeReorgIndexExecutionTicks = endTick - indexStartTick;
 
+    universeSeqLock.endWrite();
     RELEASE(universeLock);
 }
@@ -92,6 +92,9 @@ typedef struct
 } point_precomp;
 typedef point_precomp point_precomp_t[1];
 
+// Maximum number of signatures verified together by one iteration of verifyBatch()
+#define VERIFY_BATCH_SIZE 16
+
 static const unsigned long long PARAMETER_d[4] = { 0x0000000000000142, 0x00000000000000E4, 0xB3821488F1FC0C8D, 0x5E472F846657E0FC };
 static const unsigned long long curve_order[4] = { CURVE_ORDER_0, CURVE_ORDER_1, CURVE_ORDER_2, CURVE_ORDER_3 };
 static const unsigned long long Montgomery_Rprime[4] = { 0xC81DB8795FF3D621, 0x173EA5AAEA6B387D, 0x3D01B7C72136F61C, 0x0006A5F16AC8F9D3 };
@@ -730,6 +733,68 @@ static void eccnorm(point_extproj_t P, point_t Q)
     mod1271(Q->y[1]);
 }
 
+static void eccnorm_batch(point_extproj* P, point_affine* Q, unsigned int n)
+{ // Normalize n projective points (X1:Y1:Z1), including full reduction
+  // Uses Montgomery's trick to share a single field inversion between all points, so this is cheaper than
+  // calling eccnorm() n times. n must not exceed VERIFY_BATCH_SIZE.
+    felm_t norms[VERIFY_BATCH_SIZE], products[VERIFY_BATCH_SIZE], inverse, t0, t1;
+
+    if (!n)
+    {
+        return;
+    }
+
+    // products[i] = norm(Z_0) * ... * norm(Z_i), where norm(Z) = z0^2 + z1^2 is nonzero for Z != 0
+    for (unsigned int i = 0; i < n; i++)
+    {
+        fpsqr1271(P[i].z[0], t0);
+        fpsqr1271(P[i].z[1], t1);
+        fpadd1271(t0, t1, norms[i]);
+        if (i)
+        {
+            fpmul1271(products[i - 1], norms[i], products[i]);
+        }
+        else
+        {
+            products[0][0] = norms[0][0];
+            products[0][1] = norms[0][1];
+        }
+    }
+
+    // inverse = products[n - 1]^-1
+    fpexp1251(products[n - 1], t1);
+    fpsqr1271(t1, t1);
+    fpsqr1271(t1, t1);
+    fpmul1271(products[n - 1], t1, inverse);
+
+    for (unsigned int i = n; i--; )
+    {
+        // t0 = norm(Z_i)^-1, inverse = (norm(Z_0) * ... * norm(Z_i-1))^-1
+        if (i)
+        {
+            fpmul1271(inverse, products[i - 1], t0);
+            fpmul1271(inverse, norms[i], inverse);
+        }
+        else
+        {
+            t0[0] = inverse[0];
+            t0[1] = inverse[1];
+        }
+
+        // Z1 = Z1^-1 = conjugate(Z1) / norm(Z1)
+        fpneg1271(P[i].z[1]);
+        fpmul1271(P[i].z[0], t0, P[i].z[0]);
+        fpmul1271(P[i].z[1], t0, P[i].z[1]);
+
+        fp2mul1271(P[i].x, P[i].z, Q[i].x);    // X1 = X1/Z1
+        fp2mul1271(P[i].y, P[i].z, Q[i].y);    // Y1 = Y1/Z1
+        mod1271(Q[i].x[0]);
+        mod1271(Q[i].x[1]);
+        mod1271(Q[i].y[0]);
+        mod1271(Q[i].y[1]);
+    }
+}
+
 static void R1_to_R2(point_extproj_t P, point_extproj_precomp_t Q)
 { // Conversion from representation (X,Y,Z,Ta,Tb) to (X+Y,Y-X,2Z,2dT), where T = Ta*Tb
     fp2add1271(P->ta, P->ta, Q->t2);                  // T = 2*Ta
@@ -1288,14 +1353,14 @@ static void ecc_precomp_double(point_extproj_t P, point_extproj_precomp_t* Table
     R1_to_R2(Q, Table[3]);                  // Converting from (X,Y,Z,Ta,Tb) to (X+Y,Y-X,2Z,2dT)
 }
 
-static bool ecc_mul_double(unsigned long long* k, unsigned long long* l, point_t Q)
-{ // Double scalar multiplication R = k*G + l*Q, where the G is the generator
+static bool ecc_mul_double_extproj(unsigned long long* k, unsigned long long* l, point_t Q, point_extproj_t T)
+{ // Double scalar multiplication T = k*G + l*Q, where the G is the generator, without normalizing T
   // Uses DOUBLE_SCALAR_TABLE, which contains multiples of G, Phi(G), Psi(G) and Phi(Psi(G))
   // The function uses wNAF with interleaving.
     char digits_k1[65], digits_k2[65], digits_k3[65], digits_k4[65];
     char digits_l1[65], digits_l2[65], digits_l3[65], digits_l4[65];
     point_precomp_t V;
-    point_extproj_t Q1, Q2, Q3, Q4, T;
+    point_extproj_t Q1, Q2, Q3, Q4;
     point_extproj_precomp_t U, Q_table1[4], Q_table2[4], Q_table3[4], Q_table4[4];
     unsigned long long k_scalars[4], l_scalars[4];
 
@@ -1430,6 +1495,18 @@ static bool ecc_mul_double(unsigned long long* k, unsigned long long* l, point_t
         }
     }
 
+    return true;
+}
+
+static bool ecc_mul_double(unsigned long long* k, unsigned long long* l, point_t Q)
+{ // Double scalar multiplication R = k*G + l*Q, where the G is the generator
+    point_extproj_t T;
+
+    if (!ecc_mul_double_extproj(k, l, Q, T))
+    {
+        return false;
+    }
+
     eccnorm(T, Q);
 
     return true;
@@ -1834,3 +1911,59 @@ static bool verify(const unsigned char* publicKey, const unsigned char* messageD
 
     return *((__m256i*)A) == *((__m256i*)signature);
 }
+
+static void verifyBatch(unsigned int n, const unsigned char* const* publicKeys, const unsigned char* const* messageDigests, const unsigned char* const* signatures, bool* results)
+{ // Batched SchnorrQ signature verification
+  // It verifies n signatures signatures[i] of messages messageDigests[i] of size 32 in bytes with public keys publicKeys[i]
+  // The results are identical to calling verify() for each signature. The signatures are checked one by one
+  // (no random linear combination), but the final normalizations share a single field inversion.
+  // Inputs: n, arrays of n pointers to 32-byte PublicKey, 64-byte Signature, and MessageDigest of size 32 in bytes
+  // Output: results[i] = TRUE (valid signature) or FALSE (invalid signature)
+    point_t A;
+    point_extproj T[VERIFY_BATCH_SIZE];
+    point_affine R[VERIFY_BATCH_SIZE];
+    unsigned int indices[VERIFY_BATCH_SIZE];
+    unsigned char temp[32 + 64], h[64];
+
+    for (unsigned int offset = 0; offset < n; offset += VERIFY_BATCH_SIZE)
+    {
+        const unsigned int batchSize = (n - offset < VERIFY_BATCH_SIZE) ? n - offset : VERIFY_BATCH_SIZE;
+        unsigned int numberOfPoints = 0;
+
+        for (unsigned int i = offset; i < offset + batchSize; i++)
+        {
+            const unsigned char* publicKey = publicKeys[i];
+            const unsigned char* signature = signatures[i];
+            results[i] = false;
+
+            if ((publicKey[15] & 0x80) || (signature[15] & 0x80) || (signature[62] & 0xC0) || signature[63])
+            {  // Are bit128(PublicKey) = bit128(Signature) = 0 and Signature+32 < 2^246?
+                continue;
+            }
+
+            if (!decode(publicKey, A)) // Also verifies that A is on the curve, if it is not it fails
+            {
+                continue;
+            }
+
+            *((__m256i*)temp) = *((__m256i*)signature);
+            *((__m256i*)(temp + 32)) = *((__m256i*)publicKey);
+            *((__m256i*)(temp + 64)) = *((__m256i*)messageDigests[i]);
+
+            KangarooTwelve(temp, 32 + 64, h, 64);
+
+            if (ecc_mul_double_extproj((unsigned long long*)(signature + 32), (unsigned long long*)h, A, &T[numberOfPoints]))
+            {
+                indices[numberOfPoints++] = i;
+            }
+        }
+
+        eccnorm_batch(T, R, numberOfPoints);
+
+        for (unsigned int j = 0; j < numberOfPoints; j++)
+        {
+            encode(&R[j], (unsigned char*)&R[j]);
+            results[indices[j]] = *((m256i*)&R[j]) == *((m256i*)signatures[indices[j]]);
+        }
+    }
+}
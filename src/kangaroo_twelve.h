@@ -1533,6 +1533,119 @@ static inline void KangarooTwelve(const void* input, unsigned int inputByteLen,
     KangarooTwelve((const unsigned char*)input, inputByteLen, (unsigned char*)output, outputByteLen);
 }
 
+// KangarooTwelve() splits input of K12_chunkSize or more bytes into chunks of K12_chunkSize bytes (tree hashing mode).
+// The chunks after the first one are the leaves, whose 32-byte chaining values are independent of each other. The
+// following functions allow to compute the chaining values of the full leaves separately, for example in parallel.
+
+// Return number of leaves of input that have the full size of K12_chunkSize bytes
+static constexpr unsigned int KangarooTwelveNumberOfFullLeaves(unsigned int inputByteLen)
+{
+    return (inputByteLen < K12_chunkSize) ? 0 : (inputByteLen - K12_chunkSize) / K12_chunkSize;
+}
+
+// Compute chaining value of a full leaf (leaf i starts at input + (i + 1) * K12_chunkSize)
+static void KangarooTwelveLeafChainingValue(const unsigned char* leaf, unsigned char* chainingValue)
+{
+    KangarooTwelve_F leafNode;
+    setMem(&leafNode, sizeof(KangarooTwelve_F), 0);
+    KangarooTwelve_F_Absorb(&leafNode, leaf, K12_chunkSize);
+    leafNode.state[leafNode.byteIOIndex] ^= K12_suffixLeaf;
+    leafNode.state[K12_rateInBytes - 1] ^= 0x80;
+    KeccakP1600_Permute_12rounds(leafNode.state);
+    copyMem(chainingValue, leafNode.state, K12_capacityInBytes);
+}
+
+// Incremental mode: update the chaining values of the full leaves [firstLeaf, firstLeaf + numberOfLeaves) of input,
+// recomputing only those of leaves that differ from previousLeaves. previousLeaves is the copy of all full leaves of the
+// input that the chaining values have been computed from before. It is updated, so chaining values and copy stay
+// consistent. Returns the number of recomputed chaining values.
+static unsigned int KangarooTwelveUpdateLeafChainingValues(const unsigned char* input, unsigned char* previousLeaves, unsigned char* leafChainingValues, unsigned int firstLeaf, unsigned int numberOfLeaves)
+{
+    unsigned int numberOfChangedLeaves = 0;
+    for (unsigned int leaf = firstLeaf; leaf < firstLeaf + numberOfLeaves; leaf++)
+    {
+        const unsigned char* currentLeaf = input + (leaf + 1ULL) * K12_chunkSize;
+        unsigned char* previousLeaf = previousLeaves + leaf * (unsigned long long)K12_chunkSize;
+
+        // Comparing is much cheaper than hashing, so checking the whole leaf before deciding pays off
+        __m256i difference = _mm256_setzero_si256();
+        for (unsigned int i = 0; i < K12_chunkSize; i += 32)
+        {
+            difference = _mm256_or_si256(difference, _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(currentLeaf + i)), _mm256_loadu_si256((const __m256i*)(previousLeaf + i))));
+        }
+        if (!_mm256_testz_si256(difference, difference))
+        {
+            copyMem(previousLeaf, currentLeaf, K12_chunkSize);
+            KangarooTwelveLeafChainingValue(currentLeaf, leafChainingValues + leaf * (unsigned long long)K12_capacityInBytes);
+            numberOfChangedLeaves++;
+        }
+    }
+    return numberOfChangedLeaves;
+}
+
+// Compute the same output as KangarooTwelve(), using the chaining values of the full leaves computed before with
+// KangarooTwelveLeafChainingValue() (KangarooTwelveNumberOfFullLeaves(inputByteLen) * 32 bytes).
+static void KangarooTwelveFromLeafChainingValues(const unsigned char* input, unsigned int inputByteLen, const unsigned char* leafChainingValues, unsigned char* output, unsigned int outputByteLen)
+{
+    if (inputByteLen < K12_chunkSize)
+    {
+        KangarooTwelve(input, inputByteLen, output, outputByteLen);
+        return;
+    }
+
+    KangarooTwelve_F finalNode;
+    setMem(&finalNode, sizeof(KangarooTwelve_F), 0);
+    KangarooTwelve_F_Absorb(&finalNode, input, K12_chunkSize);
+    finalNode.state[finalNode.byteIOIndex] ^= 0x03;
+    if (++finalNode.byteIOIndex == K12_rateInBytes)
+    {
+        KeccakP1600_Permute_12rounds(finalNode.state);
+        finalNode.byteIOIndex = 0;
+    }
+    else
+    {
+        finalNode.byteIOIndex = (finalNode.byteIOIndex + 7) & ~7;
+    }
+
+    const unsigned int numberOfFullLeaves = KangarooTwelveNumberOfFullLeaves(inputByteLen);
+    KangarooTwelve_F_Absorb(&finalNode, leafChainingValues, numberOfFullLeaves * (unsigned long long)K12_capacityInBytes);
+
+    // The last leaf consists of the rest of the input and the zero byte encoding the empty customization string,
+    // so there is always one leaf that is not full
+    const unsigned int restOffset = (numberOfFullLeaves + 1) * K12_chunkSize;
+    KangarooTwelve_F queueNode;
+    setMem(&queueNode, sizeof(KangarooTwelve_F), 0);
+    KangarooTwelve_F_Absorb(&queueNode, input + restOffset, inputByteLen - restOffset);
+    if (++queueNode.byteIOIndex == K12_rateInBytes)
+    {
+        KeccakP1600_Permute_12rounds(queueNode.state);
+        queueNode.byteIOIndex = 0;
+    }
+    queueNode.state[queueNode.byteIOIndex] ^= K12_suffixLeaf;
+    queueNode.state[K12_rateInBytes - 1] ^= 0x80;
+    KeccakP1600_Permute_12rounds(queueNode.state);
+    KangarooTwelve_F_Absorb(&finalNode, queueNode.state, K12_capacityInBytes);
+
+    const unsigned long long numberOfLeaves = numberOfFullLeaves + 1ULL;
+    unsigned int n = 0;
+    for (unsigned long long v = numberOfLeaves; v && (n < sizeof(unsigned long long)); ++n, v >>= 8)
+    {
+    }
+    unsigned char encbuf[sizeof(unsigned long long) + 1 + 2];
+    for (unsigned int i = 1; i <= n; ++i)
+    {
+        encbuf[i - 1] = (unsigned char)(numberOfLeaves >> (8 * (n - i)));
+    }
+    encbuf[n] = (unsigned char)n;
+    encbuf[++n] = 0xFF;
+    encbuf[++n] = 0xFF;
+    KangarooTwelve_F_Absorb(&finalNode, encbuf, ++n);
+    finalNode.state[finalNode.byteIOIndex] ^= 0x06;
+    finalNode.state[K12_rateInBytes - 1] ^= 0x80;
+    KeccakP1600_Permute_12rounds(finalNode.state);
+    copyMem(output, finalNode.state, outputByteLen);
+}
+
 static void KangarooTwelve64To32(const unsigned char* input, unsigned char* output)
 {
 #if defined (__AVX512F__) && !GENERIC_K12
@@ -2494,6 +2607,158 @@ static void KangarooTwelve64To32(const void* input, void* output)
     KangarooTwelve64To32((const unsigned char*)input, (unsigned char*)output);
 }
 
+// Keccak-p[1600,12] round applied to the states of several independent inputs at once. Each element of A[25] / B[25]
+// is a vector holding one lane of the state per input. XOR / ANDN / ROL are the vector operations to use.
+#define K12MultiLaneRound(XOR, ANDN, ROL, SET1, A, B, roundConstant) \
+    { \
+        const auto C0 = XOR(XOR(XOR(A[0], A[5]), XOR(A[10], A[15])), A[20]); \
+        const auto C1 = XOR(XOR(XOR(A[1], A[6]), XOR(A[11], A[16])), A[21]); \
+        const auto C2 = XOR(XOR(XOR(A[2], A[7]), XOR(A[12], A[17])), A[22]); \
+        const auto C3 = XOR(XOR(XOR(A[3], A[8]), XOR(A[13], A[18])), A[23]); \
+        const auto C4 = XOR(XOR(XOR(A[4], A[9]), XOR(A[14], A[19])), A[24]); \
+        const auto D0 = XOR(C4, ROL(C1, 1)); \
+        const auto D1 = XOR(C0, ROL(C2, 1)); \
+        const auto D2 = XOR(C1, ROL(C3, 1)); \
+        const auto D3 = XOR(C2, ROL(C4, 1)); \
+        const auto D4 = XOR(C3, ROL(C0, 1)); \
+        B[0] = XOR(A[0], D0); \
+        B[1] = ROL(XOR(A[6], D1), 44); \
+        B[2] = ROL(XOR(A[12], D2), 43); \
+        B[3] = ROL(XOR(A[18], D3), 21); \
+        B[4] = ROL(XOR(A[24], D4), 14); \
+        B[5] = ROL(XOR(A[3], D3), 28); \
+        B[6] = ROL(XOR(A[9], D4), 20); \
+        B[7] = ROL(XOR(A[10], D0), 3); \
+        B[8] = ROL(XOR(A[16], D1), 45); \
+        B[9] = ROL(XOR(A[22], D2), 61); \
+        B[10] = ROL(XOR(A[1], D1), 1); \
+        B[11] = ROL(XOR(A[7], D2), 6); \
+        B[12] = ROL(XOR(A[13], D3), 25); \
+        B[13] = ROL(XOR(A[19], D4), 8); \
+        B[14] = ROL(XOR(A[20], D0), 18); \
+        B[15] = ROL(XOR(A[4], D4), 27); \
+        B[16] = ROL(XOR(A[5], D0), 36); \
+        B[17] = ROL(XOR(A[11], D1), 10); \
+        B[18] = ROL(XOR(A[17], D2), 15); \
+        B[19] = ROL(XOR(A[23], D3), 56); \
+        B[20] = ROL(XOR(A[2], D2), 62); \
+        B[21] = ROL(XOR(A[8], D3), 55); \
+        B[22] = ROL(XOR(A[14], D4), 39); \
+        B[23] = ROL(XOR(A[15], D0), 41); \
+        B[24] = ROL(XOR(A[21], D1), 2); \
+        for (int y = 0; y < 25; y += 5) \
+        { \
+            A[y + 0] = XOR(B[y + 0], ANDN(B[y + 1], B[y + 2])); \
+            A[y + 1] = XOR(B[y + 1], ANDN(B[y + 2], B[y + 3])); \
+            A[y + 2] = XOR(B[y + 2], ANDN(B[y + 3], B[y + 4])); \
+            A[y + 3] = XOR(B[y + 3], ANDN(B[y + 4], B[y + 0])); \
+            A[y + 4] = XOR(B[y + 4], ANDN(B[y + 0], B[y + 1])); \
+        } \
+        A[0] = XOR(A[0], SET1(roundConstant)); \
+    }
+
+#define K12MultiLaneRounds12(XOR, ANDN, ROL, SET1, A, B) \
+    K12MultiLaneRound(XOR, ANDN, ROL, SET1, A, B, KeccakF1600RoundConstant0) \
+    K12MultiLaneRound(XOR, ANDN, ROL, SET1, A, B, KeccakF1600RoundConstant1) \
+    K12MultiLaneRound(XOR, ANDN, ROL, SET1, A, B, KeccakF1600RoundConstant2) \
+    K12MultiLaneRound(XOR, ANDN, ROL, SET1, A, B, KeccakF1600RoundConstant3) \
+    K12MultiLaneRound(XOR, ANDN, ROL, SET1, A, B, KeccakF1600RoundConstant4) \
+    K12MultiLaneRound(XOR, ANDN, ROL, SET1, A, B, KeccakF1600RoundConstant5) \
+    K12MultiLaneRound(XOR, ANDN, ROL, SET1, A, B, KeccakF1600RoundConstant6) \
+    K12MultiLaneRound(XOR, ANDN, ROL, SET1, A, B, KeccakF1600RoundConstant7) \
+    K12MultiLaneRound(XOR, ANDN, ROL, SET1, A, B, KeccakF1600RoundConstant8) \
+    K12MultiLaneRound(XOR, ANDN, ROL, SET1, A, B, KeccakF1600RoundConstant9) \
+    K12MultiLaneRound(XOR, ANDN, ROL, SET1, A, B, KeccakF1600RoundConstant10) \
+    K12MultiLaneRound(XOR, ANDN, ROL, SET1, A, B, 0x8000000080008008ULL)
+
+#define K12x4Xor(a, b) _mm256_xor_si256(a, b)
+#define K12x4AndNot(a, b) _mm256_andnot_si256(a, b)
+#define K12x4Rol(a, offset) _mm256_or_si256(_mm256_slli_epi64(a, offset), _mm256_srli_epi64(a, 64 - (offset)))
+#define K12x4Set1(value) _mm256_set1_epi64x(value)
+
+// Same as calling KangarooTwelve64To32(input[i], output[i]) for i = 0..3, but hashing the 4 inputs in parallel
+// using the 4 64-bit lanes of AVX2 registers.
+static void KangarooTwelve64To32x4(const void* const input[4], void* const output[4])
+{
+    __m256i A[25], B[25];
+
+    // transpose inputs, so that A[k] holds the k-th 64-bit word of each input
+    for (int k = 0; k < 8; k += 4)
+    {
+        const __m256i i0 = _mm256_loadu_si256((const __m256i*)((const unsigned long long*)input[0] + k));
+        const __m256i i1 = _mm256_loadu_si256((const __m256i*)((const unsigned long long*)input[1] + k));
+        const __m256i i2 = _mm256_loadu_si256((const __m256i*)((const unsigned long long*)input[2] + k));
+        const __m256i i3 = _mm256_loadu_si256((const __m256i*)((const unsigned long long*)input[3] + k));
+        const __m256i t0 = _mm256_unpacklo_epi64(i0, i1);
+        const __m256i t1 = _mm256_unpackhi_epi64(i0, i1);
+        const __m256i t2 = _mm256_unpacklo_epi64(i2, i3);
+        const __m256i t3 = _mm256_unpackhi_epi64(i2, i3);
+        A[k + 0] = _mm256_permute2x128_si256(t0, t2, 0x20);
+        A[k + 1] = _mm256_permute2x128_si256(t1, t3, 0x20);
+        A[k + 2] = _mm256_permute2x128_si256(t0, t2, 0x31);
+        A[k + 3] = _mm256_permute2x128_si256(t1, t3, 0x31);
+    }
+    A[8] = _mm256_set1_epi64x(0x0700);
+    for (int k = 9; k < 25; k++)
+    {
+        A[k] = _mm256_setzero_si256();
+    }
+    A[20] = _mm256_set1_epi64x(0x8000000000000000);
+
+    K12MultiLaneRounds12(K12x4Xor, K12x4AndNot, K12x4Rol, K12x4Set1, A, B)
+
+    const __m256i t0 = _mm256_unpacklo_epi64(A[0], A[1]);
+    const __m256i t1 = _mm256_unpackhi_epi64(A[0], A[1]);
+    const __m256i t2 = _mm256_unpacklo_epi64(A[2], A[3]);
+    const __m256i t3 = _mm256_unpackhi_epi64(A[2], A[3]);
+    _mm256_storeu_si256((__m256i*)output[0], _mm256_permute2x128_si256(t0, t2, 0x20));
+    _mm256_storeu_si256((__m256i*)output[1], _mm256_permute2x128_si256(t1, t3, 0x20));
+    _mm256_storeu_si256((__m256i*)output[2], _mm256_permute2x128_si256(t0, t2, 0x31));
+    _mm256_storeu_si256((__m256i*)output[3], _mm256_permute2x128_si256(t1, t3, 0x31));
+}
+
+#if defined (__AVX512F__)
+#define K12x8Xor(a, b) _mm512_xor_si512(a, b)
+#define K12x8AndNot(a, b) _mm512_andnot_si512(a, b)
+#define K12x8Rol(a, offset) _mm512_rol_epi64(a, offset)
+#define K12x8Set1(value) _mm512_set1_epi64(value)
+
+// Same as calling KangarooTwelve64To32(input[i], output[i]) for i = 0..7, but hashing the 8 inputs in parallel
+// using the 8 64-bit lanes of AVX-512 registers.
+static void KangarooTwelve64To32x8(const void* const input[8], void* const output[8])
+{
+    __m512i A[25], B[25];
+
+    // gather the k-th 64-bit word of each input into A[k]
+    const __m512i inputAddresses = _mm512_loadu_si512(input);
+    for (int k = 0; k < 8; k++)
+    {
+        A[k] = _mm512_i64gather_epi64(_mm512_add_epi64(inputAddresses, _mm512_set1_epi64(k * 8)), (const void*)0, 1);
+    }
+    A[8] = _mm512_set1_epi64(0x0700);
+    for (int k = 9; k < 25; k++)
+    {
+        A[k] = _mm512_setzero_si512();
+    }
+    A[20] = _mm512_set1_epi64(0x8000000000000000);
+
+    K12MultiLaneRounds12(K12x8Xor, K12x8AndNot, K12x8Rol, K12x8Set1, A, B)
+
+    const __m512i outputAddresses = _mm512_loadu_si512(output);
+    for (int k = 0; k < 4; k++)
+    {
+        _mm512_i64scatter_epi64((void*)0, _mm512_add_epi64(outputAddresses, _mm512_set1_epi64(k * 8)), A[k], 1);
+    }
+}
+
+// Number of 64-byte inputs hashed by one call of KangarooTwelve64To32Lanes()
+#define K12_64To32_LANES 8
+#define KangarooTwelve64To32Lanes KangarooTwelve64To32x8
+#else
+#define K12_64To32_LANES 4
+#define KangarooTwelve64To32Lanes KangarooTwelve64To32x4
+#endif
+
 static void random(const unsigned char* publicKey, const unsigned char* nonce, unsigned char* output, unsigned long long outputSize)
 {
     unsigned char state[200];
@@ -62,6 +62,56 @@ struct ResponseLogIdRangeFromTx
 };
 
 
+// Request IDs of the logs involving an entity (as source or destination of QU transfers, asset ownership and possession
+// changes, and burnings) within [fromLogId, toLogId]. Requires LOG_ENTITY_INDEX.
+struct RequestLogIdsByEntity
+{
+    unsigned long long passcode[4];
+    m256i publicKey;
+    long long fromLogId;
+    long long toLogId; // inclusive, -1 for the latest log
+
+    enum {
+        type = 50,
+    };
+};
+
+
+// Response with the log ID ranges of an entity
+struct ResponseLogIdsByEntity
+{
+    // Variable-size array of LogIdRange, newest range first. If the array is full (LOG_ENTITY_MAX_RANGES_PER_RESPONSE),
+    // older logs may be requested with toLogId set to fromLogId of the last range - 1. Logs that are not in the log
+    // buffer anymore are not included.
+    struct LogIdRange
+    {
+        long long fromLogId;
+        long long length;
+    };
+
+    enum {
+        type = 51,
+    };
+};
+
+
+// Subscribe to logs: the node pushes the logs from fromLogId on (of the types selected by eventTypeMask) to the peer as
+// they are appended. Logs are pushed as RespondLog messages with the dejavu of this request, each containing logs of one
+// tick only, after the tick has been processed. An empty RespondLog ends the subscription: it is sent if the subscription
+// is rejected or canceled, or if the peer did not receive the logs before they were overwritten in the log buffer.
+// Each peer has at most one subscription, which is replaced by the next SubscribeLog and ends when the connection ends.
+struct SubscribeLog
+{
+    unsigned long long passcode[4];
+    long long fromLogId; // -1 for logs appended after subscribing
+    unsigned long long eventTypeMask; // bit N selects log type N (bit 63 selects type 63 and above), 0 cancels subscription
+
+    enum {
+        type = 52,
+    };
+};
+
+
 #define QU_TRANSFER 0
 #define ASSET_ISSUANCE 1
 #define ASSET_OWNERSHIP_CHANGE 2
@@ -181,12 +231,23 @@ struct Burning
 /*
  * LOGGING IMPLEMENTATION
  */
+#ifndef LOG_BUFFER_SIZE // may be reduced for tests
 #define LOG_BUFFER_SIZE 8589934592ULL // 8GiB
+#endif
 #define LOG_MAX_STORAGE_ENTRIES (LOG_BUFFER_SIZE / sizeof(QuTransfer)) // Adjustable: here we assume most of logs are just qu transfer
 #define LOG_TX_NUMBER_OF_SPECIAL_EVENT 5
 #define LOG_TX_PER_TICK (NUMBER_OF_TRANSACTIONS_PER_TICK + LOG_TX_NUMBER_OF_SPECIAL_EVENT)// +5 special events
 #define LOG_TX_INFO_STORAGE (MAX_NUMBER_OF_TICKS_PER_EPOCH * LOG_TX_PER_TICK) 
 #define LOG_HEADER_SIZE 26 // 2 bytes epoch + 4 bytes tick + 4 bytes log size/types + 8 bytes log id + 8 bytes log digest
+#ifndef LOG_ENTITY_INDEX_POSTINGS // may be reduced for tests
+#define LOG_ENTITY_INDEX_POSTINGS 0x4000000ULL // Must be 2^N, number of (entity, log ID) pairs kept by the entity index
+#define LOG_ENTITY_INDEX_BUCKETS 0x1000000ULL // Must be 2^N
+#endif
+#define LOG_ENTITY_MAX_RANGES_PER_RESPONSE 256 // Response is built on the stack of the request processor
+#define LOG_MAX_NUMBER_OF_SUBSCRIPTIONS 16
+#define LOG_SUBSCRIPTION_MAX_PENDING_SIZE (BUFFER_SIZE / 4) // Logs are only pushed to peers with less bulk data waiting for transmission
+static_assert(LOG_SUBSCRIPTION_MAX_PENDING_SIZE + RequestResponseHeader::max_size <= SendQueue<BUFFER_SIZE, RequestResponseHeader::max_size>::BULK_REGION_SIZE,
+    "Log message of a tick must fit into the send queue of a peer logs are pushed to");
 
 class qLogger
 {
@@ -236,6 +297,28 @@ public:
         return sizeAndType & 0xFFFFFF; // last 24 bits are message size
     }
 
+    static unsigned char getLogType(const char* ptr)
+    {
+        // first 6 bytes are: epoch(2) + tick(4)
+        // next 4 bytes are size&type
+        unsigned int sizeAndType = *((unsigned int*)(ptr + 6));
+
+        return sizeAndType >> 24; // first 8 bits are message type
+    }
+
+    static unsigned int getLogTick(const char* ptr)
+    {
+        // first 2 bytes are epoch
+        // next 4 bytes are tick
+        return *((unsigned int*)(ptr + 2));
+    }
+
+    // Bit of log type in SubscribeLog::eventTypeMask
+    static unsigned long long getLogTypeMaskBit(unsigned char type)
+    {
+        return 1ULL << ((type < 63) ? type : 63);
+    }
+
     // since we use round buffer, verifying digest for each log is needed to avoid sending out wrong log
     static bool verifyLog(const char* ptr, unsigned long long logId)
     {
@@ -354,49 +437,289 @@ public:
             }
         }
     } tx;
-#endif
 
-    static void registerNewTx(const unsigned int tick, const unsigned int txId)
+#if LOG_ENTITY_INDEX
+    // Inverted index from entities to the logs involving them. Each log adds a posting (log ID) per involved entity to
+    // a ring of postings. The postings of all entities of a hash bucket form a linked list from the newest to the oldest
+    // posting (bucket head and previous positions are positions in the ring, counting up from 0 and never reused).
+    // Old postings are evicted by overwriting them in the ring. Postings of logs that have been overwritten in
+    // logBuffer are skipped when reading, so the index is evicted in step with the log buffer. As several entities
+    // share a bucket, the entity is checked in the log itself.
+    static struct mapEntityToLogIds
     {
-#if ENABLED_LOGGING
-        tx._registerNewTx(tick, txId);
-#endif
-    }
+        struct Posting
+        {
+            unsigned long long logId;
+            unsigned long long previousPosition;
+        };
 
+        inline static Posting* postings = NULL;
+        inline static unsigned long long* bucketHeads = NULL; // position of newest posting of bucket
+        inline static unsigned long long nextPosition;
 
-    static bool initLogging()
-    {
-#if ENABLED_LOGGING
-        EFI_STATUS status;
-        if (logBuffer == NULL)
+        static constexpr unsigned long long NO_POSITION = 0xFFFFFFFFFFFFFFFFULL;
+
+        static void init()
+        {
+            setMem(bucketHeads, LOG_ENTITY_INDEX_BUCKETS * sizeof(unsigned long long), 0xFF);
+            nextPosition = 0;
+        }
+
+        static bool isPositionAvailable(unsigned long long position)
+        {
+            return position != NO_POSITION && position < nextPosition && nextPosition - position <= LOG_ENTITY_INDEX_POSTINGS;
+        }
+
+        // Add posting of log ID for entity
+        static void add(const m256i& publicKey, unsigned long long logId)
         {
-            if (status = bs->AllocatePool(EfiRuntimeServicesData, LOG_BUFFER_SIZE, (void**)&logBuffer))
+            if (!isZero(publicKey))
             {
-                logStatusToConsole(L"EFI_BOOT_SERVICES.AllocatePool() fails", status, __LINE__);
+                unsigned long long& bucketHead = bucketHeads[publicKey.m256i_u32[0] & (LOG_ENTITY_INDEX_BUCKETS - 1)];
+                Posting& posting = postings[nextPosition & (LOG_ENTITY_INDEX_POSTINGS - 1)];
+                posting.logId = logId;
+                posting.previousPosition = bucketHead;
+                bucketHead = nextPosition++;
+            }
+        }
 
-                return false;
+        // Add postings of the last log for source and destination entity (if it is not the source)
+        static void addLastLog(const m256i& sourcePublicKey, const m256i& destinationPublicKey)
+        {
+            add(sourcePublicKey, logId - 1);
+            if (destinationPublicKey != sourcePublicKey)
+            {
+                add(destinationPublicKey, logId - 1);
             }
         }
 
-        if (mapTxToLogId == NULL)
+        // Return true if the log at ptr names the entity as source or destination
+        static bool involvesEntity(const char* ptr, const m256i& publicKey)
         {
-            if (status = bs->AllocatePool(EfiRuntimeServicesData, LOG_TX_INFO_STORAGE * sizeof(BlobInfo), (void**)&mapTxToLogId))
+            const m256i* publicKeys = (const m256i*)(ptr + LOG_HEADER_SIZE);
+            switch (getLogType(ptr))
             {
-                logStatusToConsole(L"EFI_BOOT_SERVICES.AllocatePool() fails", status, __LINE__);
+            case QU_TRANSFER:
+            case ASSET_OWNERSHIP_CHANGE:
+            case ASSET_POSSESSION_CHANGE:
+                return publicKeys[0] == publicKey || publicKeys[1] == publicKey;
+            case BURNING:
+                return publicKeys[0] == publicKey;
+            }
+            return false;
+        }
 
-                return false;
+        // Collect IDs of the logs involving the entity within [fromLogId, toLogId] as ranges of consecutive IDs, newest
+        // first. Returns the number of ranges. The index may be changed concurrently, so all postings are validated.
+        static unsigned int getLogIdRanges(const m256i& publicKey, unsigned long long fromLogId, unsigned long long toLogId,
+            ResponseLogIdsByEntity::LogIdRange* ranges, unsigned int maxNumberOfRanges)
+        {
+            unsigned int numberOfRanges = 0;
+            unsigned long long previousLogId = NO_POSITION;
+            unsigned long long position = bucketHeads[publicKey.m256i_u32[0] & (LOG_ENTITY_INDEX_BUCKETS - 1)];
+            while (isPositionAvailable(position))
+            {
+                const Posting posting = postings[position & (LOG_ENTITY_INDEX_POSTINGS - 1)];
+                if (posting.logId < fromLogId || posting.logId > previousLogId || (posting.previousPosition >= position && posting.previousPosition != NO_POSITION))
+                {
+                    // Older than requested, or posting has been overwritten in the meantime
+                    break;
+                }
+                // Same log ID as before if source and destination share the bucket
+                if (posting.logId <= toLogId && posting.logId != previousLogId)
+                {
+                    const long long bufferIndex = logBuf.getIndex(posting.logId);
+                    if (bufferIndex < 0)
+                    {
+                        // Log and all older ones have been overwritten in logBuffer
+                        break;
+                    }
+                    if (involvesEntity(logBuffer + bufferIndex, publicKey))
+                    {
+                        if (numberOfRanges && ranges[numberOfRanges - 1].fromLogId == (long long)posting.logId + 1)
+                        {
+                            ranges[numberOfRanges - 1].fromLogId--;
+                            ranges[numberOfRanges - 1].length++;
+                        }
+                        else
+                        {
+                            if (numberOfRanges == maxNumberOfRanges)
+                            {
+                                break;
+                            }
+                            ranges[numberOfRanges].fromLogId = posting.logId;
+                            ranges[numberOfRanges].length = 1;
+                            numberOfRanges++;
+                        }
+                    }
+                }
+                previousLogId = posting.logId;
+                position = posting.previousPosition;
             }
+            return numberOfRanges;
         }
+    } entityIndex;
+#endif
+
+    // Subscriptions of peers to logs (see SubscribeLog), served by pushLogsToSubscribers() in the main loop
+    struct LogSubscription
+    {
+        Peer* peer; // NULL if unused
+        unsigned long long nextLogId;
+        unsigned long long eventTypeMask;
+        unsigned int dejavu;
+    };
 
-        if (mapLogIdToBufferIndex == NULL)
+    inline static LogSubscription logSubscriptions[LOG_MAX_NUMBER_OF_SUBSCRIPTIONS];
+    inline static volatile char logSubscriptionsLock = 0;
+    inline static unsigned long long numberOfPushedLogs = 0;
+
+    // Add empty RespondLog to send queue of subscribed peer and remove subscription. Requires logSubscriptionsLock.
+    static void endLogSubscription(LogSubscription& subscription)
+    {
+        RequestResponseHeader header;
+        header.setSize<sizeof(RequestResponseHeader)>();
+        header.setType(RespondLog::type);
+        header.setDejavu(subscription.dejavu);
+        push(subscription.peer, &header);
+        subscription.peer = NULL;
+    }
+
+    // Add the next logs of one tick of subscription to send queue of the subscribed peer. Returns false if no
+    // logs can be pushed now. Requires logSubscriptionsLock.
+    static bool pushLogsOfTick(LogSubscription& subscription)
+    {
+        const long long firstBufferIndex = logBuf.getIndex(subscription.nextLogId);
+        if (firstBufferIndex < 0)
         {
-            if (status = bs->AllocatePool(EfiRuntimeServicesData, LOG_MAX_STORAGE_ENTRIES * sizeof(BlobInfo), (void**)&mapLogIdToBufferIndex))
+            if (subscription.nextLogId + 1 < logId)
             {
-                logStatusToConsole(L"EFI_BOOT_SERVICES.AllocatePool() fails", status, __LINE__);
+                // Log has been overwritten before it could be pushed
+                endLogSubscription(subscription);
+            }
+            // Otherwise it is the last log, which may be written right now
+            return false;
+        }
+        const unsigned int tick = getLogTick(logBuffer + firstBufferIndex);
+        if (tick >= system.tick)
+        {
+            // Tick is still being processed, so more logs of it may follow
+            return false;
+        }
 
+        // Size of the message with the logs of the tick (limited by the maximum message size), so only as much space
+        // as needed is requested from the send queue. The logs are read again when they are copied and verified, so
+        // a log overwritten meanwhile only leads to a shorter message or the end of the subscription.
+        unsigned int maxSize = sizeof(RequestResponseHeader);
+        for (unsigned long long id = subscription.nextLogId; id < logId; id++)
+        {
+            const BlobInfo blob = logBuf.getBlobInfo(id);
+            if (blob.startIndex < 0 || getLogTick(logBuffer + blob.startIndex) != tick)
+            {
+                break;
+            }
+            if (subscription.eventTypeMask & getLogTypeMaskBit(getLogType(logBuffer + blob.startIndex)))
+            {
+                if (maxSize + blob.length > RequestResponseHeader::max_size)
+                {
+                    break;
+                }
+                maxSize += (unsigned int)blob.length;
+            }
+        }
+
+        // Logs are copied directly behind the header in the send queue
+        Peer* peer = subscription.peer;
+        unsigned int availableSize;
+        char* destination = peer->sendQueue.beginAppend(SEND_PRIORITY_BULK, maxSize, availableSize);
+        if (!destination)
+        {
+            return false;
+        }
+        RequestResponseHeader* header = (RequestResponseHeader*)destination;
+        unsigned int size = sizeof(RequestResponseHeader);
+        unsigned long long numberOfLogs = 0;
+        unsigned long long nextLogId = subscription.nextLogId;
+        for (; nextLogId < logId; nextLogId++)
+        {
+            const BlobInfo blob = logBuf.getBlobInfo(nextLogId);
+            if (blob.startIndex < 0 || size + blob.length > availableSize)
+            {
+                // Log that cannot be read (handled by next call) or no space for copying it
+                break;
+            }
+
+            // The log may be overwritten while it is copied (like in processRequestLog(), the log buffer is read
+            // without lock), so the copy is verified before it is used
+            char* log = destination + size;
+            copyMem(log, logBuffer + blob.startIndex, blob.length);
+            if (LOG_HEADER_SIZE + getLogSize(log) != blob.length || !verifyLog(log, nextLogId))
+            {
+                // Log has been overwritten before it could be pushed, discard the unfinished message
+                endLogSubscription(subscription);
                 return false;
             }
+            if (getLogTick(log) != tick)
+            {
+                // Next tick
+                break;
+            }
+            if (subscription.eventTypeMask & getLogTypeMaskBit(getLogType(log)))
+            {
+                if (size + blob.length > maxSize)
+                {
+                    // Message is full
+                    break;
+                }
+                size += (unsigned int)blob.length;
+                numberOfLogs++;
+            }
+        }
+
+        if (numberOfLogs)
+        {
+            header->checkAndSetSize(size);
+            header->setType(RespondLog::type);
+            header->setDejavu(subscription.dejavu);
+            peer->sendQueue.endAppend(SEND_PRIORITY_BULK, size);
+            numberOfPushedLogs += numberOfLogs;
+        }
+
+        const bool pushedAny = nextLogId != subscription.nextLogId;
+        subscription.nextLogId = nextLogId;
+        return pushedAny;
+    }
+#endif
+
+    static void registerNewTx(const unsigned int tick, const unsigned int txId)
+    {
+#if ENABLED_LOGGING
+        tx._registerNewTx(tick, txId);
+#endif
+    }
+
+
+    static bool initLogging()
+    {
+#if ENABLED_LOGGING
+        if ((logBuffer == NULL && !allocatePool(LOG_BUFFER_SIZE, (void**)&logBuffer))
+            || (mapTxToLogId == NULL && !allocatePool(LOG_TX_INFO_STORAGE * sizeof(BlobInfo), (void**)&mapTxToLogId))
+            || (mapLogIdToBufferIndex == NULL && !allocatePool(LOG_MAX_STORAGE_ENTRIES * sizeof(BlobInfo), (void**)&mapLogIdToBufferIndex)))
+        {
+            logToConsole(L"Failed to allocate logging buffers!");
+
+            return false;
         }
+
+#if LOG_ENTITY_INDEX
+        if ((entityIndex.postings == NULL && !allocatePool(LOG_ENTITY_INDEX_POSTINGS * sizeof(mapEntityToLogIds::Posting), (void**)&entityIndex.postings))
+            || (entityIndex.bucketHeads == NULL && !allocatePool(LOG_ENTITY_INDEX_BUCKETS * sizeof(unsigned long long), (void**)&entityIndex.bucketHeads)))
+        {
+            logToConsole(L"Failed to allocate entity index of logs!");
+
+            return false;
+        }
+#endif
         reset(0);
 #endif
         return true;
@@ -404,18 +727,43 @@ public:
     static void deinitLogging()
     {
 #if ENABLED_LOGGING
-        freePool(logBuffer);
+        void** buffers[] = { (void**)&logBuffer, (void**)&mapTxToLogId, (void**)&mapLogIdToBufferIndex,
+#if LOG_ENTITY_INDEX
+            (void**)&entityIndex.postings, (void**)&entityIndex.bucketHeads,
+#endif
+        };
+        for (unsigned int i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++)
+        {
+            if (*buffers[i])
+            {
+                freePool(*buffers[i]);
+                *buffers[i] = NULL;
+            }
+        }
 #endif
     }
 
     static void reset(unsigned int _tickBegin)
     {
 #if ENABLED_LOGGING
+        // Subscriptions are not served while resetting
+        ACQUIRE(logSubscriptionsLock);
+
         logBuf.init();
         tx.init();
+#if LOG_ENTITY_INDEX
+        entityIndex.init();
+#endif
         logBufferTail = 0;
         logId = 0;
         tickBegin = _tickBegin;
+
+        // Log IDs restart, so subscriptions continue with the first log of the new epoch
+        for (unsigned int i = 0; i < LOG_MAX_NUMBER_OF_SUBSCRIPTIONS; i++)
+        {
+            logSubscriptions[i].nextLogId = 0;
+        }
+        RELEASE(logSubscriptionsLock);
 #endif
     }
 
@@ -445,6 +793,9 @@ public:
     {
 #if LOG_QU_TRANSFERS
         logMessage(offsetof(T, _terminator), QU_TRANSFER, &message);
+#if LOG_ENTITY_INDEX
+        entityIndex.addLastLog(message.sourcePublicKey, message.destinationPublicKey);
+#endif
 #endif
     }
 
@@ -461,6 +812,9 @@ public:
     {
 #if LOG_ASSET_OWNERSHIP_CHANGES
         logMessage(offsetof(T, _terminator), ASSET_OWNERSHIP_CHANGE, &message);
+#if LOG_ENTITY_INDEX
+        entityIndex.addLastLog(message.sourcePublicKey, message.destinationPublicKey);
+#endif
 #endif
     }
 
@@ -469,6 +823,9 @@ public:
     {
 #if LOG_ASSET_POSSESSION_CHANGES
         logMessage(offsetof(T, _terminator), ASSET_POSSESSION_CHANGE, &message);
+#if LOG_ENTITY_INDEX
+        entityIndex.addLastLog(message.sourcePublicKey, message.destinationPublicKey);
+#endif
 #endif
     }
 
@@ -537,6 +894,9 @@ public:
     {
 #if LOG_BURNINGS
         logMessage(offsetof(T, _terminator), BURNING, &message);
+#if LOG_ENTITY_INDEX
+        entityIndex.addLastLog(message.sourcePublicKey, message.sourcePublicKey);
+#endif
 #endif
     }
 
@@ -633,6 +993,144 @@ public:
 #endif
         enqueueResponse(peer, 0, ResponseLogIdRangeFromTx::type, header->dejavu(), NULL);
     }
+
+    static void processRequestLogIdsByEntity(Peer* peer, RequestResponseHeader* header)
+    {
+#if ENABLED_LOGGING && LOG_ENTITY_INDEX
+        RequestLogIdsByEntity* request = header->getPayload<RequestLogIdsByEntity>();
+        if (request->passcode[0] == logReaderPasscodes[0]
+            && request->passcode[1] == logReaderPasscodes[1]
+            && request->passcode[2] == logReaderPasscodes[2]
+            && request->passcode[3] == logReaderPasscodes[3]
+            && request->fromLogId >= 0)
+        {
+            ResponseLogIdsByEntity::LogIdRange ranges[LOG_ENTITY_MAX_RANGES_PER_RESPONSE];
+            const unsigned long long toLogId = (request->toLogId < 0) ? entityIndex.NO_POSITION : request->toLogId;
+            const unsigned int numberOfRanges = entityIndex.getLogIdRanges(request->publicKey, request->fromLogId, toLogId, ranges, LOG_ENTITY_MAX_RANGES_PER_RESPONSE);
+            enqueueResponse(peer, numberOfRanges * sizeof(ResponseLogIdsByEntity::LogIdRange), ResponseLogIdsByEntity::type, header->dejavu(), ranges);
+            return;
+        }
+#endif
+        enqueueResponse(peer, 0, ResponseLogIdsByEntity::type, header->dejavu(), NULL);
+    }
+
+    static void processSubscribeLog(Peer* peer, RequestResponseHeader* header)
+    {
+#if ENABLED_LOGGING
+        SubscribeLog* request = header->getPayload<SubscribeLog>();
+        if (request->passcode[0] == logReaderPasscodes[0]
+            && request->passcode[1] == logReaderPasscodes[1]
+            && request->passcode[2] == logReaderPasscodes[2]
+            && request->passcode[3] == logReaderPasscodes[3])
+        {
+            bool subscribed = false;
+            ACQUIRE(logSubscriptionsLock);
+            unsigned int freeIndex = LOG_MAX_NUMBER_OF_SUBSCRIPTIONS;
+            for (unsigned int i = 0; i < LOG_MAX_NUMBER_OF_SUBSCRIPTIONS; i++)
+            {
+                if (logSubscriptions[i].peer == peer)
+                {
+                    // Replace previous subscription of peer
+                    logSubscriptions[i].peer = NULL;
+                }
+                if (!logSubscriptions[i].peer && freeIndex == LOG_MAX_NUMBER_OF_SUBSCRIPTIONS)
+                {
+                    freeIndex = i;
+                }
+            }
+            const unsigned long long fromLogId = (request->fromLogId < 0) ? logId : request->fromLogId;
+            if (request->eventTypeMask && freeIndex < LOG_MAX_NUMBER_OF_SUBSCRIPTIONS
+                && (fromLogId >= logId || logBuf.getIndex(fromLogId) >= 0))
+            {
+                logSubscriptions[freeIndex].nextLogId = fromLogId;
+                logSubscriptions[freeIndex].eventTypeMask = request->eventTypeMask;
+                logSubscriptions[freeIndex].dejavu = header->dejavu();
+                logSubscriptions[freeIndex].peer = peer;
+                subscribed = true;
+            }
+            RELEASE(logSubscriptionsLock);
+            if (subscribed)
+            {
+                return;
+            }
+        }
+#endif
+        enqueueResponse(peer, 0, RespondLog::type, header->dejavu(), NULL);
+    }
+
+    // Remove subscription of peer without notifying it, called when a new connection is established in the peer slot.
+    static void cancelLogSubscription(Peer* peer)
+    {
+#if ENABLED_LOGGING
+        ACQUIRE(logSubscriptionsLock);
+        for (unsigned int i = 0; i < LOG_MAX_NUMBER_OF_SUBSCRIPTIONS; i++)
+        {
+            if (logSubscriptions[i].peer == peer)
+            {
+                logSubscriptions[i].peer = NULL;
+            }
+        }
+        RELEASE(logSubscriptionsLock);
+#endif
+    }
+
+    static unsigned int numberOfLogSubscriptions()
+    {
+        unsigned int count = 0;
+#if ENABLED_LOGGING
+        for (unsigned int i = 0; i < LOG_MAX_NUMBER_OF_SUBSCRIPTIONS; i++)
+        {
+            if (logSubscriptions[i].peer)
+            {
+                count++;
+            }
+        }
+#endif
+        return count;
+    }
+
+    static unsigned long long numberOfLogsPushedToSubscribers()
+    {
+#if ENABLED_LOGGING
+        return numberOfPushedLogs;
+#else
+        return 0;
+#endif
+    }
+
+    // Push logs of processed ticks to subscribed peers, as long as their send queues are not filling up. Called
+    // from the main loop only (like push()), skips if subscriptions are being changed.
+    static void pushLogsToSubscribers()
+    {
+#if ENABLED_LOGGING
+        if (!TRY_ACQUIRE(logSubscriptionsLock))
+        {
+            return;
+        }
+        for (unsigned int i = 0; i < LOG_MAX_NUMBER_OF_SUBSCRIPTIONS; i++)
+        {
+            LogSubscription& subscription = logSubscriptions[i];
+            if (!subscription.peer)
+            {
+                continue;
+            }
+            if (!subscription.peer->tcp4Protocol || !subscription.peer->isConnectedAccepted || subscription.peer->isClosing)
+            {
+                // Subscription ends with connection
+                subscription.peer = NULL;
+                continue;
+            }
+            while (subscription.nextLogId < logId && subscription.peer->sendQueue.size(SEND_PRIORITY_BULK) < LOG_SUBSCRIPTION_MAX_PENDING_SIZE)
+            {
+                if (!pushLogsOfTick(subscription))
+                {
+                    break;
+                }
+            }
+        }
+        RELEASE(logSubscriptionsLock);
+#endif
+    }
 };
 
 qLogger logger;
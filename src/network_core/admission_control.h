@@ -0,0 +1,76 @@
+// admission control of received messages, applied by peerReceiveAndTransmit() before adding them to the request queue
+
+#pragma once
+
+#include "platform/memory.h"
+#include "platform/debugging.h"
+
+#include "network_messages/header.h"
+#include "network_messages/broadcast_message.h"
+#include "network_messages/computors.h"
+#include "network_messages/public_peers.h"
+#include "network_messages/tick.h"
+#include "network_messages/transactions.h"
+
+// Classes of received messages, each with its own rate limit per peer
+#define ADMISSION_CLASS_CONSENSUS 0 // ticks, tick data, computors, requests for these, and peer exchange
+#define ADMISSION_CLASS_TRANSACTIONS 1 // transactions and broadcast messages (such as mining solutions)
+#define ADMISSION_CLASS_QUERIES 2 // queries of entities, assets, contract functions, logs, and everything else
+#define NUMBER_OF_ADMISSION_CLASSES 3
+
+static unsigned int getAdmissionClass(unsigned char messageType)
+{
+    switch (messageType)
+    {
+    case ExchangePublicPeers::type:
+    case BroadcastComputors::type:
+    case BroadcastTick::type:
+    case BroadcastFutureTickData::type:
+    case BroadcastCompactFutureTickData::type:
+    case RequestComputors::type:
+    case RequestQuorumTick::type:
+    case RequestTickData::type:
+    case RequestTickTransactionDigests::type:
+    case RespondTickTransactionDigests::type:
+    case REQUEST_TICK_TRANSACTIONS:
+        return ADMISSION_CLASS_CONSENSUS;
+    case BROADCAST_TRANSACTION:
+    case BroadcastMessage::type:
+        return ADMISSION_CLASS_TRANSACTIONS;
+    }
+    return ADMISSION_CLASS_QUERIES;
+}
+
+// Rate limits of one peer, one token bucket per admission class. Each bucket is kept in the equivalent form of a
+// virtual scheduling time (the time at which the bucket will be full again, if no further message is admitted), so
+// refilling needs no periodic update and each bucket is a single number. Times are in TSC ticks.
+class PeerAdmissionControl
+{
+public:
+    // Fill all buckets, e.g. for a new connection.
+    void reset()
+    {
+        setMem(fullTimes, sizeof(fullTimes), 0);
+    }
+
+    // Take a token from the bucket of admissionClass, which is refilled with one token per interval up to burstSize
+    // tokens. Returns false if the bucket is empty.
+    bool admit(unsigned int admissionClass, unsigned long long now, unsigned long long interval, unsigned long long burstSize)
+    {
+        ASSERT(admissionClass < NUMBER_OF_ADMISSION_CLASSES && burstSize > 0);
+        unsigned long long& fullTime = fullTimes[admissionClass];
+        if (fullTime < now)
+        {
+            fullTime = now;
+        }
+        if (fullTime - now > (burstSize - 1) * interval)
+        {
+            return false;
+        }
+        fullTime += interval;
+        return true;
+    }
+
+private:
+    unsigned long long fullTimes[NUMBER_OF_ADMISSION_CLASSES];
+};
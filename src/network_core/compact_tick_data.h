@@ -0,0 +1,328 @@
+// compact relay of tick data: encoding TickData as CompactTickData and rebuilding TickData from it
+
+#pragma once
+
+#include "platform/m256.h"
+#include "platform/memory.h"
+#include "platform/debugging.h"
+
+#include "network_messages/tick.h"
+
+#include "kangaroo_twelve.h"
+
+// Short ID of transaction in compact tick data with the given timelock. The timelock depends on the ledger state at
+// the time the tick data is published, so transactions with colliding short IDs cannot be prepared in advance.
+static unsigned long long getShortTransactionId(const m256i& transactionDigest, const m256i& timelock)
+{
+    m256i preimage[2];
+    preimage[0] = transactionDigest;
+    preimage[1] = timelock;
+    unsigned long long shortTransactionId = 0;
+    KangarooTwelve(preimage, sizeof(preimage), &shortTransactionId, SHORT_TRANSACTION_ID_SIZE);
+    return shortTransactionId;
+}
+
+// Write compact form of tickData to compactTickData (MAX_COMPACT_TICK_DATA_SIZE bytes). Returns its size or 0 if
+// tickData has no compact form, because a non-zero transaction digest follows a zero one. The encoding is canonical,
+// so the compact form of rebuilt tick data is identical to the compact form it was rebuilt from.
+static unsigned int encodeCompactTickData(const TickData& tickData, CompactTickData* compactTickData)
+{
+    unsigned int numberOfTransactions = 0;
+    while (numberOfTransactions < NUMBER_OF_TRANSACTIONS_PER_TICK && !isZero(tickData.transactionDigests[numberOfTransactions]))
+    {
+        numberOfTransactions++;
+    }
+    for (unsigned int i = numberOfTransactions + 1; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+    {
+        if (!isZero(tickData.transactionDigests[i]))
+        {
+            return 0;
+        }
+    }
+
+    // Header fields up to the timelock have the same layout in both structs
+    copyMem(compactTickData, &tickData, offsetof(TickData, transactionDigests));
+    copyMem(compactTickData->signature, tickData.signature, SIGNATURE_SIZE);
+    compactTickData->numberOfTransactions = numberOfTransactions;
+
+    unsigned char* shortTransactionIds = (unsigned char*)(compactTickData + 1);
+    for (unsigned int i = 0; i < numberOfTransactions; i++)
+    {
+        const unsigned long long shortTransactionId = getShortTransactionId(tickData.transactionDigests[i], tickData.timelock);
+        copyMem(shortTransactionIds + i * SHORT_TRANSACTION_ID_SIZE, &shortTransactionId, SHORT_TRANSACTION_ID_SIZE);
+    }
+
+    CompactContractFee* contractFees = (CompactContractFee*)(shortTransactionIds + numberOfTransactions * SHORT_TRANSACTION_ID_SIZE);
+    unsigned int numberOfContractFees = 0;
+    for (unsigned int i = 0; i < MAX_NUMBER_OF_CONTRACTS; i++)
+    {
+        if (tickData.contractFees[i])
+        {
+            contractFees[numberOfContractFees].contractIndex = i;
+            contractFees[numberOfContractFees].fee = tickData.contractFees[i];
+            numberOfContractFees++;
+        }
+    }
+    compactTickData->numberOfContractFees = numberOfContractFees;
+
+    return sizeof(CompactTickData) + numberOfTransactions * SHORT_TRANSACTION_ID_SIZE + numberOfContractFees * sizeof(CompactContractFee);
+}
+
+// Rebuilds TickData from CompactTickData. After begin(), the digests of the transactions that may be part of the tick
+// data (usually the pending transactions scheduled for the tick) are matched by their short IDs with addCandidate().
+// Transactions that are not matched or whose short ID is matched by several digests are missing; their digests have
+// to be requested from the sender of the compact tick data and set with setMissingTransactionDigest().
+// The signature of the rebuilt tick data has not been verified yet.
+class TickDataReconstruction
+{
+public:
+    // Start rebuilding tick data from its compact form of size bytes. Returns false if the compact form is malformed.
+    bool begin(const CompactTickData* compactTickData, unsigned int size)
+    {
+        end();
+        if (size < sizeof(CompactTickData))
+        {
+            return false;
+        }
+        const unsigned int numberOfTransactions = compactTickData->numberOfTransactions;
+        const unsigned int numberOfContractFees = compactTickData->numberOfContractFees;
+        if (numberOfTransactions > NUMBER_OF_TRANSACTIONS_PER_TICK
+            || numberOfContractFees > MAX_NUMBER_OF_CONTRACTS
+            || size != sizeof(CompactTickData) + numberOfTransactions * SHORT_TRANSACTION_ID_SIZE + numberOfContractFees * sizeof(CompactContractFee))
+        {
+            return false;
+        }
+
+        copyMem(&data, compactTickData, offsetof(TickData, transactionDigests));
+        copyMem(data.signature, compactTickData->signature, SIGNATURE_SIZE);
+        setMem(data.transactionDigests, sizeof(data.transactionDigests), 0);
+        setMem(data.contractFees, sizeof(data.contractFees), 0);
+
+        const unsigned char* shortTransactionIds = (const unsigned char*)(compactTickData + 1);
+        const CompactContractFee* contractFees = (const CompactContractFee*)(shortTransactionIds + numberOfTransactions * SHORT_TRANSACTION_ID_SIZE);
+        for (unsigned int i = 0; i < numberOfContractFees; i++)
+        {
+            if (contractFees[i].contractIndex >= MAX_NUMBER_OF_CONTRACTS)
+            {
+                return false;
+            }
+            data.contractFees[contractFees[i].contractIndex] = contractFees[i].fee;
+        }
+
+        setMem(table, sizeof(table), 0xFF);
+        for (unsigned int i = 0; i < numberOfTransactions; i++)
+        {
+            shortIds[i] = 0;
+            copyMem(&shortIds[i], shortTransactionIds + i * SHORT_TRANSACTION_ID_SIZE, SHORT_TRANSACTION_ID_SIZE);
+            states[i] = MISSING;
+
+            unsigned int slot = (unsigned int)shortIds[i] & (TABLE_SIZE - 1);
+            while (table[slot] != NO_INDEX && shortIds[table[slot]] != shortIds[i])
+            {
+                slot = (slot + 1) & (TABLE_SIZE - 1);
+            }
+            if (table[slot] == NO_INDEX)
+            {
+                table[slot] = i;
+            }
+            else
+            {
+                // Same short ID for different transactions (or a duplicate transaction), the digests cannot be matched
+                states[table[slot]] = AMBIGUOUS;
+                states[i] = AMBIGUOUS;
+            }
+        }
+        this->numberOfTransactions = numberOfTransactions;
+        numberOfMissingTransactions = numberOfTransactions;
+        reconstructedTick = data.tick;
+
+        return true;
+    }
+
+    // Stop rebuilding, tick() returns 0 afterwards
+    void end()
+    {
+        reconstructedTick = 0;
+        numberOfTransactions = 0;
+        numberOfMissingTransactions = 0;
+    }
+
+    // Match digest of a transaction that may be part of the tick data
+    void addCandidate(const m256i& transactionDigest)
+    {
+        const unsigned long long shortTransactionId = getShortTransactionId(transactionDigest, data.timelock);
+        unsigned int slot = (unsigned int)shortTransactionId & (TABLE_SIZE - 1);
+        while (table[slot] != NO_INDEX)
+        {
+            const unsigned int index = table[slot];
+            if (shortIds[index] == shortTransactionId)
+            {
+                if (states[index] == MISSING)
+                {
+                    data.transactionDigests[index] = transactionDigest;
+                    states[index] = MATCHED;
+                    numberOfMissingTransactions--;
+                }
+                else if (states[index] == MATCHED && data.transactionDigests[index] != transactionDigest)
+                {
+                    data.transactionDigests[index] = _mm256_setzero_si256();
+                    states[index] = AMBIGUOUS;
+                    numberOfMissingTransactions++;
+                }
+                return;
+            }
+            slot = (slot + 1) & (TABLE_SIZE - 1);
+        }
+    }
+
+    // Set the flags of the missing transactions (RequestTickTransactionDigests::transactionFlags)
+    void getMissingTransactionFlags(unsigned char transactionFlags[NUMBER_OF_TRANSACTIONS_PER_TICK / 8]) const
+    {
+        setMem(transactionFlags, NUMBER_OF_TRANSACTIONS_PER_TICK / 8, 0);
+        for (unsigned int i = 0; i < numberOfTransactions; i++)
+        {
+            if (states[i] != MATCHED)
+            {
+                transactionFlags[i >> 3] |= (1 << (i & 7));
+            }
+        }
+    }
+
+    // Set digest of missing transaction with index. Returns false if the transaction is not missing or the digest
+    // does not match its short ID.
+    bool setMissingTransactionDigest(unsigned int index, const m256i& transactionDigest)
+    {
+        if (index >= numberOfTransactions || states[index] == MATCHED
+            || getShortTransactionId(transactionDigest, data.timelock) != shortIds[index])
+        {
+            return false;
+        }
+        data.transactionDigests[index] = transactionDigest;
+        states[index] = MATCHED;
+        numberOfMissingTransactions--;
+        return true;
+    }
+
+    // Tick of the tick data being rebuilt, 0 if none
+    unsigned int tick() const
+    {
+        return reconstructedTick;
+    }
+
+    unsigned int transactionCount() const
+    {
+        return numberOfTransactions;
+    }
+
+    unsigned int missingTransactionCount() const
+    {
+        return numberOfMissingTransactions;
+    }
+
+    // Tick data being rebuilt, with zero digests for missing transactions
+    TickData& tickData()
+    {
+        return data;
+    }
+
+private:
+    static constexpr unsigned int TABLE_SIZE = NUMBER_OF_TRANSACTIONS_PER_TICK * 2;
+    static constexpr unsigned short NO_INDEX = 0xFFFF;
+
+    enum : unsigned char
+    {
+        MISSING,
+        MATCHED,
+        AMBIGUOUS,
+    };
+
+    TickData data;
+    unsigned long long shortIds[NUMBER_OF_TRANSACTIONS_PER_TICK];
+    unsigned short table[TABLE_SIZE]; // open addressing hash map from short ID to transaction index
+    unsigned char states[NUMBER_OF_TRANSACTIONS_PER_TICK];
+    unsigned int numberOfTransactions = 0;
+    unsigned int numberOfMissingTransactions = 0;
+    unsigned int reconstructedTick = 0;
+};
+
+// Reconstructions of tick data of upcoming ticks, one slot per tick modulo numberOfSlots. The signature of compact tick
+// data can only be verified after all transaction digests are known, so a slot may be claimed by forged compact tick
+// data whose missing digests are never delivered. To keep it from blocking the genuine tick data, a reconstruction that
+// is still missing digests after a timeout is considered stalled: compact tick data of the same tick with another
+// signature may replace it, and its tick is reported by takeStalledTick(), so the full tick data can be requested.
+// Not thread-safe.
+template <unsigned int numberOfSlots>
+class TickDataReconstructionSlots
+{
+public:
+    struct Slot
+    {
+        TickDataReconstruction reconstruction;
+        unsigned long long beginTime; // time of claim()
+        bool relay; // relay rebuilt tick data in compact form
+        bool stallReported;
+    };
+
+    // Return slot for rebuilding compactTickData received at time now, in which reconstruction.begin() has to be called
+    // next. Returns nullptr if the tick data of the tick has been rebuilt already, if it is still being rebuilt and has
+    // not stalled yet, or if it is being rebuilt from compact tick data with the same signature.
+    Slot* claim(const CompactTickData& compactTickData, unsigned long long now, unsigned long long timeout)
+    {
+        Slot& slot = slots[compactTickData.tick % numberOfSlots];
+        if (slot.reconstruction.tick() == compactTickData.tick
+            && (!slot.reconstruction.missingTransactionCount()
+                || !isStalled(slot, now, timeout)
+                || hasSignature(slot, compactTickData.signature)))
+        {
+            return nullptr;
+        }
+        slot.beginTime = now;
+        slot.relay = false;
+        slot.stallReported = false;
+        return &slot;
+    }
+
+    // Slot rebuilding tick data of tick, nullptr if none
+    Slot* find(unsigned int tick)
+    {
+        Slot& slot = slots[tick % numberOfSlots];
+        return (tick && slot.reconstruction.tick() == tick) ? &slot : nullptr;
+    }
+
+    // Return tick of a reconstruction that has stalled and has not been returned before, 0 if none.
+    unsigned int takeStalledTick(unsigned long long now, unsigned long long timeout)
+    {
+        for (unsigned int i = 0; i < numberOfSlots; i++)
+        {
+            Slot& slot = slots[i];
+            if (slot.reconstruction.tick() && slot.reconstruction.missingTransactionCount()
+                && !slot.stallReported && isStalled(slot, now, timeout))
+            {
+                slot.stallReported = true;
+                return slot.reconstruction.tick();
+            }
+        }
+        return 0;
+    }
+
+private:
+    static bool isStalled(const Slot& slot, unsigned long long now, unsigned long long timeout)
+    {
+        return now - slot.beginTime > timeout;
+    }
+
+    static bool hasSignature(Slot& slot, const unsigned char signature[SIGNATURE_SIZE])
+    {
+        const unsigned char* slotSignature = slot.reconstruction.tickData().signature;
+        for (unsigned int i = 0; i < SIGNATURE_SIZE; i++)
+        {
+            if (slotSignature[i] != signature[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Slot slots[numberOfSlots];
+};
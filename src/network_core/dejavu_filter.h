@@ -0,0 +1,168 @@
+// filter of recently received message IDs, used by peerReceiveAndTransmit() to drop duplicate messages
+
+#pragma once
+
+#include "platform/memory.h"
+#include "platform/debugging.h"
+
+// Number of slots of a hash table of the dejavu filter: power of 2 with at most half of the slots filled
+static constexpr unsigned long long getDejavuTableSize(unsigned int numberOfIds)
+{
+    unsigned long long tableSize = 1;
+    while (tableSize < 2ULL * numberOfIds)
+    {
+        tableSize *= 2;
+    }
+    return tableSize;
+}
+
+// Set of the recently inserted 32-bit message IDs, stored in generations of hash tables with linear probing. IDs are
+// inserted into the current generation until it holds idsPerGeneration IDs, then the oldest generation becomes the
+// current one. The current and the previous NUMBER_OF_GENERATIONS - 2 generations are searched, so an ID is remembered
+// for the next (NUMBER_OF_GENERATIONS - 2) * idsPerGeneration to (NUMBER_OF_GENERATIONS - 1) * idsPerGeneration
+// insertions. The remaining generation is not searched anymore and is cleared in small slices with each insertion, so
+// it is empty when it becomes current.
+//
+// The full IDs are stored, so like with a bitmap of all IDs, false positives only happen if a new message has the same
+// ID as a remembered one. Since message IDs are salted hashes, the false positive rate is the number of remembered IDs
+// divided by 2^32. ID 0 is stored as 1, because 0 marks empty slots.
+template <unsigned int idsPerGeneration>
+class DejavuFilter
+{
+public:
+    static constexpr unsigned int NUMBER_OF_GENERATIONS = 4;
+    static constexpr unsigned int NUMBER_OF_SEARCHED_GENERATIONS = NUMBER_OF_GENERATIONS - 1;
+
+    static constexpr unsigned long long TABLE_SIZE = getDejavuTableSize(idsPerGeneration);
+
+    // Number of slots cleared per insertion
+    static constexpr unsigned long long CLEARING_SLICE_SIZE = 16;
+
+    static_assert(idsPerGeneration > 0, "Generation size must not be 0");
+    static_assert(TABLE_SIZE % CLEARING_SLICE_SIZE == 0 && TABLE_SIZE / CLEARING_SLICE_SIZE <= idsPerGeneration, "Clearing takes longer than one generation");
+
+    bool init()
+    {
+        if (!allocatePool(NUMBER_OF_GENERATIONS * TABLE_SIZE * sizeof(unsigned int), (void**)&tables))
+        {
+            return false;
+        }
+        reset();
+        return true;
+    }
+
+    void deinit()
+    {
+        if (tables)
+        {
+            freePool(tables);
+            tables = nullptr;
+        }
+    }
+
+    // Remove all IDs and reset counters.
+    void reset()
+    {
+        setMem(tables, NUMBER_OF_GENERATIONS * TABLE_SIZE * sizeof(unsigned int), 0);
+        setMem(numberOfIds, sizeof(numberOfIds), 0);
+        currentGeneration = 0;
+        numberOfClearedSlots = TABLE_SIZE;
+        numberOfRotations = 0;
+    }
+
+    // Return true if id has been inserted recently (or another ID with the same stored value).
+    bool contains(unsigned int id) const
+    {
+        const unsigned int storedId = id ? id : 1;
+        for (unsigned int i = 0; i < NUMBER_OF_SEARCHED_GENERATIONS; i++)
+        {
+            const unsigned int* table = getTable((currentGeneration + NUMBER_OF_GENERATIONS - i) % NUMBER_OF_GENERATIONS);
+            for (unsigned long long slot = storedId & (TABLE_SIZE - 1); table[slot]; slot = (slot + 1) & (TABLE_SIZE - 1))
+            {
+                if (table[slot] == storedId)
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Insert id, which is not contained yet. Not thread-safe.
+    void insert(unsigned int id)
+    {
+        if (numberOfIds[currentGeneration] == idsPerGeneration)
+        {
+            startNextGeneration();
+        }
+
+        const unsigned int storedId = id ? id : 1;
+        unsigned int* table = getTable(currentGeneration);
+        unsigned long long slot = storedId & (TABLE_SIZE - 1);
+        while (table[slot])
+        {
+            slot = (slot + 1) & (TABLE_SIZE - 1);
+        }
+        table[slot] = storedId;
+        numberOfIds[currentGeneration]++;
+
+        // Clear the next slice of the generation that will be current next
+        if (numberOfClearedSlots < TABLE_SIZE)
+        {
+            setMem(getTable((currentGeneration + 1) % NUMBER_OF_GENERATIONS) + numberOfClearedSlots, CLEARING_SLICE_SIZE * sizeof(unsigned int), 0);
+            numberOfClearedSlots += CLEARING_SLICE_SIZE;
+        }
+    }
+
+    // Number of IDs in the searched generations
+    unsigned long long rememberedCount() const
+    {
+        unsigned long long count = 0;
+        for (unsigned int i = 0; i < NUMBER_OF_SEARCHED_GENERATIONS; i++)
+        {
+            count += numberOfIds[(currentGeneration + NUMBER_OF_GENERATIONS - i) % NUMBER_OF_GENERATIONS];
+        }
+        return count;
+    }
+
+    // Percentage of the maximum number of remembered IDs, which is reached just before the next generation is started
+    unsigned int fillLevelPercent() const
+    {
+        return (unsigned int)(rememberedCount() * 100 / (NUMBER_OF_SEARCHED_GENERATIONS * (unsigned long long)idsPerGeneration));
+    }
+
+    // Probability that a new ID is considered as contained, in millionths
+    unsigned long long falsePositiveRatePpm() const
+    {
+        return rememberedCount() * 1000000 / (1ULL << 32);
+    }
+
+    // Number of times a new generation has been started
+    unsigned long long rotationCount() const
+    {
+        return numberOfRotations;
+    }
+
+private:
+    void startNextGeneration()
+    {
+        ASSERT(numberOfClearedSlots == TABLE_SIZE);
+
+        currentGeneration = (currentGeneration + 1) % NUMBER_OF_GENERATIONS;
+        numberOfIds[currentGeneration] = 0;
+        numberOfIds[(currentGeneration + 1) % NUMBER_OF_GENERATIONS] = 0;
+        numberOfClearedSlots = 0;
+        numberOfRotations++;
+    }
+
+    unsigned int* getTable(unsigned int generation) const
+    {
+        return tables + generation * TABLE_SIZE;
+    }
+
+    unsigned int* tables = nullptr;
+    unsigned int numberOfIds[NUMBER_OF_GENERATIONS];
+    unsigned int currentGeneration;
+    unsigned long long numberOfClearedSlots;
+    unsigned long long numberOfRotations;
+};
@@ -0,0 +1,48 @@
+// splitting data received from a peer (a stream of messages) into messages
+
+#pragma once
+
+#include "platform/memory.h"
+
+#include "network_messages/header.h"
+
+// Return the complete message at readOffset in the received data and advance readOffset behind it. Returns nullptr
+// if there is no complete message left (readOffset then points to the incomplete rest) or if the message header
+// violates the protocol (protocolViolation is set in this case).
+// Messages are returned in place, so all complete messages are processed without copying the received data.
+static RequestResponseHeader* readReceivedMessage(void* receiveBuffer, unsigned int receivedDataSize, unsigned int& readOffset, bool& protocolViolation)
+{
+    protocolViolation = false;
+    if (receivedDataSize - readOffset < sizeof(RequestResponseHeader))
+    {
+        return nullptr;
+    }
+
+    RequestResponseHeader* requestResponseHeader = (RequestResponseHeader*)((char*)receiveBuffer + readOffset);
+    const unsigned int messageSize = requestResponseHeader->size();
+    if (messageSize < sizeof(RequestResponseHeader))
+    {
+        protocolViolation = true;
+        return nullptr;
+    }
+    if (receivedDataSize - readOffset < messageSize)
+    {
+        return nullptr;
+    }
+
+    readOffset += messageSize;
+    return requestResponseHeader;
+}
+
+// Move the incomplete rest of the received data behind readOffset to the beginning of the buffer and return its size.
+// Called once after reading all complete messages. Each byte is moved at most once, because the incomplete message
+// stays at the beginning of the buffer until the rest of it is received.
+static unsigned int compactReceiveBuffer(void* receiveBuffer, unsigned int receivedDataSize, unsigned int readOffset)
+{
+    const unsigned int restSize = receivedDataSize - readOffset;
+    if (readOffset && restSize)
+    {
+        copyMem(receiveBuffer, (char*)receiveBuffer + readOffset, restSize);
+    }
+    return restSize;
+}
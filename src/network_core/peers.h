@@ -6,26 +6,37 @@
 #include "platform/uefi.h"
 #include "platform/random.h"
 #include "platform/concurrency.h"
+#include "platform/time_stamp_counter.h"
 
 #include "network_messages/common_def.h"
 #include "network_messages/header.h"
 #include "network_messages/common_response.h"
 
 #include "tcp4.h"
+#include "request_queue.h"
+#include "response_queue.h"
+#include "send_queue.h"
+#include "dejavu_filter.h"
+#include "admission_control.h"
+#include "message_framing.h"
 #include "kangaroo_twelve.h"
 
-#define DEJAVU_SWAP_LIMIT 1000000
+#define DEJAVU_GENERATION_SIZE 500000 // received messages are recognized as duplicates for the next 1 to 1.5 million messages
 #define DISSEMINATION_MULTIPLIER 6
 #define NUMBER_OF_OUTGOING_CONNECTIONS 8
 #define NUMBER_OF_INCOMING_CONNECTIONS 88
 #define MAX_NUMBER_OF_PUBLIC_PEERS 1024
 #define REQUEST_QUEUE_BUFFER_SIZE 1073741824
-#define REQUEST_QUEUE_LENGTH 65536 // Must be 65536
+#define REQUEST_QUEUE_LENGTH 65536 // Must be power of 2
 #define RESPONSE_QUEUE_BUFFER_SIZE 1073741824
-#define RESPONSE_QUEUE_LENGTH 65536 // Must be 65536
 #define NUMBER_OF_PUBLIC_PEERS_TO_KEEP 10
 #define NUMBER_OF_WHITE_LIST_PEERS sizeof(whiteListPeers) / sizeof(whiteListPeers[0])
 #define NUMBER_OF_INCOMING_CONNECTIONS_RESERVED_FOR_WHITELIST_IPS 16
+#define MAX_BULK_TRANSMISSION_SIZE 1048576 // Bulk messages per transmission (at least one), which higher priority messages may have to wait for
+#define MAX_BULK_SEND_QUEUE_SIZE_FOR_RECEIVING (BUFFER_SIZE / 2) // Stop receiving from peer while more bulk data is waiting for transmission
+#define MAX_RESPONSE_BLOCKING_TIME 10000 // Milliseconds a response may wait for space in the send queue of a peer that does not read at all
+#define REQUEST_QUEUE_LENGTH_RESERVED_FOR_CONSENSUS (REQUEST_QUEUE_LENGTH / 4) // Only usable by consensus messages and white list peers
+#define REQUEST_QUEUE_BUFFER_SIZE_RESERVED_FOR_CONSENSUS (REQUEST_QUEUE_BUFFER_SIZE / 4) // Only usable by consensus messages and white list peers
 static_assert((NUMBER_OF_INCOMING_CONNECTIONS / NUMBER_OF_OUTGOING_CONNECTIONS) >= 11, "Number of incoming connections must be x11+ number of outgoing connections to keep healthy network");
 
 static volatile bool listOfPeersIsStatic = false;
@@ -41,8 +52,7 @@ typedef struct
     EFI_TCP4_IO_TOKEN receiveToken;
     EFI_TCP4_TRANSMIT_DATA transmitData;
     EFI_TCP4_IO_TOKEN transmitToken;
-    char* dataToTransmit;
-    unsigned int dataToTransmitSize;
+    SendQueue<BUFFER_SIZE, RequestResponseHeader::max_size> sendQueue;
     BOOLEAN isConnectingAccepting;
     BOOLEAN isConnectedAccepted;
     BOOLEAN isReceiving, isTransmitting;
@@ -50,8 +60,20 @@ typedef struct
     BOOLEAN isClosing;
     // Indicate the peer is incomming connection type
     BOOLEAN isIncommingConnection;
+    // Indicate the peer has an IP of the white list (not rate limited and allowed to use reserved request queue capacity)
+    BOOLEAN isWhiteListed;
+    PeerAdmissionControl admissionControl;
 } Peer;
 
+// Rate limits of received messages per peer and admission class (messages per second and burst size in messages)
+static const unsigned int admissionRates[NUMBER_OF_ADMISSION_CLASSES] = { 10000, 2000, 200 };
+static const unsigned int admissionBurstSizes[NUMBER_OF_ADMISSION_CLASSES] = { 20000, 10000, 1000 };
+
+// Dejavus of the last requests for tick transactions sent by this node
+#define NUMBER_OF_SOLICITED_TRANSACTIONS_REQUESTS 16
+static unsigned int solicitedTransactionsDejavus[NUMBER_OF_SOLICITED_TRANSACTIONS_REQUESTS] = { 0 };
+static unsigned int numberOfSolicitedTransactionsRequests = 0;
+
 typedef struct
 {
     bool isVerified;
@@ -67,36 +89,20 @@ static volatile char publicPeersLock = 0;
 static unsigned int numberOfPublicPeers = 0;
 static PublicPeer publicPeers[MAX_NUMBER_OF_PUBLIC_PEERS];
 
-static unsigned long long* dejavu0 = NULL;
-static unsigned long long* dejavu1 = NULL;
-static unsigned int dejavuSwapCounter = DEJAVU_SWAP_LIMIT;
+static DejavuFilter<DEJAVU_GENERATION_SIZE> dejavuFilter;
 
 static volatile long long numberOfProcessedRequests = 0, prevNumberOfProcessedRequests = 0;
 static volatile long long numberOfDiscardedRequests = 0, prevNumberOfDiscardedRequests = 0;
 static volatile long long numberOfDuplicateRequests = 0, prevNumberOfDuplicateRequests = 0;
 static volatile long long numberOfDisseminatedRequests = 0, prevNumberOfDisseminatedRequests = 0;
-
-static unsigned char* requestQueueBuffer = NULL;
-static unsigned char* responseQueueBuffer = NULL;
-
-static struct Request
-{
-    Peer* peer;
-    unsigned int offset;
-} requestQueueElements[REQUEST_QUEUE_LENGTH];
-
-static struct Response
-{
-    Peer* peer;
-    unsigned int offset;
-} responseQueueElements[RESPONSE_QUEUE_LENGTH];
-
-static volatile unsigned int requestQueueBufferHead = 0, requestQueueBufferTail = 0;
-static volatile unsigned int responseQueueBufferHead = 0, responseQueueBufferTail = 0;
-static volatile unsigned short requestQueueElementHead = 0, requestQueueElementTail = 0;
-static volatile unsigned short responseQueueElementHead = 0, responseQueueElementTail = 0;
-static volatile char requestQueueTailLock = 0;
-static volatile char responseQueueHeadLock = 0;
+static long long numberOfRateLimitedRequests[NUMBER_OF_ADMISSION_CLASSES] = { 0 };
+static long long numberOfRequestsRejectedForReservedCapacity[NUMBER_OF_ADMISSION_CLASSES] = { 0 };
+
+static RequestQueue<Peer, REQUEST_QUEUE_BUFFER_SIZE, REQUEST_QUEUE_LENGTH, BUFFER_SIZE> requestQueue;
+static ResponseQueue<Peer, RESPONSE_QUEUE_BUFFER_SIZE, BUFFER_SIZE> responseQueue;
+static Peer* blockingResponsePeer = NULL; // Peer whose full send queue holds back the response queue
+static unsigned int blockingSendQueueSize = 0;
+static unsigned long long blockingStartTick = 0;
 static volatile unsigned long long queueProcessingNumerator = 0, queueProcessingDenominator = 0;
 static volatile unsigned long long tickerLoopNumerator = 0, tickerLoopDenominator = 0;
 
@@ -156,36 +162,41 @@ static void closePeer(Peer* peer)
     }
 }
 
-// Add message to sending buffer of specific peer, can only called from main thread (not thread-safe).
+static bool isSendingToPeerPossible(const Peer* peer)
+{
+    return peer->tcp4Protocol && peer->isConnectedAccepted && !peer->isClosing;
+}
+
+// Check if message can be added to send queue of peer without being dropped.
+static bool hasSendQueueSpace(const Peer* peer, const RequestResponseHeader* requestResponseHeader)
+{
+    return peer->sendQueue.hasSpace(getSendPriority(requestResponseHeader->type()), requestResponseHeader->size());
+}
+
+// Add message to send queue of specific peer, can only called from main thread (not thread-safe).
 static void push(Peer* peer, RequestResponseHeader* requestResponseHeader)
 {
-    // The sending buffer may queue multiple messages, each of which may need to transmitted in many small packets.
-    if (peer->tcp4Protocol && peer->isConnectedAccepted && !peer->isClosing)
+    // The send queue may hold multiple messages, each of which may need to transmitted in many small packets.
+    // If the queue of the message's priority is full, the message is dropped (the peer is not reading fast enough).
+    // Responses are not pushed before there is space (see pushResponses()), so this only affects gossip.
+    if (isSendingToPeerPossible(peer))
     {
-        if (peer->dataToTransmitSize + requestResponseHeader->size() > BUFFER_SIZE)
+        if (peer->sendQueue.add(getSendPriority(requestResponseHeader->type()), requestResponseHeader))
         {
-            // Buffer is full, which indicates a problem
-            closePeer(peer);
-        }
-        else
-        {
-            // Add message to buffer
-            bs->CopyMem(&peer->dataToTransmit[peer->dataToTransmitSize], requestResponseHeader, requestResponseHeader->size());
-            peer->dataToTransmitSize += requestResponseHeader->size();
-
             _InterlockedIncrement64(&numberOfDisseminatedRequests);
         }
     }
 }
 
 // Add message to sending buffer of random peer, can only called from main thread (not thread-safe).
+// Peers whose send queue is full are skipped. If all are full, the message is dropped.
 static void pushToAny(RequestResponseHeader* requestResponseHeader)
 {
     unsigned short suitablePeerIndices[NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS];
     unsigned short numberOfSuitablePeers = 0;
     for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
     {
-        if (peers[i].tcp4Protocol && peers[i].isConnectedAccepted && peers[i].exchangedPublicPeers && !peers[i].isClosing)
+        if (isSendingToPeerPossible(&peers[i]) && peers[i].exchangedPublicPeers && hasSendQueueSpace(&peers[i], requestResponseHeader))
         {
             suitablePeerIndices[numberOfSuitablePeers++] = i;
         }
@@ -197,13 +208,14 @@ static void pushToAny(RequestResponseHeader* requestResponseHeader)
 }
 
 // Add message to sending buffer of some random peers, can only called from main thread (not thread-safe).
+// Peers whose send queue is full are skipped.
 static void pushToSeveral(RequestResponseHeader* requestResponseHeader)
 {
     unsigned short suitablePeerIndices[NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS];
     unsigned short numberOfSuitablePeers = 0;
     for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
     {
-        if (peers[i].tcp4Protocol && peers[i].isConnectedAccepted && peers[i].exchangedPublicPeers && !peers[i].isClosing)
+        if (isSendingToPeerPossible(&peers[i]) && peers[i].exchangedPublicPeers && hasSendQueueSpace(&peers[i], requestResponseHeader))
         {
             suitablePeerIndices[numberOfSuitablePeers++] = i;
         }
@@ -217,63 +229,87 @@ static void pushToSeveral(RequestResponseHeader* requestResponseHeader)
     }
 }
 
-// Add message to response queue of specific peer. If peer is NULL, it will be sent to random peers. Can be called from any thread.
-static void enqueueResponse(Peer* peer, RequestResponseHeader* responseHeader)
+// Add messages from response queue to send queues (in one batch of the responses waiting now), can only be called from
+// main thread. A response to a peer whose send queue is full stays in the response queue (together with all responses
+// behind it) until the transmission to the peer frees enough space, because dropping it would leave the peer waiting
+// for the rest of the response. Only if the peer does not take any data from its send queue for
+// MAX_RESPONSE_BLOCKING_TIME, it is considered dead and closed, so it cannot hold back the responses to other peers.
+static void pushResponses()
 {
-    ACQUIRE(responseQueueHeadLock);
-
-    if ((responseQueueBufferHead >= responseQueueBufferTail || responseQueueBufferHead + responseHeader->size() < responseQueueBufferTail)
-        && (unsigned short)(responseQueueElementHead + 1) != responseQueueElementTail)
+    for (unsigned int numberOfResponses = responseQueue.waitingLength(); numberOfResponses; numberOfResponses--)
     {
-        responseQueueElements[responseQueueElementHead].offset = responseQueueBufferHead;
-        bs->CopyMem(&responseQueueBuffer[responseQueueBufferHead], responseHeader, responseHeader->size());
-        responseQueueBufferHead += responseHeader->size();
-        responseQueueElements[responseQueueElementHead].peer = peer;
-        if (responseQueueBufferHead > RESPONSE_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
+        Peer* responsePeer;
+        RequestResponseHeader* responseHeader = responseQueue.dequeue(responsePeer);
+        if (!responseHeader)
+        {
+            // Next response is still being written
+            break;
+        }
+        if (responsePeer)
+        {
+            if (isSendingToPeerPossible(responsePeer) && !hasSendQueueSpace(responsePeer, responseHeader))
+            {
+                const unsigned long long now = __rdtsc();
+                const unsigned int sendQueueSize = responsePeer->sendQueue.size();
+                if (responsePeer != blockingResponsePeer || sendQueueSize < blockingSendQueueSize)
+                {
+                    // Started waiting or peer made progress
+                    blockingResponsePeer = responsePeer;
+                    blockingSendQueueSize = sendQueueSize;
+                    blockingStartTick = now;
+                    break;
+                }
+                if ((now - blockingStartTick) * 1000 < MAX_RESPONSE_BLOCKING_TIME * frequency)
+                {
+                    break;
+                }
+                closePeer(responsePeer);
+            }
+            blockingResponsePeer = NULL;
+            push(responsePeer, responseHeader);
+        }
+        else
         {
-            responseQueueBufferHead = 0;
+            pushToSeveral(responseHeader);
         }
-        responseQueueElementHead++;
+        responseQueue.release();
     }
+}
 
-    RELEASE(responseQueueHeadLock);
+// Add message to response queue of specific peer. If peer is NULL, it will be sent to random peers. Can be called from any thread.
+static void enqueueResponse(Peer* peer, RequestResponseHeader* responseHeader)
+{
+    responseQueue.enqueue(peer, responseHeader);
 }
 
 // Add message to response queue of specific peer. If peer is NULL, it will be sent to random peers. Can be called from any thread.
 static void enqueueResponse(Peer* peer, unsigned int dataSize, unsigned char type, unsigned int dejavu, const void* data)
 {
-    ACQUIRE(responseQueueHeadLock);
+    if (sizeof(RequestResponseHeader) + dataSize > RequestResponseHeader::max_size)
+    {
+        setText(message, L"Error: Message size ");
+        appendNumber(message, sizeof(RequestResponseHeader) + dataSize, TRUE);
+        appendText(message, L" of message of type ");
+        appendNumber(message, type, FALSE);
+        appendText(message, L" exceeds maximum message size!");
+        logToConsole(message);
+        return;
+    }
 
-    if ((responseQueueBufferHead >= responseQueueBufferTail || responseQueueBufferHead + sizeof(RequestResponseHeader) + dataSize < responseQueueBufferTail)
-        && (unsigned short)(responseQueueElementHead + 1) != responseQueueElementTail)
+    // The response is written directly into the queue
+    long long position;
+    RequestResponseHeader* responseHeader = responseQueue.reserve(peer, sizeof(RequestResponseHeader) + dataSize, position);
+    if (responseHeader)
     {
-        responseQueueElements[responseQueueElementHead].offset = responseQueueBufferHead;
-        RequestResponseHeader* responseHeader = (RequestResponseHeader*)&responseQueueBuffer[responseQueueBufferHead];
-        if (!responseHeader->checkAndSetSize(sizeof(RequestResponseHeader) + dataSize))
-        {
-            setText(message, L"Error: Message size ");
-            appendNumber(message, sizeof(RequestResponseHeader) + dataSize, TRUE);
-            appendText(message, L" of message of type ");
-            appendNumber(message, type, FALSE);
-            appendText(message, L" exceeds maximum message size!");
-            logToConsole(message);
-        }
+        responseHeader->checkAndSetSize(sizeof(RequestResponseHeader) + dataSize);
         responseHeader->setType(type);
         responseHeader->setDejavu(dejavu);
         if (data)
         {
-            copyMem(&responseQueueBuffer[responseQueueBufferHead + sizeof(RequestResponseHeader)], data, dataSize);
+            copyMem(responseHeader + 1, data, dataSize);
         }
-        responseQueueBufferHead += responseHeader->size();
-        responseQueueElements[responseQueueElementHead].peer = peer;
-        if (responseQueueBufferHead > RESPONSE_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
-        {
-            responseQueueBufferHead = 0;
-        }
-        responseQueueElementHead++;
+        responseQueue.publish(position);
     }
-
-    RELEASE(responseQueueHeadLock);
 }
 
 /**
@@ -503,13 +539,73 @@ static bool peerConnectionNewlyEstablished(unsigned int i)
             {
                 numberOfAcceptedIncommingConnection++;
                 ASSERT(numberOfAcceptedIncommingConnection <= NUMBER_OF_INCOMING_CONNECTIONS);
+
+                EFI_TCP4_CONFIG_DATA tcp4ConfigData;
+                peers[i].isWhiteListed = !peers[i].tcp4Protocol->GetModeData(peers[i].tcp4Protocol, NULL, &tcp4ConfigData, NULL, NULL, NULL)
+                    && isWhiteListPeer(tcp4ConfigData.AccessPoint.RemoteAddress.Addr);
+            }
+            else
+            {
+                peers[i].isWhiteListed = isWhiteListPeer(peers[i].address.u8);
             }
+            peers[i].admissionControl.reset();
             return true;
         }
     }
     return false;
 }
 
+// Remember the dejavu of a request for transactions sent by this node, can only be called from main thread. Transactions
+// received with this dejavu answer the request and are admitted like consensus messages (see getReceivedAdmissionClass()).
+static void registerSolicitedTransactionsDejavu(unsigned int dejavu)
+{
+    solicitedTransactionsDejavus[numberOfSolicitedTransactionsRequests++ % NUMBER_OF_SOLICITED_TRANSACTIONS_REQUESTS] = dejavu;
+}
+
+// Return admission class of received message. Transactions are only rate limited like unsolicited ones, if they do not
+// answer one of the last requests for transactions sent by this node (the transactions of ticks needed for consensus).
+static unsigned int getReceivedAdmissionClass(const RequestResponseHeader* requestResponseHeader)
+{
+    if (requestResponseHeader->type() == BROADCAST_TRANSACTION && !requestResponseHeader->isDejavuZero())
+    {
+        for (unsigned int i = 0; i < NUMBER_OF_SOLICITED_TRANSACTIONS_REQUESTS; i++)
+        {
+            if (solicitedTransactionsDejavus[i] == requestResponseHeader->dejavu())
+            {
+                return ADMISSION_CLASS_CONSENSUS;
+            }
+        }
+    }
+    return getAdmissionClass(requestResponseHeader->type());
+}
+
+// Check whether a received message of admissionClass may be added to the request queue. Consensus messages may use the
+// whole queue, other messages only the part not reserved for consensus messages. White list peers may use the whole
+// queue for all messages and are not rate limited. Other peers are rate limited per admission class.
+static bool admitReceivedRequest(Peer* peer, unsigned int admissionClass)
+{
+    if (peer->isWhiteListed)
+    {
+        return true;
+    }
+
+    if (admissionClass != ADMISSION_CLASS_CONSENSUS
+        && (requestQueue.waitingLength() >= REQUEST_QUEUE_LENGTH - REQUEST_QUEUE_LENGTH_RESERVED_FOR_CONSENSUS
+            || requestQueue.filledBufferSize() >= REQUEST_QUEUE_BUFFER_SIZE - REQUEST_QUEUE_BUFFER_SIZE_RESERVED_FOR_CONSENSUS))
+    {
+        numberOfRequestsRejectedForReservedCapacity[admissionClass]++;
+        return false;
+    }
+
+    if (!peer->admissionControl.admit(admissionClass, __rdtsc(), frequency / admissionRates[admissionClass], admissionBurstSizes[admissionClass]))
+    {
+        numberOfRateLimitedRequests[admissionClass]++;
+        return false;
+    }
+
+    return true;
+}
+
 static void peerReceiveAndTransmit(unsigned int i, unsigned int salt)
 {
     EFI_STATUS status;
@@ -543,82 +639,65 @@ static void peerReceiveAndTransmit(unsigned int i, unsigned int salt)
                     numberOfReceivedBytes += peers[i].receiveData.DataLength;
                     *((unsigned long long*) & peers[i].receiveData.FragmentTable[0].FragmentBuffer) += peers[i].receiveData.DataLength;
 
-                iteration:
-                    unsigned int receivedDataSize = (unsigned int)(((unsigned long long)peers[i].receiveData.FragmentTable[0].FragmentBuffer) - ((unsigned long long)peers[i].receiveBuffer));
-
-                    if (receivedDataSize >= sizeof(RequestResponseHeader))
+                    const unsigned int receivedDataSize = (unsigned int)(((unsigned long long)peers[i].receiveData.FragmentTable[0].FragmentBuffer) - ((unsigned long long)peers[i].receiveBuffer));
+                    unsigned int readOffset = 0;
+                    bool protocolViolation;
+                    RequestResponseHeader* requestResponseHeader;
+                    while (requestResponseHeader = readReceivedMessage(peers[i].receiveBuffer, receivedDataSize, readOffset, protocolViolation))
                     {
-                        RequestResponseHeader* requestResponseHeader = (RequestResponseHeader*)peers[i].receiveBuffer;
-                        if (requestResponseHeader->size() < sizeof(RequestResponseHeader))
-                        {
-                            // protocol violation -> forget peer
-                            setText(message, L"Forgetting ");
-                            appendIPv4Address(message, peers[i].address);
-                            appendText(message, L"...");
-                            forgetPublicPeer(peers[i].address);
-                            closePeer(&peers[i]);
-                        }
-                        else
-                        {
-                            if (receivedDataSize >= requestResponseHeader->size())
-                            {
-                                unsigned int saltedId;
+                        unsigned int saltedId;
 
-                                const unsigned int header = *((unsigned int*)requestResponseHeader);
-                                *((unsigned int*)requestResponseHeader) = salt;
-                                KangarooTwelve(requestResponseHeader, header & 0xFFFFFF, &saltedId, sizeof(saltedId));
-                                *((unsigned int*)requestResponseHeader) = header;
+                        const unsigned int header = *((unsigned int*)requestResponseHeader);
+                        *((unsigned int*)requestResponseHeader) = salt;
+                        KangarooTwelve(requestResponseHeader, header & 0xFFFFFF, &saltedId, sizeof(saltedId));
+                        *((unsigned int*)requestResponseHeader) = header;
 
-                                // Initiate transfer of already received packet to processing thread
-                                // (or drop it without processing if Dejavu filter tells to ignore it)
-                                if (!((dejavu0[saltedId >> 6] | dejavu1[saltedId >> 6]) & (1ULL << (saltedId & 63))))
+                        // Initiate transfer of already received packet to processing thread
+                        // (or drop it without processing if Dejavu filter tells to ignore it)
+                        if (!dejavuFilter.contains(saltedId))
+                        {
+                            // Requests that are not accepted are answered with TryAgain, messages without dejavu (which
+                            // are not requests for a response) are dropped silently
+                            if (!admitReceivedRequest(&peers[i], getReceivedAdmissionClass(requestResponseHeader)))
+                            {
+                                if (!requestResponseHeader->isDejavuZero())
                                 {
-                                    if ((requestQueueBufferHead >= requestQueueBufferTail || requestQueueBufferHead + requestResponseHeader->size() < requestQueueBufferTail)
-                                        && (unsigned short)(requestQueueElementHead + 1) != requestQueueElementTail)
-                                    {
-                                        dejavu0[saltedId >> 6] |= (1ULL << (saltedId & 63));
-
-                                        ASSERT(requestQueueElementHead < REQUEST_QUEUE_LENGTH);
-                                        ASSERT(requestQueueBufferHead < REQUEST_QUEUE_BUFFER_SIZE);
-                                        ASSERT(requestQueueBufferHead + requestResponseHeader->size() < REQUEST_QUEUE_BUFFER_SIZE);
-
-                                        requestQueueElements[requestQueueElementHead].offset = requestQueueBufferHead;
-                                        bs->CopyMem(&requestQueueBuffer[requestQueueBufferHead], peers[i].receiveBuffer, requestResponseHeader->size());
-                                        requestQueueBufferHead += requestResponseHeader->size();
-                                        requestQueueElements[requestQueueElementHead].peer = &peers[i];
-                                        if (requestQueueBufferHead > REQUEST_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
-                                        {
-                                            requestQueueBufferHead = 0;
-                                        }
-                                        // TODO: Place a fence
-                                        requestQueueElementHead++;
-
-                                        if (!(--dejavuSwapCounter))
-                                        {
-                                            unsigned long long* tmp = dejavu1;
-                                            dejavu1 = dejavu0;
-                                            bs->SetMem(dejavu0 = tmp, 536870912, 0);
-                                            dejavuSwapCounter = DEJAVU_SWAP_LIMIT;
-                                        }
-                                    }
-                                    else
-                                    {
-                                        _InterlockedIncrement64(&numberOfDiscardedRequests);
-
-                                        enqueueResponse(&peers[i], 0, TryAgain::type, requestResponseHeader->dejavu(), NULL);
-                                    }
+                                    enqueueResponse(&peers[i], 0, TryAgain::type, requestResponseHeader->dejavu(), NULL);
                                 }
-                                else
+                            }
+                            else if (requestQueue.enqueue(&peers[i], requestResponseHeader))
+                            {
+                                dejavuFilter.insert(saltedId);
+                            }
+                            else
+                            {
+                                _InterlockedIncrement64(&numberOfDiscardedRequests);
+
+                                if (!requestResponseHeader->isDejavuZero())
                                 {
-                                    _InterlockedIncrement64(&numberOfDuplicateRequests);
+                                    enqueueResponse(&peers[i], 0, TryAgain::type, requestResponseHeader->dejavu(), NULL);
                                 }
-
-                                bs->CopyMem(peers[i].receiveBuffer, ((char*)peers[i].receiveBuffer) + requestResponseHeader->size(), receivedDataSize -= requestResponseHeader->size());
-                                peers[i].receiveData.FragmentTable[0].FragmentBuffer = ((char*)peers[i].receiveBuffer) + receivedDataSize;
-
-                                goto iteration;
                             }
                         }
+                        else
+                        {
+                            _InterlockedIncrement64(&numberOfDuplicateRequests);
+                        }
+                    }
+
+                    if (protocolViolation)
+                    {
+                        // protocol violation -> forget peer
+                        setText(message, L"Forgetting ");
+                        appendIPv4Address(message, peers[i].address);
+                        appendText(message, L"...");
+                        forgetPublicPeer(peers[i].address);
+                        closePeer(&peers[i]);
+                    }
+                    else
+                    {
+                        // Keep only the incomplete message (if any) for the next receive
+                        peers[i].receiveData.FragmentTable[0].FragmentBuffer = ((char*)peers[i].receiveBuffer) + compactReceiveBuffer(peers[i].receiveBuffer, receivedDataSize, readOffset);
                     }
                 }
             }
@@ -626,7 +705,9 @@ static void peerReceiveAndTransmit(unsigned int i, unsigned int salt)
     }
     if (((unsigned long long)peers[i].tcp4Protocol) > 1)
     {
-        if (!peers[i].isReceiving && peers[i].isConnectedAccepted && !peers[i].isClosing)
+        // backpressure: do not receive further requests while the peer is not reading the responses
+        if (!peers[i].isReceiving && peers[i].isConnectedAccepted && !peers[i].isClosing
+            && peers[i].sendQueue.size(SEND_PRIORITY_BULK) < MAX_BULK_SEND_QUEUE_SIZE_FOR_RECEIVING)
         {
             // check that receive buffer has enough space (less than BUFFER_SIZE is used)
             if ((((unsigned long long)peers[i].receiveData.FragmentTable[0].FragmentBuffer) - ((unsigned long long)peers[i].receiveBuffer)) < BUFFER_SIZE)
@@ -692,11 +773,10 @@ static void peerReceiveAndTransmit(unsigned int i, unsigned int salt)
     }
     if (((unsigned long long)peers[i].tcp4Protocol) > 1)
     {
-        if (peers[i].dataToTransmitSize && !peers[i].isTransmitting && peers[i].isConnectedAccepted && !peers[i].isClosing)
+        if (peers[i].sendQueue.size() && !peers[i].isTransmitting && peers[i].isConnectedAccepted && !peers[i].isClosing)
         {
-            // initiate transmission
-            bs->CopyMem(peers[i].transmitData.FragmentTable[0].FragmentBuffer, peers[i].dataToTransmit, peers[i].transmitData.DataLength = peers[i].transmitData.FragmentTable[0].FragmentLength = peers[i].dataToTransmitSize);
-            peers[i].dataToTransmitSize = 0;
+            // initiate transmission (messages of higher priority first)
+            peers[i].transmitData.DataLength = peers[i].transmitData.FragmentTable[0].FragmentLength = peers[i].sendQueue.takeForTransmission((char*)peers[i].transmitData.FragmentTable[0].FragmentBuffer, BUFFER_SIZE, MAX_BULK_TRANSMISSION_SIZE);
             if (status = peers[i].tcp4Protocol->Transmit(peers[i].tcp4Protocol, &peers[i].transmitToken))
             {
                 logStatusToConsole(L"EFI_TCP4_PROTOCOL.Transmit() fails", status, __LINE__);
@@ -739,7 +819,7 @@ static void peerReconnectIfInactive(unsigned int i, unsigned short port)
                 if (peers[i].connectAcceptToken.NewChildHandle = getTcp4Protocol(peers[i].address.u8, port, &peers[i].tcp4Protocol))
                 {
                     peers[i].receiveData.FragmentTable[0].FragmentBuffer = peers[i].receiveBuffer;
-                    peers[i].dataToTransmitSize = 0;
+                    peers[i].sendQueue.reset();
                     peers[i].isReceiving = FALSE;
                     peers[i].isTransmitting = FALSE;
                     peers[i].exchangedPublicPeers = FALSE;
@@ -772,7 +852,7 @@ static void peerReconnectIfInactive(unsigned int i, unsigned short port)
             {
                 peers[i].isIncommingConnection = TRUE;
                 peers[i].receiveData.FragmentTable[0].FragmentBuffer = peers[i].receiveBuffer;
-                peers[i].dataToTransmitSize = 0;
+                peers[i].sendQueue.reset();
                 peers[i].isReceiving = FALSE;
                 peers[i].isTransmitting = FALSE;
                 peers[i].exchangedPublicPeers = FALSE;
@@ -0,0 +1,260 @@
+// queue of received requests, filled by peerReceiveAndTransmit() and processed by the request processors
+
+#pragma once
+
+#include "platform/concurrency.h"
+#include "platform/memory.h"
+#include "platform/debugging.h"
+
+#include "network_messages/header.h"
+
+// Ring buffer of requests (each stored contiguously) with a ring of sequence-numbered slots describing them.
+// Consumers claim the next slot lock-free with a compare-and-swap and process the request in place, so requests
+// are neither copied out nor is a lock held while dequeuing. After processing, the consumer releases the slot.
+// Buffer space is reclaimed in order by the producer when it enqueues the next request. Producers only hold
+// a lock while reserving space, the request is copied without holding it.
+//
+// The sequence number of the slot used for queue position p is:
+// - p if the slot is free,
+// - p + 1 if the request has been enqueued and can be claimed,
+// - p + 2 if the request has been processed and its buffer space can be reclaimed.
+template <typename PeerType, unsigned int bufferSize, unsigned int length, unsigned int maxRequestSize>
+class RequestQueue
+{
+public:
+    static_assert(length > 2 && (length & (length - 1)) == 0, "Queue length must be power of 2");
+    static_assert(bufferSize > 2ULL * maxRequestSize, "Buffer size is too small");
+
+    bool init()
+    {
+        if (!allocatePool(bufferSize, (void**)&buffer))
+        {
+            return false;
+        }
+        reset();
+        return true;
+    }
+
+    void deinit()
+    {
+        if (buffer)
+        {
+            freePool(buffer);
+            buffer = nullptr;
+        }
+    }
+
+    // Remove all requests and reset counters. Not thread-safe.
+    void reset()
+    {
+        for (unsigned int i = 0; i < length; i++)
+        {
+            slots[i].sequence = i;
+        }
+        enqueuePosition = 0;
+        dequeuePosition = 0;
+        releasePosition = 0;
+        bufferHead = 0;
+        bufferTail = 0;
+        producerLock = 0;
+        numberOfEnqueuedRequests = 0;
+        numberOfDequeuedRequests = 0;
+        numberOfFailedClaims = 0;
+        numberOfContendedEnqueues = 0;
+    }
+
+    // Copy request into queue. Returns false if queue is full.
+    bool enqueue(PeerType* peer, const RequestResponseHeader* request)
+    {
+        const unsigned int size = request->size();
+        ASSERT(size <= maxRequestSize);
+
+        if (!TRY_ACQUIRE(producerLock))
+        {
+            _InterlockedIncrement64(&numberOfContendedEnqueues);
+            ACQUIRE(producerLock);
+        }
+
+        reclaimProcessedRequests();
+
+        const long long position = enqueuePosition;
+        Slot& slot = slots[position & (length - 1)];
+        bool hasSpace = slot.sequence == position;
+        if (hasSpace)
+        {
+            if (releasePosition == position)
+            {
+                // All requests have been processed
+                bufferHead = 0;
+                bufferTail = 0;
+            }
+            else if (bufferHead <= bufferTail)
+            {
+                hasSpace = bufferHead + size < bufferTail;
+            }
+        }
+        if (!hasSpace)
+        {
+            RELEASE(producerLock);
+            return false;
+        }
+
+        const unsigned int offset = bufferHead;
+        bufferHead += size;
+        if (bufferHead > bufferSize - maxRequestSize)
+        {
+            bufferHead = 0;
+        }
+        enqueuePosition = position + 1;
+
+        RELEASE(producerLock);
+
+        // Consumers cannot claim the slot before the sequence number is updated
+        copyMem(buffer + offset, request, size);
+        slot.peer = peer;
+        slot.offset = offset;
+        slot.size = size;
+        _InterlockedExchange64(&slot.sequence, position + 1);
+        _InterlockedIncrement64(&numberOfEnqueuedRequests);
+
+        return true;
+    }
+
+    // Claim next request for processing in place. Returns nullptr if queue is empty. Otherwise, position and peer
+    // are set and release(position) has to be called after processing the request.
+    RequestResponseHeader* dequeue(long long& position, PeerType*& peer)
+    {
+        return claim(position, peer, false, 0);
+    }
+
+    // Same as dequeue(), but only claims the next request if it is of the given type (returns nullptr otherwise).
+    RequestResponseHeader* dequeueIfType(long long& position, PeerType*& peer, unsigned char type)
+    {
+        return claim(position, peer, true, type);
+    }
+
+    // Mark request as processed, so its buffer space can be reused.
+    void release(long long position)
+    {
+        _InterlockedExchange64(&slots[position & (length - 1)].sequence, position + 2);
+    }
+
+    bool isEmpty() const
+    {
+        return slots[dequeuePosition & (length - 1)].sequence != dequeuePosition + 1;
+    }
+
+    // Number of requests waiting to be claimed
+    unsigned int waitingLength() const
+    {
+        return (unsigned int)(enqueuePosition - dequeuePosition);
+    }
+
+    // Number of bytes of buffer in use, including processed requests that have not been reclaimed yet
+    unsigned int filledBufferSize() const
+    {
+        const unsigned int head = bufferHead, tail = bufferTail;
+        if (head == tail)
+        {
+            return (releasePosition == enqueuePosition) ? 0 : bufferSize;
+        }
+        return (head > tail) ? head - tail : bufferSize - (tail - head);
+    }
+
+    long long enqueuedCount() const
+    {
+        return numberOfEnqueuedRequests;
+    }
+
+    long long dequeuedCount() const
+    {
+        return numberOfDequeuedRequests;
+    }
+
+    // Number of failed compare-and-swaps of consumers that tried to claim the same request concurrently
+    long long failedClaimCount() const
+    {
+        return numberOfFailedClaims;
+    }
+
+    // Number of enqueue() calls that had to wait for another producer
+    long long contendedEnqueueCount() const
+    {
+        return numberOfContendedEnqueues;
+    }
+
+private:
+    RequestResponseHeader* claim(long long& position, PeerType*& peer, bool checkType, unsigned char type)
+    {
+        long long currentPosition = dequeuePosition;
+        while (true)
+        {
+            Slot& slot = slots[currentPosition & (length - 1)];
+            const long long sequence = slot.sequence;
+            if (sequence == currentPosition + 1)
+            {
+                // If the slot is claimed concurrently, the type may be outdated but then the compare-and-swap fails
+                if (checkType && ((RequestResponseHeader*)(buffer + slot.offset))->type() != type)
+                {
+                    return nullptr;
+                }
+                if (_InterlockedCompareExchange64(&dequeuePosition, currentPosition + 1, currentPosition) == currentPosition)
+                {
+                    _InterlockedIncrement64(&numberOfDequeuedRequests);
+                    position = currentPosition;
+                    peer = slot.peer;
+                    return (RequestResponseHeader*)(buffer + slot.offset);
+                }
+                _InterlockedIncrement64(&numberOfFailedClaims);
+            }
+            else if (sequence < currentPosition + 1)
+            {
+                // Not enqueued yet
+                return nullptr;
+            }
+            currentPosition = dequeuePosition;
+        }
+    }
+
+    // Advance buffer tail over processed requests. Requires producerLock.
+    void reclaimProcessedRequests()
+    {
+        while (releasePosition != enqueuePosition)
+        {
+            Slot& slot = slots[releasePosition & (length - 1)];
+            if (slot.sequence != releasePosition + 2)
+            {
+                break;
+            }
+            bufferTail = slot.offset + slot.size;
+            if (bufferTail > bufferSize - maxRequestSize)
+            {
+                bufferTail = 0;
+            }
+            slot.sequence = releasePosition + length;
+            releasePosition++;
+        }
+    }
+
+    struct Slot
+    {
+        volatile long long sequence;
+        PeerType* peer;
+        unsigned int offset;
+        unsigned int size;
+    };
+
+    unsigned char* buffer = nullptr;
+    Slot slots[length];
+    volatile long long enqueuePosition;
+    volatile long long dequeuePosition;
+    volatile long long releasePosition;
+    volatile unsigned int bufferHead;
+    volatile unsigned int bufferTail;
+    volatile char producerLock;
+
+    volatile long long numberOfEnqueuedRequests;
+    volatile long long numberOfDequeuedRequests;
+    volatile long long numberOfFailedClaims;
+    volatile long long numberOfContendedEnqueues;
+};
@@ -0,0 +1,273 @@
+// queue of responses, filled by enqueueResponse() on any processor and emptied by the main loop
+
+#pragma once
+
+#include "platform/concurrency.h"
+#include "platform/memory.h"
+#include "platform/debugging.h"
+
+#include "network_messages/header.h"
+
+// Lock-free ring buffer of responses with many producers and a single consumer. Each response is stored contiguously
+// behind an entry header. Producers reserve space by advancing the head position with a compare-and-swap (retrying if
+// another producer was faster), write the response without any synchronization, and publish it by setting the
+// position in the entry header. The consumer takes published responses in the order of reservation, so producers are
+// served fairly, and frees their space by advancing the tail position.
+//
+// Positions count bytes and never wrap around, so the entry header of a response published in an earlier round
+// through the buffer is never mistaken for a new one. Entry headers of the next round may be located anywhere in the
+// space of the responses of this round, whose bytes may be chosen by peers. So the consumer clears the space before
+// freeing it, and a position that has not been set by the producer yet is always 0. Responses do not wrap around the
+// end of the buffer, the rest of the buffer is skipped with a padding entry instead.
+template <typename PeerType, unsigned int bufferSize, unsigned int maxResponseSize>
+class ResponseQueue
+{
+    struct Entry
+    {
+        volatile long long position; // set last, when the response is published
+        PeerType* peer;
+        unsigned int size; // size of response or PADDING
+        unsigned int reserved;
+        unsigned long long enqueueTick;
+    };
+
+    static constexpr unsigned int PADDING = 0xFFFFFFFF;
+    static constexpr unsigned int ENTRY_ALIGNMENT = sizeof(Entry);
+
+public:
+    static_assert(bufferSize % ENTRY_ALIGNMENT == 0, "Buffer size must be multiple of entry header size");
+    static_assert(bufferSize > 2ULL * (maxResponseSize + ENTRY_ALIGNMENT), "Buffer size is too small");
+
+    bool init()
+    {
+        if (!allocatePool(bufferSize, (void**)&buffer))
+        {
+            return false;
+        }
+        reset();
+        return true;
+    }
+
+    void deinit()
+    {
+        if (buffer)
+        {
+            freePool(buffer);
+            buffer = nullptr;
+        }
+    }
+
+    // Remove all responses and reset counters. Not thread-safe.
+    void reset()
+    {
+        // Positions start at bufferSize, so no cleared entry header has a valid position
+        setMem(buffer, bufferSize, 0);
+        headPosition = bufferSize;
+        tailPosition = bufferSize;
+        numberOfEnqueuedResponses = 0;
+        numberOfDequeuedResponses = 0;
+        numberOfRejectedResponses = 0;
+        numberOfFailedReservations = 0;
+        totalEnqueueTicks = 0;
+        maxEnqueueTicks = 0;
+        totalWaitingTicks = 0;
+        maxWaitingTicks = 0;
+    }
+
+    // Reserve space for a response of size bytes (including header) to peer. Returns pointer for writing the response
+    // or nullptr if the queue is full. If not nullptr, publish(position) has to be called after writing the response.
+    RequestResponseHeader* reserve(PeerType* peer, unsigned int size, long long& position)
+    {
+        ASSERT(size <= maxResponseSize);
+        const unsigned long long enqueueTick = __rdtsc();
+        const long long entrySize = sizeof(Entry) + ((size + ENTRY_ALIGNMENT - 1) & ~(ENTRY_ALIGNMENT - 1));
+        long long currentHeadPosition = headPosition;
+        long long paddingSize;
+        while (true)
+        {
+            const long long offset = currentHeadPosition % bufferSize;
+            paddingSize = (offset + entrySize > bufferSize) ? bufferSize - offset : 0;
+            if (currentHeadPosition + paddingSize + entrySize - tailPosition > bufferSize)
+            {
+                _InterlockedIncrement64(&numberOfRejectedResponses);
+                return nullptr;
+            }
+            const long long observedHeadPosition = _InterlockedCompareExchange64(&headPosition, currentHeadPosition + paddingSize + entrySize, currentHeadPosition);
+            if (observedHeadPosition == currentHeadPosition)
+            {
+                break;
+            }
+            _InterlockedIncrement64(&numberOfFailedReservations);
+            currentHeadPosition = observedHeadPosition;
+        }
+        _InterlockedIncrement64(&numberOfEnqueuedResponses);
+
+        if (paddingSize)
+        {
+            Entry* padding = getEntry(currentHeadPosition);
+            padding->size = PADDING;
+            _InterlockedExchange64(&padding->position, currentHeadPosition);
+            currentHeadPosition += paddingSize;
+        }
+
+        Entry* entry = getEntry(currentHeadPosition);
+        entry->peer = peer;
+        entry->size = size;
+        entry->enqueueTick = enqueueTick;
+        position = currentHeadPosition;
+        return (RequestResponseHeader*)(entry + 1);
+    }
+
+    // Make response written to the pointer returned by reserve() available to the consumer.
+    void publish(long long position)
+    {
+        Entry* entry = getEntry(position);
+        const unsigned long long publishTick = __rdtsc();
+        const unsigned long long enqueueTicks = publishTick - entry->enqueueTick;
+        entry->enqueueTick = publishTick;
+        _InterlockedExchangeAdd64((volatile long long*)&totalEnqueueTicks, enqueueTicks);
+        updateMax(maxEnqueueTicks, enqueueTicks);
+
+        // The consumer cannot take the response before the position is set
+        _InterlockedExchange64(&entry->position, position);
+    }
+
+    // Copy response into queue. Returns false if queue is full.
+    bool enqueue(PeerType* peer, const RequestResponseHeader* response)
+    {
+        long long position;
+        RequestResponseHeader* destination = reserve(peer, response->size(), position);
+        if (!destination)
+        {
+            return false;
+        }
+        copyMem(destination, response, response->size());
+        publish(position);
+        return true;
+    }
+
+    // Return next response or nullptr if the next response has not been published yet (or the queue is empty). Only
+    // to be called by the consumer, which has to call release() after processing the response. As long as release()
+    // is not called, the same response is returned again, so the consumer can defer a response it cannot process yet.
+    RequestResponseHeader* dequeue(PeerType*& peer)
+    {
+        while (tailPosition != headPosition)
+        {
+            Entry* entry = getEntry(tailPosition);
+            if (entry->position != tailPosition)
+            {
+                return nullptr;
+            }
+            if (entry->size == PADDING)
+            {
+                freeSpace(bufferSize - tailPosition % bufferSize);
+                continue;
+            }
+            peer = entry->peer;
+            return (RequestResponseHeader*)(entry + 1);
+        }
+        return nullptr;
+    }
+
+    // Free the space of the response returned by the last dequeue().
+    void release()
+    {
+        const Entry* entry = getEntry(tailPosition);
+        const unsigned long long waitingTicks = __rdtsc() - entry->enqueueTick;
+        totalWaitingTicks += waitingTicks;
+        updateMax(maxWaitingTicks, waitingTicks);
+        numberOfDequeuedResponses++;
+        freeSpace(sizeof(Entry) + ((entry->size + ENTRY_ALIGNMENT - 1) & ~(ENTRY_ALIGNMENT - 1)));
+    }
+
+    // Number of responses that have been enqueued but not released yet
+    unsigned int waitingLength() const
+    {
+        return (unsigned int)(numberOfEnqueuedResponses - numberOfDequeuedResponses);
+    }
+
+    // Number of bytes of buffer in use (including entry headers and padding)
+    unsigned long long filledBufferSize() const
+    {
+        return headPosition - tailPosition;
+    }
+
+    long long enqueuedCount() const
+    {
+        return numberOfEnqueuedResponses;
+    }
+
+    // Number of responses that have not been enqueued, because the queue was full
+    long long rejectedCount() const
+    {
+        return numberOfRejectedResponses;
+    }
+
+    // Number of failed compare-and-swaps of producers that reserved space concurrently
+    long long failedReservationCount() const
+    {
+        return numberOfFailedReservations;
+    }
+
+    // Average and maximum number of TSC ticks from start of reserve() to publish()
+    unsigned long long averageEnqueueTicks() const
+    {
+        return numberOfEnqueuedResponses ? totalEnqueueTicks / numberOfEnqueuedResponses : 0;
+    }
+
+    unsigned long long maxEnqueueTickCount() const
+    {
+        return maxEnqueueTicks;
+    }
+
+    // Average and maximum number of TSC ticks from publish() to release()
+    unsigned long long averageWaitingTicks() const
+    {
+        return numberOfDequeuedResponses ? totalWaitingTicks / numberOfDequeuedResponses : 0;
+    }
+
+    unsigned long long maxWaitingTickCount() const
+    {
+        return maxWaitingTicks;
+    }
+
+private:
+    Entry* getEntry(long long position) const
+    {
+        return (Entry*)(buffer + position % bufferSize);
+    }
+
+    // Clear size bytes at the tail and advance the tail behind them, so producers can reuse the space.
+    void freeSpace(long long size)
+    {
+        setMem(getEntry(tailPosition), size, 0);
+        _InterlockedExchange64(&tailPosition, tailPosition + size);
+    }
+
+    static void updateMax(volatile unsigned long long& maxValue, unsigned long long value)
+    {
+        unsigned long long currentMaxValue = maxValue;
+        while (value > currentMaxValue)
+        {
+            const unsigned long long observedMaxValue = _InterlockedCompareExchange64((volatile long long*)&maxValue, value, currentMaxValue);
+            if (observedMaxValue == currentMaxValue)
+            {
+                break;
+            }
+            currentMaxValue = observedMaxValue;
+        }
+    }
+
+    unsigned char* buffer = nullptr;
+    volatile long long headPosition;
+    volatile long long tailPosition;
+
+    volatile long long numberOfEnqueuedResponses;
+    volatile long long numberOfDequeuedResponses;
+    volatile long long numberOfRejectedResponses;
+    volatile long long numberOfFailedReservations;
+    volatile unsigned long long totalEnqueueTicks;
+    volatile unsigned long long maxEnqueueTicks;
+    volatile unsigned long long totalWaitingTicks;
+    volatile unsigned long long maxWaitingTicks;
+};
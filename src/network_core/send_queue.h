@@ -0,0 +1,237 @@
+// queue of messages to be sent to a peer, filled by push() and emptied by peerReceiveAndTransmit()
+
+#pragma once
+
+#include "platform/memory.h"
+#include "platform/debugging.h"
+
+#include "network_messages/header.h"
+#include "network_messages/computors.h"
+#include "network_messages/public_peers.h"
+#include "network_messages/tick.h"
+#include "network_messages/transactions.h"
+
+// Priorities of outgoing messages, messages of lower values are transmitted first
+#define SEND_PRIORITY_CONSENSUS 0 // ticks, tick data, computors, requests for these, and peer exchange
+#define SEND_PRIORITY_TRANSACTIONS 1
+#define SEND_PRIORITY_BULK 2 // responses to queries, logs, and everything else
+#define NUMBER_OF_SEND_PRIORITIES 3
+
+static unsigned int getSendPriority(unsigned char messageType)
+{
+    switch (messageType)
+    {
+    case ExchangePublicPeers::type:
+    case BroadcastComputors::type:
+    case BroadcastTick::type:
+    case BroadcastFutureTickData::type:
+    case BroadcastCompactFutureTickData::type:
+    case RequestComputors::type:
+    case RequestQuorumTick::type:
+    case RequestTickData::type:
+    case RequestTickTransactionDigests::type:
+    case RespondTickTransactionDigests::type:
+    case REQUEST_TICK_TRANSACTIONS:
+        return SEND_PRIORITY_CONSENSUS;
+    case BROADCAST_TRANSACTION:
+        return SEND_PRIORITY_TRANSACTIONS;
+    }
+    return SEND_PRIORITY_BULK;
+}
+
+// Messages waiting for transmission to one peer, in one FIFO queue per send priority. Each queue has its own region of
+// the buffer, so bulk responses filling their queue neither delay nor crowd out consensus messages. Messages of the
+// same priority keep their order. Messages of a lower priority may be overtaken by messages of a higher priority that
+// are added later, which is fine for all responses ending with EndResponse, because EndResponse is a bulk message.
+//
+// Each queue stores complete messages contiguously from begin to end of the queue's region. Space freed by transmitted
+// messages is reused by moving the remaining messages to the beginning of the region, which is only done if a new
+// message does not fit behind the last one.
+template <unsigned int bufferSize, unsigned int maxMessageSize>
+class SendQueue
+{
+public:
+    static constexpr unsigned int CONSENSUS_REGION_SIZE = bufferSize / 8;
+    static constexpr unsigned int TRANSACTIONS_REGION_SIZE = bufferSize / 8;
+    static constexpr unsigned int BULK_REGION_SIZE = bufferSize - CONSENSUS_REGION_SIZE - TRANSACTIONS_REGION_SIZE;
+    static_assert(BULK_REGION_SIZE >= maxMessageSize, "Buffer size is too small");
+
+    bool init()
+    {
+        if (!allocatePool(bufferSize, (void**)&buffer))
+        {
+            return false;
+        }
+        reset();
+        return true;
+    }
+
+    void deinit()
+    {
+        if (buffer)
+        {
+            freePool(buffer);
+            buffer = nullptr;
+        }
+    }
+
+    bool isInitialized() const
+    {
+        return buffer != nullptr;
+    }
+
+    // Remove all messages (without counting them as dropped) and reset counters.
+    void reset()
+    {
+        for (unsigned int priority = 0; priority < NUMBER_OF_SEND_PRIORITIES; priority++)
+        {
+            queues[priority].begin = 0;
+            queues[priority].end = 0;
+            numberOfDroppedMessages[priority] = 0;
+        }
+    }
+
+    // Copy message into queue of priority. Returns false (and counts the message as dropped) if the queue is full.
+    bool add(unsigned int priority, const RequestResponseHeader* message)
+    {
+        const unsigned int size = message->size();
+        unsigned int availableSize;
+        char* destination = beginAppend(priority, size, availableSize);
+        if (!destination)
+        {
+            return false;
+        }
+        copyMem(destination, message, size);
+        endAppend(priority, size);
+        return true;
+    }
+
+    // Check if a message of size bytes can be added to queue of priority (possibly after reusing the space of
+    // transmitted messages).
+    bool hasSpace(unsigned int priority, unsigned int size) const
+    {
+        ASSERT(priority < NUMBER_OF_SEND_PRIORITIES);
+        return getRegionSize(priority) - (queues[priority].end - queues[priority].begin) >= size;
+    }
+
+    // Return pointer for writing messages of priority in place, with availableSize bytes of space. Returns nullptr
+    // (and counts a dropped message) if less than minSize bytes are available. Call endAppend() after writing.
+    char* beginAppend(unsigned int priority, unsigned int minSize, unsigned int& availableSize)
+    {
+        ASSERT(priority < NUMBER_OF_SEND_PRIORITIES);
+        Queue& queue = queues[priority];
+        const unsigned int regionSize = getRegionSize(priority);
+        if (regionSize - queue.end < minSize && queue.begin)
+        {
+            // Reuse space of transmitted messages
+            copyMem(getRegion(priority), getRegion(priority) + queue.begin, queue.end - queue.begin);
+            queue.end -= queue.begin;
+            queue.begin = 0;
+        }
+        availableSize = regionSize - queue.end;
+        if (availableSize < minSize)
+        {
+            numberOfDroppedMessages[priority]++;
+            return nullptr;
+        }
+        return getRegion(priority) + queue.end;
+    }
+
+    // Add the complete messages of size bytes written to the pointer returned by beginAppend().
+    void endAppend(unsigned int priority, unsigned int size)
+    {
+        ASSERT(priority < NUMBER_OF_SEND_PRIORITIES);
+        ASSERT(queues[priority].end + size <= getRegionSize(priority));
+        queues[priority].end += size;
+    }
+
+    // Move messages to the transmission buffer, highest priority first, as many as fit into transmissionBufferSize.
+    // Bulk messages are only taken until their size reaches maxBulkSize (but at least one is taken), so that messages
+    // of higher priority added in the meantime only wait for the transmission of this part. Returns the number of
+    // bytes written to transmissionBuffer.
+    unsigned int takeForTransmission(char* transmissionBuffer, unsigned int transmissionBufferSize, unsigned int maxBulkSize)
+    {
+        unsigned int transmissionSize = 0;
+        for (unsigned int priority = 0; priority < NUMBER_OF_SEND_PRIORITIES; priority++)
+        {
+            Queue& queue = queues[priority];
+            const char* region = getRegion(priority);
+            const unsigned int maxSize = (priority == SEND_PRIORITY_BULK) ? maxBulkSize : transmissionBufferSize;
+
+            // Find end of the messages to take
+            unsigned int takenEnd = queue.begin;
+            while (takenEnd < queue.end)
+            {
+                const unsigned int messageSize = ((const RequestResponseHeader*)(region + takenEnd))->size();
+                if (transmissionSize + (takenEnd - queue.begin) + messageSize > transmissionBufferSize
+                    || (takenEnd > queue.begin && takenEnd - queue.begin + messageSize > maxSize))
+                {
+                    break;
+                }
+                takenEnd += messageSize;
+            }
+
+            if (takenEnd > queue.begin)
+            {
+                copyMem(transmissionBuffer + transmissionSize, region + queue.begin, takenEnd - queue.begin);
+                transmissionSize += takenEnd - queue.begin;
+                if (takenEnd == queue.end)
+                {
+                    queue.begin = 0;
+                    queue.end = 0;
+                }
+                else
+                {
+                    queue.begin = takenEnd;
+                }
+            }
+        }
+        return transmissionSize;
+    }
+
+    // Number of bytes waiting for transmission in all queues
+    unsigned int size() const
+    {
+        unsigned int sum = 0;
+        for (unsigned int priority = 0; priority < NUMBER_OF_SEND_PRIORITIES; priority++)
+        {
+            sum += queues[priority].end - queues[priority].begin;
+        }
+        return sum;
+    }
+
+    // Number of bytes waiting for transmission in queue of priority
+    unsigned int size(unsigned int priority) const
+    {
+        ASSERT(priority < NUMBER_OF_SEND_PRIORITIES);
+        return queues[priority].end - queues[priority].begin;
+    }
+
+    // Number of messages of priority that have not been added, because the queue was full
+    unsigned long long droppedCount(unsigned int priority) const
+    {
+        ASSERT(priority < NUMBER_OF_SEND_PRIORITIES);
+        return numberOfDroppedMessages[priority];
+    }
+
+private:
+    static unsigned int getRegionSize(unsigned int priority)
+    {
+        return (priority == SEND_PRIORITY_CONSENSUS) ? CONSENSUS_REGION_SIZE : (priority == SEND_PRIORITY_TRANSACTIONS) ? TRANSACTIONS_REGION_SIZE : BULK_REGION_SIZE;
+    }
+
+    char* getRegion(unsigned int priority) const
+    {
+        return buffer + ((priority == SEND_PRIORITY_CONSENSUS) ? 0 : (priority == SEND_PRIORITY_TRANSACTIONS) ? CONSENSUS_REGION_SIZE : CONSENSUS_REGION_SIZE + TRANSACTIONS_REGION_SIZE);
+    }
+
+    struct Queue
+    {
+        unsigned int begin;
+        unsigned int end;
+    };
+
+    char* buffer = nullptr;
+    Queue queues[NUMBER_OF_SEND_PRIORITIES];
+    unsigned long long numberOfDroppedMessages[NUMBER_OF_SEND_PRIORITIES];
+};
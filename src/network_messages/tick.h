@@ -81,6 +81,65 @@ struct BroadcastFutureTickData
 };
 
 
+// Number of bytes of a short transaction ID, see BroadcastCompactFutureTickData
+#define SHORT_TRANSACTION_ID_SIZE 6
+
+#pragma pack(push, 1)
+
+// TickData with short transaction IDs instead of transaction digests and without zero contract fees
+struct CompactTickData
+{
+    unsigned short computorIndex;
+    unsigned short epoch;
+    unsigned int tick;
+
+    unsigned short millisecond;
+    unsigned char second;
+    unsigned char minute;
+    unsigned char hour;
+    unsigned char day;
+    unsigned char month;
+    unsigned char year;
+
+    m256i timelock;
+
+    unsigned char signature[SIGNATURE_SIZE]; // signature of the full TickData
+
+    unsigned short numberOfTransactions; // transaction digests from this index on are zero
+    unsigned short numberOfContractFees;
+
+    // Followed by numberOfTransactions short transaction IDs (SHORT_TRANSACTION_ID_SIZE bytes each, in the order of
+    // the transaction digests) and numberOfContractFees CompactContractFee entries
+};
+
+struct CompactContractFee
+{
+    unsigned short contractIndex;
+    long long fee;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(CompactTickData) == 8 + 8 + 32 + SIGNATURE_SIZE + 4, "Something is wrong with the struct size.");
+static_assert(sizeof(CompactContractFee) == 2 + 8, "Something is wrong with the struct size.");
+
+#define MAX_COMPACT_TICK_DATA_SIZE (sizeof(CompactTickData) + NUMBER_OF_TRANSACTIONS_PER_TICK * SHORT_TRANSACTION_ID_SIZE + MAX_NUMBER_OF_CONTRACTS * sizeof(CompactContractFee))
+
+
+// Alternative to BroadcastFutureTickData with a fraction of its size. The short ID of a transaction is derived from its
+// digest salted with the timelock, so receivers can match the transactions in their pending transaction pools. The
+// digests of transactions that a receiver cannot match are requested from the sender with
+// RequestTickTransactionDigests.
+struct BroadcastCompactFutureTickData
+{
+    CompactTickData compactTickData;
+
+    enum {
+        type = 53,
+    };
+};
+
+
 struct RequestedQuorumTick
 {
     unsigned int tick;
@@ -114,6 +173,32 @@ struct RequestTickData
 };
 
 
+// Request the digests of the transactions of a tick whose flags are set. Answered with RespondTickTransactionDigests
+// or with EndResponse if the tick data is not available.
+struct RequestTickTransactionDigests
+{
+    unsigned int tick;
+    unsigned char transactionFlags[NUMBER_OF_TRANSACTIONS_PER_TICK / 8];
+
+    enum {
+        type = 54,
+    };
+};
+
+
+struct RespondTickTransactionDigests
+{
+    unsigned int tick;
+    unsigned char transactionFlags[NUMBER_OF_TRANSACTIONS_PER_TICK / 8];
+
+    // Followed by the digests of the transactions whose flags are set, in the order of their indices
+
+    enum {
+        type = 55,
+    };
+};
+
+
 #define REQUEST_CURRENT_TICK_INFO 27
 
 #define RESPOND_CURRENT_TICK_INFO 28
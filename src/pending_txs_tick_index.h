@@ -0,0 +1,143 @@
+#pragma once
+
+#include "platform/memory.h"
+#include "platform/debugging.h"
+#include "platform/console_logging.h"
+
+#include "public_settings.h"
+
+// Index of the slots of a pending transaction pool (entityPendingTransactions or computorPendingTransactions) by the
+// scheduled tick of the transaction, so that the transactions of one tick can be found without scanning the whole
+// pool. The slots of each tick of the current epoch are linked in a doubly-linked list. Transactions scheduled for a
+// tick outside of the current epoch are not indexed (they are never processed).
+//
+// The index does not store transaction ticks itself, the caller passes the tick stored in the pool slot. So add() and
+// remove() need to be called whenever the tick of a slot changes, while holding the lock of the pool.
+class PendingTransactionTickIndex
+{
+public:
+    static constexpr unsigned int NO_SLOT = 0xFFFFFFFF;
+
+    bool init(unsigned int numberOfSlots)
+    {
+        this->numberOfSlots = numberOfSlots;
+        if (!allocatePool(numberOfSlots * sizeof(unsigned int), (void**)&nextSlot)
+            || !allocatePool(numberOfSlots * sizeof(unsigned int), (void**)&previousSlot))
+        {
+            logToConsole(L"Failed to allocate pending transaction index memory!");
+            return false;
+        }
+        reset(0);
+        return true;
+    }
+
+    void deinit()
+    {
+        if (previousSlot)
+        {
+            freePool(previousSlot);
+            previousSlot = nullptr;
+        }
+        if (nextSlot)
+        {
+            freePool(nextSlot);
+            nextSlot = nullptr;
+        }
+    }
+
+    // Remove all slots from index and set the first tick of the epoch. The pool slots need to be cleared
+    // (tick set to 0) at the same time.
+    void reset(unsigned int initialTick)
+    {
+        this->initialTick = initialTick;
+        setMem(firstSlot, sizeof(firstSlot), 0xFF);
+        setMem(numberOfSlotsOfTick, sizeof(numberOfSlotsOfTick), 0);
+    }
+
+    // Add slot, which now holds a transaction scheduled for tick.
+    void add(unsigned int slot, unsigned int tick)
+    {
+        ASSERT(slot < numberOfSlots);
+        if (isIndexed(tick))
+        {
+            const unsigned int tickIndex = tick - initialTick;
+            previousSlot[slot] = NO_SLOT;
+            nextSlot[slot] = firstSlot[tickIndex];
+            if (firstSlot[tickIndex] != NO_SLOT)
+            {
+                previousSlot[firstSlot[tickIndex]] = slot;
+            }
+            firstSlot[tickIndex] = slot;
+            numberOfSlotsOfTick[tickIndex]++;
+        }
+    }
+
+    // Remove slot, which held a transaction scheduled for tick (before overwriting it).
+    void remove(unsigned int slot, unsigned int tick)
+    {
+        ASSERT(slot < numberOfSlots);
+        if (isIndexed(tick))
+        {
+            const unsigned int tickIndex = tick - initialTick;
+            ASSERT(numberOfSlotsOfTick[tickIndex] > 0);
+            if (previousSlot[slot] == NO_SLOT)
+            {
+                ASSERT(firstSlot[tickIndex] == slot);
+                firstSlot[tickIndex] = nextSlot[slot];
+            }
+            else
+            {
+                nextSlot[previousSlot[slot]] = nextSlot[slot];
+            }
+            if (nextSlot[slot] != NO_SLOT)
+            {
+                previousSlot[nextSlot[slot]] = previousSlot[slot];
+            }
+            numberOfSlotsOfTick[tickIndex]--;
+        }
+    }
+
+    // Return first slot with transaction scheduled for tick or NO_SLOT.
+    unsigned int first(unsigned int tick) const
+    {
+        return isIndexed(tick) ? firstSlot[tick - initialTick] : NO_SLOT;
+    }
+
+    // Return next slot with transaction scheduled for the same tick or NO_SLOT.
+    unsigned int next(unsigned int slot) const
+    {
+        ASSERT(slot < numberOfSlots);
+        return nextSlot[slot];
+    }
+
+    // Return number of slots with transaction scheduled for tick.
+    unsigned int count(unsigned int tick) const
+    {
+        return isIndexed(tick) ? numberOfSlotsOfTick[tick - initialTick] : 0;
+    }
+
+    // Return number of slots with transaction scheduled for a tick after the given tick.
+    unsigned int countAfter(unsigned int tick) const
+    {
+        unsigned int tickIndex = (tick < initialTick) ? 0 : tick - initialTick + 1;
+        unsigned int sum = 0;
+        for (; tickIndex < MAX_NUMBER_OF_TICKS_PER_EPOCH; tickIndex++)
+        {
+            sum += numberOfSlotsOfTick[tickIndex];
+        }
+        return sum;
+    }
+
+private:
+    bool isIndexed(unsigned int tick) const
+    {
+        return tick >= initialTick && tick - initialTick < MAX_NUMBER_OF_TICKS_PER_EPOCH;
+    }
+
+    unsigned int initialTick;
+    unsigned int numberOfSlots;
+    unsigned int* nextSlot;
+    unsigned int* previousSlot;
+    unsigned int firstSlot[MAX_NUMBER_OF_TICKS_PER_EPOCH];
+    unsigned int numberOfSlotsOfTick[MAX_NUMBER_OF_TICKS_PER_EPOCH];
+};
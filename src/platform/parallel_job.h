@@ -0,0 +1,107 @@
+#pragma once
+
+#include <intrin.h>
+
+#include "concurrency.h"
+
+// Work sharing between the processor owning a job (for example the tick processor) and idle processors.
+// The owner splits a job into parts and calls run(). Idle processors (request processors) regularly call help(),
+// which processes parts of the currently running job, if any. run() also processes parts itself, so it completes
+// even if no other processor helps (for example in tests or if all request processors are busy).
+class ParallelJob
+{
+public:
+    typedef void (*PartFunction)(void* context, unsigned int partIndex);
+
+    // Set state without active job. Static instances are zero-initialized, so calling this is only needed for
+    // dynamically allocated instances.
+    void reset()
+    {
+        ownerLock = 0;
+        active = 0;
+        activeHelpers = 0;
+        numberOfParts = 0;
+        nextPart = 0;
+        finishedParts = 0;
+    }
+
+    // Run function(context, partIndex) for partIndex = 0 ... numberOfParts - 1, distributing the parts to
+    // helping processors. Returns after all parts are finished. Parts are processed in arbitrary order and
+    // concurrently, so they must not depend on each other.
+    void run(PartFunction function, void* context, unsigned int numberOfParts)
+    {
+        // Only one owner at a time
+        ACQUIRE(ownerLock);
+
+        this->function = function;
+        this->context = context;
+        this->numberOfParts = numberOfParts;
+        finishedParts = 0;
+        nextPart = 0;
+        _mm_mfence();
+        active = 1;
+
+        processParts();
+
+        while (finishedParts != (long)numberOfParts)
+        {
+            _mm_pause();
+        }
+
+        // Wait until no helper can claim a part of this job anymore before it may be replaced by the next one
+        active = 0;
+        _mm_mfence();
+        while (activeHelpers)
+        {
+            _mm_pause();
+        }
+
+        RELEASE(ownerLock);
+    }
+
+    // Help processing the current job, if any. Cheap if no job is running, so it can be called in busy loops.
+    void help()
+    {
+        if (!active)
+        {
+            return;
+        }
+
+        _InterlockedIncrement(&activeHelpers);
+        if (active)
+        {
+            processParts();
+        }
+        _InterlockedDecrement(&activeHelpers);
+    }
+
+    // Return true if a job is currently running.
+    bool isActive() const
+    {
+        return active != 0;
+    }
+
+private:
+    void processParts()
+    {
+        long partIndex;
+        while ((partIndex = _InterlockedIncrement(&nextPart) - 1) < numberOfParts)
+        {
+            function(context, (unsigned int)partIndex);
+            _InterlockedIncrement(&finishedParts);
+        }
+    }
+
+    PartFunction function;
+    void* context;
+    volatile char ownerLock;
+    volatile char active;
+    volatile long activeHelpers;
+    volatile long numberOfParts;
+    volatile long nextPart;
+    volatile long finishedParts;
+};
+
+// Job shared by all processors. The tick processor distributes heavy work (such as rebuilding digests) with
+// parallelJob.run(), request processors call parallelJob.help() when idle.
+static ParallelJob parallelJob;
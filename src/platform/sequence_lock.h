@@ -0,0 +1,72 @@
+#pragma once
+
+#include <intrin.h>
+
+// Sequence lock (seqlock) for reading shared data without blocking the writers. Writers are serialized by another
+// lock and call beginWrite() before and endWrite() after changing the data, so the sequence number is odd while the
+// data is changed. Readers do not block writers, they retry until they read without concurrent change:
+//
+//     long long sequence;
+//     do
+//     {
+//         sequence = seqLock.beginRead();
+//         // read data
+//     } while (!seqLock.endRead(sequence));
+//
+// Data read before endRead() succeeded may be inconsistent, so indices read from it need to be bound-checked.
+// A writer must not start a read while it is changing the data, because beginRead() would wait forever.
+// Static instances are zero-initialized, which is the unlocked state.
+class SequenceLock
+{
+public:
+    // Set unlocked state and reset counter.
+    void reset()
+    {
+        sequence = 0;
+        numberOfRetries = 0;
+    }
+
+    void beginWrite()
+    {
+        _InterlockedIncrement64(&sequence);
+    }
+
+    void endWrite()
+    {
+        _InterlockedIncrement64(&sequence);
+    }
+
+    // Wait until the data is not being changed and return sequence number to pass to endRead().
+    long long beginRead() const
+    {
+        long long currentSequence;
+        while ((currentSequence = sequence) & 1)
+        {
+            _mm_pause();
+        }
+        _mm_lfence();
+        return currentSequence;
+    }
+
+    // Return true if the data has not been changed since beginRead(). Otherwise the read has to be repeated.
+    bool endRead(long long beginSequence)
+    {
+        _mm_lfence();
+        if (sequence == beginSequence)
+        {
+            return true;
+        }
+        _InterlockedIncrement64(&numberOfRetries);
+        return false;
+    }
+
+    // Number of reads that had to be repeated because of a concurrent change
+    long long retryCount() const
+    {
+        return numberOfRetries;
+    }
+
+private:
+    volatile long long sequence;
+    volatile long long numberOfRetries;
+};
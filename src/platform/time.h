@@ -1,36 +1,37 @@
 #pragma once
 
 #include "uefi.h"
+#include "memory.h"
 #include <stddef.h>
 
-#ifdef NO_UEFI
-#error "NO_UEFI implementation is missing!"
-#endif
-
 static EFI_TIME time;
 
 static void initTime()
 {
-    bs->SetMem(&time, sizeof(time), 0);
+    setMem(&time, sizeof(time), 0);
     time.Year = 2022;
     time.Month = 4;
     time.Day = 13;
     time.Hour = 12;
 
+#ifndef NO_UEFI
     EFI_TIME newTime;
     if (!rs->GetTime(&newTime, NULL))
     {
-        bs->CopyMem(&time, &newTime, sizeof(time));
+        copyMem(&time, &newTime, sizeof(time));
     }
+#endif
 }
 
 static void updateTime()
 {
+#ifndef NO_UEFI
     EFI_TIME newTime;
     if (!rs->GetTime(&newTime, NULL))
     {
-        bs->CopyMem(&time, &newTime, sizeof(time));
+        copyMem(&time, &newTime, sizeof(time));
     }
+#endif
 }
 
 inline int dayIndex(unsigned int year, unsigned int month, unsigned int day) // 0 = Wednesday
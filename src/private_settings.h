@@ -32,6 +32,7 @@ static const unsigned char whiteListPeers[][4] = {
 #define LOG_CONTRACT_DEBUG_MESSAGES 0
 #define LOG_BURNINGS 0
 #define LOG_CUSTOM_MESSAGES 0
+#define LOG_ENTITY_INDEX 0 // "1" indexes logs by entity for RequestLogIdsByEntity (needs about 1.1 GiB)
 static unsigned long long logReaderPasscodes[4] = {
     0, 0, 0, 0 // REMOVE THIS ENTRY AND REPLACE IT WITH YOUR OWN RANDOM NUMBERS IN [0..18446744073709551615] RANGE IF LOGGING IS ENABLED
 };
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <intrin.h>
+
+#include "platform/m256.h"
+#include "platform/memory.h"
+#include "platform/debugging.h"
+
+// Probing accelerator for hash maps of public keys with linear probing (such as the spectrum and the universe).
+// For each slot of the hash map, it stores a 1-byte tag derived from the public key in the slot (0 for empty slots).
+// Probing scans the tags of a block of slots with one SIMD compare and only visits the slots whose tag matches the
+// tag of the key or which are empty, so most full key compares (each usually a cache miss) are skipped.
+//
+// The hash map itself is not changed, so the slot of each key is the same as without tags. The owner of the hash map
+// has to call set() / clear() whenever a slot is filled / emptied, and rebuild() after changing it otherwise.
+template <unsigned int capacity>
+class ProbeTags
+{
+public:
+    static_assert(capacity >= 64 && (capacity & (capacity - 1)) == 0, "Capacity must be power of 2");
+
+    static constexpr unsigned int NO_SLOT = 0xFFFFFFFF;
+
+#if defined (__AVX512BW__)
+    static constexpr unsigned int BLOCK_SIZE = 64;
+#else
+    static constexpr unsigned int BLOCK_SIZE = 32;
+#endif
+
+    bool init()
+    {
+        if (!allocatePool(capacity, (void**)&tags))
+        {
+            return false;
+        }
+        setMem(tags, capacity, 0);
+        resetStatistics();
+        return true;
+    }
+
+    void deinit()
+    {
+        if (tags)
+        {
+            freePool(tags);
+            tags = nullptr;
+        }
+    }
+
+    // Tag of public key (never 0). Derived from bits that are not used for the home slot.
+    static unsigned char tagOf(const m256i& publicKey)
+    {
+        const unsigned char tag = publicKey.m256i_u8[4];
+        return tag ? tag : 1;
+    }
+
+    void set(unsigned int slot, const m256i& publicKey)
+    {
+        ASSERT(slot < capacity);
+        tags[slot] = tagOf(publicKey);
+    }
+
+    void clear(unsigned int slot)
+    {
+        ASSERT(slot < capacity);
+        tags[slot] = 0;
+    }
+
+    void clear(unsigned int beginSlot, unsigned int endSlot)
+    {
+        ASSERT(beginSlot <= endSlot && endSlot <= capacity);
+        setMem(tags + beginSlot, endSlot - beginSlot, 0);
+    }
+
+    // Recompute tags from the public keys of the hash map. The public key of slot i is read at
+    // (const m256i*)((const char*)firstPublicKey + i * stride), zero public keys mark empty slots.
+    void rebuild(const m256i* firstPublicKey, unsigned long long stride)
+    {
+        const char* publicKey = (const char*)firstPublicKey;
+        for (unsigned int i = 0; i < capacity; i++, publicKey += stride)
+        {
+            tags[i] = isZero(*(const m256i*)publicKey) ? 0 : tagOf(*(const m256i*)publicKey);
+        }
+    }
+
+    // Return first slot at or after slot (in probing order) that is empty or has the given tag. Passing tag 0 finds
+    // the next empty slot. Returns NO_SLOT if there is no such slot, which is only possible if the hash map is full
+    // or changed concurrently.
+    unsigned int nextCandidate(unsigned int slot, unsigned char tag) const
+    {
+        ASSERT(slot < capacity);
+        for (unsigned int scannedSlots = 0; scannedSlots <= capacity; )
+        {
+            if (slot <= capacity - BLOCK_SIZE)
+            {
+                const unsigned long long mask = candidateMask(tags + slot, tag);
+                if (mask)
+                {
+                    return slot + (unsigned int)_tzcnt_u64(mask);
+                }
+                slot = (slot + BLOCK_SIZE) & (capacity - 1);
+                scannedSlots += BLOCK_SIZE;
+            }
+            else
+            {
+                // Last slots before wrapping around
+                if (tags[slot] == tag || !tags[slot])
+                {
+                    return slot;
+                }
+                slot = (slot + 1) & (capacity - 1);
+                scannedSlots++;
+            }
+        }
+        return NO_SLOT;
+    }
+
+    // Count an update or insertion that ended in foundSlot after comparing keyComparisons full keys. Only to be called
+    // by writers holding the lock of the hash map, so lock-free readers never write to the shared statistics.
+    void countProbe(unsigned int homeSlot, unsigned int foundSlot, unsigned int keyComparisons)
+    {
+        const unsigned int probeLength = ((foundSlot - homeSlot) & (capacity - 1)) + 1;
+        numberOfProbes++;
+        totalProbeLength += probeLength;
+        totalKeyComparisons += keyComparisons;
+        if (probeLength > maxProbeLength)
+        {
+            maxProbeLength = probeLength;
+        }
+    }
+
+    void resetStatistics()
+    {
+        numberOfProbes = 0;
+        totalProbeLength = 0;
+        totalKeyComparisons = 0;
+        maxProbeLength = 0;
+    }
+
+    // Number of updates and insertions counted with countProbe()
+    unsigned long long probeCount() const
+    {
+        return numberOfProbes;
+    }
+
+    // Average number of slots from the home slot to the found slot (including both) times 100
+    unsigned long long averageProbeLengthTimes100() const
+    {
+        return numberOfProbes ? totalProbeLength * 100 / numberOfProbes : 0;
+    }
+
+    // Average number of full key compares per probe times 100
+    unsigned long long averageKeyComparisonsTimes100() const
+    {
+        return numberOfProbes ? totalKeyComparisons * 100 / numberOfProbes : 0;
+    }
+
+    unsigned int maxProbeLengthSlots() const
+    {
+        return maxProbeLength;
+    }
+
+    const unsigned char* data() const
+    {
+        return tags;
+    }
+
+private:
+    // Bit i is set if block[i] is 0 or tag
+    static unsigned long long candidateMask(const unsigned char* block, unsigned char tag)
+    {
+#if defined (__AVX512BW__)
+        const __m512i tags = _mm512_loadu_si512(block);
+        return _mm512_cmpeq_epi8_mask(tags, _mm512_set1_epi8(tag)) | _mm512_cmpeq_epi8_mask(tags, _mm512_setzero_si512());
+#else
+        const __m256i tags = _mm256_loadu_si256((const __m256i*)block);
+        return (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(tags, _mm256_set1_epi8(tag)), _mm256_cmpeq_epi8(tags, _mm256_setzero_si256())));
+#endif
+    }
+
+    unsigned char* tags = nullptr;
+
+    unsigned long long numberOfProbes;
+    unsigned long long totalProbeLength;
+    unsigned long long totalKeyComparisons;
+    unsigned int maxProbeLength;
+};
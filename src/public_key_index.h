@@ -0,0 +1,76 @@
+#pragma once
+
+#include "platform/m256.h"
+#include "platform/memory.h"
+#include "platform/concurrency.h"
+#include "platform/debugging.h"
+
+// Hash index (open addressing with linear probing) mapping public keys to their position in a list of public keys,
+// such as the computor list. Replaces linear scans comparing all keys of the list.
+//
+// The index is double-buffered: build() fills the inactive table and then switches to it, so find() can be called
+// concurrently to build() and sees either the old or the new list. Zero-initialized instances are empty.
+template <unsigned int capacity>
+class PublicKeyIndex
+{
+public:
+    static_assert(capacity >= 2 && (capacity & (capacity - 1)) == 0, "Capacity must be power of 2");
+
+    // Rebuild index from list of public keys. If a key occurs multiple times, find() returns the lowest position
+    // like a linear scan would.
+    void build(const m256i* publicKeys, unsigned int numberOfPublicKeys)
+    {
+        ASSERT(numberOfPublicKeys <= capacity / 2);
+
+        ACQUIRE(buildLock);
+
+        Table& table = tables[activeTable ^ 1];
+        setMem(table.positions, sizeof(table.positions), 0);
+        for (unsigned int i = 0; i < numberOfPublicKeys; i++)
+        {
+            unsigned int slot = publicKeys[i].m256i_u32[0] & (capacity - 1);
+            while (table.positions[slot] && table.keys[slot] != publicKeys[i])
+            {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            if (!table.positions[slot])
+            {
+                table.keys[slot] = publicKeys[i];
+                table.positions[slot] = i + 1;
+            }
+        }
+
+        // Table has to be complete before readers switch to it
+        _mm_mfence();
+        activeTable ^= 1;
+
+        RELEASE(buildLock);
+    }
+
+    // Return position of public key in list or -1 if it is not in the list.
+    int find(const m256i& publicKey) const
+    {
+        const Table& table = tables[activeTable];
+        unsigned int slot = publicKey.m256i_u32[0] & (capacity - 1);
+        while (table.positions[slot])
+        {
+            if (table.keys[slot] == publicKey)
+            {
+                return table.positions[slot] - 1;
+            }
+            slot = (slot + 1) & (capacity - 1);
+        }
+        return -1;
+    }
+
+private:
+    struct Table
+    {
+        m256i keys[capacity];
+        unsigned int positions[capacity]; // position + 1, 0 means empty slot
+    };
+
+    Table tables[2];
+    volatile unsigned char activeTable;
+    volatile char buildLock;
+};
@@ -45,6 +45,11 @@
 // If you restart your node after seamless epoch transition, make sure EPOCH and TICK are set correctly for the currently running epoch.
 #define START_NETWORK_FROM_SCRATCH 1
 
+// Broadcast tick data as leader in compact form (short transaction IDs instead of transaction digests), which receivers
+// rebuild from their pending transactions. Nodes of older versions ignore compact tick data and would have to request
+// the full tick data, so only set this to 1 once most nodes of the network understand BroadcastCompactFutureTickData.
+#define BROADCAST_COMPACT_TICK_DATA 0
+
 // Addons: If you don't know it, leave it 0.
 #define ADDON_TX_STATUS_REQUEST 0
 
@@ -33,6 +33,7 @@
 
 #include "network_core/tcp4.h"
 #include "network_core/peers.h"
+#include "network_core/compact_tick_data.h"
 
 #include "system.h"
 
@@ -41,6 +42,8 @@
 #include "logging.h"
 
 #include "tick_storage.h"
+#include "pending_txs_tick_index.h"
+#include "public_key_index.h"
 #include "vote_counter.h"
 
 #include "addons/tx_status_request.h"
@@ -74,7 +77,6 @@ struct Processor : public CustomStack
     Type type;
     EFI_EVENT event;
     Peer* peer;
-    void* buffer;
 };
 
 
@@ -104,6 +106,9 @@ static m256i computorPublicKeys[sizeof(computorSeeds) / sizeof(computorSeeds[0])
 static m256i arbitratorPublicKey;
 
 BroadcastComputors broadcastedComputors;
+static PublicKeyIndex<2048> computorPublicKeyIndex; // rebuilt whenever broadcastedComputors changes
+static PublicKeyIndex<2048> ownComputorPublicKeyIndex; // built from computorPublicKeys in initialize()
+static_assert(NUMBER_OF_COMPUTORS <= 1024 && sizeof(computorSeeds) / sizeof(computorSeeds[0]) <= 1024, "Public key index capacity too small");
 
 // data closely related to system
 static int solutionPublicationTicks[MAX_NUMBER_OF_SOLUTIONS]; // scheduled tick to broadcast solution, -1 means already broadcasted, -2 means obsolete solution
@@ -135,7 +140,8 @@ static unsigned int entityPendingTransactionIndices[SPECTRUM_CAPACITY]; // [SPEC
 static volatile char computorPendingTransactionsLock = 0;
 static unsigned char* computorPendingTransactions = NULL;
 static unsigned char* computorPendingTransactionDigests = NULL;
-static unsigned long long spectrumChangeFlags[SPECTRUM_CAPACITY / (sizeof(unsigned long long) * 8)];
+static PendingTransactionTickIndex entityPendingTransactionTickIndex; // protected by entityPendingTransactionsLock
+static PendingTransactionTickIndex computorPendingTransactionTickIndex; // protected by computorPendingTransactionsLock
 
 static unsigned long long mainLoopNumerator = 0, mainLoopDenominator = 0;
 static unsigned char contractProcessorState = 0;
@@ -193,8 +199,6 @@ static bool competitorComputorStatuses[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
 static unsigned int minimumComputorScore = 0, minimumCandidateScore = 0;
 static int solutionThreshold[MAX_NUMBER_EPOCH] = { -1 };
 static unsigned long long solutionTotalExecutionTicks = 0;
-static unsigned long long K12TotalExecutionTicks = 0;
-static unsigned long long K12StartingExecutionTicks = 0;
 int K12GlobalIndex = 0;
 static unsigned long long K12MeasurementsSum = 0;
 static volatile char minerScoreArrayLock = 0;
@@ -232,6 +236,19 @@ static bool loadComputer(CHAR16* directory = NULL, bool forceLoadFromFile = fals
 
 BroadcastFutureTickData broadcastedFutureTickData;
 
+// Compact tick data that is being rebuilt, one slot per tick modulo NUMBER_OF_TICK_DATA_RECONSTRUCTIONS
+#define NUMBER_OF_TICK_DATA_RECONSTRUCTIONS 4
+#define TICK_DATA_RECONSTRUCTION_TIMEOUT 2000 // ms until missing transaction digests are given up and the full tick data is requested
+static volatile char tickDataReconstructionLock = 0;
+static TickDataReconstructionSlots<NUMBER_OF_TICK_DATA_RECONSTRUCTIONS> tickDataReconstructions; // protected by tickDataReconstructionLock
+static unsigned char compactTickDataBuffer[MAX_COMPACT_TICK_DATA_SIZE]; // protected by tickDataReconstructionLock
+static unsigned long long numberOfReceivedCompactTickData = 0;
+static unsigned long long numberOfTickDataRebuiltFromPendingTransactions = 0;
+static unsigned long long numberOfTickDataRebuiltWithRequestedDigests = 0;
+static unsigned long long numberOfRequestedTransactionDigests = 0;
+static unsigned long long numberOfFailedTickDataReconstructions = 0;
+static unsigned long long numberOfStalledTickDataReconstructions = 0;
+
 static struct
 {
 	Transaction transaction;
@@ -335,15 +352,13 @@ static void logToConsole(const CHAR16* message)
 
 static int computorIndex(m256i computor)
 {
-    for (int computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS; computorIndex++)
-    {
-        if (broadcastedComputors.computors.publicKeys[computorIndex] == computor)
-        {
-            return computorIndex;
-        }
-    }
+    return computorPublicKeyIndex.find(computor);
+}
 
-    return -1;
+// Return index of own computor (in computorSeeds) with public key or -1 if it is not one of our computors.
+static int ownComputorIndex(const m256i& publicKey)
+{
+    return ownComputorPublicKeyIndex.find(publicKey);
 }
 
 // NOTE: this function doesn't work well on a few CPUs, some bits will be flipped after calling this. It's probably microcode bug.
@@ -357,9 +372,100 @@ static void enableAVX()
         ));
 }
 
+#define CONTRACT_STATE_DIGEST_LEAVES_PER_PART 64 // 512 KB of contract state per part of the parallel job
+
+// Number of parts of the contract state digest job if all contract states have changed. Small states are hashed
+// in one part, the full K12 leaves of large states are split into parts of CONTRACT_STATE_DIGEST_LEAVES_PER_PART.
+static constexpr unsigned int maxNumberOfContractStateDigestParts()
+{
+    unsigned int numberOfParts = 0;
+    for (unsigned int i = 0; i < contractCount; i++)
+    {
+        const unsigned int numberOfFullLeaves = KangarooTwelveNumberOfFullLeaves((unsigned int)contractDescriptions[i].stateSize);
+        numberOfParts += (numberOfFullLeaves < CONTRACT_STATE_DIGEST_LEAVES_PER_PART) ? 1 : (numberOfFullLeaves + CONTRACT_STATE_DIGEST_LEAVES_PER_PART - 1) / CONTRACT_STATE_DIGEST_LEAVES_PER_PART;
+    }
+    return numberOfParts;
+}
+
+// Index of the first leaf chaining value of contract in contractStateLeafChainingValues
+static constexpr unsigned long long contractStateLeafChainingValuesOffset(unsigned int contractIndex)
+{
+    unsigned long long offset = 0;
+    for (unsigned int i = 0; i < contractIndex; i++)
+    {
+        offset += KangarooTwelveNumberOfFullLeaves((unsigned int)contractDescriptions[i].stateSize);
+    }
+    return offset;
+}
+
+// Part of the parallel contract state digest job
+struct ContractStateDigestPart
+{
+    unsigned int contractIndex;
+    unsigned int firstLeaf;
+    unsigned int numberOfLeaves; // 0 means that the whole state is hashed in this part
+};
+
+static ContractStateDigestPart contractStateDigestParts[maxNumberOfContractStateDigestParts()];
+static m256i contractStateLeafChainingValues[contractStateLeafChainingValuesOffset(contractCount) + 1];
+
+// Large states are hashed incrementally: the full leaves are compared with their copy from the last digest and only
+// the chaining values of changed leaves are recomputed (the copy is allocated for large states only and doubles their
+// memory, see initialize())
+static unsigned char* contractStateLeafCopies[contractCount];
+static bool contractStateLeafChainingValuesValid[contractCount];
+static volatile long long numberOfCheckedContractStateLeaves = 0;
+static volatile long long numberOfRehashedContractStateLeaves = 0;
+static volatile long long contractStateDigestTicks[contractCount];
+
+// Number of digests of each contract state by duration: < 0.1 ms, < 1 ms, < 10 ms, < 100 ms, longer
+#define CONTRACT_STATE_DIGEST_HISTOGRAM_BUCKETS 5
+static unsigned long long contractStateDigestDurationHistogram[contractCount][CONTRACT_STATE_DIGEST_HISTOGRAM_BUCKETS];
+
+static void hashContractStatePart(void* context, unsigned int partIndex)
+{
+    const ContractStateDigestPart& part = ((const ContractStateDigestPart*)context)[partIndex];
+    const unsigned char* state = contractStates[part.contractIndex];
+    const unsigned long long startTick = __rdtsc();
+    if (!part.numberOfLeaves)
+    {
+        KangarooTwelve(state, (unsigned int)contractDescriptions[part.contractIndex].stateSize, &contractStateDigests[part.contractIndex], 32);
+    }
+    else
+    {
+        m256i* chainingValues = &contractStateLeafChainingValues[contractStateLeafChainingValuesOffset(part.contractIndex)];
+        unsigned char* leafCopies = contractStateLeafCopies[part.contractIndex];
+        unsigned int numberOfRehashedLeaves;
+        if (contractStateLeafChainingValuesValid[part.contractIndex])
+        {
+            numberOfRehashedLeaves = KangarooTwelveUpdateLeafChainingValues(state, leafCopies, chainingValues[0].m256i_u8, part.firstLeaf, part.numberOfLeaves);
+        }
+        else
+        {
+            for (unsigned int leaf = part.firstLeaf; leaf < part.firstLeaf + part.numberOfLeaves; leaf++)
+            {
+                copyMem(leafCopies + leaf * (unsigned long long)K12_chunkSize, state + (leaf + 1ULL) * K12_chunkSize, K12_chunkSize);
+                KangarooTwelveLeafChainingValue(state + (leaf + 1ULL) * K12_chunkSize, chainingValues[leaf].m256i_u8);
+            }
+            numberOfRehashedLeaves = part.numberOfLeaves;
+        }
+        _InterlockedExchangeAdd64(&numberOfCheckedContractStateLeaves, part.numberOfLeaves);
+        _InterlockedExchangeAdd64(&numberOfRehashedContractStateLeaves, numberOfRehashedLeaves);
+    }
+    _InterlockedExchangeAdd64(&contractStateDigestTicks[part.contractIndex], __rdtsc() - startTick);
+}
+
 // Should only be called from tick processor to avoid concurrent state changes, which can cause race conditions as detailed in FIXME below.
 static void getComputerDigest(m256i& digest)
 {
+    // FIXME: We may have a race condition here if a digest is computed here by thread A, the state is changed
+    // + contractStateChangeFlags set afterwards by thread B and contractStateChangeFlags cleared below below
+    // by thread A. We then have a changed state but a cleared contractStateChangeFlags flag leading to wrong
+    // digest.
+    // This is currently avoided by calling getComputerDigest() from tick processor only (and in non-concurrent init)
+
+    // Split hashing of changed contract states into parts that are processed in parallel with idle processors
+    unsigned int numberOfParts = 0;
     unsigned int digestIndex;
     for (digestIndex = 0; digestIndex < MAX_NUMBER_OF_CONTRACTS; digestIndex++)
     {
@@ -372,25 +478,70 @@ static void getComputerDigest(m256i& digest)
             }
             else
             {
-                // FIXME: We may have a race condition here if a digest is computed here by thread A, the state is changed
-                // + contractStateChangeFlags set afterwards by thread B and contractStateChangeFlags cleared below below
-                // by thread A. We then have a changed state but a cleared contractStateChangeFlags flag leading to wrong
-                // digest.
-                // This is currently avoided by calling getComputerDigest() from tick processor only (and in non-concurrent init)
                 contractStateLock[digestIndex].acquireRead();
+                contractStateDigestTicks[digestIndex] = 0;
 
-                K12StartingExecutionTicks = __rdtsc();
-                KangarooTwelve(contractStates[digestIndex], (unsigned int)size, &contractStateDigests[digestIndex], 32);
-                K12TotalExecutionTicks = __rdtsc() - K12StartingExecutionTicks;
-                if (K12GlobalIndex < 500)
+                const unsigned int numberOfFullLeaves = KangarooTwelveNumberOfFullLeaves((unsigned int)size);
+                if (numberOfFullLeaves < CONTRACT_STATE_DIGEST_LEAVES_PER_PART)
                 {
-                    K12MeasurementsSum += K12TotalExecutionTicks;
-                    K12GlobalIndex++;
+                    ContractStateDigestPart& part = contractStateDigestParts[numberOfParts++];
+                    part.contractIndex = digestIndex;
+                    part.firstLeaf = 0;
+                    part.numberOfLeaves = 0;
+                }
+                else
+                {
+                    for (unsigned int leaf = 0; leaf < numberOfFullLeaves; leaf += CONTRACT_STATE_DIGEST_LEAVES_PER_PART)
+                    {
+                        ContractStateDigestPart& part = contractStateDigestParts[numberOfParts++];
+                        part.contractIndex = digestIndex;
+                        part.firstLeaf = leaf;
+                        part.numberOfLeaves = (leaf + CONTRACT_STATE_DIGEST_LEAVES_PER_PART < numberOfFullLeaves) ? CONTRACT_STATE_DIGEST_LEAVES_PER_PART : numberOfFullLeaves - leaf;
+                    }
                 }
-                contractStateLock[digestIndex].releaseRead();
             }
         }
     }
+    if (numberOfParts > 1)
+    {
+        parallelJob.run(hashContractStatePart, contractStateDigestParts, numberOfParts);
+    }
+    else if (numberOfParts)
+    {
+        hashContractStatePart(contractStateDigestParts, 0);
+    }
+
+    // Finalize digests of large states from the leaf chaining values, release locks, and update statistics
+    for (digestIndex = 0; digestIndex < contractCount; digestIndex++)
+    {
+        if ((contractStateChangeFlags[digestIndex >> 6] & (1ULL << (digestIndex & 63))) && contractDescriptions[digestIndex].stateSize)
+        {
+            const unsigned int size = (unsigned int)contractDescriptions[digestIndex].stateSize;
+            if (KangarooTwelveNumberOfFullLeaves(size) >= CONTRACT_STATE_DIGEST_LEAVES_PER_PART)
+            {
+                const unsigned long long startTick = __rdtsc();
+                KangarooTwelveFromLeafChainingValues(contractStates[digestIndex], size, contractStateLeafChainingValues[contractStateLeafChainingValuesOffset(digestIndex)].m256i_u8, contractStateDigests[digestIndex].m256i_u8, 32);
+                contractStateLeafChainingValuesValid[digestIndex] = true;
+                contractStateDigestTicks[digestIndex] += __rdtsc() - startTick;
+            }
+            contractStateLock[digestIndex].releaseRead();
+
+            const unsigned long long digestTicks = contractStateDigestTicks[digestIndex];
+            if (K12GlobalIndex < 500)
+            {
+                K12MeasurementsSum += digestTicks;
+                K12GlobalIndex++;
+            }
+            unsigned int bucket = 0;
+            for (unsigned long long limit = frequency / 10000; bucket < CONTRACT_STATE_DIGEST_HISTOGRAM_BUCKETS - 1 && digestTicks >= limit; limit *= 10)
+            {
+                bucket++;
+            }
+            contractStateDigestDurationHistogram[digestIndex][bucket]++;
+        }
+    }
+
+    digestIndex = MAX_NUMBER_OF_CONTRACTS;
     unsigned int previousLevelBeginning = 0;
     unsigned int numberOfLeafs = MAX_NUMBER_OF_CONTRACTS;
     while (numberOfLeafs > 1)
@@ -475,95 +626,91 @@ static void processBroadcastMessage(const unsigned long long processorNumber, Re
                 }
             }
 
-            for (unsigned int i = 0; i < sizeof(computorSeeds) / sizeof(computorSeeds[0]); i++)
+            const int ownComputorIndex = ::ownComputorIndex(request->destinationPublicKey);
+            if (ownComputorIndex >= 0)
             {
-                if (request->destinationPublicKey == computorPublicKeys[i])
+                const unsigned int messagePayloadSize = messageSize - sizeof(BroadcastMessage) - SIGNATURE_SIZE;
+                if (messagePayloadSize)
                 {
-                    const unsigned int messagePayloadSize = messageSize - sizeof(BroadcastMessage) - SIGNATURE_SIZE;
-                    if (messagePayloadSize)
-                    {
-                        unsigned char sharedKeyAndGammingNonce[64];
+                    unsigned char sharedKeyAndGammingNonce[64];
 
-                        if (isZero(request->sourcePublicKey))
+                    if (isZero(request->sourcePublicKey))
+                    {
+                        bs->SetMem(sharedKeyAndGammingNonce, 32, 0);
+                    }
+                    else
+                    {
+                        if (!getSharedKey(computorPrivateKeys[ownComputorIndex].m256i_u8, request->sourcePublicKey.m256i_u8, sharedKeyAndGammingNonce))
                         {
-                            bs->SetMem(sharedKeyAndGammingNonce, 32, 0);
+                            ok = false;
                         }
-                        else
+                    }
+
+                    if (ok)
+                    {
+                        bs->CopyMem(&sharedKeyAndGammingNonce[32], &request->gammingNonce, 32);
+                        unsigned char gammingKey[32];
+                        KangarooTwelve64To32(sharedKeyAndGammingNonce, gammingKey);
+                        bs->SetMem(sharedKeyAndGammingNonce, 32, 0); // Zero the shared key in case stack content could be leaked later
+                        unsigned char gamma[MAX_MESSAGE_PAYLOAD_SIZE];
+                        KangarooTwelve(gammingKey, sizeof(gammingKey), gamma, messagePayloadSize);
+                        for (unsigned int j = 0; j < messagePayloadSize; j++)
                         {
-                            if (!getSharedKey(computorPrivateKeys[i].m256i_u8, request->sourcePublicKey.m256i_u8, sharedKeyAndGammingNonce))
-                            {
-                                ok = false;
-                            }
+                            ((unsigned char*)request)[sizeof(BroadcastMessage) + j] ^= gamma[j];
                         }
 
-                        if (ok)
+                        switch (gammingKey[0])
                         {
-                            bs->CopyMem(&sharedKeyAndGammingNonce[32], &request->gammingNonce, 32);
-                            unsigned char gammingKey[32];
-                            KangarooTwelve64To32(sharedKeyAndGammingNonce, gammingKey);
-                            bs->SetMem(sharedKeyAndGammingNonce, 32, 0); // Zero the shared key in case stack content could be leaked later
-                            unsigned char gamma[MAX_MESSAGE_PAYLOAD_SIZE];
-                            KangarooTwelve(gammingKey, sizeof(gammingKey), gamma, messagePayloadSize);
-                            for (unsigned int j = 0; j < messagePayloadSize; j++)
-                            {
-                                ((unsigned char*)request)[sizeof(BroadcastMessage) + j] ^= gamma[j];
-                            }
-
-                            switch (gammingKey[0])
-                            {
-                            case MESSAGE_TYPE_SOLUTION:
+                        case MESSAGE_TYPE_SOLUTION:
+                        {
+                            if (messagePayloadSize >= 32 + 32)
                             {
-                                if (messagePayloadSize >= 32 + 32)
+                                const m256i& solution_miningSeed = *(m256i*)((unsigned char*)request + sizeof(BroadcastMessage));
+                                const m256i& solution_nonce = *(m256i*)((unsigned char*)request + sizeof(BroadcastMessage) + 32);
+                                unsigned int k;
+                                for (k = 0; k < system.numberOfSolutions; k++)
                                 {
-                                    const m256i& solution_miningSeed = *(m256i*)((unsigned char*)request + sizeof(BroadcastMessage));
-                                    const m256i& solution_nonce = *(m256i*)((unsigned char*)request + sizeof(BroadcastMessage) + 32);
-                                    unsigned int k;
-                                    for (k = 0; k < system.numberOfSolutions; k++)
+                                    if (solution_nonce == system.solutions[k].nonce
+                                        && solution_miningSeed == system.solutions[k].miningSeed
+                                        && request->destinationPublicKey == system.solutions[k].computorPublicKey)
                                     {
-                                        if (solution_nonce == system.solutions[k].nonce
-                                            && solution_miningSeed == system.solutions[k].miningSeed
-                                            && request->destinationPublicKey == system.solutions[k].computorPublicKey)
-                                        {
-                                            break;
-                                        }
+                                        break;
                                     }
-                                    if (k == system.numberOfSolutions)
+                                }
+                                if (k == system.numberOfSolutions)
+                                {
+                                    unsigned int solutionScore = (*score)(processorNumber, request->destinationPublicKey, solution_miningSeed, solution_nonce);
+                                    const int threshold = (system.epoch < MAX_NUMBER_EPOCH) ? solutionThreshold[system.epoch] : SOLUTION_THRESHOLD_DEFAULT;
+                                    if (system.numberOfSolutions < MAX_NUMBER_OF_SOLUTIONS
+                                        && score->isValidScore(solutionScore)
+                                        && score->isGoodScore(solutionScore, threshold))
                                     {
-                                        unsigned int solutionScore = (*score)(processorNumber, request->destinationPublicKey, solution_miningSeed, solution_nonce);
-                                        const int threshold = (system.epoch < MAX_NUMBER_EPOCH) ? solutionThreshold[system.epoch] : SOLUTION_THRESHOLD_DEFAULT;
-                                        if (system.numberOfSolutions < MAX_NUMBER_OF_SOLUTIONS
-                                            && score->isValidScore(solutionScore)
-                                            && score->isGoodScore(solutionScore, threshold))
-                                        {
-                                            ACQUIRE(solutionsLock);
+                                        ACQUIRE(solutionsLock);
 
-                                            for (k = 0; k < system.numberOfSolutions; k++)
-                                            {
-                                                if (solution_nonce == system.solutions[k].nonce
-                                                    && solution_miningSeed == system.solutions[k].miningSeed
-                                                    && request->destinationPublicKey == system.solutions[k].computorPublicKey)
-                                                {
-                                                    break;
-                                                }
-                                            }
-                                            if (k == system.numberOfSolutions)
+                                        for (k = 0; k < system.numberOfSolutions; k++)
+                                        {
+                                            if (solution_nonce == system.solutions[k].nonce
+                                                && solution_miningSeed == system.solutions[k].miningSeed
+                                                && request->destinationPublicKey == system.solutions[k].computorPublicKey)
                                             {
-                                                system.solutions[system.numberOfSolutions].computorPublicKey = request->destinationPublicKey;
-                                                system.solutions[system.numberOfSolutions].miningSeed = solution_miningSeed;
-                                                system.solutions[system.numberOfSolutions++].nonce = solution_nonce;
+                                                break;
                                             }
-
-                                            RELEASE(solutionsLock);
                                         }
+                                        if (k == system.numberOfSolutions)
+                                        {
+                                            system.solutions[system.numberOfSolutions].computorPublicKey = request->destinationPublicKey;
+                                            system.solutions[system.numberOfSolutions].miningSeed = solution_miningSeed;
+                                            system.solutions[system.numberOfSolutions++].nonce = solution_nonce;
+                                        }
+
+                                        RELEASE(solutionsLock);
                                     }
                                 }
                             }
-                            break;
-                            }
+                        }
+                        break;
                         }
                     }
-
-                    break;
                 }
             }
         }
@@ -599,6 +746,7 @@ static void processBroadcastComputors(Peer* peer, RequestResponseHeader* header)
 
             // Copy computor list
             bs->CopyMem(&broadcastedComputors.computors, &request->computors, sizeof(Computors));
+            computorPublicKeyIndex.build(broadcastedComputors.computors.publicKeys, NUMBER_OF_COMPUTORS);
 
             // Update ownComputorIndices and minerPublicKeys
             if (request->computors.epoch == system.epoch)
@@ -609,15 +757,11 @@ static void processBroadcastComputors(Peer* peer, RequestResponseHeader* header)
                 {
                     minerPublicKeys[i] = request->computors.publicKeys[i];
 
-                    for (unsigned int j = 0; j < sizeof(computorSeeds) / sizeof(computorSeeds[0]); j++)
+                    const int ownComputorIndex = ::ownComputorIndex(request->computors.publicKeys[i]);
+                    if (ownComputorIndex >= 0)
                     {
-                        if (request->computors.publicKeys[i] == computorPublicKeys[j])
-                        {
-                            ownComputorIndices[numberOfOwnComputorIndices] = i;
-                            ownComputorIndicesMapping[numberOfOwnComputorIndices++] = j;
-
-                            break;
-                        }
+                        ownComputorIndices[numberOfOwnComputorIndices] = i;
+                        ownComputorIndicesMapping[numberOfOwnComputorIndices++] = ownComputorIndex;
                     }
                 }
                 RELEASE(minerScoreArrayLock);
@@ -682,177 +826,400 @@ static void processBroadcastTick(Peer* peer, RequestResponseHeader* header)
     }
 }
 
-static void processBroadcastFutureTickData(Peer* peer, RequestResponseHeader* header)
+// Check fields of tick data of a future tick before verifying its signature
+static bool isFutureTickDataValid(const TickData& tickData)
 {
-    BroadcastFutureTickData* request = header->getPayload<BroadcastFutureTickData>();
-    if (request->tickData.epoch == system.epoch
-        && request->tickData.tick > system.tick
-        && ts.tickInCurrentEpochStorage(request->tickData.tick)
-        && request->tickData.tick % NUMBER_OF_COMPUTORS == request->tickData.computorIndex
-        && request->tickData.month >= 1 && request->tickData.month <= 12
-        && request->tickData.day >= 1 && request->tickData.day <= ((request->tickData.month == 1 || request->tickData.month == 3 || request->tickData.month == 5 || request->tickData.month == 7 || request->tickData.month == 8 || request->tickData.month == 10 || request->tickData.month == 12) ? 31 : ((request->tickData.month == 4 || request->tickData.month == 6 || request->tickData.month == 9 || request->tickData.month == 11) ? 30 : ((request->tickData.year & 3) ? 28 : 29)))
-        && request->tickData.hour <= 23
-        && request->tickData.minute <= 59
-        && request->tickData.second <= 59
-        && request->tickData.millisecond <= 999
-        && ms(request->tickData.year, request->tickData.month, request->tickData.day, request->tickData.hour, request->tickData.minute, request->tickData.second, request->tickData.millisecond) <= ms(time.Year - 2000, time.Month, time.Day, time.Hour, time.Minute, time.Second, time.Nanosecond / 1000000) + TIME_ACCURACY)
-    {
-        bool ok = true;
-        for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK && ok; i++)
-        {
-            if (!isZero(request->tickData.transactionDigests[i]))
-            {
-                for (unsigned int j = 0; j < i; j++)
-                {
-                    if (request->tickData.transactionDigests[i] == request->tickData.transactionDigests[j])
-                    {
-                        ok = false;
+    return tickData.epoch == system.epoch
+        && tickData.tick > system.tick
+        && ts.tickInCurrentEpochStorage(tickData.tick)
+        && tickData.tick % NUMBER_OF_COMPUTORS == tickData.computorIndex
+        && tickData.month >= 1 && tickData.month <= 12
+        && tickData.day >= 1 && tickData.day <= ((tickData.month == 1 || tickData.month == 3 || tickData.month == 5 || tickData.month == 7 || tickData.month == 8 || tickData.month == 10 || tickData.month == 12) ? 31 : ((tickData.month == 4 || tickData.month == 6 || tickData.month == 9 || tickData.month == 11) ? 30 : ((tickData.year & 3) ? 28 : 29)))
+        && tickData.hour <= 23
+        && tickData.minute <= 59
+        && tickData.second <= 59
+        && tickData.millisecond <= 999
+        && ms(tickData.year, tickData.month, tickData.day, tickData.hour, tickData.minute, tickData.second, tickData.millisecond) <= ms(time.Year - 2000, time.Month, time.Day, time.Hour, time.Minute, time.Second, time.Nanosecond / 1000000) + TIME_ACCURACY;
+}
 
-                        break;
-                    }
+// Check that the transaction digests are unique and the signature is valid
+static bool verifyTickData(TickData& tickData)
+{
+    for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+    {
+        if (!isZero(tickData.transactionDigests[i]))
+        {
+            for (unsigned int j = 0; j < i; j++)
+            {
+                if (tickData.transactionDigests[i] == tickData.transactionDigests[j])
+                {
+                    return false;
                 }
             }
         }
-        if (ok)
+    }
+
+    unsigned char digest[32];
+    tickData.computorIndex ^= BroadcastFutureTickData::type;
+    KangarooTwelve(&tickData, sizeof(TickData) - SIGNATURE_SIZE, digest, sizeof(digest));
+    tickData.computorIndex ^= BroadcastFutureTickData::type;
+    return verify(broadcastedComputors.computors.publicKeys[tickData.computorIndex].m256i_u8, digest, tickData.signature);
+}
+
+// Store tick data with verified signature (or mark its computor as faulty if it differs from the stored tick data)
+static void storeTickData(const TickData& tickData)
+{
+    ts.tickData.acquireLock();
+    TickData& td = ts.tickData.getByTickInCurrentEpoch(tickData.tick);
+    if (tickData.tick == system.tick + 1 && targetNextTickDataDigestIsKnown)
+    {
+        if (!isZero(targetNextTickDataDigest))
         {
             unsigned char digest[32];
-            request->tickData.computorIndex ^= BroadcastFutureTickData::type;
-            KangarooTwelve(&request->tickData, sizeof(TickData) - SIGNATURE_SIZE, digest, sizeof(digest));
-            request->tickData.computorIndex ^= BroadcastFutureTickData::type;
-            if (verify(broadcastedComputors.computors.publicKeys[request->tickData.computorIndex].m256i_u8, digest, request->tickData.signature))
+            KangarooTwelve(&tickData, sizeof(TickData), digest, 32);
+            if (digest == targetNextTickDataDigest)
             {
-                if (header->isDejavuZero())
-                {
-                    enqueueResponse(NULL, header);
-                }
-
-                ts.tickData.acquireLock();
-                TickData& td = ts.tickData.getByTickInCurrentEpoch(request->tickData.tick);
-                if (request->tickData.tick == system.tick + 1 && targetNextTickDataDigestIsKnown)
-                {
-                    if (!isZero(targetNextTickDataDigest))
-                    {
-                        unsigned char digest[32];
-                        KangarooTwelve(&request->tickData, sizeof(TickData), digest, 32);
-                        if (digest == targetNextTickDataDigest)
-                        {
-                            bs->CopyMem(&td, &request->tickData, sizeof(TickData));
-                        }
-                    }
-                }
-                else
+                bs->CopyMem(&td, (void*)&tickData, sizeof(TickData));
+            }
+        }
+    }
+    else
+    {
+        if (td.epoch == system.epoch)
+        {
+            // Tick data already available. Mark computor as faulty if the data that was sent differs.
+            if (*((unsigned long long*)&tickData.millisecond) != *((unsigned long long*)&td.millisecond))
+            {
+                faultyComputorFlags[tickData.computorIndex >> 6] |= (1ULL << (tickData.computorIndex & 63));
+            }
+            else
+            {
+                for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
                 {
-                    if (td.epoch == system.epoch)
+                    if (tickData.transactionDigests[i] != td.transactionDigests[i])
                     {
-                        // Tick data already available. Mark computor as faulty if the data that was sent differs.
-                        if (*((unsigned long long*)&request->tickData.millisecond) != *((unsigned long long*)&td.millisecond))
-                        {
-                            faultyComputorFlags[request->tickData.computorIndex >> 6] |= (1ULL << (request->tickData.computorIndex & 63));
-                        }
-                        else
-                        {
-                            for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
-                            {
-                                if (request->tickData.transactionDigests[i] != td.transactionDigests[i])
-                                {
-                                    faultyComputorFlags[request->tickData.computorIndex >> 6] |= (1ULL << (request->tickData.computorIndex & 63));
+                        faultyComputorFlags[tickData.computorIndex >> 6] |= (1ULL << (tickData.computorIndex & 63));
 
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                    else
-                    {
-                        bs->CopyMem(&td, &request->tickData, sizeof(TickData));
+                        break;
                     }
                 }
-                ts.tickData.releaseLock();
             }
         }
+        else
+        {
+            bs->CopyMem(&td, (void*)&tickData, sizeof(TickData));
+        }
     }
+    ts.tickData.releaseLock();
 }
 
-static void processBroadcastTransaction(Peer* peer, RequestResponseHeader* header)
+static void processBroadcastFutureTickData(Peer* peer, RequestResponseHeader* header)
 {
-    Transaction* request = header->getPayload<Transaction>();
-    const unsigned int transactionSize = request->totalSize();
-    if (request->checkValidity() && transactionSize == header->size() - sizeof(RequestResponseHeader))
+    BroadcastFutureTickData* request = header->getPayload<BroadcastFutureTickData>();
+    if (isFutureTickDataValid(request->tickData) && verifyTickData(request->tickData))
     {
-        unsigned char digest[32];
-        KangarooTwelve(request, transactionSize - SIGNATURE_SIZE, digest, sizeof(digest));
-        if (verify(request->sourcePublicKey.m256i_u8, digest, request->signaturePtr()))
+        if (header->isDejavuZero())
         {
-            if (header->isDejavuZero())
+            enqueueResponse(NULL, header);
+        }
+
+        storeTickData(request->tickData);
+    }
+}
+
+// Verify and store the completely rebuilt tick data, and relay it in compact form if requested. Called with
+// tickDataReconstructionLock acquired.
+static void completeTickDataReconstruction(TickDataReconstruction& reconstruction, bool relay)
+{
+    ASSERT(!reconstruction.missingTransactionCount());
+    TickData& tickData = reconstruction.tickData();
+    if (verifyTickData(tickData))
+    {
+        if (relay)
+        {
+            // The compact form is canonical, so the relayed message is identical to the received one
+            const unsigned int compactTickDataSize = encodeCompactTickData(tickData, (CompactTickData*)compactTickDataBuffer);
+            enqueueResponse(NULL, compactTickDataSize, BroadcastCompactFutureTickData::type, 0, compactTickDataBuffer);
+        }
+
+        storeTickData(tickData);
+
+        // tick() stays set, so the same tick data received from other peers is ignored
+    }
+    else
+    {
+        numberOfFailedTickDataReconstructions++;
+        reconstruction.end();
+    }
+}
+
+static void processBroadcastCompactFutureTickData(Peer* peer, RequestResponseHeader* header)
+{
+    BroadcastCompactFutureTickData* request = header->getPayload<BroadcastCompactFutureTickData>();
+    const unsigned int size = header->size() - sizeof(RequestResponseHeader);
+    if (size < sizeof(CompactTickData)
+        || !ts.tickInCurrentEpochStorage(request->compactTickData.tick)
+        || ts.tickData.getByTickInCurrentEpoch(request->compactTickData.tick).epoch == system.epoch)
+    {
+        return;
+    }
+
+    ACQUIRE(tickDataReconstructionLock);
+
+    auto* slot = tickDataReconstructions.claim(request->compactTickData, __rdtsc(), TICK_DATA_RECONSTRUCTION_TIMEOUT * frequency / 1000);
+    if (slot)
+    {
+        TickDataReconstruction& reconstruction = slot->reconstruction;
+        numberOfReceivedCompactTickData++;
+        if (!reconstruction.begin(&request->compactTickData, size) || !isFutureTickDataValid(reconstruction.tickData()))
+        {
+            numberOfFailedTickDataReconstructions++;
+            reconstruction.end();
+        }
+        else
+        {
+            const unsigned int tick = reconstruction.tick();
+
+            // match pending transactions scheduled for the tick
+            ACQUIRE(computorPendingTransactionsLock);
+            for (unsigned int pendingSlot = computorPendingTransactionTickIndex.first(tick); pendingSlot != PendingTransactionTickIndex::NO_SLOT; pendingSlot = computorPendingTransactionTickIndex.next(pendingSlot))
             {
-                enqueueResponse(NULL, header);
+                reconstruction.addCandidate(*((m256i*)&computorPendingTransactionDigests[pendingSlot * 32ULL]));
             }
-
-            const int computorIndex = ::computorIndex(request->sourcePublicKey);
-            if (computorIndex >= 0)
+            RELEASE(computorPendingTransactionsLock);
+            ACQUIRE(entityPendingTransactionsLock);
+            for (unsigned int pendingSlot = entityPendingTransactionTickIndex.first(tick); pendingSlot != PendingTransactionTickIndex::NO_SLOT; pendingSlot = entityPendingTransactionTickIndex.next(pendingSlot))
             {
-                ACQUIRE(computorPendingTransactionsLock);
-
-                const unsigned int offset = random(MAX_NUMBER_OF_PENDING_TRANSACTIONS_PER_COMPUTOR);
-                if (((Transaction*)&computorPendingTransactions[computorIndex * offset * MAX_TRANSACTION_SIZE])->tick < request->tick
-                    && request->tick < system.initialTick + MAX_NUMBER_OF_TICKS_PER_EPOCH)
-                {
-                    bs->CopyMem(&computorPendingTransactions[computorIndex * offset * MAX_TRANSACTION_SIZE], request, transactionSize);
-                    KangarooTwelve(request, transactionSize, &computorPendingTransactionDigests[computorIndex * offset * 32ULL], 32);
-                }
+                reconstruction.addCandidate(*((m256i*)&entityPendingTransactionDigests[pendingSlot * 32ULL]));
+            }
+            RELEASE(entityPendingTransactionsLock);
 
-                RELEASE(computorPendingTransactionsLock);
+            slot->relay = header->isDejavuZero();
+            if (!reconstruction.missingTransactionCount())
+            {
+                numberOfTickDataRebuiltFromPendingTransactions++;
+                completeTickDataReconstruction(reconstruction, slot->relay);
             }
             else
             {
-                const int spectrumIndex = ::spectrumIndex(request->sourcePublicKey);
-                if (spectrumIndex >= 0)
+                // request only the digests of the missing transactions from the sender
+                struct
                 {
-                    ACQUIRE(entityPendingTransactionsLock);
+                    RequestResponseHeader header;
+                    RequestTickTransactionDigests payload;
+                } requestedTickTransactionDigests;
+                requestedTickTransactionDigests.header.setSize<sizeof(requestedTickTransactionDigests)>();
+                requestedTickTransactionDigests.header.setType(RequestTickTransactionDigests::type);
+                requestedTickTransactionDigests.header.randomizeDejavu();
+                requestedTickTransactionDigests.payload.tick = tick;
+                reconstruction.getMissingTransactionFlags(requestedTickTransactionDigests.payload.transactionFlags);
+                numberOfRequestedTransactionDigests += reconstruction.missingTransactionCount();
+                enqueueResponse(peer, &requestedTickTransactionDigests.header);
+            }
+        }
+    }
 
-                    // Pending transactions pool follows the rule: A transaction with a higher tick overwrites previous transaction from the same address.
-                    // The second filter is to avoid accident made by users/devs (setting scheduled tick too high) and get locked until end of epoch.
-                    // It also makes sense that a node doesn't need to store a transaction that is scheduled on a tick that node will never reach.
-                    // Notice: MAX_NUMBER_OF_TICKS_PER_EPOCH is not set globally since every node may have different TARGET_TICK_DURATION time due to memory limitation.
-                    if (((Transaction*)&entityPendingTransactions[spectrumIndex * MAX_TRANSACTION_SIZE])->tick < request->tick
-                        && request->tick < system.initialTick + MAX_NUMBER_OF_TICKS_PER_EPOCH)
-                    {
-                        bs->CopyMem(&entityPendingTransactions[spectrumIndex * MAX_TRANSACTION_SIZE], request, transactionSize);
-                        KangarooTwelve(request, transactionSize, &entityPendingTransactionDigests[spectrumIndex * 32ULL], 32);
-                    }
+    RELEASE(tickDataReconstructionLock);
+}
 
-                    RELEASE(entityPendingTransactionsLock);
-                }
+static void processRequestTickTransactionDigests(Peer* peer, RequestResponseHeader* header)
+{
+    RequestTickTransactionDigests* request = header->getPayload<RequestTickTransactionDigests>();
+    const TickData* td = ts.tickData.getByTickIfNotEmpty(request->tick);
+    if (td)
+    {
+        unsigned int numberOfDigests = 0;
+        for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+        {
+            if (request->transactionFlags[i >> 3] & (1 << (i & 7)))
+            {
+                numberOfDigests++;
             }
+        }
 
-            unsigned int tickIndex = ts.tickToIndexCurrentEpoch(request->tick);
-            ts.tickData.acquireLock();
-            if (request->tick == system.tick + 1
-                && ts.tickData[tickIndex].epoch == system.epoch)
+        // The response is written directly into the queue
+        long long position;
+        const unsigned int responseSize = sizeof(RequestResponseHeader) + sizeof(RespondTickTransactionDigests) + numberOfDigests * sizeof(m256i);
+        RequestResponseHeader* responseHeader = responseQueue.reserve(peer, responseSize, position);
+        if (responseHeader)
+        {
+            responseHeader->checkAndSetSize(responseSize);
+            responseHeader->setType(RespondTickTransactionDigests::type);
+            responseHeader->setDejavu(header->dejavu());
+            RespondTickTransactionDigests* response = responseHeader->getPayload<RespondTickTransactionDigests>();
+            response->tick = request->tick;
+            copyMem(response->transactionFlags, request->transactionFlags, sizeof(response->transactionFlags));
+            m256i* digests = (m256i*)(response + 1);
+            for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
             {
-                KangarooTwelve(request, transactionSize, digest, sizeof(digest));
-                auto* tsReqTickTransactionOffsets = ts.tickTransactionOffsets.getByTickIndex(tickIndex);
-                for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+                if (request->transactionFlags[i >> 3] & (1 << (i & 7)))
                 {
-                    if (digest == ts.tickData[tickIndex].transactionDigests[i])
-                    {
-                        ts.tickTransactions.acquireLock();
-                        if (!tsReqTickTransactionOffsets[i])
-                        {
-                            if (ts.nextTickTransactionOffset + transactionSize <= ts.tickTransactions.storageSpaceCurrentEpoch)
-                            {
-                                tsReqTickTransactionOffsets[i] = ts.nextTickTransactionOffset;
-                                bs->CopyMem(ts.tickTransactions(ts.nextTickTransactionOffset), request, transactionSize);
-                                ts.nextTickTransactionOffset += transactionSize;
-                            }
-                        }
-                        ts.tickTransactions.releaseLock();
+                    *digests++ = td->transactionDigests[i];
+                }
+            }
+            responseQueue.publish(position);
+        }
+    }
+    else
+    {
+        enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
+    }
+}
 
-                        break;
+static void processRespondTickTransactionDigests(Peer* peer, RequestResponseHeader* header)
+{
+    RespondTickTransactionDigests* response = header->getPayload<RespondTickTransactionDigests>();
+    const unsigned int size = header->size() - sizeof(RequestResponseHeader);
+    if (size < sizeof(RespondTickTransactionDigests) || (size - sizeof(RespondTickTransactionDigests)) % sizeof(m256i))
+    {
+        return;
+    }
+    const unsigned int numberOfDigests = (size - sizeof(RespondTickTransactionDigests)) / sizeof(m256i);
+    const m256i* digests = (const m256i*)(response + 1);
+
+    ACQUIRE(tickDataReconstructionLock);
+
+    auto* slot = tickDataReconstructions.find(response->tick);
+    if (slot && slot->reconstruction.missingTransactionCount())
+    {
+        TickDataReconstruction& reconstruction = slot->reconstruction;
+        unsigned int digestIndex = 0;
+        for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK && digestIndex < numberOfDigests; i++)
+        {
+            if (response->transactionFlags[i >> 3] & (1 << (i & 7)))
+            {
+                reconstruction.setMissingTransactionDigest(i, digests[digestIndex++]);
+            }
+        }
+        if (!reconstruction.missingTransactionCount())
+        {
+            numberOfTickDataRebuiltWithRequestedDigests++;
+            completeTickDataReconstruction(reconstruction, slot->relay);
+        }
+    }
+
+    RELEASE(tickDataReconstructionLock);
+}
+
+// Process transaction with already verified signature
+static void processVerifiedBroadcastTransaction(RequestResponseHeader* header)
+{
+    Transaction* request = header->getPayload<Transaction>();
+    const unsigned int transactionSize = request->totalSize();
+    unsigned char digest[32];
+
+    if (header->isDejavuZero())
+    {
+        enqueueResponse(NULL, header);
+    }
+
+    const int computorIndex = ::computorIndex(request->sourcePublicKey);
+    if (computorIndex >= 0)
+    {
+        ACQUIRE(computorPendingTransactionsLock);
+
+        const unsigned int offset = random(MAX_NUMBER_OF_PENDING_TRANSACTIONS_PER_COMPUTOR);
+        Transaction* pendingTransaction = (Transaction*)&computorPendingTransactions[computorIndex * offset * MAX_TRANSACTION_SIZE];
+        if (pendingTransaction->tick < request->tick
+            && request->tick < system.initialTick + MAX_NUMBER_OF_TICKS_PER_EPOCH)
+        {
+            computorPendingTransactionTickIndex.remove(computorIndex * offset, pendingTransaction->tick);
+            bs->CopyMem(pendingTransaction, request, transactionSize);
+            KangarooTwelve(request, transactionSize, &computorPendingTransactionDigests[computorIndex * offset * 32ULL], 32);
+            computorPendingTransactionTickIndex.add(computorIndex * offset, request->tick);
+        }
+
+        RELEASE(computorPendingTransactionsLock);
+    }
+    else
+    {
+        const int spectrumIndex = ::spectrumIndex(request->sourcePublicKey);
+        if (spectrumIndex >= 0)
+        {
+            ACQUIRE(entityPendingTransactionsLock);
+
+            // Pending transactions pool follows the rule: A transaction with a higher tick overwrites previous transaction from the same address.
+            // The second filter is to avoid accident made by users/devs (setting scheduled tick too high) and get locked until end of epoch.
+            // It also makes sense that a node doesn't need to store a transaction that is scheduled on a tick that node will never reach.
+            // Notice: MAX_NUMBER_OF_TICKS_PER_EPOCH is not set globally since every node may have different TARGET_TICK_DURATION time due to memory limitation.
+            Transaction* pendingTransaction = (Transaction*)&entityPendingTransactions[spectrumIndex * MAX_TRANSACTION_SIZE];
+            if (pendingTransaction->tick < request->tick
+                && request->tick < system.initialTick + MAX_NUMBER_OF_TICKS_PER_EPOCH)
+            {
+                entityPendingTransactionTickIndex.remove(spectrumIndex, pendingTransaction->tick);
+                bs->CopyMem(pendingTransaction, request, transactionSize);
+                KangarooTwelve(request, transactionSize, &entityPendingTransactionDigests[spectrumIndex * 32ULL], 32);
+                entityPendingTransactionTickIndex.add(spectrumIndex, request->tick);
+            }
+
+            RELEASE(entityPendingTransactionsLock);
+        }
+    }
+
+    unsigned int tickIndex = ts.tickToIndexCurrentEpoch(request->tick);
+    ts.tickData.acquireLock();
+    if (request->tick == system.tick + 1
+        && ts.tickData[tickIndex].epoch == system.epoch)
+    {
+        KangarooTwelve(request, transactionSize, digest, sizeof(digest));
+        auto* tsReqTickTransactionOffsets = ts.tickTransactionOffsets.getByTickIndex(tickIndex);
+        for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+        {
+            if (digest == ts.tickData[tickIndex].transactionDigests[i])
+            {
+                ts.tickTransactions.acquireLock();
+                if (!tsReqTickTransactionOffsets[i])
+                {
+                    if (ts.nextTickTransactionOffset + transactionSize <= ts.tickTransactions.storageSpaceCurrentEpoch)
+                    {
+                        tsReqTickTransactionOffsets[i] = ts.nextTickTransactionOffset;
+                        bs->CopyMem(ts.tickTransactions(ts.nextTickTransactionOffset), request, transactionSize);
+                        ts.nextTickTransactionOffset += transactionSize;
                     }
                 }
+                ts.tickTransactions.releaseLock();
+
+                break;
             }
-            ts.tickData.releaseLock();
+        }
+    }
+    ts.tickData.releaseLock();
+}
+
+// Process batch of BroadcastTransaction messages, verifying all signatures with one call of verifyBatch()
+static void processBroadcastTransactions(RequestResponseHeader* const* headers, unsigned int numberOfHeaders)
+{
+    ASSERT(numberOfHeaders <= VERIFY_BATCH_SIZE);
+    RequestResponseHeader* validHeaders[VERIFY_BATCH_SIZE];
+    const unsigned char* publicKeys[VERIFY_BATCH_SIZE];
+    const unsigned char* digestPtrs[VERIFY_BATCH_SIZE];
+    const unsigned char* signatures[VERIFY_BATCH_SIZE];
+    unsigned char digests[VERIFY_BATCH_SIZE][32];
+    bool results[VERIFY_BATCH_SIZE];
+    unsigned int numberOfValidHeaders = 0;
+
+    for (unsigned int i = 0; i < numberOfHeaders; i++)
+    {
+        Transaction* request = headers[i]->getPayload<Transaction>();
+        const unsigned int transactionSize = request->totalSize();
+        if (request->checkValidity() && transactionSize == headers[i]->size() - sizeof(RequestResponseHeader))
+        {
+            KangarooTwelve(request, transactionSize - SIGNATURE_SIZE, digests[numberOfValidHeaders], sizeof(digests[numberOfValidHeaders]));
+            validHeaders[numberOfValidHeaders] = headers[i];
+            publicKeys[numberOfValidHeaders] = request->sourcePublicKey.m256i_u8;
+            digestPtrs[numberOfValidHeaders] = digests[numberOfValidHeaders];
+            signatures[numberOfValidHeaders] = request->signaturePtr();
+            numberOfValidHeaders++;
+        }
+    }
+
+    verifyBatch(numberOfValidHeaders, publicKeys, digestPtrs, signatures, results);
+
+    for (unsigned int i = 0; i < numberOfValidHeaders; i++)
+    {
+        if (results[i])
+        {
+            processVerifiedBroadcastTransaction(validHeaders[i]);
         }
     }
 }
@@ -1023,8 +1390,22 @@ static void processRequestEntity(Peer* peer, RequestResponseHeader* header)
 
     RequestedEntity* request = header->getPayload<RequestedEntity>();
     respondedEntity.entity.publicKey = request->publicKey;
-    // Inside spectrumIndex already have acquire/release lock
-    respondedEntity.spectrumIndex = spectrumIndex(respondedEntity.entity.publicKey);
+    respondedEntity.spectrumIndex = -1;
+    if (!isZero(request->publicKey))
+    {
+        // Read entity and siblings without spectrumLock, retrying if the spectrum is changed meanwhile
+        long long sequence;
+        do
+        {
+            sequence = spectrumSeqLock.beginRead();
+            respondedEntity.spectrumIndex = findSpectrumIndex(request->publicKey);
+            if (respondedEntity.spectrumIndex >= 0)
+            {
+                bs->CopyMem(&respondedEntity.entity, &spectrum[respondedEntity.spectrumIndex], sizeof(::Entity));
+                getSiblings<SPECTRUM_DEPTH>(respondedEntity.spectrumIndex, spectrumDigests, respondedEntity.siblings);
+            }
+        } while (!spectrumSeqLock.endRead(sequence));
+    }
     respondedEntity.tick = system.tick;
     if (respondedEntity.spectrumIndex < 0)
     {
@@ -1037,13 +1418,6 @@ static void processRequestEntity(Peer* peer, RequestResponseHeader* header)
 
         bs->SetMem(respondedEntity.siblings, sizeof(respondedEntity.siblings), 0);
     }
-    else
-    {
-        bs->CopyMem(&respondedEntity.entity, &spectrum[respondedEntity.spectrumIndex], sizeof(::Entity));
-        ACQUIRE(spectrumLock);
-        getSiblings<SPECTRUM_DEPTH>(respondedEntity.spectrumIndex, spectrumDigests, respondedEntity.siblings);
-        RELEASE(spectrumLock);
-    }
 
 
     enqueueResponse(peer, sizeof(respondedEntity), RESPOND_ENTITY, header->dejavu(), &respondedEntity);
@@ -1273,8 +1647,9 @@ static void requestProcessor(void* ProcedureArgument)
     unsigned long long processorNumber;
     mpServicesProtocol->WhoAmI(mpServicesProtocol, &processorNumber);
 
-    Processor* processor = (Processor*)ProcedureArgument;
-    RequestResponseHeader* header = (RequestResponseHeader*)processor->buffer;
+    RequestResponseHeader* transactionHeaders[VERIFY_BATCH_SIZE];
+    long long requestPositions[VERIFY_BATCH_SIZE];
+    Peer* transactionPeer;
     while (!shutDownNode)
     {
         checkinTime(processorNumber);
@@ -1284,193 +1659,222 @@ static void requestProcessor(void* ProcedureArgument)
             _InterlockedIncrement(&epochTransitionWaitingRequestProcessors);
             while (epochTransitionState)
             {
+                parallelJob.help();
                 _mm_pause();
             }
             _InterlockedDecrement(&epochTransitionWaitingRequestProcessors);
         }
 
+        // help the tick processor with parallelized work such as rebuilding digests
+        parallelJob.help();
+
         // try to compute a solution if any is queued and this thread is assigned to compute solution
         if (solutionProcessorFlags[processorNumber])
         {
             score->tryProcessSolution(processorNumber);
         }
         
-        if (requestQueueElementTail == requestQueueElementHead)
+        Peer* peer;
+        RequestResponseHeader* header = requestQueue.dequeue(requestPositions[0], peer);
+        if (!header)
         {
             _mm_pause();
         }
         else
         {
-            ACQUIRE(requestQueueTailLock);
+            const unsigned long long beginningTick = __rdtsc();
 
-            if (requestQueueElementTail == requestQueueElementHead)
+            // Transactions are verified in batches, so also claim the transactions directly following this one
+            unsigned int numberOfDequeuedRequests = 1;
+            if (header->type() == BROADCAST_TRANSACTION)
             {
-                RELEASE(requestQueueTailLock);
+                transactionHeaders[0] = header;
+                while (numberOfDequeuedRequests < VERIFY_BATCH_SIZE
+                    && (transactionHeaders[numberOfDequeuedRequests] = requestQueue.dequeueIfType(requestPositions[numberOfDequeuedRequests], transactionPeer, BROADCAST_TRANSACTION)))
+                {
+                    numberOfDequeuedRequests++;
+                }
             }
-            else
+
+            switch (header->type())
             {
-                const unsigned long long beginningTick = __rdtsc();
+            case ExchangePublicPeers::type:
+            {
+                processExchangePublicPeers(peer, header);
+            }
+            break;
 
-                {
-                    RequestResponseHeader* requestHeader = (RequestResponseHeader*)&requestQueueBuffer[requestQueueElements[requestQueueElementTail].offset];
-                    bs->CopyMem(header, requestHeader, requestHeader->size());
-                    requestQueueBufferTail += requestHeader->size();
-                }
+            case BroadcastMessage::type:
+            {
+                processBroadcastMessage(processorNumber, header);
+            }
+            break;
 
-                Peer* peer = requestQueueElements[requestQueueElementTail].peer;
+            case BroadcastComputors::type:
+            {
+                processBroadcastComputors(peer, header);
+            }
+            break;
 
-                if (requestQueueBufferTail > REQUEST_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
-                {
-                    requestQueueBufferTail = 0;
-                }
-                requestQueueElementTail++;
+            case BroadcastTick::type:
+            {
+                processBroadcastTick(peer, header);
+            }
+            break;
 
-                RELEASE(requestQueueTailLock);
+            case BroadcastFutureTickData::type:
+            {
+                processBroadcastFutureTickData(peer, header);
+            }
+            break;
 
-                switch (header->type())
-                {
-                case ExchangePublicPeers::type:
-                {
-                    processExchangePublicPeers(peer, header);
-                }
-                break;
+            case BroadcastCompactFutureTickData::type:
+            {
+                processBroadcastCompactFutureTickData(peer, header);
+            }
+            break;
 
-                case BroadcastMessage::type:
-                {
-                    processBroadcastMessage(processorNumber, header);
-                }
-                break;
+            case BROADCAST_TRANSACTION:
+            {
+                processBroadcastTransactions(transactionHeaders, numberOfDequeuedRequests);
+            }
+            break;
 
-                case BroadcastComputors::type:
-                {
-                    processBroadcastComputors(peer, header);
-                }
-                break;
+            case RequestComputors::type:
+            {
+                processRequestComputors(peer, header);
+            }
+            break;
 
-                case BroadcastTick::type:
-                {
-                    processBroadcastTick(peer, header);
-                }
-                break;
+            case RequestQuorumTick::type:
+            {
+                processRequestQuorumTick(peer, header);
+            }
+            break;
 
-                case BroadcastFutureTickData::type:
-                {
-                    processBroadcastFutureTickData(peer, header);
-                }
-                break;
+            case RequestTickData::type:
+            {
+                processRequestTickData(peer, header);
+            }
+            break;
 
-                case BROADCAST_TRANSACTION:
-                {
-                    processBroadcastTransaction(peer, header);
-                }
-                break;
+            case REQUEST_TICK_TRANSACTIONS:
+            {
+                processRequestTickTransactions(peer, header);
+            }
+            break;
 
-                case RequestComputors::type:
-                {
-                    processRequestComputors(peer, header);
-                }
-                break;
+            case RequestTickTransactionDigests::type:
+            {
+                processRequestTickTransactionDigests(peer, header);
+            }
+            break;
 
-                case RequestQuorumTick::type:
-                {
-                    processRequestQuorumTick(peer, header);
-                }
-                break;
+            case RespondTickTransactionDigests::type:
+            {
+                processRespondTickTransactionDigests(peer, header);
+            }
+            break;
 
-                case RequestTickData::type:
-                {
-                    processRequestTickData(peer, header);
-                }
-                break;
+            case REQUEST_CURRENT_TICK_INFO:
+            {
+                processRequestCurrentTickInfo(peer, header);
+            }
+            break;
 
-                case REQUEST_TICK_TRANSACTIONS:
-                {
-                    processRequestTickTransactions(peer, header);
-                }
-                break;
+            case REQUEST_ENTITY:
+            {
+                processRequestEntity(peer, header);
+            }
+            break;
 
-                case REQUEST_CURRENT_TICK_INFO:
-                {
-                    processRequestCurrentTickInfo(peer, header);
-                }
-                break;
+            case RequestContractIPO::type:
+            {
+                processRequestContractIPO(peer, header);
+            }
+            break;
 
-                case REQUEST_ENTITY:
-                {
-                    processRequestEntity(peer, header);
-                }
-                break;
+            case RequestIssuedAssets::type:
+            {
+                processRequestIssuedAssets(peer, header);
+            }
+            break;
 
-                case RequestContractIPO::type:
-                {
-                    processRequestContractIPO(peer, header);
-                }
-                break;
+            case RequestOwnedAssets::type:
+            {
+                processRequestOwnedAssets(peer, header);
+            }
+            break;
 
-                case RequestIssuedAssets::type:
-                {
-                    processRequestIssuedAssets(peer, header);
-                }
-                break;
+            case RequestPossessedAssets::type:
+            {
+                processRequestPossessedAssets(peer, header);
+            }
+            break;
 
-                case RequestOwnedAssets::type:
-                {
-                    processRequestOwnedAssets(peer, header);
-                }
-                break;
+            case RequestContractFunction::type:
+            {
+                processRequestContractFunction(peer, processorNumber, header);
+            }
+            break;
 
-                case RequestPossessedAssets::type:
-                {
-                    processRequestPossessedAssets(peer, header);
-                }
-                break;
+            case RequestLog::type:
+            {
+                logger.processRequestLog(peer, header);
+            }
+            break;
 
-                case RequestContractFunction::type:
-                {
-                    processRequestContractFunction(peer, processorNumber, header);
-                }
-                break;
+            case RequestLogIdRangeFromTx::type:
+            {
+                logger.processRequestTxLogInfo(peer, header);
+            }
+            break;
 
-                case RequestLog::type:
-                {
-                    logger.processRequestLog(peer, header);
-                }
-                break;
+            case RequestLogIdsByEntity::type:
+            {
+                logger.processRequestLogIdsByEntity(peer, header);
+            }
+            break;
 
-                case RequestLogIdRangeFromTx::type:
-                {
-                    logger.processRequestTxLogInfo(peer, header);
-                }
-                break;
+            case SubscribeLog::type:
+            {
+                logger.processSubscribeLog(peer, header);
+            }
+            break;
 
-                case REQUEST_SYSTEM_INFO:
-                {
-                    processRequestSystemInfo(peer, header);
-                }
-                break;
+            case REQUEST_SYSTEM_INFO:
+            {
+                processRequestSystemInfo(peer, header);
+            }
+            break;
 
-                case SpecialCommand::type:
-                {
-                    processSpecialCommand(peer, header);
-                }
-                break;
+            case SpecialCommand::type:
+            {
+                processSpecialCommand(peer, header);
+            }
+            break;
 
 #if ADDON_TX_STATUS_REQUEST
-                /* qli: process RequestTxStatus message */
-                case REQUEST_TX_STATUS:
-                {
-                    processRequestConfirmedTx(processorNumber, peer, header);
-                }
-                break;
+            /* qli: process RequestTxStatus message */
+            case REQUEST_TX_STATUS:
+            {
+                processRequestConfirmedTx(processorNumber, peer, header);
+            }
+            break;
 #endif
 
-                }
-
-                queueProcessingNumerator += __rdtsc() - beginningTick;
-                queueProcessingDenominator++;
+            }
 
-                _InterlockedIncrement64(&numberOfProcessedRequests);
+            // Requests are processed in place, so the buffer space can only be reused after processing
+            for (unsigned int i = 0; i < numberOfDequeuedRequests; i++)
+            {
+                requestQueue.release(requestPositions[i]);
             }
+
+            queueProcessingNumerator += __rdtsc() - beginningTick;
+            queueProcessingDenominator += numberOfDequeuedRequests;
+
+            _InterlockedExchangeAdd64(&numberOfProcessedRequests, numberOfDequeuedRequests);
         }
     }
 }
@@ -1740,79 +2144,12 @@ long long QPI::QpiContextFunctionCall::numberOfPossessedShares(unsigned long lon
 {
     ACQUIRE(universeLock);
 
-    int issuanceIndex = issuer.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-iteration:
-    if (assets[issuanceIndex].varStruct.issuance.type == EMPTY)
-    {
-        RELEASE(universeLock);
-
-        return 0;
-    }
-    else
-    {
-        if (assets[issuanceIndex].varStruct.issuance.type == ISSUANCE
-            && ((*((unsigned long long*)assets[issuanceIndex].varStruct.issuance.name)) & 0xFFFFFFFFFFFFFF) == assetName
-            && assets[issuanceIndex].varStruct.issuance.publicKey == issuer)
-        {
-            int ownershipIndex = owner.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-        iteration2:
-            if (assets[ownershipIndex].varStruct.ownership.type == EMPTY)
-            {
-                RELEASE(universeLock);
-
-                return 0;
-            }
-            else
-            {
-                if (assets[ownershipIndex].varStruct.ownership.type == OWNERSHIP
-                    && assets[ownershipIndex].varStruct.ownership.issuanceIndex == issuanceIndex
-                    && assets[ownershipIndex].varStruct.ownership.publicKey == owner
-                    && assets[ownershipIndex].varStruct.ownership.managingContractIndex == ownershipManagingContractIndex)
-                {
-                    int possessionIndex = possessor.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-                iteration3:
-                    if (assets[possessionIndex].varStruct.possession.type == EMPTY)
-                    {
-                        RELEASE(universeLock);
-
-                        return 0;
-                    }
-                    else
-                    {
-                        if (assets[possessionIndex].varStruct.possession.type == POSSESSION
-                            && assets[possessionIndex].varStruct.possession.ownershipIndex == ownershipIndex
-                            && assets[possessionIndex].varStruct.possession.publicKey == possessor
-                            && assets[possessionIndex].varStruct.possession.managingContractIndex == possessionManagingContractIndex)
-                        {
-                            const long long numberOfPossessedShares = assets[possessionIndex].varStruct.possession.numberOfShares;
-
-                            RELEASE(universeLock);
-
-                            return numberOfPossessedShares;
-                        }
-                        else
-                        {
-                            possessionIndex = (possessionIndex + 1) & (ASSETS_CAPACITY - 1);
-
-                            goto iteration3;
-                        }
-                    }
-                }
-                else
-                {
-                    ownershipIndex = (ownershipIndex + 1) & (ASSETS_CAPACITY - 1);
+    const int possessionIndex = findAssetPossession(assetName, issuer, owner, possessor, ownershipManagingContractIndex, possessionManagingContractIndex);
+    const long long numberOfPossessedShares = (possessionIndex < 0) ? 0 : assets[possessionIndex].varStruct.possession.numberOfShares;
 
-                    goto iteration2;
-                }
-            }
-        }
-        else
-        {
-            issuanceIndex = (issuanceIndex + 1) & (ASSETS_CAPACITY - 1);
+    RELEASE(universeLock);
 
-            goto iteration;
-        }
-    }
+    return numberOfPossessedShares;
 }
 
 int QPI::QpiContextFunctionCall::numberOfTickTransactions() const
@@ -1891,96 +2228,29 @@ long long QPI::QpiContextProcedureCall::transferShareOwnershipAndPossession(unsi
 
     ACQUIRE(universeLock);
 
-    int issuanceIndex = issuer.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-iteration:
-    if (assets[issuanceIndex].varStruct.issuance.type == EMPTY)
-    {
-        RELEASE(universeLock);
-
-        return -numberOfShares;
-    }
-    else
-    {
-        if (assets[issuanceIndex].varStruct.issuance.type == ISSUANCE
-            && ((*((unsigned long long*)assets[issuanceIndex].varStruct.issuance.name)) & 0xFFFFFFFFFFFFFF) == assetName
-            && assets[issuanceIndex].varStruct.issuance.publicKey == issuer)
-        {
-            int ownershipIndex = owner.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-        iteration2:
-            if (assets[ownershipIndex].varStruct.ownership.type == EMPTY)
-            {
-                RELEASE(universeLock);
-
-                return -numberOfShares;
-            }
-            else
-            {
-                if (assets[ownershipIndex].varStruct.ownership.type == OWNERSHIP
-                    && assets[ownershipIndex].varStruct.ownership.issuanceIndex == issuanceIndex
-                    && assets[ownershipIndex].varStruct.ownership.publicKey == owner
-                    && assets[ownershipIndex].varStruct.ownership.managingContractIndex == _currentContractIndex) // TODO: This condition needs extra attention during refactoring!
-                {
-                    int possessionIndex = possessor.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-                iteration3:
-                    if (assets[possessionIndex].varStruct.possession.type == EMPTY)
-                    {
-                        RELEASE(universeLock);
-
-                        return -numberOfShares;
-                    }
-                    else
-                    {
-                        if (assets[possessionIndex].varStruct.possession.type == POSSESSION
-                            && assets[possessionIndex].varStruct.possession.ownershipIndex == ownershipIndex
-                            && assets[possessionIndex].varStruct.possession.publicKey == possessor)
-                        {
-                            if (assets[possessionIndex].varStruct.possession.managingContractIndex == _currentContractIndex) // TODO: This condition needs extra attention during refactoring!
-                            {
-                                if (assets[possessionIndex].varStruct.possession.numberOfShares >= numberOfShares)
-                                {
-                                    int destinationOwnershipIndex, destinationPossessionIndex;
-                                    ::transferShareOwnershipAndPossession(ownershipIndex, possessionIndex, newOwnerAndPossessor, numberOfShares, &destinationOwnershipIndex, &destinationPossessionIndex, false);
-
-                                    RELEASE(universeLock);
-
-                                    return assets[possessionIndex].varStruct.possession.numberOfShares;
-                                }
-                                else
-                                {
-                                    RELEASE(universeLock);
+    // TODO: The managing contract conditions need extra attention during refactoring!
+    const int possessionIndex = findAssetPossession(assetName, issuer, owner, possessor, _currentContractIndex, _currentContractIndex);
+    if (possessionIndex < 0)
+    {
+        RELEASE(universeLock);
 
-                                    return assets[possessionIndex].varStruct.possession.numberOfShares - numberOfShares;
-                                }
-                            }
-                            else
-                            {
-                                RELEASE(universeLock);
+        return -numberOfShares;
+    }
 
-                                return -numberOfShares;
-                            }
-                        }
-                        else
-                        {
-                            possessionIndex = (possessionIndex + 1) & (ASSETS_CAPACITY - 1);
+    if (assets[possessionIndex].varStruct.possession.numberOfShares >= numberOfShares)
+    {
+        int destinationOwnershipIndex, destinationPossessionIndex;
+        ::transferShareOwnershipAndPossession(assets[possessionIndex].varStruct.possession.ownershipIndex, possessionIndex, newOwnerAndPossessor, numberOfShares, &destinationOwnershipIndex, &destinationPossessionIndex, false);
 
-                            goto iteration3;
-                        }
-                    }
-                }
-                else
-                {
-                    ownershipIndex = (ownershipIndex + 1) & (ASSETS_CAPACITY - 1);
+        RELEASE(universeLock);
 
-                    goto iteration2;
-                }
-            }
-        }
-        else
-        {
-            issuanceIndex = (issuanceIndex + 1) & (ASSETS_CAPACITY - 1);
+        return assets[possessionIndex].varStruct.possession.numberOfShares;
+    }
+    else
+    {
+        RELEASE(universeLock);
 
-            goto iteration;
-        }
+        return assets[possessionIndex].varStruct.possession.numberOfShares - numberOfShares;
     }
 }
 
@@ -2262,37 +2532,32 @@ static void processTickTransactionSolution(const MiningSolutionTransaction* tran
                     logger.logQuTransfer(quTransfer);
                 }
 
-                for (unsigned int i = 0; i < sizeof(computorSeeds) / sizeof(computorSeeds[0]); i++)
+                if (ownComputorIndex(transaction->sourcePublicKey) >= 0)
                 {
-                    if (transaction->sourcePublicKey == computorPublicKeys[i])
-                    {
-                        ACQUIRE(solutionsLock);
+                    ACQUIRE(solutionsLock);
 
-                        unsigned int j;
-                        for (j = 0; j < system.numberOfSolutions; j++)
+                    unsigned int j;
+                    for (j = 0; j < system.numberOfSolutions; j++)
+                    {
+                        if (transaction->nonce == system.solutions[j].nonce
+                            && transaction->miningSeed == system.solutions[j].miningSeed
+                            && transaction->sourcePublicKey == system.solutions[j].computorPublicKey)
                         {
-                            if (transaction->nonce == system.solutions[j].nonce
-                                && transaction->miningSeed == system.solutions[j].miningSeed
-                                && transaction->sourcePublicKey == system.solutions[j].computorPublicKey)
-                            {
-                                solutionPublicationTicks[j] = SOLUTION_RECORDED_FLAG;
+                            solutionPublicationTicks[j] = SOLUTION_RECORDED_FLAG;
 
-                                break;
-                            }
-                        }
-                        if (j == system.numberOfSolutions
-                            && system.numberOfSolutions < MAX_NUMBER_OF_SOLUTIONS)
-                        {
-                            system.solutions[system.numberOfSolutions].computorPublicKey = transaction->sourcePublicKey;
-                            system.solutions[system.numberOfSolutions].miningSeed = transaction->miningSeed;
-                            system.solutions[system.numberOfSolutions].nonce = transaction->nonce;
-                            solutionPublicationTicks[system.numberOfSolutions++] = SOLUTION_RECORDED_FLAG;
+                            break;
                         }
-
-                        RELEASE(solutionsLock);
-
-                        break;
                     }
+                    if (j == system.numberOfSolutions
+                        && system.numberOfSolutions < MAX_NUMBER_OF_SOLUTIONS)
+                    {
+                        system.solutions[system.numberOfSolutions].computorPublicKey = transaction->sourcePublicKey;
+                        system.solutions[system.numberOfSolutions].miningSeed = transaction->miningSeed;
+                        system.solutions[system.numberOfSolutions].nonce = transaction->nonce;
+                        solutionPublicationTicks[system.numberOfSolutions++] = SOLUTION_RECORDED_FLAG;
+                    }
+
+                    RELEASE(solutionsLock);
                 }
 
                 ACQUIRE(minerScoreArrayLock);
@@ -2395,37 +2660,32 @@ static void processTickTransactionSolution(const MiningSolutionTransaction* tran
     }
     else
     {
-        for (unsigned int i = 0; i < sizeof(computorSeeds) / sizeof(computorSeeds[0]); i++)
+        if (ownComputorIndex(transaction->sourcePublicKey) >= 0)
         {
-            if (transaction->sourcePublicKey == computorPublicKeys[i])
-            {
-                ACQUIRE(solutionsLock);
+            ACQUIRE(solutionsLock);
 
-                unsigned int j;
-                for (j = 0; j < system.numberOfSolutions; j++)
+            unsigned int j;
+            for (j = 0; j < system.numberOfSolutions; j++)
+            {
+                if (transaction->nonce == system.solutions[j].nonce
+                    && transaction->miningSeed == system.solutions[j].miningSeed
+                    && transaction->sourcePublicKey == system.solutions[j].computorPublicKey)
                 {
-                    if (transaction->nonce == system.solutions[j].nonce
-                        && transaction->miningSeed == system.solutions[j].miningSeed
-                        && transaction->sourcePublicKey == system.solutions[j].computorPublicKey)
-                    {
-                        solutionPublicationTicks[j] = SOLUTION_RECORDED_FLAG;
+                    solutionPublicationTicks[j] = SOLUTION_RECORDED_FLAG;
 
-                        break;
-                    }
-                }
-                if (j == system.numberOfSolutions
-                    && system.numberOfSolutions < MAX_NUMBER_OF_SOLUTIONS)
-                {
-                    system.solutions[system.numberOfSolutions].computorPublicKey = transaction->sourcePublicKey;
-                    system.solutions[system.numberOfSolutions].miningSeed = transaction->miningSeed;
-                    system.solutions[system.numberOfSolutions].nonce = transaction->nonce;
-                    solutionPublicationTicks[system.numberOfSolutions++] = SOLUTION_RECORDED_FLAG;
+                    break;
                 }
-
-                RELEASE(solutionsLock);
-
-                break;
             }
+            if (j == system.numberOfSolutions
+                && system.numberOfSolutions < MAX_NUMBER_OF_SOLUTIONS)
+            {
+                system.solutions[system.numberOfSolutions].computorPublicKey = transaction->sourcePublicKey;
+                system.solutions[system.numberOfSolutions].miningSeed = transaction->miningSeed;
+                system.solutions[system.numberOfSolutions].nonce = transaction->nonce;
+                solutionPublicationTicks[system.numberOfSolutions++] = SOLUTION_RECORDED_FLAG;
+            }
+
+            RELEASE(solutionsLock);
         }
     }
 }
@@ -2452,14 +2712,17 @@ static void processTickTransactionOracleReplyReveal(const OracleReplyRevealTrans
     // TODO
 }
 
-static void processTickTransaction(const Transaction* transaction, const m256i& transactionDigest, unsigned long long processorNumber)
+// cachedSourceSpectrumIndex and cachedDestinationSpectrumIndex are the indices of the source and destination entities
+// found by a lookup earlier in the tick (see processTick())
+static void processTickTransaction(const Transaction* transaction, const m256i& transactionDigest, int cachedSourceSpectrumIndex, int cachedDestinationSpectrumIndex,
+    unsigned long long processorNumber)
 {
     ASSERT(nextTickData.epoch == system.epoch);
     ASSERT(transaction != nullptr);
     ASSERT(transaction->checkValidity());
     ASSERT(transaction->tick == system.tick);
 
-    const int spectrumIndex = ::spectrumIndex(transaction->sourcePublicKey);
+    const int spectrumIndex = ::spectrumIndex(transaction->sourcePublicKey, cachedSourceSpectrumIndex);
     if (spectrumIndex >= 0)
     {
         numberOfTransactions++;
@@ -2469,7 +2732,7 @@ static void processTickTransaction(const Transaction* transaction, const m256i&
 #endif
         if (decreaseEnergy(spectrumIndex, transaction->amount))
         {
-            increaseEnergy(transaction->destinationPublicKey, transaction->amount);
+            increaseEnergy(transaction->destinationPublicKey, transaction->amount, cachedDestinationSpectrumIndex);
 
             if (transaction->amount)
             {
@@ -2577,6 +2840,13 @@ static void processTickTransaction(const Transaction* transaction, const m256i&
     }
 }
 
+// Public keys and spectrum indices of the sources (element 2 * i) and destinations (element 2 * i + 1) of the
+// transactions of the tick processed by processTick(), looked up in one batch before processing the transactions.
+// The source indices are reused by the solution pre-scan and processTickTransaction(), the destination indices by
+// increaseEnergy(), which then only probes for destinations that were not found (new entities).
+static const m256i* tickTransactionPublicKeys[NUMBER_OF_TRANSACTIONS_PER_TICK * 2];
+static int tickTransactionSpectrumIndices[NUMBER_OF_TRANSACTIONS_PER_TICK * 2];
+
 static void processTick(unsigned long long processorNumber)
 {
     if (system.tick > system.initialTick)
@@ -2650,6 +2920,20 @@ static void processTick(unsigned long long processorNumber)
 #if ADDON_TX_STATUS_REQUEST
         txStatusData.tickTxIndexStart[system.tick - system.initialTick] = numberOfTransactions; // qli: part of tx_status_request add-on
 #endif
+        // look up sources and destinations of all transactions in one batch
+        for (unsigned int transactionIndex = 0; transactionIndex < NUMBER_OF_TRANSACTIONS_PER_TICK; transactionIndex++)
+        {
+            tickTransactionPublicKeys[transactionIndex * 2] = nullptr;
+            tickTransactionPublicKeys[transactionIndex * 2 + 1] = nullptr;
+            if (!isZero(nextTickData.transactionDigests[transactionIndex]) && tsCurrentTickTransactionOffsets[transactionIndex])
+            {
+                const Transaction* transaction = ts.tickTransactions(tsCurrentTickTransactionOffsets[transactionIndex]);
+                tickTransactionPublicKeys[transactionIndex * 2] = &transaction->sourcePublicKey;
+                tickTransactionPublicKeys[transactionIndex * 2 + 1] = &transaction->destinationPublicKey;
+            }
+        }
+        spectrumIndices(tickTransactionPublicKeys, NUMBER_OF_TRANSACTIONS_PER_TICK * 2, tickTransactionSpectrumIndices);
+
         // reset solution task queue
         score->resetTaskQueue();
         // pre-scan any solution tx and add them to solution task queue
@@ -2662,7 +2946,7 @@ static void processTick(unsigned long long processorNumber)
                     Transaction* transaction = ts.tickTransactions(tsCurrentTickTransactionOffsets[transactionIndex]);
                     ASSERT(transaction->checkValidity());
                     ASSERT(transaction->tick == system.tick);
-                    const int spectrumIndex = ::spectrumIndex(transaction->sourcePublicKey);
+                    const int spectrumIndex = tickTransactionSpectrumIndices[transactionIndex * 2];
                     if (spectrumIndex >= 0)
                     {
                         if ((transaction->destinationPublicKey == arbitratorPublicKey && !transaction->amount && !transaction->inputType) ||
@@ -2709,7 +2993,8 @@ static void processTick(unsigned long long processorNumber)
                 {
                     Transaction* transaction = ts.tickTransactions(tsCurrentTickTransactionOffsets[transactionIndex]);
                     logger.registerNewTx(transaction->tick, transactionIndex);
-                    processTickTransaction(transaction, nextTickData.transactionDigests[transactionIndex], processorNumber);
+                    processTickTransaction(transaction, nextTickData.transactionDigests[transactionIndex], tickTransactionSpectrumIndices[transactionIndex * 2],
+                        tickTransactionSpectrumIndices[transactionIndex * 2 + 1], processorNumber);
                 }
                 else
                 {
@@ -2730,37 +3015,12 @@ static void processTick(unsigned long long processorNumber)
         _mm_pause();
     }
 
-    unsigned int digestIndex;
-    ACQUIRE(spectrumLock);
-    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
-    {
-        if (spectrum[digestIndex].latestIncomingTransferTick == system.tick || spectrum[digestIndex].latestOutgoingTransferTick == system.tick)
-        {
-            KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
-            spectrumChangeFlags[digestIndex >> 6] |= (1ULL << (digestIndex & 63));
-        }
-    }
-    unsigned int previousLevelBeginning = 0;
-    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-    while (numberOfLeafs > 1)
-    {
-        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-        {
-            if (spectrumChangeFlags[i >> 6] & (3ULL << (i & 63)))
-            {
-                KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex]);
-                spectrumChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
-                spectrumChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
-            }
-            digestIndex++;
-        }
-        previousLevelBeginning += numberOfLeafs;
-        numberOfLeafs >>= 1;
-    }
-    spectrumChangeFlags[0] = 0;
+    // entities changed in this tick have been recorded by increaseEnergy() / decreaseEnergy()
+    beginSpectrumChange();
+    updateSpectrumDigests();
 
     etalonTick.saltedSpectrumDigest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
-    RELEASE(spectrumLock);
+    endSpectrumChange();
 
     getUniverseDigest(etalonTick.saltedUniverseDigest);
     getComputerDigest(etalonTick.saltedComputerDigest);
@@ -2794,11 +3054,14 @@ static void processTick(unsigned long long processorNumber)
 
                     unsigned int j = 0;
 
-                    unsigned int numberOfEntityPendingTransactionIndices;
-                    for (numberOfEntityPendingTransactionIndices = 0; numberOfEntityPendingTransactionIndices < NUMBER_OF_COMPUTORS * MAX_NUMBER_OF_PENDING_TRANSACTIONS_PER_COMPUTOR; numberOfEntityPendingTransactionIndices++)
+                    // collect candidates (slots of transactions scheduled for the tick) from the tick index
+                    unsigned int numberOfEntityPendingTransactionIndices = 0;
+                    ACQUIRE(computorPendingTransactionsLock);
+                    for (unsigned int slot = computorPendingTransactionTickIndex.first(system.tick + TICK_TRANSACTIONS_PUBLICATION_OFFSET); slot != PendingTransactionTickIndex::NO_SLOT; slot = computorPendingTransactionTickIndex.next(slot))
                     {
-                        entityPendingTransactionIndices[numberOfEntityPendingTransactionIndices] = numberOfEntityPendingTransactionIndices;
+                        entityPendingTransactionIndices[numberOfEntityPendingTransactionIndices++] = slot;
                     }
+                    RELEASE(computorPendingTransactionsLock);
                     while (j < NUMBER_OF_TRANSACTIONS_PER_TICK && numberOfEntityPendingTransactionIndices)
                     {
                         const unsigned int index = random(numberOfEntityPendingTransactionIndices);
@@ -2826,10 +3089,13 @@ static void processTick(unsigned long long processorNumber)
                         entityPendingTransactionIndices[index] = entityPendingTransactionIndices[--numberOfEntityPendingTransactionIndices];
                     }
 
-                    for (numberOfEntityPendingTransactionIndices = 0; numberOfEntityPendingTransactionIndices < SPECTRUM_CAPACITY; numberOfEntityPendingTransactionIndices++)
+                    numberOfEntityPendingTransactionIndices = 0;
+                    ACQUIRE(entityPendingTransactionsLock);
+                    for (unsigned int slot = entityPendingTransactionTickIndex.first(system.tick + TICK_TRANSACTIONS_PUBLICATION_OFFSET); slot != PendingTransactionTickIndex::NO_SLOT; slot = entityPendingTransactionTickIndex.next(slot))
                     {
-                        entityPendingTransactionIndices[numberOfEntityPendingTransactionIndices] = numberOfEntityPendingTransactionIndices;
+                        entityPendingTransactionIndices[numberOfEntityPendingTransactionIndices++] = slot;
                     }
+                    RELEASE(entityPendingTransactionsLock);
                     while (j < NUMBER_OF_TRANSACTIONS_PER_TICK && numberOfEntityPendingTransactionIndices)
                     {
                         const unsigned int index = random(numberOfEntityPendingTransactionIndices);
@@ -2869,7 +3135,19 @@ static void processTick(unsigned long long processorNumber)
                     broadcastedFutureTickData.tickData.computorIndex ^= BroadcastFutureTickData::type;
                     sign(computorSubseeds[ownComputorIndicesMapping[i]].m256i_u8, computorPublicKeys[ownComputorIndicesMapping[i]].m256i_u8, digest, broadcastedFutureTickData.tickData.signature);
 
-                    enqueueResponse(NULL, sizeof(broadcastedFutureTickData), BroadcastFutureTickData::type, 0, &broadcastedFutureTickData);
+#if BROADCAST_COMPACT_TICK_DATA
+                    ACQUIRE(tickDataReconstructionLock);
+                    const unsigned int compactTickDataSize = encodeCompactTickData(broadcastedFutureTickData.tickData, (CompactTickData*)compactTickDataBuffer);
+                    if (compactTickDataSize)
+                    {
+                        enqueueResponse(NULL, compactTickDataSize, BroadcastCompactFutureTickData::type, 0, compactTickDataBuffer);
+                    }
+                    RELEASE(tickDataReconstructionLock);
+                    if (!compactTickDataSize)
+#endif
+                    {
+                        enqueueResponse(NULL, sizeof(broadcastedFutureTickData), BroadcastFutureTickData::type, 0, &broadcastedFutureTickData);
+                    }
                 }
 
                 system.latestLedTick = system.tick;
@@ -2981,11 +3259,32 @@ static void processTick(unsigned long long processorNumber)
     {
         addDebugMessage(L"BUG DETECTED: Spectrum info of continuous updating is inconsistent with counting from scratch!");
     }
+    // Count from the entities instead of spectrumBalances with countEntityCategoryPopulations(), so the balance column
+    // is checked as well
+    unsigned int populations[entityCategoryCount];
+    setMem(populations, sizeof(populations), 0);
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
+    {
+        const long long balance = spectrum[i].incomingAmount - spectrum[i].outgoingAmount;
+        ASSERT(spectrumBalances[i] == balance);
+        if (balance)
+        {
+            populations[entityCategory(balance)]++;
+        }
+    }
+    for (unsigned int i = 0; i < entityCategoryCount; i++)
+    {
+        if (populations[i] != entityCategoryPopulations[i])
+        {
+            addDebugMessage(L"BUG DETECTED: Entity category populations of continuous updating are inconsistent with counting from scratch!");
+            break;
+        }
+    }
 #endif
 
-    // Update entity category populations and dust thresholds each 8 ticks
+    // Update dust thresholds each 8 ticks (entity category populations are updated continuously)
     if ((system.tick & 7) == 0)
-        updateAndAnalzeEntityCategoryPopulations();
+        analyzeEntityCategoryPopulations();
 }
 
 static void beginEpoch()
@@ -3000,6 +3299,7 @@ static void beginEpoch()
         broadcastedComputors.computors.publicKeys[i].setRandomValue();
     }
     bs->SetMem(&broadcastedComputors.computors.signature, sizeof(broadcastedComputors.computors.signature), 0);
+    computorPublicKeyIndex.build(broadcastedComputors.computors.publicKeys, NUMBER_OF_COMPUTORS);
 
 #ifndef NDEBUG
     ts.checkStateConsistencyWithAssert();
@@ -3021,6 +3321,8 @@ static void beginEpoch()
     {
         ((Transaction*)&entityPendingTransactions[i * MAX_TRANSACTION_SIZE])->tick = 0;
     }
+    computorPendingTransactionTickIndex.reset(system.initialTick);
+    entityPendingTransactionTickIndex.reset(system.initialTick);
 
     bs->SetMem(solutionPublicationTicks, sizeof(solutionPublicationTicks), 0);
     bs->SetMem(faultyComputorFlags, sizeof(faultyComputorFlags), 0);
@@ -3324,11 +3626,11 @@ static void endEpoch()
 
     // Reorganize spectrum hash map (also updates spectrumInfo)
     {
-        ACQUIRE(spectrumLock);
+        beginSpectrumChange();
 
         reorganizeSpectrum();
 
-        RELEASE(spectrumLock);
+        endSpectrumChange();
     }
 
     assetsEndEpoch();
@@ -3664,6 +3966,7 @@ static bool loadAllNodeStates()
     copyMem((void*)solutionPublicationTicks, nodeStateBuffer.solutionPublicationTicks, sizeof(solutionPublicationTicks));
     copyMem((void*)faultyComputorFlags, nodeStateBuffer.faultyComputorFlags, sizeof(faultyComputorFlags));
     copyMem((void*)&broadcastedComputors, &nodeStateBuffer.broadcastedComputors, sizeof(broadcastedComputors));
+    computorPublicKeyIndex.build(broadcastedComputors.computors.publicKeys, NUMBER_OF_COMPUTORS);
     copyMem(&resourceTestingDigest, &nodeStateBuffer.resourceTestingDigest, sizeof(resourceTestingDigest));
     numberOfMiners = nodeStateBuffer.numberOfMiners;
     initialRandomSeedFromPersistingState = nodeStateBuffer.currentRandomSeed;
@@ -3674,15 +3977,11 @@ static bool loadAllNodeStates()
     // update own computor indices
     for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
     {
-        for (unsigned int j = 0; j < sizeof(computorSeeds) / sizeof(computorSeeds[0]); j++)
+        const int ownComputorIndex = ::ownComputorIndex(broadcastedComputors.computors.publicKeys[i]);
+        if (ownComputorIndex >= 0)
         {
-            if (broadcastedComputors.computors.publicKeys[i] == computorPublicKeys[j])
-            {
-                ownComputorIndices[numberOfOwnComputorIndices] = i;
-                ownComputorIndicesMapping[numberOfOwnComputorIndices++] = j;
-
-                break;
-            }
+            ownComputorIndices[numberOfOwnComputorIndices] = i;
+            ownComputorIndicesMapping[numberOfOwnComputorIndices++] = ownComputorIndex;
         }
     }
 
@@ -3695,7 +3994,7 @@ static bool loadAllNodeStates()
     }
 
     setMem(assetChangeFlags, sizeof(assetChangeFlags), 0);
-    setMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0);
+    clearSpectrumChangeFlags();
     CHAR16 SPECTRUM_DIGEST_FILE_NAME[] = L"snapshotSpectrumDigest";
     loadedSize = load(SPECTRUM_DIGEST_FILE_NAME, spectrumDigestsSizeInByte, (unsigned char*)spectrumDigests, directory);
     logToConsole(L"Loading spectrum digests");
@@ -4076,88 +4375,80 @@ static void tickProcessor(void*)
                         }
                         if (numberOfKnownNextTickTransactions != numberOfNextTickTransactions)
                         {
-                            for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS * MAX_NUMBER_OF_PENDING_TRANSACTIONS_PER_COMPUTOR; i++)
+                            ACQUIRE(computorPendingTransactionsLock);
+                            for (unsigned int i = computorPendingTransactionTickIndex.first(nextTick); i != PendingTransactionTickIndex::NO_SLOT; i = computorPendingTransactionTickIndex.next(i))
                             {
                                 Transaction* pendingTransaction = (Transaction*)&computorPendingTransactions[i * MAX_TRANSACTION_SIZE];
-                                if (pendingTransaction->tick == nextTick)
+                                ASSERT(pendingTransaction->tick == nextTick);
+                                ASSERT(pendingTransaction->checkValidity());
+                                auto* tsPendingTransactionOffsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(pendingTransaction->tick);
+                                for (unsigned int j = 0; j < NUMBER_OF_TRANSACTIONS_PER_TICK; j++)
                                 {
-                                    ACQUIRE(computorPendingTransactionsLock);
-
-                                    ASSERT(pendingTransaction->checkValidity());
-                                    auto* tsPendingTransactionOffsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(pendingTransaction->tick);
-                                    for (unsigned int j = 0; j < NUMBER_OF_TRANSACTIONS_PER_TICK; j++)
+                                    if (unknownTransactions[j >> 6] & (1ULL << (j & 63)))
                                     {
-                                        if (unknownTransactions[j >> 6] & (1ULL << (j & 63)))
+                                        if (&computorPendingTransactionDigests[i * 32ULL] == nextTickData.transactionDigests[j])
                                         {
-                                            if (&computorPendingTransactionDigests[i * 32ULL] == nextTickData.transactionDigests[j])
-                                            {
-                                                unsigned char transactionBuffer[MAX_TRANSACTION_SIZE];
-                                                const unsigned int transactionSize = pendingTransaction->totalSize();
-                                                bs->CopyMem(transactionBuffer, (void*)pendingTransaction, transactionSize);
+                                            unsigned char transactionBuffer[MAX_TRANSACTION_SIZE];
+                                            const unsigned int transactionSize = pendingTransaction->totalSize();
+                                            bs->CopyMem(transactionBuffer, (void*)pendingTransaction, transactionSize);
 
-                                                pendingTransaction = (Transaction*)transactionBuffer;
-                                                ts.tickTransactions.acquireLock();
-                                                if (!tsPendingTransactionOffsets[j])
+                                            pendingTransaction = (Transaction*)transactionBuffer;
+                                            ts.tickTransactions.acquireLock();
+                                            if (!tsPendingTransactionOffsets[j])
+                                            {
+                                                if (ts.nextTickTransactionOffset + transactionSize <= ts.tickTransactions.storageSpaceCurrentEpoch)
                                                 {
-                                                    if (ts.nextTickTransactionOffset + transactionSize <= ts.tickTransactions.storageSpaceCurrentEpoch)
-                                                    {
-                                                        tsPendingTransactionOffsets[j] = ts.nextTickTransactionOffset;
-                                                        bs->CopyMem(ts.tickTransactions(ts.nextTickTransactionOffset), pendingTransaction, transactionSize);
-                                                        ts.nextTickTransactionOffset += transactionSize;
-                                                    }
+                                                    tsPendingTransactionOffsets[j] = ts.nextTickTransactionOffset;
+                                                    bs->CopyMem(ts.tickTransactions(ts.nextTickTransactionOffset), pendingTransaction, transactionSize);
+                                                    ts.nextTickTransactionOffset += transactionSize;
                                                 }
-                                                ts.tickTransactions.releaseLock();
-
-                                                numberOfKnownNextTickTransactions++;
-                                                unknownTransactions[j >> 6] &= ~(1ULL << (j & 63));
                                             }
+                                            ts.tickTransactions.releaseLock();
+
+                                            numberOfKnownNextTickTransactions++;
+                                            unknownTransactions[j >> 6] &= ~(1ULL << (j & 63));
                                         }
                                     }
-
-                                    RELEASE(computorPendingTransactionsLock);
                                 }
                             }
-                            for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
+                            RELEASE(computorPendingTransactionsLock);
+                            ACQUIRE(entityPendingTransactionsLock);
+                            for (unsigned int i = entityPendingTransactionTickIndex.first(nextTick); i != PendingTransactionTickIndex::NO_SLOT; i = entityPendingTransactionTickIndex.next(i))
                             {
                                 Transaction* pendingTransaction = (Transaction*)&entityPendingTransactions[i * MAX_TRANSACTION_SIZE];
-                                if (pendingTransaction->tick == nextTick)
+                                ASSERT(pendingTransaction->tick == nextTick);
+                                ASSERT(pendingTransaction->checkValidity());
+                                auto* tsPendingTransactionOffsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(pendingTransaction->tick);
+                                for (unsigned int j = 0; j < NUMBER_OF_TRANSACTIONS_PER_TICK; j++)
                                 {
-                                    ACQUIRE(entityPendingTransactionsLock);
-
-                                    ASSERT(pendingTransaction->checkValidity());
-                                    auto* tsPendingTransactionOffsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(pendingTransaction->tick);
-                                    for (unsigned int j = 0; j < NUMBER_OF_TRANSACTIONS_PER_TICK; j++)
+                                    if (unknownTransactions[j >> 6] & (1ULL << (j & 63)))
                                     {
-                                        if (unknownTransactions[j >> 6] & (1ULL << (j & 63)))
+                                        if (&entityPendingTransactionDigests[i * 32ULL] == nextTickData.transactionDigests[j])
                                         {
-                                            if (&entityPendingTransactionDigests[i * 32ULL] == nextTickData.transactionDigests[j])
-                                            {
-                                                unsigned char transactionBuffer[MAX_TRANSACTION_SIZE];
-                                                const unsigned int transactionSize = pendingTransaction->totalSize();
-                                                bs->CopyMem(transactionBuffer, (void*)pendingTransaction, transactionSize);
+                                            unsigned char transactionBuffer[MAX_TRANSACTION_SIZE];
+                                            const unsigned int transactionSize = pendingTransaction->totalSize();
+                                            bs->CopyMem(transactionBuffer, (void*)pendingTransaction, transactionSize);
 
-                                                pendingTransaction = (Transaction*)transactionBuffer;
-                                                ts.tickTransactions.acquireLock();
-                                                if (!tsPendingTransactionOffsets[j])
+                                            pendingTransaction = (Transaction*)transactionBuffer;
+                                            ts.tickTransactions.acquireLock();
+                                            if (!tsPendingTransactionOffsets[j])
+                                            {
+                                                if (ts.nextTickTransactionOffset + transactionSize <= ts.tickTransactions.storageSpaceCurrentEpoch)
                                                 {
-                                                    if (ts.nextTickTransactionOffset + transactionSize <= ts.tickTransactions.storageSpaceCurrentEpoch)
-                                                    {
-                                                        tsPendingTransactionOffsets[j] = ts.nextTickTransactionOffset;
-                                                        bs->CopyMem(ts.tickTransactions(ts.nextTickTransactionOffset), pendingTransaction, transactionSize);
-                                                        ts.nextTickTransactionOffset += transactionSize;
-                                                    }
+                                                    tsPendingTransactionOffsets[j] = ts.nextTickTransactionOffset;
+                                                    bs->CopyMem(ts.tickTransactions(ts.nextTickTransactionOffset), pendingTransaction, transactionSize);
+                                                    ts.nextTickTransactionOffset += transactionSize;
                                                 }
-                                                ts.tickTransactions.releaseLock();
-
-                                                numberOfKnownNextTickTransactions++;
-                                                unknownTransactions[j >> 6] &= ~(1ULL << (j & 63));
                                             }
+                                            ts.tickTransactions.releaseLock();
+
+                                            numberOfKnownNextTickTransactions++;
+                                            unknownTransactions[j >> 6] &= ~(1ULL << (j & 63));
                                         }
                                     }
-
-                                    RELEASE(entityPendingTransactionsLock);
                                 }
                             }
+                            RELEASE(entityPendingTransactionsLock);
 
                             for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
                             {
@@ -4547,6 +4838,8 @@ static void tickProcessor(void*)
                                         tickTicks[i] = tickTicks[i + 1];
                                     }
                                     tickTicks[sizeof(tickTicks) / sizeof(tickTicks[0]) - 1] = __rdtsc();
+
+                                    updateSpectrumLockStatistics();
                                 }
                             }
                         }
@@ -4682,6 +4975,7 @@ static bool initialize()
     for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
     {
         contractStates[contractIndex] = NULL;
+        contractStateLeafCopies[contractIndex] = NULL;
     }
     bs->SetMem(contractSystemProcedures, sizeof(contractSystemProcedures), 0);
     bs->SetMem(contractSystemProcedureLocalsSizes, sizeof(contractSystemProcedureLocalsSizes), 0);
@@ -4709,6 +5003,7 @@ static bool initialize()
         getPrivateKey(computorSubseeds[i].m256i_u8, computorPrivateKeys[i].m256i_u8);
         getPublicKey(computorPrivateKeys[i].m256i_u8, computorPublicKeys[i].m256i_u8);
     }
+    ownComputorPublicKeyIndex.build(computorPublicKeys, sizeof(computorSeeds) / sizeof(computorSeeds[0]));
 
     getPublicKeyFromIdentity((const unsigned char*)ARBITRATOR, (unsigned char*)&arbitratorPublicKey);
 
@@ -4759,7 +5054,12 @@ static bool initialize()
 
             return false;
         }
-        bs->SetMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0);
+        if (!entityPendingTransactionTickIndex.init(SPECTRUM_CAPACITY)
+            || !computorPendingTransactionTickIndex.init(NUMBER_OF_COMPUTORS * MAX_NUMBER_OF_PENDING_TRANSACTIONS_PER_COMPUTOR))
+        {
+            return false;
+        }
+        clearSpectrumChangeFlags();
 
         if (!initSpectrum())
             return false;
@@ -4780,6 +5080,22 @@ static bool initialize()
 
                 return false;
             }
+
+            // The leaf copy for incremental digests costs as much memory as the full leaves of the state, which
+            // nearly doubles the memory of each large contract state (for example, 64 MB more for a 64 MB state).
+            // It is only allocated for states of at least CONTRACT_STATE_DIGEST_LEAVES_PER_PART full leaves (512 KB),
+            // smaller states are hashed completely in one part of the digest job.
+            const unsigned int numberOfFullLeaves = KangarooTwelveNumberOfFullLeaves((unsigned int)size);
+            if (numberOfFullLeaves >= CONTRACT_STATE_DIGEST_LEAVES_PER_PART)
+            {
+                const unsigned long long leafCopySize = numberOfFullLeaves * (unsigned long long)K12_chunkSize;
+                if (status = bs->AllocatePool(EfiRuntimeServicesData, leafCopySize, (void**)&contractStateLeafCopies[contractIndex]))
+                {
+                    logStatusAndMemInfoToConsole(L"EFI_BOOT_SERVICES.AllocatePool() fails", status, __LINE__, leafCopySize);
+
+                    return false;
+                }
+            }
         }
         if ((status = bs->AllocatePool(EfiRuntimeServicesData, MAX_NUMBER_OF_CONTRACTS / 8, (void**)&contractStateChangeFlags)))
         {
@@ -4857,23 +5173,7 @@ static bool initialize()
             {
                 const unsigned long long beginningTick = __rdtsc();
 
-                unsigned int digestIndex;
-                for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
-                {
-                    KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
-                }
-                unsigned int previousLevelBeginning = 0;
-                unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-                while (numberOfLeafs > 1)
-                {
-                    for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-                    {
-                        KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex++]);
-                    }
-
-                    previousLevelBeginning += numberOfLeafs;
-                    numberOfLeafs >>= 1;
-                }
+                rebuildSpectrumDigests();
 
                 setNumber(message, SPECTRUM_CAPACITY * sizeof(::Entity), TRUE);
                 appendText(message, L" bytes of the spectrum data are hashed (");
@@ -4945,25 +5245,20 @@ static bool initialize()
     score->loadScoreCache(system.epoch);
 
     logToConsole(L"Allocating buffers ...");
-    if ((status = bs->AllocatePool(EfiRuntimeServicesData, 536870912, (void**)&dejavu0))
-        || (status = bs->AllocatePool(EfiRuntimeServicesData, 536870912, (void**)&dejavu1)))
+    if (!dejavuFilter.init())
     {
-        logStatusAndMemInfoToConsole(L"EFI_BOOT_SERVICES.AllocatePool() fails", status, __LINE__, 536870912);
-
+        logToConsole(L"Failed to allocate dejavu filter!");
         return false;
     }
-    bs->SetMem((void*)dejavu0, 536870912, 0);
-    bs->SetMem((void*)dejavu1, 536870912, 0);
 
-    if (status = bs->AllocatePool(EfiRuntimeServicesData, REQUEST_QUEUE_BUFFER_SIZE, (void**)&requestQueueBuffer))
+    if (!requestQueue.init())
     {
-        logStatusAndMemInfoToConsole(L"EFI_BOOT_SERVICES.AllocatePool() fails", status, __LINE__, REQUEST_QUEUE_BUFFER_SIZE);
+        logToConsole(L"Failed to allocate request queue buffer!");
         return false;
     }
-    else if (status = bs->AllocatePool(EfiRuntimeServicesData, RESPONSE_QUEUE_BUFFER_SIZE, (void**)&responseQueueBuffer))
+    else if (!responseQueue.init())
     {
-        logStatusAndMemInfoToConsole(L"EFI_BOOT_SERVICES.AllocatePool() fails", status, __LINE__, RESPONSE_QUEUE_BUFFER_SIZE);
-
+        logToConsole(L"Failed to allocate response queue buffer!");
         return false;
     }
 
@@ -4983,9 +5278,9 @@ static bool initialize()
 
             return false;
         }
-        else if (status = bs->AllocatePool(EfiRuntimeServicesData, BUFFER_SIZE, (void**)&peers[i].dataToTransmit))
+        else if (!peers[i].sendQueue.init())
         {
-            logStatusAndMemInfoToConsole(L"EFI_BOOT_SERVICES.AllocatePool() fails", status, __LINE__, BUFFER_SIZE);
+            logStatusAndMemInfoToConsole(L"EFI_BOOT_SERVICES.AllocatePool() fails", EFI_OUT_OF_RESOURCES, __LINE__, BUFFER_SIZE);
 
             return false;
         }
@@ -5069,8 +5364,15 @@ static void deinitialize()
         {
             bs->FreePool(contractStates[contractIndex]);
         }
+        if (contractStateLeafCopies[contractIndex])
+        {
+            bs->FreePool(contractStateLeafCopies[contractIndex]);
+        }
     }
 
+    computorPendingTransactionTickIndex.deinit();
+    entityPendingTransactionTickIndex.deinit();
+
     if (computorPendingTransactionDigests)
     {
         bs->FreePool(computorPendingTransactionDigests);
@@ -5098,31 +5400,10 @@ static void deinitialize()
         bs->FreePool(minerSolutionFlags);
     }
 
-    if (dejavu0)
-    {
-        bs->FreePool((void*)dejavu0);
-    }
-    if (dejavu1)
-    {
-        bs->FreePool((void*)dejavu1);
-    }
-
-    if (requestQueueBuffer)
-    {
-        bs->FreePool(requestQueueBuffer);
-    }
-    if (responseQueueBuffer)
-    {
-        bs->FreePool(responseQueueBuffer);
-    }
+    dejavuFilter.deinit();
 
-    for (unsigned int processorIndex = 0; processorIndex < MAX_NUMBER_OF_PROCESSORS; processorIndex++)
-    {
-        if (processors[processorIndex].buffer)
-        {
-            bs->FreePool(processors[processorIndex].buffer);
-        }
-    }
+    requestQueue.deinit();
+    responseQueue.deinit();
 
     for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
     {
@@ -5134,9 +5415,9 @@ static void deinitialize()
         {
             bs->FreePool(peers[i].transmitData.FragmentTable[0].FragmentBuffer);
         }
-        if (peers[i].dataToTransmit)
+        if (peers[i].sendQueue.isInitialized())
         {
-            bs->FreePool(peers[i].dataToTransmit);
+            peers[i].sendQueue.deinit();
 
             bs->CloseEvent(peers[i].connectAcceptToken.CompletionToken.Event);
             bs->CloseEvent(peers[i].receiveToken.CompletionToken.Event);
@@ -5145,6 +5426,28 @@ static void deinitialize()
     }
 }
 
+// Append number with two decimal places, given as value times 100
+static void appendHundredths(CHAR16* text, unsigned long long valueTimes100)
+{
+    appendNumber(text, valueTimes100 / 100, TRUE);
+    appendText(text, L".");
+    appendNumber(text, (valueTimes100 / 10) % 10, FALSE);
+    appendNumber(text, valueTimes100 % 10, FALSE);
+}
+
+template <unsigned int capacity>
+static void appendProbeStatistics(CHAR16* text, const ProbeTags<capacity>& probeTags)
+{
+    appendNumber(text, probeTags.probeCount(), TRUE);
+    appendText(text, L" updates, ");
+    appendHundredths(text, probeTags.averageProbeLengthTimes100());
+    appendText(text, L" slots and ");
+    appendHundredths(text, probeTags.averageKeyComparisonsTimes100());
+    appendText(text, L" key compares per update (max ");
+    appendNumber(text, probeTags.maxProbeLengthSlots(), TRUE);
+    appendText(text, L" slots)");
+}
+
 static void logInfo()
 {
     unsigned long long numberOfWaitingBytes = 0;
@@ -5153,7 +5456,7 @@ static void logInfo()
     {
         if (peers[i].tcp4Protocol)
         {
-            numberOfWaitingBytes += peers[i].dataToTransmitSize;
+            numberOfWaitingBytes += peers[i].sendQueue.size();
         }
     }
 
@@ -5254,21 +5557,7 @@ static void logInfo()
     }
     logToConsole(message);
 
-    unsigned int numberOfPendingTransactions = 0;
-    for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS * MAX_NUMBER_OF_PENDING_TRANSACTIONS_PER_COMPUTOR; i++)
-    {
-        if (((Transaction*)&computorPendingTransactions[i * MAX_TRANSACTION_SIZE])->tick > system.tick)
-        {
-            numberOfPendingTransactions++;
-        }
-    }
-    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
-    {
-        if (((Transaction*)&entityPendingTransactions[i * MAX_TRANSACTION_SIZE])->tick > system.tick)
-        {
-            numberOfPendingTransactions++;
-        }
-    }
+    const unsigned int numberOfPendingTransactions = computorPendingTransactionTickIndex.countAfter(system.tick) + entityPendingTransactionTickIndex.countAfter(system.tick);
     if (nextTickTransactionsSemaphore)
     {
         setText(message, L"?");
@@ -5318,10 +5607,10 @@ static void logInfo()
     appendText(message, L" pending transactions.");
     logToConsole(message);
 
-    unsigned int filledRequestQueueBufferSize = (requestQueueBufferHead >= requestQueueBufferTail) ? (requestQueueBufferHead - requestQueueBufferTail) : (REQUEST_QUEUE_BUFFER_SIZE - (requestQueueBufferTail - requestQueueBufferHead));
-    unsigned int filledResponseQueueBufferSize = (responseQueueBufferHead >= responseQueueBufferTail) ? (responseQueueBufferHead - responseQueueBufferTail) : (RESPONSE_QUEUE_BUFFER_SIZE - (responseQueueBufferTail - responseQueueBufferHead));
-    unsigned int filledRequestQueueLength = (requestQueueElementHead >= requestQueueElementTail) ? (requestQueueElementHead - requestQueueElementTail) : (REQUEST_QUEUE_LENGTH - (requestQueueElementTail - requestQueueElementHead));
-    unsigned int filledResponseQueueLength = (responseQueueElementHead >= responseQueueElementTail) ? (responseQueueElementHead - responseQueueElementTail) : (RESPONSE_QUEUE_LENGTH - (responseQueueElementTail - responseQueueElementHead));
+    unsigned int filledRequestQueueBufferSize = requestQueue.filledBufferSize();
+    unsigned long long filledResponseQueueBufferSize = responseQueue.filledBufferSize();
+    unsigned int filledRequestQueueLength = requestQueue.waitingLength();
+    unsigned int filledResponseQueueLength = responseQueue.waitingLength();
     setNumber(message, filledRequestQueueBufferSize, TRUE);
     appendText(message, L" (");
     appendNumber(message, filledRequestQueueLength, TRUE);
@@ -5344,7 +5633,182 @@ static void logInfo()
     appendNumber(message, solutionTotalExecutionTicks * 1000 / frequency, TRUE);
     appendText(message, L" ms | Spectrum reorg time = ");
     appendNumber(message, spectrumReorgTotalExecutionTicks * 1000 / frequency, TRUE);
-    appendText(message, L" ms.");
+    appendText(message, L" ms (");
+    appendNumber(message, spectrumReorgPrepareExecutionTicks * 1000 / frequency, TRUE);
+    appendText(message, L" ms preparing + ");
+    appendNumber(message, spectrumReorgRelocateExecutionTicks * 1000 / frequency, TRUE);
+    appendText(message, L" ms relocating + ");
+    appendNumber(message, spectrumReorgDigestExecutionTicks * 1000 / frequency, TRUE);
+    appendText(message, L" ms hashing).");
+    logToConsole(message);
+
+    setText(message, L"Universe reorg time = ");
+    appendNumber(message, (universeReorgClearExecutionTicks + universeReorgCompactExecutionTicks + universeReorgCommitExecutionTicks + universeReorgIndexExecutionTicks) * 1000 / frequency, TRUE);
+    appendText(message, L" ms (");
+    appendNumber(message, universeReorgClearExecutionTicks * 1000 / frequency, TRUE);
+    appendText(message, L" ms clearing + ");
+    appendNumber(message, universeReorgCompactExecutionTicks * 1000 / frequency, TRUE);
+    appendText(message, L" ms compacting + ");
+    appendNumber(message, universeReorgCommitExecutionTicks * 1000 / frequency, TRUE);
+    appendText(message, L" ms committing + ");
+    appendNumber(message, universeReorgIndexExecutionTicks * 1000 / frequency, TRUE);
+    appendText(message, L" ms indexing), ");
+    appendNumber(message, numberOfRecordsChangedByUniverseReorg, TRUE);
+    appendText(message, L" records changed.");
+    logToConsole(message);
+
+    setText(message, L"Log subscriptions: ");
+    appendNumber(message, logger.numberOfLogSubscriptions(), TRUE);
+    appendText(message, L" peers | ");
+    appendNumber(message, logger.numberOfLogsPushedToSubscribers(), TRUE);
+    appendText(message, L" logs pushed.");
+    logToConsole(message);
+
+    setText(message, L"Compact tick data: ");
+    appendNumber(message, numberOfReceivedCompactTickData, TRUE);
+    appendText(message, L" received | ");
+    appendNumber(message, numberOfTickDataRebuiltFromPendingTransactions, TRUE);
+    appendText(message, L" rebuilt from pending transactions | ");
+    appendNumber(message, numberOfTickDataRebuiltWithRequestedDigests, TRUE);
+    appendText(message, L" rebuilt with ");
+    appendNumber(message, numberOfRequestedTransactionDigests, TRUE);
+    appendText(message, L" requested digests | ");
+    appendNumber(message, numberOfFailedTickDataReconstructions, TRUE);
+    appendText(message, L" failed | ");
+    appendNumber(message, numberOfStalledTickDataReconstructions, TRUE);
+    appendText(message, L" stalled.");
+    logToConsole(message);
+
+    setText(message, L"Dejavu filter: ");
+    appendNumber(message, dejavuFilter.rememberedCount(), TRUE);
+    appendText(message, L" message IDs remembered (");
+    appendNumber(message, dejavuFilter.fillLevelPercent(), TRUE);
+    appendText(message, L"% filled) | False positive rate = ");
+    appendNumber(message, dejavuFilter.falsePositiveRatePpm(), TRUE);
+    appendText(message, L" ppm | ");
+    appendNumber(message, dejavuFilter.rotationCount(), TRUE);
+    appendText(message, L" generations started.");
+    logToConsole(message);
+
+    setText(message, L"Admission control (consensus|transactions|queries): ");
+    for (unsigned int admissionClass = 0; admissionClass < NUMBER_OF_ADMISSION_CLASSES; admissionClass++)
+    {
+        if (admissionClass)
+        {
+            appendText(message, L"|");
+        }
+        appendNumber(message, numberOfRateLimitedRequests[admissionClass], TRUE);
+    }
+    appendText(message, L" rate limited | ");
+    for (unsigned int admissionClass = 0; admissionClass < NUMBER_OF_ADMISSION_CLASSES; admissionClass++)
+    {
+        if (admissionClass)
+        {
+            appendText(message, L"|");
+        }
+        appendNumber(message, numberOfRequestsRejectedForReservedCapacity[admissionClass], TRUE);
+    }
+    appendText(message, L" rejected to keep queue capacity for consensus.");
+    logToConsole(message);
+
+    setText(message, L"Request queue: ");
+    appendNumber(message, requestQueue.dequeuedCount(), TRUE);
+    appendText(message, L" dequeued | ");
+    appendNumber(message, requestQueue.failedClaimCount(), TRUE);
+    appendText(message, L" failed claims | ");
+    appendNumber(message, requestQueue.contendedEnqueueCount(), TRUE);
+    appendText(message, L" contended enqueues.");
+    logToConsole(message);
+
+    setText(message, L"Response queue: ");
+    appendNumber(message, responseQueue.enqueuedCount(), TRUE);
+    appendText(message, L" enqueued | ");
+    appendNumber(message, responseQueue.rejectedCount(), TRUE);
+    appendText(message, L" rejected | ");
+    appendNumber(message, responseQueue.failedReservationCount(), TRUE);
+    appendText(message, L" failed reservations | Enqueue latency = ");
+    appendNumber(message, responseQueue.averageEnqueueTicks() * 1000000000 / frequency, TRUE);
+    appendText(message, L" ns (max ");
+    appendNumber(message, responseQueue.maxEnqueueTickCount() * 1000000 / frequency, TRUE);
+    appendText(message, L" mcs) | Waiting time = ");
+    appendNumber(message, responseQueue.averageWaitingTicks() * 1000000 / frequency, TRUE);
+    appendText(message, L" mcs (max ");
+    appendNumber(message, responseQueue.maxWaitingTickCount() * 1000 / frequency, TRUE);
+    appendText(message, L" ms).");
+    logToConsole(message);
+
+    unsigned long long numberOfWaitingBytesOfPriority[NUMBER_OF_SEND_PRIORITIES] = { 0 };
+    unsigned long long numberOfDroppedMessagesOfPriority[NUMBER_OF_SEND_PRIORITIES] = { 0 };
+    for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
+    {
+        for (unsigned int priority = 0; priority < NUMBER_OF_SEND_PRIORITIES; priority++)
+        {
+            if (peers[i].tcp4Protocol)
+            {
+                numberOfWaitingBytesOfPriority[priority] += peers[i].sendQueue.size(priority);
+            }
+            numberOfDroppedMessagesOfPriority[priority] += peers[i].sendQueue.droppedCount(priority);
+        }
+    }
+    setText(message, L"Send queues (consensus|transactions|bulk): ");
+    for (unsigned int priority = 0; priority < NUMBER_OF_SEND_PRIORITIES; priority++)
+    {
+        if (priority)
+        {
+            appendText(message, L"|");
+        }
+        appendNumber(message, numberOfWaitingBytesOfPriority[priority], TRUE);
+    }
+    appendText(message, L" bytes waiting | ");
+    for (unsigned int priority = 0; priority < NUMBER_OF_SEND_PRIORITIES; priority++)
+    {
+        if (priority)
+        {
+            appendText(message, L"|");
+        }
+        appendNumber(message, numberOfDroppedMessagesOfPriority[priority], TRUE);
+    }
+    appendText(message, L" messages dropped.");
+    logToConsole(message);
+
+    setText(message, L"Spectrum lock in last tick: ");
+    appendNumber(message, spectrumLockWaitTicksOfLastTick * 1000000 / frequency, TRUE);
+    appendText(message, L" mcs waited by writers | ");
+    appendNumber(message, spectrumReadRetriesOfLastTick, TRUE);
+    appendText(message, L" read retries.");
+    logToConsole(message);
+
+    setText(message, L"Spectrum probing: ");
+    appendProbeStatistics(message, spectrumProbeTags);
+    appendText(message, L" | Universe probing: ");
+    appendProbeStatistics(message, assetProbeTags);
+    appendText(message, L".");
+    logToConsole(message);
+
+    setText(message, L"Contract state digests (< 0.1 ms / < 1 ms / < 10 ms / < 100 ms / longer):");
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
+    {
+        const unsigned long long* histogram = contractStateDigestDurationHistogram[contractIndex];
+        if (histogram[0] | histogram[1] | histogram[2] | histogram[3] | histogram[4])
+        {
+            appendText(message, L" #");
+            appendNumber(message, contractIndex, FALSE);
+            appendText(message, L" ");
+            for (unsigned int bucket = 0; bucket < CONTRACT_STATE_DIGEST_HISTOGRAM_BUCKETS; bucket++)
+            {
+                if (bucket)
+                {
+                    appendText(message, L"/");
+                }
+                appendNumber(message, histogram[bucket], FALSE);
+            }
+        }
+    }
+    appendText(message, L" | ");
+    appendNumber(message, numberOfRehashedContractStateLeaves, TRUE);
+    appendText(message, L" of ");
+    appendNumber(message, numberOfCheckedContractStateLeaves, TRUE);
+    appendText(message, L" large state chunks rehashed.");
     logToConsole(message);
 
     setText(message, L"Entity balance dust threshold: ");
@@ -5854,14 +6318,6 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
             mpServicesProtocol->GetProcessorInfo(mpServicesProtocol, i, &processorInformation);
             if (processorInformation.StatusFlag == (PROCESSOR_ENABLED_BIT | PROCESSOR_HEALTH_STATUS_BIT))
             {
-                if (status = bs->AllocatePool(EfiRuntimeServicesData, BUFFER_SIZE, &processors[numberOfProcessors].buffer))
-                {
-                    logStatusAndMemInfoToConsole(L"EFI_BOOT_SERVICES.AllocatePool() fails", status, __LINE__, BUFFER_SIZE);
-
-                    numberOfProcessors = 0;
-
-                    break;
-                }
                 if (!processors[numberOfProcessors].alloc(STACK_SIZE))
                 {
                     logToConsole(L"Failed to allocate stack for processor!");
@@ -6022,9 +6478,17 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                     // handle new connections
                     if (peerConnectionNewlyEstablished(i))
                     {
+                        // subscriptions of the previous connection in this slot have ended
+                        logger.cancelLogSubscription(&peers[i]);
+
                         // new connection established:
                         // prepare and send ExchangePublicPeers message
-                        ExchangePublicPeers* request = (ExchangePublicPeers*)&peers[i].dataToTransmit[sizeof(RequestResponseHeader)];
+                        struct
+                        {
+                            RequestResponseHeader header;
+                            ExchangePublicPeers exchangePublicPeers;
+                        } exchangePublicPeersMessage;
+                        ExchangePublicPeers* request = &exchangePublicPeersMessage.exchangePublicPeers;
                         bool noVerifiedPublicPeers = true;
                         for (unsigned int k = 0; k < numberOfPublicPeers; k++)
                         {
@@ -6057,21 +6521,17 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                             }
                         }
 
-                        RequestResponseHeader* requestHeader = (RequestResponseHeader*)peers[i].dataToTransmit;
-                        requestHeader->setSize<sizeof(RequestResponseHeader) + sizeof(ExchangePublicPeers)>();
-                        requestHeader->randomizeDejavu();
-                        requestHeader->setType(ExchangePublicPeers::type);
-                        peers[i].dataToTransmitSize = requestHeader->size();
-                        _InterlockedIncrement64(&numberOfDisseminatedRequests);
+                        exchangePublicPeersMessage.header.setSize<sizeof(exchangePublicPeersMessage)>();
+                        exchangePublicPeersMessage.header.randomizeDejavu();
+                        exchangePublicPeersMessage.header.setType(ExchangePublicPeers::type);
+                        push(&peers[i], &exchangePublicPeersMessage.header);
 
                         // send RequestComputors message at beginning of epoch
                         if (!broadcastedComputors.computors.epoch
                             || broadcastedComputors.computors.epoch != system.epoch)
                         {
                             requestedComputors.header.randomizeDejavu();
-                            bs->CopyMem(&peers[i].dataToTransmit[peers[i].dataToTransmitSize], &requestedComputors, requestedComputors.header.size());
-                            peers[i].dataToTransmitSize += requestedComputors.header.size();
-                            _InterlockedIncrement64(&numberOfDisseminatedRequests);
+                            push(&peers[i], &requestedComputors.header);
                         }
                     }
 
@@ -6082,6 +6542,9 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                     peerReconnectIfInactive(i, PORT);
                 }
 
+                // push new logs to peers that subscribed to them
+                logger.pushLogsToSubscribers();
+
                 if (curTimeTick - systemDataSavingTick >= SYSTEM_DATA_SAVING_PERIOD * frequency / 1000)
                 {
                     systemDataSavingTick = curTimeTick;
@@ -6169,39 +6632,33 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                         pushToAny(&requestedTickData.header);
                     }
 
+                    // Fall back to full tick data if the missing transaction digests of compact tick data have not
+                    // been received in time (the sender may not have them, for example because the data is forged)
+                    ACQUIRE(tickDataReconstructionLock);
+                    const unsigned int stalledTick = tickDataReconstructions.takeStalledTick(curTimeTick, TICK_DATA_RECONSTRUCTION_TIMEOUT * frequency / 1000);
+                    RELEASE(tickDataReconstructionLock);
+                    if (stalledTick)
+                    {
+                        numberOfStalledTickDataReconstructions++;
+                        if (ts.tickInCurrentEpochStorage(stalledTick) && ts.tickData.getByTickInCurrentEpoch(stalledTick).epoch != system.epoch)
+                        {
+                            requestedTickData.header.randomizeDejavu();
+                            requestedTickData.requestTickData.requestedTickData.tick = stalledTick;
+                            pushToAny(&requestedTickData.header);
+                        }
+                    }
+
                     if (requestedTickTransactions.requestedTickTransactions.tick)
                     {
                         requestedTickTransactions.header.randomizeDejavu();
+                        registerSolicitedTransactionsDejavu(requestedTickTransactions.header.dejavu());
                         pushToAny(&requestedTickTransactions.header);
 
                         requestedTickTransactions.requestedTickTransactions.tick = 0;
                     }
                 }
 
-                // Add messages from response queue to sending buffer
-                const unsigned short responseQueueElementHead = ::responseQueueElementHead;
-                if (responseQueueElementTail != responseQueueElementHead)
-                {
-                    while (responseQueueElementTail != responseQueueElementHead)
-                    {
-                        RequestResponseHeader* responseHeader = (RequestResponseHeader*)&responseQueueBuffer[responseQueueElements[responseQueueElementTail].offset];
-                        if (responseQueueElements[responseQueueElementTail].peer)
-                        {
-                            push(responseQueueElements[responseQueueElementTail].peer, responseHeader);
-                        }
-                        else
-                        {
-                            pushToSeveral(responseHeader);
-                        }
-                        responseQueueBufferTail += responseHeader->size();
-                        if (responseQueueBufferTail > RESPONSE_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
-                        {
-                            responseQueueBufferTail = 0;
-                        }
-                        // TODO: Place a fence
-                        responseQueueElementTail++;
-                    }
-                }
+                pushResponses();
 
                 if (systemMustBeSaved)
                 {
@@ -2,8 +2,10 @@
 
 #include "platform/m256.h"
 #include "platform/concurrency.h"
+#include "platform/sequence_lock.h"
 #include "platform/file_io.h"
 #include "platform/time_stamp_counter.h"
+#include "platform/parallel_job.h"
 
 #include "network_messages/entity.h"
 
@@ -11,15 +13,30 @@
 #include "system.h"
 #include "kangaroo_twelve.h"
 #include "common_buffers.h"
+#include "probe_tags.h"
 
 
 static volatile char spectrumLock = 0;
+static SequenceLock spectrumSeqLock; // for reading without spectrumLock, see beginSpectrumChange() and spectrumIndex()
+static volatile long long spectrumLockWaitTicks = 0; // total time writers waited for spectrumLock
+static long long spectrumLockWaitTicksOfLastTick = 0, spectrumReadRetriesOfLastTick = 0;
 static ::Entity* spectrum = nullptr;
+
+// Hot column of the spectrum: spectrumBalances[i] is the balance of spectrum[i] (incomingAmount - outgoingAmount).
+// It is kept in sync with every balance change, so scans of the whole hash map that only need balances read 8 instead
+// of 64 bytes per entity. The 64-byte entities in spectrum remain the data used for digests, files, and responses.
+static long long* spectrumBalances = nullptr;
+constexpr unsigned long long spectrumBalancesSizeInBytes = SPECTRUM_CAPACITY * sizeof(long long);
+
+// Tags of the public keys in the spectrum for probing the hash map without comparing the keys of all slots. Updated
+// together with spectrumBalances whenever a slot is filled or emptied.
+static ProbeTags<SPECTRUM_CAPACITY> spectrumProbeTags;
 static struct SpectrumInfo {
     unsigned int numberOfEntities = 0;  // Number of entities in the spectrum hash map, may include entries with balance == 0
     unsigned long long totalAmount = 0; // Total amount of qubics in the spectrum
 } spectrumInfo;
 
+// Number of entities with balance in [2^i, 2^(i+1) - 1] for each category i, updated with every balance change
 static unsigned int entityCategoryPopulations[48]; // Array size depends on max possible balance
 static constexpr unsigned char entityCategoryCount = sizeof(entityCategoryPopulations) / sizeof(entityCategoryPopulations[0]);
 unsigned long long dustThresholdBurnAll = 0, dustThresholdBurnHalf = 0;
@@ -27,7 +44,329 @@ unsigned long long dustThresholdBurnAll = 0, dustThresholdBurnHalf = 0;
 static m256i* spectrumDigests = nullptr;
 constexpr unsigned long long spectrumDigestsSizeInByte = (SPECTRUM_CAPACITY * 2 - 1) * 32ULL;
 
+// Flags marking the spectrum digests to recompute in updateSpectrumDigests(). Bit i of spectrumChangeFlags is set
+// by markSpectrumLeafChanged(i). spectrumChangeFlagsNextLevel is used internally for the inner tree levels.
+static unsigned long long spectrumChangeFlags[SPECTRUM_CAPACITY / (sizeof(unsigned long long) * 8)];
+static unsigned long long spectrumChangeFlagsNextLevel[SPECTRUM_CAPACITY / (sizeof(unsigned long long) * 8 * 2)];
+
+// List of changed spectrum indices since the last digest update (each index only once, deduplicated with
+// spectrumChangeFlags). If more leaves change than fit into the list, updateSpectrumDigests() scans the flags instead.
+static constexpr unsigned int MAX_NUMBER_OF_CHANGED_SPECTRUM_LEAVES = 65536;
+static unsigned int changedSpectrumLeaves[MAX_NUMBER_OF_CHANGED_SPECTRUM_LEAVES];
+static unsigned int numberOfChangedSpectrumLeaves = 0;
+
+// Number of tree nodes (or flag words in updateSpectrumDigests()) processed per part of parallel digest jobs.
+// Levels with less nodes are processed by the calling processor without distributing work.
+static constexpr unsigned int SPECTRUM_DIGEST_NODES_PER_PART = 32768;
+static constexpr unsigned int SPECTRUM_DIGEST_FLAG_WORDS_PER_PART = 4096;
+
+// Number of parts of the parallel spectrum reorganization (each a range of the hash map)
+static constexpr unsigned int SPECTRUM_REORG_PARTS = 256;
+
+// Execution time of reorganizeSpectrum(), in total and per phase
 static unsigned long long spectrumReorgTotalExecutionTicks = 0;
+static unsigned long long spectrumReorgPrepareExecutionTicks = 0;   // finding part boundaries, counting burn candidates
+static unsigned long long spectrumReorgRelocateExecutionTicks = 0;  // burning and moving entities
+static unsigned long long spectrumReorgDigestExecutionTicks = 0;    // rebuilding digests
+
+
+// Collects independent 64-byte nodes and hashes them with the multi-lane KangarooTwelve64To32 once enough are
+// available.
+struct SpectrumDigestBatch
+{
+    const void* input[K12_64To32_LANES];
+    void* output[K12_64To32_LANES];
+    unsigned int size;
+
+    void add(const void* nodeInput, void* nodeOutput)
+    {
+        input[size] = nodeInput;
+        output[size] = nodeOutput;
+        if (++size == K12_64To32_LANES)
+        {
+            KangarooTwelve64To32Lanes(input, output);
+            size = 0;
+        }
+    }
+
+    void flush()
+    {
+        for (unsigned int i = 0; i < size; i++)
+        {
+            KangarooTwelve64To32(input[i], output[i]);
+        }
+        size = 0;
+    }
+};
+
+// Record that spectrum[index] has been changed and its digest needs to be updated. Caller must hold spectrumLock.
+static void markSpectrumLeafChanged(unsigned int index)
+{
+    const unsigned long long bit = 1ULL << (index & 63);
+    if (!(spectrumChangeFlags[index >> 6] & bit))
+    {
+        spectrumChangeFlags[index >> 6] |= bit;
+        if (numberOfChangedSpectrumLeaves < MAX_NUMBER_OF_CHANGED_SPECTRUM_LEAVES)
+        {
+            changedSpectrumLeaves[numberOfChangedSpectrumLeaves] = index;
+        }
+        // keep counting after the list is full, to detect overflow
+        numberOfChangedSpectrumLeaves++;
+    }
+}
+
+// Forget all changes recorded by markSpectrumLeafChanged(), for example after loading digests from a snapshot.
+static void clearSpectrumChangeFlags()
+{
+    setMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0);
+    setMem(spectrumChangeFlagsNextLevel, sizeof(spectrumChangeFlagsNextLevel), 0);
+    numberOfChangedSpectrumLeaves = 0;
+}
+
+// Parameters of one tree level (or the leaf level) processed in parallel
+struct SpectrumDigestLevelJob
+{
+    const unsigned char* input;         // 64-byte input nodes (entities or pairs of child digests)
+    m256i* output;                      // 32-byte output digests
+    unsigned int numberOfNodes;         // number of output digests / number of input nodes of level
+
+    // only used in updateSpectrumDigests()
+    unsigned long long* flags;          // flags of changed child nodes (cleared while processing)
+    unsigned long long* nextLevelFlags; // flags of changed output nodes
+    unsigned int numberOfFlagWords;
+};
+
+// Hash input nodes [begin, end) of level
+static void hashSpectrumDigestNodes(const SpectrumDigestLevelJob& level, unsigned int begin, unsigned int end)
+{
+    SpectrumDigestBatch batch;
+    batch.size = 0;
+    for (unsigned int i = begin; i < end; i++)
+    {
+        batch.add(level.input + i * 64ULL, &level.output[i]);
+    }
+    batch.flush();
+}
+
+static void hashSpectrumDigestNodesPart(void* context, unsigned int partIndex)
+{
+    const SpectrumDigestLevelJob& level = *(const SpectrumDigestLevelJob*)context;
+    const unsigned int begin = partIndex * SPECTRUM_DIGEST_NODES_PER_PART;
+    const unsigned int end = (begin + SPECTRUM_DIGEST_NODES_PER_PART < level.numberOfNodes) ? begin + SPECTRUM_DIGEST_NODES_PER_PART : level.numberOfNodes;
+    hashSpectrumDigestNodes(level, begin, end);
+}
+
+// Hash all input nodes of level, distributing work to idle processors if the level is large
+static void hashSpectrumDigestLevel(SpectrumDigestLevelJob& level)
+{
+    if (level.numberOfNodes > SPECTRUM_DIGEST_NODES_PER_PART)
+    {
+        parallelJob.run(hashSpectrumDigestNodesPart, &level, (level.numberOfNodes + SPECTRUM_DIGEST_NODES_PER_PART - 1) / SPECTRUM_DIGEST_NODES_PER_PART);
+    }
+    else
+    {
+        hashSpectrumDigestNodes(level, 0, level.numberOfNodes);
+    }
+}
+
+// Recompute the whole spectrum digest tree from the spectrum, acquire no lock. Also clears all change flags.
+static void rebuildSpectrumDigests()
+{
+    SpectrumDigestLevelJob level;
+    level.input = (const unsigned char*)spectrum;
+    level.output = spectrumDigests;
+    level.numberOfNodes = SPECTRUM_CAPACITY;
+    hashSpectrumDigestLevel(level);
+
+    unsigned int previousLevelBeginning = 0;
+    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
+    while (numberOfLeafs > 1)
+    {
+        level.input = (const unsigned char*)&spectrumDigests[previousLevelBeginning];
+        level.output = &spectrumDigests[previousLevelBeginning + numberOfLeafs];
+        level.numberOfNodes = numberOfLeafs / 2;
+        hashSpectrumDigestLevel(level);
+
+        previousLevelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+    }
+
+    clearSpectrumChangeFlags();
+}
+
+// Rehash changed leaves of flag words [beginWord, endWord)
+static void hashChangedSpectrumLeaves(const SpectrumDigestLevelJob& level, unsigned int beginWord, unsigned int endWord)
+{
+    SpectrumDigestBatch batch;
+    batch.size = 0;
+    for (unsigned int w = beginWord; w < endWord; w++)
+    {
+        unsigned long long flags = level.flags[w];
+        while (flags)
+        {
+            const unsigned int bit = (unsigned int)_tzcnt_u64(flags);
+            flags &= flags - 1;
+            const unsigned int i = w * 64 + bit;
+            batch.add(level.input + i * 64ULL, &level.output[i]);
+        }
+    }
+    batch.flush();
+}
+
+// Rehash parents of changed nodes of flag words [beginWord, endWord) and set the flags of the parents. beginWord
+// needs to be even, so that the parent flags of different ranges do not share words.
+static void hashChangedSpectrumNodes(const SpectrumDigestLevelJob& level, unsigned int beginWord, unsigned int endWord)
+{
+    SpectrumDigestBatch batch;
+    batch.size = 0;
+    for (unsigned int w = beginWord; w < endWord; w++)
+    {
+        const unsigned long long flags = level.flags[w];
+        if (flags)
+        {
+            level.flags[w] = 0;
+
+            // one bit per pair of siblings (at even position) having at least one changed node
+            unsigned long long pairFlags = (flags | (flags >> 1)) & 0x5555555555555555ULL;
+            unsigned long long parentFlags = 0;
+            while (pairFlags)
+            {
+                const unsigned int bit = (unsigned int)_tzcnt_u64(pairFlags);
+                pairFlags &= pairFlags - 1;
+                const unsigned int i = w * 64 + bit;
+                batch.add(level.input + i * 32ULL, &level.output[i >> 1]);
+                parentFlags |= 1ULL << (bit >> 1);
+            }
+            level.nextLevelFlags[w >> 1] |= parentFlags << ((w & 1) * 32);
+        }
+    }
+    batch.flush();
+}
+
+static void hashChangedSpectrumLeavesPart(void* context, unsigned int partIndex)
+{
+    const SpectrumDigestLevelJob& level = *(const SpectrumDigestLevelJob*)context;
+    const unsigned int beginWord = partIndex * SPECTRUM_DIGEST_FLAG_WORDS_PER_PART;
+    hashChangedSpectrumLeaves(level, beginWord, beginWord + SPECTRUM_DIGEST_FLAG_WORDS_PER_PART);
+}
+
+static void hashChangedSpectrumNodesPart(void* context, unsigned int partIndex)
+{
+    const SpectrumDigestLevelJob& level = *(const SpectrumDigestLevelJob*)context;
+    const unsigned int beginWord = partIndex * SPECTRUM_DIGEST_FLAG_WORDS_PER_PART;
+    hashChangedSpectrumNodes(level, beginWord, beginWord + SPECTRUM_DIGEST_FLAG_WORDS_PER_PART);
+}
+
+// Update digests by scanning all change flags of each level, distributing work of large levels to idle processors.
+// Used if too many leaves have changed for updateSpectrumDigestsOfChangedLeaves().
+static void updateSpectrumDigestsOfFlaggedLeaves()
+{
+    static_assert(SPECTRUM_DIGEST_FLAG_WORDS_PER_PART % 2 == 0, "Flag words per part must be even");
+    static_assert((SPECTRUM_CAPACITY / 64) % SPECTRUM_DIGEST_FLAG_WORDS_PER_PART == 0, "Capacity must be multiple of words per part");
+
+    // leaves
+    SpectrumDigestLevelJob level;
+    level.input = (const unsigned char*)spectrum;
+    level.output = spectrumDigests;
+    level.flags = spectrumChangeFlags;
+    level.numberOfFlagWords = SPECTRUM_CAPACITY / 64;
+    parallelJob.run(hashChangedSpectrumLeavesPart, &level, level.numberOfFlagWords / SPECTRUM_DIGEST_FLAG_WORDS_PER_PART);
+
+    // inner nodes, using spectrumChangeFlags and spectrumChangeFlagsNextLevel alternately for the flags
+    unsigned long long* flags = spectrumChangeFlags;
+    unsigned long long* nextLevelFlags = spectrumChangeFlagsNextLevel;
+    unsigned int previousLevelBeginning = 0;
+    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
+    while (numberOfLeafs > 1)
+    {
+        level.input = (const unsigned char*)&spectrumDigests[previousLevelBeginning];
+        level.output = &spectrumDigests[previousLevelBeginning + numberOfLeafs];
+        level.flags = flags;
+        level.nextLevelFlags = nextLevelFlags;
+        level.numberOfFlagWords = (numberOfLeafs + 63) / 64;
+        if (level.numberOfFlagWords >= 2 * SPECTRUM_DIGEST_FLAG_WORDS_PER_PART)
+        {
+            parallelJob.run(hashChangedSpectrumNodesPart, &level, level.numberOfFlagWords / SPECTRUM_DIGEST_FLAG_WORDS_PER_PART);
+        }
+        else
+        {
+            hashChangedSpectrumNodes(level, 0, level.numberOfFlagWords);
+        }
+
+        flags = nextLevelFlags;
+        nextLevelFlags = level.flags;
+        previousLevelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+    }
+
+    // flag of root
+    flags[0] = 0;
+}
+
+// Update digests of the leaves in changedSpectrumLeaves and of their ancestors. Costs O(changes * depth) instead of
+// scanning the whole flag arrays.
+static void updateSpectrumDigestsOfChangedLeaves()
+{
+    SpectrumDigestBatch batch;
+    batch.size = 0;
+    unsigned int* changedNodes = changedSpectrumLeaves;
+    unsigned int numberOfChangedNodes = numberOfChangedSpectrumLeaves;
+    for (unsigned int j = 0; j < numberOfChangedNodes; j++)
+    {
+        const unsigned int i = changedNodes[j];
+        batch.add(&spectrum[i], &spectrumDigests[i]);
+    }
+    batch.flush();
+
+    // inner nodes: replace list of changed child nodes by list of their parents (in place, the parents list is
+    // never longer), using the flags of the parent level for deduplication
+    unsigned long long* flags = spectrumChangeFlags;
+    unsigned long long* nextLevelFlags = spectrumChangeFlagsNextLevel;
+    unsigned int previousLevelBeginning = 0;
+    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
+    while (numberOfLeafs > 1)
+    {
+        unsigned int numberOfChangedParents = 0;
+        for (unsigned int j = 0; j < numberOfChangedNodes; j++)
+        {
+            const unsigned int i = changedNodes[j];
+            const unsigned int parent = i >> 1;
+            flags[i >> 6] &= ~(1ULL << (i & 63));
+            if (!(nextLevelFlags[parent >> 6] & (1ULL << (parent & 63))))
+            {
+                nextLevelFlags[parent >> 6] |= (1ULL << (parent & 63));
+                batch.add(&spectrumDigests[previousLevelBeginning + (i & ~1)], &spectrumDigests[previousLevelBeginning + numberOfLeafs + parent]);
+                changedNodes[numberOfChangedParents++] = parent;
+            }
+        }
+        batch.flush();
+        numberOfChangedNodes = numberOfChangedParents;
+
+        unsigned long long* tmp = flags;
+        flags = nextLevelFlags;
+        nextLevelFlags = tmp;
+        previousLevelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+    }
+
+    // flag of root
+    flags[0] = 0;
+}
+
+// Recompute the digests of the spectrum entities marked with markSpectrumLeafChanged() and of all their ancestors in
+// the digest tree, acquire no lock. Clears all change flags. The result is identical to rebuildSpectrumDigests().
+static void updateSpectrumDigests()
+{
+    if (numberOfChangedSpectrumLeaves <= MAX_NUMBER_OF_CHANGED_SPECTRUM_LEAVES)
+    {
+        updateSpectrumDigestsOfChangedLeaves();
+    }
+    else
+    {
+        updateSpectrumDigestsOfFlaggedLeaves();
+    }
+    numberOfChangedSpectrumLeaves = 0;
+}
 
 
 // Update SpectrumInfo data (exensive, because it iterates the whole spectrum), acquire no lock
@@ -37,6 +376,8 @@ void updateSpectrumInfo(SpectrumInfo& si = spectrumInfo)
     si.totalAmount = 0;
     for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
     {
+        // Reads the entities instead of spectrumBalances, because entities without balance need to be checked for
+        // being empty slots, which would read most cache lines of the entities anyway
         long long balance = spectrum[i].incomingAmount - spectrum[i].outgoingAmount;
         if (balance || !isZero(spectrum[i].publicKey))
         {
@@ -46,23 +387,57 @@ void updateSpectrumInfo(SpectrumInfo& si = spectrumInfo)
     }
 }
 
-// Compute balances that count as dust and are burned if 75% of spectrum hash map is filled.
-// All balances <= dustThresholdBurnAll are burned in this case.
-// Every 2nd balance <= dustThresholdBurnHalf is burned in this case.
-void updateAndAnalzeEntityCategoryPopulations()
+// Recompute spectrumBalances and spectrumProbeTags from spectrum. Needed after the spectrum has been changed without
+// increaseEnergy() / decreaseEnergy() / reorganizeSpectrum(), for example after loading it.
+static void rebuildSpectrumBalances()
+{
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
+    {
+        spectrumBalances[i] = spectrum[i].incomingAmount - spectrum[i].outgoingAmount;
+    }
+    spectrumProbeTags.rebuild(&spectrum[0].publicKey, sizeof(::Entity));
+}
+
+static inline unsigned int entityCategory(unsigned long long balance)
+{
+    return 63 - __lzcnt64(balance);
+}
+
+// Update entityCategoryPopulations after the balance of an entity has changed. Caller must hold spectrumLock.
+static inline void updateEntityCategoryPopulations(unsigned long long oldBalance, unsigned long long newBalance)
+{
+    if (oldBalance)
+    {
+        entityCategoryPopulations[entityCategory(oldBalance)]--;
+    }
+    if (newBalance)
+    {
+        entityCategoryPopulations[entityCategory(newBalance)]++;
+    }
+}
+
+// Count entities per balance category from scratch (expensive, because it iterates the whole spectrum), acquire no lock
+static void countEntityCategoryPopulations(unsigned int populations[entityCategoryCount])
 {
     static_assert(MAX_SUPPLY < (1llu << entityCategoryCount));
-    setMem(entityCategoryPopulations, sizeof(entityCategoryPopulations), 0);
+    setMem(populations, entityCategoryCount * sizeof(unsigned int), 0);
 
     for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
     {
-        const unsigned long long balance = spectrum[i].incomingAmount - spectrum[i].outgoingAmount;
+        const unsigned long long balance = spectrumBalances[i];
         if (balance)
         {
-            entityCategoryPopulations[63 - __lzcnt64(balance)]++;
+            populations[entityCategory(balance)]++;
         }
     }
+}
 
+// Compute balances that count as dust and are burned if 75% of spectrum hash map is filled, using the current
+// entityCategoryPopulations (cheap, only iterates the categories).
+// All balances <= dustThresholdBurnAll are burned in this case.
+// Every 2nd balance <= dustThresholdBurnHalf is burned in this case.
+static void analyzeEntityCategoryPopulations()
+{
     dustThresholdBurnAll = 0;
     dustThresholdBurnHalf = 0;
     unsigned int numberOfEntities = 0;
@@ -91,57 +466,306 @@ void updateAndAnalzeEntityCategoryPopulations()
     }
 }
 
-// Clean up spectrum hash map, removing all entities with balance 0. Updates spectrumInfo.
-static void reorganizeSpectrum()
+// Recount entityCategoryPopulations from scratch and compute dust thresholds. Needed after the spectrum has been
+// changed without increaseEnergy() / decreaseEnergy(), for example after loading it.
+void updateAndAnalzeEntityCategoryPopulations()
 {
-    unsigned long long spectrumReorgStartTick = __rdtsc();
+    countEntityCategoryPopulations(entityCategoryPopulations);
+    analyzeEntityCategoryPopulations();
+}
 
-    ::Entity* reorgSpectrum = (::Entity*)reorgBuffer;
-    setMem(reorgSpectrum, SPECTRUM_CAPACITY * sizeof(::Entity), 0);
-    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
+// Acquire spectrumLock for changing the spectrum. Readers using spectrumSeqLock do not block the writers, they
+// retry if the spectrum is changed while they read it.
+static void beginSpectrumChange()
+{
+    if (!TRY_ACQUIRE(spectrumLock))
+    {
+        const unsigned long long beginningTick = __rdtsc();
+        ACQUIRE(spectrumLock);
+        _InterlockedExchangeAdd64(&spectrumLockWaitTicks, __rdtsc() - beginningTick);
+    }
+    spectrumSeqLock.beginWrite();
+}
+
+static void endSpectrumChange()
+{
+    spectrumSeqLock.endWrite();
+    RELEASE(spectrumLock);
+}
+
+// Update spectrum lock statistics of the last tick. Called by the tick processor when a tick is complete.
+static void updateSpectrumLockStatistics()
+{
+    static long long previousSpectrumLockWaitTicks = 0, previousSpectrumReadRetries = 0;
+    const long long waitTicks = spectrumLockWaitTicks, readRetries = spectrumSeqLock.retryCount();
+    spectrumLockWaitTicksOfLastTick = waitTicks - previousSpectrumLockWaitTicks;
+    spectrumReadRetriesOfLastTick = readRetries - previousSpectrumReadRetries;
+    previousSpectrumLockWaitTicks = waitTicks;
+    previousSpectrumReadRetries = readRetries;
+}
+
+// Range [begin, end) of the spectrum hash map processed by one part of the parallel reorganization. Ranges begin at
+// an empty slot, so every cluster of occupied slots is in one range. Entities of different clusters never compete for
+// the same slot when they are reinserted (removing entities cannot make a cluster larger), so ranges can be processed
+// independently. Processing the entities of a cluster in index order yields the same layout as reinserting all
+// entities of the hash map into an empty one in index order.
+struct SpectrumReorgRange
+{
+    unsigned int begin, end;
+    unsigned int burnHalfCandidatesBefore; // number of burn-half candidates with lower index than the range
+
+    // results
+    unsigned int numberOfEntities;
+    unsigned long long totalAmount;
+    unsigned int entityCategoryPopulations[entityCategoryCount];
+};
+
+// Range 0 is the head of the cluster wrapping around the end of the hash map, range SPECTRUM_REORG_PARTS + 1 its tail.
+// Both are processed together by part 0, ranges 1 ... SPECTRUM_REORG_PARTS by the other parts.
+struct SpectrumReorgJob
+{
+    unsigned long long burnAllThreshold, burnHalfThreshold;
+    SpectrumReorgRange ranges[SPECTRUM_REORG_PARTS + 2];
+};
+static SpectrumReorgJob spectrumReorgJob;
+
+static void countSpectrumBurnHalfCandidatesPart(void* context, unsigned int partIndex)
+{
+    SpectrumReorgJob& job = *(SpectrumReorgJob*)context;
+    SpectrumReorgRange& range = job.ranges[partIndex];
+    unsigned int numberOfBurnHalfCandidates = 0;
+    for (unsigned int i = range.begin; i < range.end; i++)
     {
-        if (spectrum[i].incomingAmount - spectrum[i].outgoingAmount)
+        const unsigned long long balance = spectrumBalances[i];
+        if (balance > job.burnAllThreshold && balance <= job.burnHalfThreshold)
         {
-            unsigned int index = spectrum[i].publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
+            numberOfBurnHalfCandidates++;
+        }
+    }
+    range.burnHalfCandidatesBefore = numberOfBurnHalfCandidates; // converted to prefix sum after all parts finished
+}
+
+// Decide whether entity is kept (not burned, balance not 0) and count it in the results of range if so
+static bool keepSpectrumEntity(const SpectrumReorgJob& job, SpectrumReorgRange& range, const ::Entity& entity, unsigned int& numberOfBurnHalfCandidates)
+{
+    const unsigned long long balance = entity.incomingAmount - entity.outgoingAmount;
+    if (!balance || balance <= job.burnAllThreshold)
+    {
+        return false;
+    }
+    if (balance <= job.burnHalfThreshold && (++numberOfBurnHalfCandidates & 1))
+    {
+        return false;
+    }
+    range.entityCategoryPopulations[entityCategory(balance)]++;
+    range.numberOfEntities++;
+    range.totalAmount += balance;
+    return true;
+}
+
+static void insertSpectrumEntity(const ::Entity& entity)
+{
+    const unsigned int index = spectrumProbeTags.nextCandidate(entity.publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1), 0);
+    ASSERT(index != spectrumProbeTags.NO_SLOT && isZero(spectrum[index].publicKey));
+    copyMem(&spectrum[index], &entity, sizeof(::Entity));
+    spectrumBalances[index] = entity.incomingAmount - entity.outgoingAmount;
+    spectrumProbeTags.set(index, entity.publicKey);
+}
 
-        iteration:
-            if (isZero(reorgSpectrum[index].publicKey))
+// Reorganize range in place. Each entity is taken out of its slot and reinserted. It never moves behind its old slot,
+// because the entities reinserted before have lower indices and fit into the slots before the old slot.
+static void relocateSpectrumRange(const SpectrumReorgJob& job, SpectrumReorgRange& range)
+{
+    unsigned int numberOfBurnHalfCandidates = range.burnHalfCandidatesBefore;
+    for (unsigned int i = range.begin; i < range.end; i++)
+    {
+        if (!isZero(spectrum[i].publicKey))
+        {
+            ::Entity entity;
+            copyMem(&entity, &spectrum[i], sizeof(::Entity));
+            setMem(&spectrum[i], sizeof(::Entity), 0);
+            spectrumBalances[i] = 0;
+            spectrumProbeTags.clear(i);
+            if (keepSpectrumEntity(job, range, entity, numberOfBurnHalfCandidates))
             {
-                copyMem(&reorgSpectrum[index], &spectrum[i], sizeof(::Entity));
+                insertSpectrumEntity(entity);
             }
-            else
-            {
-                index = (index + 1) & (SPECTRUM_CAPACITY - 1);
+        }
+    }
+}
 
-                goto iteration;
-            }
+// Reorganize the cluster wrapping around the end of the hash map. Its head is processed before its tail (index order),
+// but entities of the head may belong to slots of the tail, so all entities are taken out before reinserting them.
+static void relocateWrappingSpectrumCluster(const SpectrumReorgJob& job, SpectrumReorgRange& head, SpectrumReorgRange& tail)
+{
+    ::Entity* entities = (::Entity*)reorgBuffer;
+    unsigned int numberOfEntities = 0;
+    unsigned int numberOfBurnHalfCandidates = head.burnHalfCandidatesBefore;
+    for (unsigned int i = head.begin; i < head.end; i++)
+    {
+        if (keepSpectrumEntity(job, head, spectrum[i], numberOfBurnHalfCandidates))
+        {
+            copyMem(&entities[numberOfEntities++], &spectrum[i], sizeof(::Entity));
+        }
+    }
+    numberOfBurnHalfCandidates = tail.burnHalfCandidatesBefore;
+    for (unsigned int i = tail.begin; i < tail.end; i++)
+    {
+        if (keepSpectrumEntity(job, tail, spectrum[i], numberOfBurnHalfCandidates))
+        {
+            copyMem(&entities[numberOfEntities++], &spectrum[i], sizeof(::Entity));
         }
     }
-    copyMem(spectrum, reorgSpectrum, SPECTRUM_CAPACITY * sizeof(::Entity));
+    setMem(&spectrum[head.begin], (head.end - head.begin) * sizeof(::Entity), 0);
+    setMem(&spectrum[tail.begin], (tail.end - tail.begin) * sizeof(::Entity), 0);
+    setMem(&spectrumBalances[head.begin], (head.end - head.begin) * sizeof(long long), 0);
+    setMem(&spectrumBalances[tail.begin], (tail.end - tail.begin) * sizeof(long long), 0);
+    spectrumProbeTags.clear(head.begin, head.end);
+    spectrumProbeTags.clear(tail.begin, tail.end);
+    for (unsigned int i = 0; i < numberOfEntities; i++)
+    {
+        insertSpectrumEntity(entities[i]);
+    }
+}
 
-    unsigned int digestIndex;
-    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
+static void relocateSpectrumEntitiesPart(void* context, unsigned int partIndex)
+{
+    SpectrumReorgJob& job = *(SpectrumReorgJob*)context;
+    if (partIndex)
     {
-        KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
+        relocateSpectrumRange(job, job.ranges[partIndex]);
     }
-    unsigned int previousLevelBeginning = 0;
-    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-    while (numberOfLeafs > 1)
+    else
+    {
+        relocateWrappingSpectrumCluster(job, job.ranges[0], job.ranges[SPECTRUM_REORG_PARTS + 1]);
+    }
+}
+
+// Clean up spectrum hash map, removing all entities with balance 0. Dust is burned in the same pass: balances
+// <= burnAllThreshold are removed as well as every second balance <= burnHalfThreshold (in order of spectrum index).
+// Updates spectrumInfo and entityCategoryPopulations. The resulting layout is the same as if all remaining entities
+// were inserted into an empty hash map in index order, but entities are moved in place, distributing ranges of the
+// hash map to idle processors.
+static void reorganizeSpectrum(unsigned long long burnAllThreshold = 0, unsigned long long burnHalfThreshold = 0)
+{
+    const unsigned long long spectrumReorgStartTick = __rdtsc();
+
+    SpectrumReorgJob& job = spectrumReorgJob;
+    job.burnAllThreshold = burnAllThreshold;
+    job.burnHalfThreshold = burnHalfThreshold;
+
+    // Head [0, headEnd) and tail [tailBegin, SPECTRUM_CAPACITY) of the cluster wrapping around the end (both may be
+    // empty). If there is no empty slot at all, the whole hash map is handled as the head.
+    unsigned int headEnd = 0;
+    while (headEnd < SPECTRUM_CAPACITY && !isZero(spectrum[headEnd].publicKey))
     {
-        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+        headEnd++;
+    }
+    unsigned int tailBegin = SPECTRUM_CAPACITY;
+    while (tailBegin > headEnd && !isZero(spectrum[tailBegin - 1].publicKey))
+    {
+        tailBegin--;
+    }
+    job.ranges[0].begin = 0;
+    job.ranges[0].end = headEnd;
+    job.ranges[SPECTRUM_REORG_PARTS + 1].begin = tailBegin;
+    job.ranges[SPECTRUM_REORG_PARTS + 1].end = SPECTRUM_CAPACITY;
+
+    // Split [headEnd, tailBegin) into ranges beginning at empty slots (headEnd and tailBegin - 1 are empty)
+    for (unsigned int part = 1; part <= SPECTRUM_REORG_PARTS; part++)
+    {
+        unsigned int begin = headEnd + (unsigned int)((tailBegin - headEnd) * (unsigned long long)(part - 1) / SPECTRUM_REORG_PARTS);
+        while (begin < tailBegin && !isZero(spectrum[begin].publicKey))
         {
-            KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex++]);
+            begin++;
         }
+        job.ranges[part].begin = begin;
+    }
+    for (unsigned int part = 1; part < SPECTRUM_REORG_PARTS; part++)
+    {
+        job.ranges[part].end = job.ranges[part + 1].begin;
+    }
+    job.ranges[SPECTRUM_REORG_PARTS].end = tailBegin;
 
-        previousLevelBeginning += numberOfLeafs;
-        numberOfLeafs >>= 1;
+    for (unsigned int i = 0; i < SPECTRUM_REORG_PARTS + 2; i++)
+    {
+        SpectrumReorgRange& range = job.ranges[i];
+        range.burnHalfCandidatesBefore = 0;
+        range.numberOfEntities = 0;
+        range.totalAmount = 0;
+        setMem(range.entityCategoryPopulations, sizeof(range.entityCategoryPopulations), 0);
     }
+    if (burnHalfThreshold > burnAllThreshold)
+    {
+        // Which of the burn-half candidates are burned depends on the number of candidates with lower index
+        parallelJob.run(countSpectrumBurnHalfCandidatesPart, &job, SPECTRUM_REORG_PARTS + 2);
+        unsigned int numberOfBurnHalfCandidates = 0;
+        for (unsigned int i = 0; i < SPECTRUM_REORG_PARTS + 2; i++)
+        {
+            const unsigned int numberOfBurnHalfCandidatesInRange = job.ranges[i].burnHalfCandidatesBefore;
+            job.ranges[i].burnHalfCandidatesBefore = numberOfBurnHalfCandidates;
+            numberOfBurnHalfCandidates += numberOfBurnHalfCandidatesInRange;
+        }
+    }
+    const unsigned long long relocateStartTick = __rdtsc();
+    spectrumReorgPrepareExecutionTicks += relocateStartTick - spectrumReorgStartTick;
 
-    updateSpectrumInfo();
+    parallelJob.run(relocateSpectrumEntitiesPart, &job, SPECTRUM_REORG_PARTS + 1);
 
-    spectrumReorgTotalExecutionTicks += __rdtsc() - spectrumReorgStartTick;
+    setMem(entityCategoryPopulations, sizeof(entityCategoryPopulations), 0);
+    spectrumInfo.numberOfEntities = 0;
+    spectrumInfo.totalAmount = 0;
+    for (unsigned int i = 0; i < SPECTRUM_REORG_PARTS + 2; i++)
+    {
+        const SpectrumReorgRange& range = job.ranges[i];
+        for (unsigned int category = 0; category < entityCategoryCount; category++)
+        {
+            entityCategoryPopulations[category] += range.entityCategoryPopulations[category];
+        }
+        spectrumInfo.numberOfEntities += range.numberOfEntities;
+        spectrumInfo.totalAmount += range.totalAmount;
+    }
+    const unsigned long long digestStartTick = __rdtsc();
+    spectrumReorgRelocateExecutionTicks += digestStartTick - relocateStartTick;
+
+    rebuildSpectrumDigests();
+
+    const unsigned long long spectrumReorgEndTick = __rdtsc();
+    spectrumReorgDigestExecutionTicks += spectrumReorgEndTick - digestStartTick;
+    spectrumReorgTotalExecutionTicks += spectrumReorgEndTick - spectrumReorgStartTick;
+}
+
+// Find entity in spectrum hash map without synchronization. Caller must hold spectrumLock or read in a read section of
+// spectrumSeqLock. The number of probes is limited, because the spectrum may be changed concurrently in the latter case.
+// Only slots with matching tag in spectrumProbeTags (or empty slots) are compared. Probes are not counted here, because
+// readers must not write shared data.
+static int findSpectrumIndex(const m256i& publicKey)
+{
+    const unsigned int homeIndex = publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
+    const unsigned char tag = spectrumProbeTags.tagOf(publicKey);
+    unsigned int index = homeIndex;
+    for (unsigned int keyComparisons = 1; keyComparisons <= SPECTRUM_CAPACITY; keyComparisons++)
+    {
+        index = spectrumProbeTags.nextCandidate(index, tag);
+        if (index == spectrumProbeTags.NO_SLOT)
+        {
+            return -1;
+        }
+        if (spectrum[index].publicKey == publicKey)
+        {
+            return index;
+        }
+        if (isZero(spectrum[index].publicKey))
+        {
+            return -1;
+        }
+        index = (index + 1) & (SPECTRUM_CAPACITY - 1);
+    }
+    return -1;
 }
 
+// Return index of entity in spectrum or -1 if it is not found. Does not block writers. Must not be called between
+// beginSpectrumChange() and endSpectrumChange().
 static int spectrumIndex(const m256i& publicKey)
 {
     if (isZero(publicKey))
@@ -149,32 +773,68 @@ static int spectrumIndex(const m256i& publicKey)
         return -1;
     }
 
-    unsigned int index = publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
+    int index;
+    long long sequence;
+    do
+    {
+        sequence = spectrumSeqLock.beginRead();
+        index = findSpectrumIndex(publicKey);
+    } while (!spectrumSeqLock.endRead(sequence));
 
-    ACQUIRE(spectrumLock);
+    return index;
+}
 
-iteration:
-    if (spectrum[index].publicKey == publicKey)
-    {
-        RELEASE(spectrumLock);
+// Number of public keys ahead of the current one whose home slots are prefetched by spectrumIndices()
+static constexpr unsigned int SPECTRUM_LOOKUP_PREFETCH_DISTANCE = 16;
 
-        return index;
-    }
-    else
+// Look up many entities at once: set indices[i] to spectrumIndex(*publicKeys[i]) (-1 if publicKeys[i] is nullptr).
+// The home slots of the next keys are prefetched while probing, so the cache misses of the independent lookups overlap
+// instead of being paid one after the other. Does not block writers.
+static void spectrumIndices(const m256i* const* publicKeys, unsigned int count, int* indices)
+{
+    long long sequence;
+    do
     {
-        if (isZero(spectrum[index].publicKey))
+        sequence = spectrumSeqLock.beginRead();
+        for (unsigned int i = 0; i < count && i < SPECTRUM_LOOKUP_PREFETCH_DISTANCE; i++)
         {
-            RELEASE(spectrumLock);
-
-            return -1;
+            if (publicKeys[i])
+            {
+                _mm_prefetch((const char*)&spectrum[publicKeys[i]->m256i_u32[0] & (SPECTRUM_CAPACITY - 1)], _MM_HINT_T0);
+            }
         }
-        else
+        for (unsigned int i = 0; i < count; i++)
+        {
+            if (i + SPECTRUM_LOOKUP_PREFETCH_DISTANCE < count && publicKeys[i + SPECTRUM_LOOKUP_PREFETCH_DISTANCE])
+            {
+                _mm_prefetch((const char*)&spectrum[publicKeys[i + SPECTRUM_LOOKUP_PREFETCH_DISTANCE]->m256i_u32[0] & (SPECTRUM_CAPACITY - 1)], _MM_HINT_T0);
+            }
+            indices[i] = (publicKeys[i] && !isZero(*publicKeys[i])) ? findSpectrumIndex(*publicKeys[i]) : -1;
+        }
+    } while (!spectrumSeqLock.endRead(sequence));
+}
+
+// Same as spectrumIndex(publicKey), but only checks cachedIndex if the entity has been found there before (for example
+// with spectrumIndices()). Entities only move if the spectrum is reorganized and new ones may have been added since
+// the lookup, so the full lookup is done if the entity is not at cachedIndex anymore or has not been found before.
+static int spectrumIndex(const m256i& publicKey, int cachedIndex)
+{
+    if (cachedIndex >= 0)
+    {
+        bool isCachedIndexValid;
+        long long sequence;
+        do
         {
-            index = (index + 1) & (SPECTRUM_CAPACITY - 1);
+            sequence = spectrumSeqLock.beginRead();
+            isCachedIndexValid = spectrum[cachedIndex].publicKey == publicKey;
+        } while (!spectrumSeqLock.endRead(sequence));
 
-            goto iteration;
+        if (isCachedIndexValid)
+        {
+            return cachedIndex;
         }
     }
+    return spectrumIndex(publicKey);
 }
 
 static long long energy(const int index)
@@ -182,52 +842,25 @@ static long long energy(const int index)
     return spectrum[index].incomingAmount - spectrum[index].outgoingAmount;
 }
 
-// Increase balance of entity. Does not update spectrumInfo.totalAmount.
-static void increaseEnergy(const m256i& publicKey, long long amount)
+// Increase balance of entity. Does not update spectrumInfo.totalAmount. If cachedIndex is the index the entity has
+// been found at before (for example with spectrumIndices()) and the entity is still there, probing is skipped.
+static void increaseEnergy(const m256i& publicKey, long long amount, int cachedIndex = -1)
 {
     if (!isZero(publicKey) && amount >= 0)
     {
-        unsigned int index = publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
+        const unsigned int homeIndex = publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
+        const unsigned char tag = spectrumProbeTags.tagOf(publicKey);
+        unsigned int keyComparisons = 1;
 
-        ACQUIRE(spectrumLock);
+        beginSpectrumChange();
 
         if (spectrumInfo.numberOfEntities >= (SPECTRUM_CAPACITY / 2) + (SPECTRUM_CAPACITY / 4))
         {
             // Update anti-dust burn thresholds
-            updateAndAnalzeEntityCategoryPopulations();
+            analyzeEntityCategoryPopulations();
 
-            if (dustThresholdBurnAll > 0)
-            {
-                // Burn every balance with balance < dustThresholdBurnAll
-                for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
-                {
-                    const unsigned long long balance = spectrum[i].incomingAmount - spectrum[i].outgoingAmount;
-                    if (balance <= dustThresholdBurnAll && balance)
-                    {
-                        spectrum[i].outgoingAmount = spectrum[i].incomingAmount;
-                    }
-                }
-            }
-
-            if (dustThresholdBurnHalf > 0)
-            {
-                // Burn every second balance with balance < dustThresholdBurnHalf
-                unsigned int countBurnCanadiates = 0;
-                for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
-                {
-                    const unsigned long long balance = spectrum[i].incomingAmount - spectrum[i].outgoingAmount;
-                    if (balance <= dustThresholdBurnHalf && balance)
-                    {
-                        if (++countBurnCanadiates & 1)
-                        {
-                            spectrum[i].outgoingAmount = spectrum[i].incomingAmount;
-                        }
-                    }
-                }
-            }
-
-            // Remove entries with balance zero from hash map
-            reorganizeSpectrum();
+            // Burn dust and remove entries with balance zero from hash map
+            reorganizeSpectrum(dustThresholdBurnAll, dustThresholdBurnHalf);
 
             // Correct total amount (spectrum info has been recomputed before increasing energy;
             // in transfer case energy has been decreased before and total amount is not changed
@@ -235,33 +868,46 @@ static void increaseEnergy(const m256i& publicKey, long long amount)
             spectrumInfo.totalAmount += amount;
         }
 
+        // Slots with other tags cannot hold the entity and are not empty. The cached index is checked after the
+        // reorganization above, which moves entities.
+        unsigned int index = (cachedIndex >= 0 && spectrum[cachedIndex].publicKey == publicKey) ? cachedIndex : spectrumProbeTags.nextCandidate(homeIndex, tag);
     iteration:
         if (spectrum[index].publicKey == publicKey)
         {
+            updateEntityCategoryPopulations(energy(index), energy(index) + amount);
             spectrum[index].incomingAmount += amount;
+            spectrumBalances[index] += amount;
             spectrum[index].numberOfIncomingTransfers++;
             spectrum[index].latestIncomingTransferTick = system.tick;
+            markSpectrumLeafChanged(index);
+            spectrumProbeTags.countProbe(homeIndex, index, keyComparisons);
         }
         else
         {
             if (isZero(spectrum[index].publicKey))
             {
+                updateEntityCategoryPopulations(0, amount);
                 spectrum[index].publicKey = publicKey;
                 spectrum[index].incomingAmount = amount;
+                spectrumBalances[index] = amount;
+                spectrumProbeTags.set(index, publicKey);
                 spectrum[index].numberOfIncomingTransfers = 1;
                 spectrum[index].latestIncomingTransferTick = system.tick;
+                markSpectrumLeafChanged(index);
+                spectrumProbeTags.countProbe(homeIndex, index, keyComparisons);
 
                 spectrumInfo.numberOfEntities++;
             }
             else
             {
-                index = (index + 1) & (SPECTRUM_CAPACITY - 1);
+                index = spectrumProbeTags.nextCandidate((index + 1) & (SPECTRUM_CAPACITY - 1), tag);
+                keyComparisons++;
 
                 goto iteration;
             }
         }
 
-        RELEASE(spectrumLock);
+        endSpectrumChange();
     }
 }
 
@@ -270,20 +916,23 @@ static bool decreaseEnergy(const int index, long long amount)
 {
     if (amount >= 0)
     {
-        ACQUIRE(spectrumLock);
+        beginSpectrumChange();
 
         if (energy(index) >= amount)
         {
+            updateEntityCategoryPopulations(energy(index), energy(index) - amount);
             spectrum[index].outgoingAmount += amount;
+            spectrumBalances[index] -= amount;
             spectrum[index].numberOfOutgoingTransfers++;
             spectrum[index].latestOutgoingTransferTick = system.tick;
+            markSpectrumLeafChanged(index);
 
-            RELEASE(spectrumLock);
+            endSpectrumChange();
 
             return true;
         }
 
-        RELEASE(spectrumLock);
+        endSpectrumChange();
     }
 
     return false;
@@ -293,14 +942,19 @@ static bool decreaseEnergy(const int index, long long amount)
 static bool loadSpectrum(const CHAR16* fileName = SPECTRUM_FILE_NAME, const CHAR16* directory = nullptr)
 {
     logToConsole(L"Loading spectrum file ...");
+    beginSpectrumChange();
     long long loadedSize = load(fileName, SPECTRUM_CAPACITY * sizeof(::Entity), (unsigned char*)spectrum, directory);
     if (loadedSize != SPECTRUM_CAPACITY * sizeof(::Entity))
     {
+        endSpectrumChange();
         logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() reads invalid number of bytes", loadedSize, __LINE__);
 
         return false;
     }
+    rebuildSpectrumBalances();
     updateSpectrumInfo();
+    updateAndAnalzeEntityCategoryPopulations();
+    endSpectrumChange();
     return true;
 }
 
@@ -329,6 +983,8 @@ static bool saveSpectrum(const CHAR16* fileName = SPECTRUM_FILE_NAME, const CHAR
 static bool initSpectrum()
 {
     if (!allocatePool(spectrumSizeInBytes, (void**)&spectrum)
+        || !allocatePool(spectrumBalancesSizeInBytes, (void**)&spectrumBalances)
+        || !spectrumProbeTags.init()
         || !allocatePool(spectrumDigestsSizeInByte, (void**)&spectrumDigests))
     {
         logToConsole(L"Failed to allocate spectrum memory!");
@@ -344,6 +1000,11 @@ static void deinitSpectrum()
     {
         freePool(spectrumDigests);
     }
+    spectrumProbeTags.deinit();
+    if (spectrumBalances)
+    {
+        freePool(spectrumBalances);
+    }
     if (spectrum)
     {
         freePool(spectrum);
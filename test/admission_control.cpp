@@ -0,0 +1,58 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/network_core/admission_control.h"
+
+
+TEST(TestCoreAdmissionControl, AdmissionClasses)
+{
+    EXPECT_EQ(getAdmissionClass(BroadcastTick::type), ADMISSION_CLASS_CONSENSUS);
+    EXPECT_EQ(getAdmissionClass(BroadcastFutureTickData::type), ADMISSION_CLASS_CONSENSUS);
+    EXPECT_EQ(getAdmissionClass(RequestTickData::type), ADMISSION_CLASS_CONSENSUS);
+    EXPECT_EQ(getAdmissionClass(REQUEST_TICK_TRANSACTIONS), ADMISSION_CLASS_CONSENSUS);
+    EXPECT_EQ(getAdmissionClass(BROADCAST_TRANSACTION), ADMISSION_CLASS_TRANSACTIONS);
+    EXPECT_EQ(getAdmissionClass(BroadcastMessage::type), ADMISSION_CLASS_TRANSACTIONS);
+    EXPECT_EQ(getAdmissionClass(REQUEST_CURRENT_TICK_INFO), ADMISSION_CLASS_QUERIES);
+    EXPECT_EQ(getAdmissionClass(200), ADMISSION_CLASS_QUERIES);
+}
+
+TEST(TestCoreAdmissionControl, TokenBuckets)
+{
+    constexpr unsigned long long interval = 1000, burstSize = 50;
+    PeerAdmissionControl admissionControl;
+    admissionControl.reset();
+
+    // full bucket admits burst at once
+    unsigned long long now = 123456789;
+    for (unsigned int i = 0; i < burstSize; i++)
+        EXPECT_TRUE(admissionControl.admit(ADMISSION_CLASS_QUERIES, now, interval, burstSize));
+    EXPECT_FALSE(admissionControl.admit(ADMISSION_CLASS_QUERIES, now, interval, burstSize));
+
+    // other classes have their own buckets
+    EXPECT_TRUE(admissionControl.admit(ADMISSION_CLASS_CONSENSUS, now, interval, burstSize));
+    EXPECT_TRUE(admissionControl.admit(ADMISSION_CLASS_TRANSACTIONS, now, interval, burstSize));
+
+    // one token per interval is refilled
+    EXPECT_FALSE(admissionControl.admit(ADMISSION_CLASS_QUERIES, now + interval - 1, interval, burstSize));
+    EXPECT_TRUE(admissionControl.admit(ADMISSION_CLASS_QUERIES, now + interval, interval, burstSize));
+    EXPECT_FALSE(admissionControl.admit(ADMISSION_CLASS_QUERIES, now + interval, interval, burstSize));
+
+    // sustained rate is limited to one message per interval (starting when the next token is refilled)
+    now += 2 * interval;
+    unsigned int numberOfAdmitted = 0;
+    for (unsigned long long t = now; t < now + 100 * interval; t += interval / 10)
+        numberOfAdmitted += admissionControl.admit(ADMISSION_CLASS_QUERIES, t, interval, burstSize);
+    EXPECT_EQ(numberOfAdmitted, 100);
+
+    // bucket does not fill beyond burst size while idle
+    now += 1000 * interval;
+    numberOfAdmitted = 0;
+    for (unsigned int i = 0; i < 2 * burstSize; i++)
+        numberOfAdmitted += admissionControl.admit(ADMISSION_CLASS_QUERIES, now, interval, burstSize);
+    EXPECT_EQ(numberOfAdmitted, burstSize);
+
+    // reset fills all buckets
+    admissionControl.reset();
+    EXPECT_TRUE(admissionControl.admit(ADMISSION_CLASS_QUERIES, now, interval, burstSize));
+}
@@ -0,0 +1,516 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#define system qubicSystemStruct
+#define time qubicTime
+
+#include "../src/text_output.h"
+#include "../src/assets.h"
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+// Take the responses to the last request from the response queue, return the universe indices of the records in order
+// of the responses
+static std::vector<unsigned int> dequeueAssetResponses(unsigned char responseType)
+{
+    std::vector<unsigned int> universeIndices;
+    unsigned int numberOfEndResponses = 0;
+    Peer* peer;
+    RequestResponseHeader* header;
+    while ((header = responseQueue.dequeue(peer)) != nullptr)
+    {
+        if (header->type() == EndResponse::type)
+        {
+            EXPECT_EQ(header->size(), sizeof(RequestResponseHeader));
+            numberOfEndResponses++;
+        }
+        else
+        {
+            EXPECT_EQ(header->type(), responseType);
+            EXPECT_EQ(numberOfEndResponses, 0);
+            switch (header->type())
+            {
+            case RespondIssuedAssets::type:
+            {
+                const RespondIssuedAssets* response = header->getPayload<RespondIssuedAssets>();
+                EXPECT_EQ(memcmp(&response->asset, &assets[response->universeIndex], sizeof(Asset)), 0);
+                universeIndices.push_back(response->universeIndex);
+                break;
+            }
+            case RespondOwnedAssets::type:
+            {
+                const RespondOwnedAssets* response = header->getPayload<RespondOwnedAssets>();
+                EXPECT_EQ(memcmp(&response->asset, &assets[response->universeIndex], sizeof(Asset)), 0);
+                EXPECT_EQ(memcmp(&response->issuanceAsset, &assets[response->asset.varStruct.ownership.issuanceIndex], sizeof(Asset)), 0);
+                universeIndices.push_back(response->universeIndex);
+                break;
+            }
+            case RespondPossessedAssets::type:
+            {
+                const RespondPossessedAssets* response = header->getPayload<RespondPossessedAssets>();
+                EXPECT_EQ(memcmp(&response->asset, &assets[response->universeIndex], sizeof(Asset)), 0);
+                EXPECT_EQ(memcmp(&response->ownershipAsset, &assets[response->asset.varStruct.possession.ownershipIndex], sizeof(Asset)), 0);
+                universeIndices.push_back(response->universeIndex);
+                break;
+            }
+            }
+        }
+        responseQueue.release();
+    }
+    EXPECT_EQ(numberOfEndResponses, 1);
+    return universeIndices;
+}
+
+// Reference: universe indices of the records with type and publicKey found by scanning the whole universe
+static std::vector<unsigned int> scanUniverse(const m256i& publicKey, unsigned char type)
+{
+    std::vector<unsigned int> universeIndices;
+    for (unsigned int universeIndex = 0; universeIndex < ASSETS_CAPACITY; universeIndex++)
+    {
+        if (assets[universeIndex].varStruct.issuance.type == type && assets[universeIndex].varStruct.issuance.publicKey == publicKey)
+        {
+            universeIndices.push_back(universeIndex);
+        }
+    }
+    return universeIndices;
+}
+
+// Reference: universe indices of the records with type and publicKey in the order of the index list, which has to
+// contain the same records as a scan of the whole universe
+static std::vector<unsigned int> walkAssetIndex(const m256i& publicKey, unsigned char type)
+{
+    std::vector<unsigned int> universeIndices;
+    for (unsigned int universeIndex = assetIndexFirst[publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1)]; universeIndex != NO_ASSET_INDEX; universeIndex = assetIndexNext[universeIndex])
+    {
+        if (assets[universeIndex].varStruct.issuance.type == type && assets[universeIndex].varStruct.issuance.publicKey == publicKey)
+        {
+            universeIndices.push_back(universeIndex);
+        }
+    }
+    std::vector<unsigned int> sortedUniverseIndices = universeIndices;
+    std::sort(sortedUniverseIndices.begin(), sortedUniverseIndices.end());
+    EXPECT_EQ(sortedUniverseIndices, scanUniverse(publicKey, type));
+    return universeIndices;
+}
+
+// Check the responses of the asset requests of publicKey against the index list and a scan of the universe
+static void checkAssetRequests(const m256i& publicKey)
+{
+    struct
+    {
+        RequestResponseHeader header;
+        m256i publicKey;
+    } request;
+    request.header.checkAndSetSize(sizeof(request));
+    request.header.setDejavu(1234);
+    request.publicKey = publicKey;
+
+    request.header.setType(RequestIssuedAssets::type);
+    processRequestIssuedAssets(nullptr, &request.header);
+    EXPECT_EQ(dequeueAssetResponses(RespondIssuedAssets::type), walkAssetIndex(publicKey, ISSUANCE));
+
+    request.header.setType(RequestOwnedAssets::type);
+    processRequestOwnedAssets(nullptr, &request.header);
+    EXPECT_EQ(dequeueAssetResponses(RespondOwnedAssets::type), walkAssetIndex(publicKey, OWNERSHIP));
+
+    request.header.setType(RequestPossessedAssets::type);
+    processRequestPossessedAssets(nullptr, &request.header);
+    EXPECT_EQ(dequeueAssetResponses(RespondPossessedAssets::type), walkAssetIndex(publicKey, POSSESSION));
+}
+
+// Check findAssetPossession() for the key of each possession record against a scan of the universe, which also checks
+// that there is only one record per key
+static void checkFindAssetPossession()
+{
+    unsigned int numberOfPossessions = 0;
+    for (unsigned int universeIndex = 0; universeIndex < ASSETS_CAPACITY; universeIndex++)
+    {
+        if (assets[universeIndex].varStruct.possession.type != POSSESSION)
+        {
+            continue;
+        }
+        const auto& possession = assets[universeIndex].varStruct.possession;
+        const auto& ownership = assets[possession.ownershipIndex].varStruct.ownership;
+        const auto& issuance = assets[ownership.issuanceIndex].varStruct.issuance;
+        const unsigned long long assetName = *((unsigned long long*)issuance.name) & 0xFFFFFFFFFFFFFF;
+        EXPECT_EQ(findAssetPossession(assetName, issuance.publicKey, ownership.publicKey, possession.publicKey,
+            ownership.managingContractIndex, possession.managingContractIndex), (int)universeIndex);
+        numberOfPossessions++;
+
+        // Changing any part of the key must not find the record
+        EXPECT_NE(findAssetPossession(assetName ^ 1, issuance.publicKey, ownership.publicKey, possession.publicKey,
+            ownership.managingContractIndex, possession.managingContractIndex), (int)universeIndex);
+        EXPECT_NE(findAssetPossession(assetName, issuance.publicKey, ownership.publicKey, possession.publicKey,
+            ownership.managingContractIndex, possession.managingContractIndex + 1), (int)universeIndex);
+        EXPECT_NE(findAssetPossession(assetName, issuance.publicKey, ownership.publicKey, possession.publicKey,
+            ownership.managingContractIndex + 1, possession.managingContractIndex), (int)universeIndex);
+    }
+    EXPECT_GT(numberOfPossessions, 0);
+}
+
+static void rebuildAssetIndexLocked()
+{
+    ACQUIRE(universeLock);
+    universeSeqLock.beginWrite();
+    rebuildAssetIndex();
+    universeSeqLock.endWrite();
+    RELEASE(universeLock);
+}
+
+class AssetsTest : public ::testing::Test
+{
+protected:
+    static void SetUpTestSuite()
+    {
+        ASSERT_TRUE(initAssets());
+        ASSERT_TRUE(responseQueue.init());
+    }
+
+    static void TearDownTestSuite()
+    {
+        responseQueue.deinit();
+        deinitAssets();
+    }
+
+    void SetUp() override
+    {
+        setMem(assets, ASSETS_CAPACITY * sizeof(Asset), 0);
+        universeSeqLock.reset();
+        rebuildAssetIndexLocked();
+    }
+
+    // Public keys sharing the hash bucket of the index and the home slot in the universe, so their records are in the
+    // same index list and probe sequence
+    void initPublicKeys(std::mt19937_64& gen64, m256i* publicKeys, unsigned int numberOfPublicKeys)
+    {
+        for (unsigned int i = 0; i < numberOfPublicKeys; i++)
+        {
+            publicKeys[i] = m256i(gen64(), gen64(), gen64(), gen64());
+            publicKeys[i].m256i_u32[0] = 0x12345;
+        }
+    }
+
+    // Issue numberOfAssets assets of issuer, return ownership and possession indices of each
+    void issue(const m256i& issuer, unsigned int numberOfAssets, std::vector<int>& ownershipIndices, std::vector<int>& possessionIndices,
+        unsigned short managingContractIndex = 1)
+    {
+        for (unsigned int i = 0; i < numberOfAssets; i++)
+        {
+            char name[7] = { 'A', 'S', 'S', 'E', 'T', (char)('A' + i / 26), (char)('A' + i % 26) };
+            char unit[7] = { 0, 0, 0, 0, 0, 0, 0 };
+            int issuanceIndex, ownershipIndex, possessionIndex;
+            EXPECT_EQ(issueAsset(issuer, name, 0, unit, 1000000, managingContractIndex, &issuanceIndex, &ownershipIndex, &possessionIndex), 1000000);
+            ownershipIndices.push_back(ownershipIndex);
+            possessionIndices.push_back(possessionIndex);
+        }
+    }
+};
+
+TEST_F(AssetsTest, RequestsMatchLinearScan)
+{
+    std::mt19937_64 gen64(42);
+    m256i publicKeys[4];
+    initPublicKeys(gen64, publicKeys, 4);
+
+    // More assets than fit into one batch of collectAssetRecords()
+    std::vector<int> ownershipIndices, possessionIndices;
+    issue(publicKeys[0], ASSET_RECORD_BATCH_SIZE * 2 + 5, ownershipIndices, possessionIndices);
+    issue(publicKeys[1], 3, ownershipIndices, possessionIndices);
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        checkAssetRequests(publicKeys[i]);
+    }
+
+    // Transfers add ownership and possession records to the index during the epoch
+    for (unsigned int i = 0; i < 300; i++)
+    {
+        const unsigned int sourceIndex = (unsigned int)(gen64() % ownershipIndices.size());
+        const m256i& destination = publicKeys[gen64() % 4];
+        int destinationOwnershipIndex, destinationPossessionIndex;
+        if (transferShareOwnershipAndPossession(ownershipIndices[sourceIndex], possessionIndices[sourceIndex], destination, 1 + gen64() % 100,
+            &destinationOwnershipIndex, &destinationPossessionIndex, true))
+        {
+            ownershipIndices.push_back(destinationOwnershipIndex);
+            possessionIndices.push_back(destinationPossessionIndex);
+        }
+    }
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        checkAssetRequests(publicKeys[i]);
+    }
+
+    // Records added during the epoch are at the beginning of the lists, rebuilding orders the lists by universe index
+    EXPECT_NE(walkAssetIndex(publicKeys[0], OWNERSHIP), scanUniverse(publicKeys[0], OWNERSHIP));
+    rebuildAssetIndexLocked();
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        EXPECT_EQ(walkAssetIndex(publicKeys[i], OWNERSHIP), scanUniverse(publicKeys[i], OWNERSHIP));
+        checkAssetRequests(publicKeys[i]);
+    }
+
+    // Unknown public key sharing the bucket
+    m256i unknownPublicKey;
+    initPublicKeys(gen64, &unknownPublicKey, 1);
+    checkAssetRequests(unknownPublicKey);
+}
+
+TEST_F(AssetsTest, CollectAssetRecordsInBatches)
+{
+    std::mt19937_64 gen64(123);
+    m256i issuer;
+    initPublicKeys(gen64, &issuer, 1);
+    std::vector<int> ownershipIndices, possessionIndices;
+    issue(issuer, ASSET_RECORD_BATCH_SIZE + 1, ownershipIndices, possessionIndices);
+
+    rebuildAssetIndexLocked();
+    const std::vector<unsigned int> expected = scanUniverse(issuer, OWNERSHIP);
+    ASSERT_EQ(expected.size(), ASSET_RECORD_BATCH_SIZE + 1);
+
+    // Each batch continues where the previous one ended
+    unsigned int universeIndices[ASSET_RECORD_BATCH_SIZE];
+    AssetRecordCursor cursor;
+    beginAssetRecords(issuer, cursor);
+    EXPECT_EQ(collectAssetRecords(issuer, OWNERSHIP, cursor, universeIndices), ASSET_RECORD_BATCH_SIZE);
+    EXPECT_TRUE(std::equal(universeIndices, universeIndices + ASSET_RECORD_BATCH_SIZE, expected.begin()));
+    EXPECT_EQ(collectAssetRecords(issuer, OWNERSHIP, cursor, universeIndices), 1);
+    EXPECT_EQ(universeIndices[0], expected.back());
+    EXPECT_EQ(cursor.nextUniverseIndex, NO_ASSET_INDEX);
+    EXPECT_EQ(collectAssetRecords(issuer, OWNERSHIP, cursor, universeIndices), 0);
+
+    // Positions are not valid anymore after the index is rebuilt
+    beginAssetRecords(issuer, cursor);
+    EXPECT_EQ(collectAssetRecords(issuer, OWNERSHIP, cursor, universeIndices), ASSET_RECORD_BATCH_SIZE);
+    rebuildAssetIndexLocked();
+    EXPECT_EQ(collectAssetRecords(issuer, OWNERSHIP, cursor, universeIndices), 0);
+}
+
+TEST_F(AssetsTest, FindAssetPossessionMatchesLinearScan)
+{
+    std::mt19937_64 gen64(7);
+    m256i publicKeys[6];
+    initPublicKeys(gen64, publicKeys, 3);
+    for (unsigned int i = 3; i < 6; i++)
+    {
+        publicKeys[i] = m256i(gen64(), gen64(), gen64(), gen64());
+    }
+
+    // Same asset names issued by several issuers, managed by different contracts
+    std::vector<int> ownershipIndices, possessionIndices;
+    issue(publicKeys[0], 10, ownershipIndices, possessionIndices, 1);
+    issue(publicKeys[3], 10, ownershipIndices, possessionIndices, 2);
+    checkFindAssetPossession();
+
+    // Repeated transfers between few public keys add shares to the existing records instead of new ones
+    for (unsigned int i = 0; i < 2000; i++)
+    {
+        const unsigned int sourceIndex = (unsigned int)(gen64() % ownershipIndices.size());
+        int destinationOwnershipIndex, destinationPossessionIndex;
+        if (transferShareOwnershipAndPossession(ownershipIndices[sourceIndex], possessionIndices[sourceIndex], publicKeys[gen64() % 6], 1 + gen64() % 1000,
+            &destinationOwnershipIndex, &destinationPossessionIndex, true))
+        {
+            ownershipIndices.push_back(destinationOwnershipIndex);
+            possessionIndices.push_back(destinationPossessionIndex);
+        }
+    }
+    checkFindAssetPossession();
+
+    // Unknown possessor
+    const auto& issuance = assets[assets[ownershipIndices[0]].varStruct.ownership.issuanceIndex].varStruct.issuance;
+    EXPECT_EQ(findAssetPossession(*((unsigned long long*)issuance.name) & 0xFFFFFFFFFFFFFF, issuance.publicKey, issuance.publicKey,
+        m256i(1, 2, 3, 4), 1, 1), -1);
+
+    rebuildAssetIndexLocked();
+    checkFindAssetPossession();
+}
+
+// Reference: reorganization of the universe into reorgBuffer as done by assetsEndEpoch() before it was parallelized
+static void reorganizeUniverseSerially()
+{
+    Asset* reorgAssets = (Asset*)reorgBuffer;
+    setMem(reorgAssets, ASSETS_CAPACITY * sizeof(Asset), 0);
+    for (unsigned int i = 0; i < ASSETS_CAPACITY; i++)
+    {
+        if (assets[i].varStruct.possession.type == POSSESSION
+            && assets[i].varStruct.possession.numberOfShares > 0)
+        {
+            const unsigned int oldOwnershipIndex = assets[i].varStruct.possession.ownershipIndex;
+            const unsigned int oldIssuanceIndex = assets[oldOwnershipIndex].varStruct.ownership.issuanceIndex;
+            const m256i& issuerPublicKey = assets[oldIssuanceIndex].varStruct.issuance.publicKey;
+            char* name = assets[oldIssuanceIndex].varStruct.issuance.name;
+            int issuanceIndex = issuerPublicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
+            while (!(reorgAssets[issuanceIndex].varStruct.issuance.type == EMPTY
+                || (reorgAssets[issuanceIndex].varStruct.issuance.type == ISSUANCE
+                    && ((*((unsigned long long*)reorgAssets[issuanceIndex].varStruct.issuance.name)) & 0xFFFFFFFFFFFFFF) == ((*((unsigned long long*)name)) & 0xFFFFFFFFFFFFFF)
+                    && reorgAssets[issuanceIndex].varStruct.issuance.publicKey == issuerPublicKey)))
+            {
+                issuanceIndex = (issuanceIndex + 1) & (ASSETS_CAPACITY - 1);
+            }
+            if (reorgAssets[issuanceIndex].varStruct.issuance.type == EMPTY)
+            {
+                copyMem(&reorgAssets[issuanceIndex], &assets[oldIssuanceIndex], sizeof(Asset));
+            }
+
+            const m256i& ownerPublicKey = assets[oldOwnershipIndex].varStruct.ownership.publicKey;
+            int ownershipIndex = ownerPublicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
+            while (!(reorgAssets[ownershipIndex].varStruct.ownership.type == EMPTY
+                || (reorgAssets[ownershipIndex].varStruct.ownership.type == OWNERSHIP
+                    && reorgAssets[ownershipIndex].varStruct.ownership.managingContractIndex == assets[oldOwnershipIndex].varStruct.ownership.managingContractIndex
+                    && reorgAssets[ownershipIndex].varStruct.ownership.issuanceIndex == issuanceIndex
+                    && reorgAssets[ownershipIndex].varStruct.ownership.publicKey == ownerPublicKey)))
+            {
+                ownershipIndex = (ownershipIndex + 1) & (ASSETS_CAPACITY - 1);
+            }
+            if (reorgAssets[ownershipIndex].varStruct.ownership.type == EMPTY)
+            {
+                reorgAssets[ownershipIndex].varStruct.ownership.publicKey = ownerPublicKey;
+                reorgAssets[ownershipIndex].varStruct.ownership.type = OWNERSHIP;
+                reorgAssets[ownershipIndex].varStruct.ownership.managingContractIndex = assets[oldOwnershipIndex].varStruct.ownership.managingContractIndex;
+                reorgAssets[ownershipIndex].varStruct.ownership.issuanceIndex = issuanceIndex;
+            }
+            reorgAssets[ownershipIndex].varStruct.ownership.numberOfShares += assets[i].varStruct.possession.numberOfShares;
+
+            int possessionIndex = assets[i].varStruct.possession.publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
+            while (!(reorgAssets[possessionIndex].varStruct.possession.type == EMPTY
+                || (reorgAssets[possessionIndex].varStruct.possession.type == POSSESSION
+                    && reorgAssets[possessionIndex].varStruct.possession.managingContractIndex == assets[i].varStruct.possession.managingContractIndex
+                    && reorgAssets[possessionIndex].varStruct.possession.ownershipIndex == ownershipIndex
+                    && reorgAssets[possessionIndex].varStruct.possession.publicKey == assets[i].varStruct.possession.publicKey)))
+            {
+                possessionIndex = (possessionIndex + 1) & (ASSETS_CAPACITY - 1);
+            }
+            if (reorgAssets[possessionIndex].varStruct.possession.type == EMPTY)
+            {
+                reorgAssets[possessionIndex].varStruct.possession.publicKey = assets[i].varStruct.possession.publicKey;
+                reorgAssets[possessionIndex].varStruct.possession.type = POSSESSION;
+                reorgAssets[possessionIndex].varStruct.possession.managingContractIndex = assets[i].varStruct.possession.managingContractIndex;
+                reorgAssets[possessionIndex].varStruct.possession.ownershipIndex = ownershipIndex;
+            }
+            reorgAssets[possessionIndex].varStruct.possession.numberOfShares += assets[i].varStruct.possession.numberOfShares;
+        }
+    }
+}
+
+// Check that the digest tree updated from the change flags equals the tree hashed from scratch
+static void checkUniverseDigestAgainstFullRecompute()
+{
+    m256i digest, treeDigest;
+    getUniverseDigest(digest);
+    KangarooTwelve(assetDigests, (unsigned int)assetDigestsSizeInBytes, &treeDigest, 32);
+
+    setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0xFF);
+    m256i recomputedDigest, recomputedTreeDigest;
+    getUniverseDigest(recomputedDigest);
+    KangarooTwelve(assetDigests, (unsigned int)assetDigestsSizeInBytes, &recomputedTreeDigest, 32);
+    EXPECT_EQ(digest, recomputedDigest);
+    EXPECT_EQ(treeDigest, recomputedTreeDigest);
+}
+
+TEST(TestCoreAssets, EndEpochMatchesSerialReorganization)
+{
+    ASSERT_TRUE(initAssets());
+    ASSERT_TRUE(initCommonBuffers());
+    setMem(assets, ASSETS_CAPACITY * sizeof(Asset), 0);
+    universeSeqLock.reset();
+    rebuildAssetIndexLocked();
+    m256i digest;
+    getUniverseDigest(digest);
+
+    // Issuers and holders, some of them sharing their home slot (also at the end of the universe, so probe sequences
+    // wrap around)
+    std::mt19937_64 gen64(2024);
+    std::vector<m256i> publicKeys(2000);
+    for (unsigned int i = 0; i < publicKeys.size(); i++)
+    {
+        publicKeys[i] = m256i(gen64(), gen64(), gen64(), gen64());
+        if (i % 4 == 0)
+        {
+            publicKeys[i].m256i_u32[0] = (i % 8 == 0) ? 0x54321 : (unsigned int)(ASSETS_CAPACITY - 3);
+        }
+    }
+    std::vector<int> ownershipIndices, possessionIndices;
+    for (unsigned int i = 0; i < 200; i++)
+    {
+        char name[7] = { 'A', 'S', 'S', 'E', 'T', (char)('A' + i / 26), (char)('A' + i % 26) };
+        char unit[7] = { 0, 0, 0, 0, 0, 0, 0 };
+        int issuanceIndex, ownershipIndex, possessionIndex;
+        EXPECT_EQ(issueAsset(publicKeys[i % 50], name, 0, unit, 1000000, 1 + i % 3, &issuanceIndex, &ownershipIndex, &possessionIndex), 1000000);
+        ownershipIndices.push_back(ownershipIndex);
+        possessionIndices.push_back(possessionIndex);
+    }
+
+    // Transfers, a quarter of them of all shares of the source, which leaves records without shares
+    for (unsigned int i = 0; i < 20000; i++)
+    {
+        const unsigned int sourceIndex = (unsigned int)(gen64() % ownershipIndices.size());
+        const long long numberOfShares = assets[possessionIndices[sourceIndex]].varStruct.possession.numberOfShares;
+        if (!numberOfShares)
+        {
+            continue;
+        }
+        const long long numberOfTransferredShares = (gen64() % 4 == 0) ? numberOfShares : 1 + gen64() % numberOfShares;
+        int destinationOwnershipIndex, destinationPossessionIndex;
+        if (transferShareOwnershipAndPossession(ownershipIndices[sourceIndex], possessionIndices[sourceIndex], publicKeys[gen64() % publicKeys.size()],
+            numberOfTransferredShares, &destinationOwnershipIndex, &destinationPossessionIndex, true))
+        {
+            ownershipIndices.push_back(destinationOwnershipIndex);
+            possessionIndices.push_back(destinationPossessionIndex);
+        }
+    }
+    checkUniverseDigestAgainstFullRecompute();
+
+    // Expected layout and number of records changed by the reorganization
+    reorganizeUniverseSerially();
+    Asset* expectedAssets = nullptr;
+    ASSERT_TRUE(allocatePool(ASSETS_CAPACITY * sizeof(Asset), (void**)&expectedAssets));
+    copyMem(expectedAssets, reorgBuffer, ASSETS_CAPACITY * sizeof(Asset));
+    unsigned long long numberOfChangedRecords = 0;
+    for (unsigned int universeIndex = 0; universeIndex < ASSETS_CAPACITY; universeIndex++)
+    {
+        if (memcmp(&assets[universeIndex], &expectedAssets[universeIndex], sizeof(Asset)))
+        {
+            numberOfChangedRecords++;
+        }
+    }
+    EXPECT_GT(numberOfChangedRecords, 0);
+
+    // Clearing and committing in parallel with helper threads
+    std::atomic<bool> stopHelpers = false;
+    std::vector<std::thread> helpers;
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        helpers.emplace_back([&stopHelpers]()
+            {
+                while (!stopHelpers)
+                {
+                    parallelJob.help();
+                    _mm_pause();
+                }
+            });
+    }
+    assetsEndEpoch();
+    stopHelpers = true;
+    for (auto& helper : helpers)
+    {
+        helper.join();
+    }
+
+    EXPECT_EQ(memcmp(assets, expectedAssets, ASSETS_CAPACITY * sizeof(Asset)), 0);
+    EXPECT_EQ(numberOfRecordsChangedByUniverseReorg, numberOfChangedRecords);
+    unsigned long long numberOfFlaggedRecords = 0;
+    for (unsigned int i = 0; i < ASSETS_CAPACITY / 64; i++)
+    {
+        numberOfFlaggedRecords += _mm_popcnt_u64(assetChangeFlags[i]);
+    }
+    EXPECT_EQ(numberOfFlaggedRecords, numberOfChangedRecords);
+    checkUniverseDigestAgainstFullRecompute();
+
+    freePool(expectedAssets);
+    deinitCommonBuffers();
+    deinitAssets();
+}
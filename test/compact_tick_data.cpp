@@ -0,0 +1,221 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/network_core/compact_tick_data.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+
+static std::mt19937_64 gen64(42);
+
+static m256i randomDigest()
+{
+    return m256i(gen64(), gen64(), gen64(), gen64());
+}
+
+static void setRandomTickData(TickData& tickData, unsigned int numberOfTransactions, unsigned int numberOfContractFees)
+{
+    memset(&tickData, 0, sizeof(tickData));
+    tickData.computorIndex = 123;
+    tickData.epoch = 126;
+    tickData.tick = 15840123;
+    tickData.millisecond = 456;
+    tickData.second = 7;
+    tickData.minute = 8;
+    tickData.hour = 9;
+    tickData.day = 10;
+    tickData.month = 11;
+    tickData.year = 24;
+    tickData.timelock = randomDigest();
+    for (unsigned int i = 0; i < numberOfTransactions; i++)
+        tickData.transactionDigests[i] = randomDigest();
+    for (unsigned int i = 0; i < numberOfContractFees; i++)
+        tickData.contractFees[gen64() % MAX_NUMBER_OF_CONTRACTS] = gen64() % 1000000 + 1;
+    for (unsigned int i = 0; i < SIGNATURE_SIZE; i++)
+        tickData.signature[i] = (unsigned char)gen64();
+}
+
+TEST(TestCoreCompactTickData, RebuildFromPendingTransactions)
+{
+    static TickData tickData;
+    static unsigned char compactTickData[MAX_COMPACT_TICK_DATA_SIZE], reencodedCompactTickData[MAX_COMPACT_TICK_DATA_SIZE];
+    static TickDataReconstruction reconstruction;
+
+    for (unsigned int numberOfTransactions : { 0u, 1u, 500u, (unsigned int)NUMBER_OF_TRANSACTIONS_PER_TICK })
+    {
+        setRandomTickData(tickData, numberOfTransactions, numberOfTransactions % 7);
+        const unsigned int size = encodeCompactTickData(tickData, (CompactTickData*)compactTickData);
+        EXPECT_EQ(size, sizeof(CompactTickData) + numberOfTransactions * SHORT_TRANSACTION_ID_SIZE + (numberOfTransactions % 7) * sizeof(CompactContractFee));
+        EXPECT_LT(size, sizeof(TickData) / 4);
+
+        ASSERT_TRUE(reconstruction.begin((CompactTickData*)compactTickData, size));
+        EXPECT_EQ(reconstruction.tick(), tickData.tick);
+        EXPECT_EQ(reconstruction.transactionCount(), numberOfTransactions);
+        EXPECT_EQ(reconstruction.missingTransactionCount(), numberOfTransactions);
+
+        // pending transactions of the tick in random order, including some that are not part of the tick data
+        std::vector<m256i> candidates(tickData.transactionDigests, tickData.transactionDigests + numberOfTransactions);
+        for (unsigned int i = 0; i < 1000; i++)
+            candidates.push_back(randomDigest());
+        std::shuffle(candidates.begin(), candidates.end(), gen64);
+        for (const m256i& candidate : candidates)
+            reconstruction.addCandidate(candidate);
+
+        EXPECT_EQ(reconstruction.missingTransactionCount(), 0);
+        EXPECT_EQ(memcmp(&reconstruction.tickData(), &tickData, sizeof(TickData)), 0);
+        EXPECT_EQ(encodeCompactTickData(reconstruction.tickData(), (CompactTickData*)reencodedCompactTickData), size);
+        EXPECT_EQ(memcmp(reencodedCompactTickData, compactTickData, size), 0);
+
+        reconstruction.end();
+        EXPECT_EQ(reconstruction.tick(), 0);
+    }
+}
+
+TEST(TestCoreCompactTickData, RequestMissingTransactions)
+{
+    static TickData tickData;
+    static unsigned char compactTickData[MAX_COMPACT_TICK_DATA_SIZE];
+    static TickDataReconstruction reconstruction;
+
+    const unsigned int numberOfTransactions = 300;
+    setRandomTickData(tickData, numberOfTransactions, 0);
+    const unsigned int size = encodeCompactTickData(tickData, (CompactTickData*)compactTickData);
+    ASSERT_TRUE(reconstruction.begin((CompactTickData*)compactTickData, size));
+
+    // every third transaction is not pending
+    for (unsigned int i = 0; i < numberOfTransactions; i++)
+        if (i % 3)
+            reconstruction.addCandidate(tickData.transactionDigests[i]);
+    EXPECT_EQ(reconstruction.missingTransactionCount(), numberOfTransactions / 3);
+
+    unsigned char transactionFlags[NUMBER_OF_TRANSACTIONS_PER_TICK / 8];
+    reconstruction.getMissingTransactionFlags(transactionFlags);
+    for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+        EXPECT_EQ((transactionFlags[i >> 3] >> (i & 7)) & 1, (i < numberOfTransactions && i % 3 == 0) ? 1 : 0);
+
+    // digests have to match the short IDs and are only accepted for missing transactions
+    EXPECT_FALSE(reconstruction.setMissingTransactionDigest(0, randomDigest()));
+    EXPECT_FALSE(reconstruction.setMissingTransactionDigest(0, tickData.transactionDigests[3]));
+    EXPECT_FALSE(reconstruction.setMissingTransactionDigest(1, tickData.transactionDigests[1]));
+    EXPECT_FALSE(reconstruction.setMissingTransactionDigest(numberOfTransactions, tickData.transactionDigests[0]));
+    for (unsigned int i = 0; i < numberOfTransactions; i += 3)
+        EXPECT_TRUE(reconstruction.setMissingTransactionDigest(i, tickData.transactionDigests[i]));
+
+    EXPECT_EQ(reconstruction.missingTransactionCount(), 0);
+    EXPECT_EQ(memcmp(&reconstruction.tickData(), &tickData, sizeof(TickData)), 0);
+}
+
+TEST(TestCoreCompactTickData, DuplicateShortIds)
+{
+    static TickData tickData;
+    static unsigned char compactTickData[MAX_COMPACT_TICK_DATA_SIZE];
+    static TickDataReconstruction reconstruction;
+
+    setRandomTickData(tickData, 10, 0);
+    const unsigned int size = encodeCompactTickData(tickData, (CompactTickData*)compactTickData);
+
+    // short ID of transaction 7 replaced by the one of transaction 2
+    unsigned char* shortTransactionIds = compactTickData + sizeof(CompactTickData);
+    memcpy(shortTransactionIds + 7 * SHORT_TRANSACTION_ID_SIZE, shortTransactionIds + 2 * SHORT_TRANSACTION_ID_SIZE, SHORT_TRANSACTION_ID_SIZE);
+
+    ASSERT_TRUE(reconstruction.begin((CompactTickData*)compactTickData, size));
+    for (unsigned int i = 0; i < 10; i++)
+        reconstruction.addCandidate(tickData.transactionDigests[i]);
+    EXPECT_EQ(reconstruction.missingTransactionCount(), 2);
+
+    unsigned char transactionFlags[NUMBER_OF_TRANSACTIONS_PER_TICK / 8];
+    reconstruction.getMissingTransactionFlags(transactionFlags);
+    EXPECT_EQ(transactionFlags[0], (1 << 2) | (1 << 7));
+    EXPECT_EQ(transactionFlags[1], 0);
+    EXPECT_TRUE(isZero(reconstruction.tickData().transactionDigests[2]));
+
+    EXPECT_TRUE(reconstruction.setMissingTransactionDigest(2, tickData.transactionDigests[2]));
+    EXPECT_FALSE(reconstruction.setMissingTransactionDigest(7, tickData.transactionDigests[7]));
+    EXPECT_EQ(reconstruction.missingTransactionCount(), 1);
+}
+
+TEST(TestCoreCompactTickData, MalformedCompactTickData)
+{
+    static TickData tickData;
+    static unsigned char compactTickData[MAX_COMPACT_TICK_DATA_SIZE];
+    static TickDataReconstruction reconstruction;
+
+    // zero digest followed by non-zero digest has no compact form
+    setRandomTickData(tickData, 20, 0);
+    tickData.transactionDigests[5] = _mm256_setzero_si256();
+    EXPECT_EQ(encodeCompactTickData(tickData, (CompactTickData*)compactTickData), 0);
+
+    setRandomTickData(tickData, 20, 3);
+    const unsigned int size = encodeCompactTickData(tickData, (CompactTickData*)compactTickData);
+    ASSERT_GT(size, 0);
+    EXPECT_FALSE(reconstruction.begin((CompactTickData*)compactTickData, sizeof(CompactTickData) - 1));
+    EXPECT_FALSE(reconstruction.begin((CompactTickData*)compactTickData, size - 1));
+    EXPECT_FALSE(reconstruction.begin((CompactTickData*)compactTickData, size + 1));
+    EXPECT_EQ(reconstruction.tick(), 0);
+
+    CompactContractFee* contractFees = (CompactContractFee*)(compactTickData + sizeof(CompactTickData) + 20 * SHORT_TRANSACTION_ID_SIZE);
+    contractFees[1].contractIndex = MAX_NUMBER_OF_CONTRACTS;
+    EXPECT_FALSE(reconstruction.begin((CompactTickData*)compactTickData, size));
+
+    ((CompactTickData*)compactTickData)->numberOfTransactions = NUMBER_OF_TRANSACTIONS_PER_TICK + 1;
+    EXPECT_FALSE(reconstruction.begin((CompactTickData*)compactTickData, sizeof(CompactTickData) + (NUMBER_OF_TRANSACTIONS_PER_TICK + 1) * SHORT_TRANSACTION_ID_SIZE + 3 * sizeof(CompactContractFee)));
+    EXPECT_EQ(reconstruction.tick(), 0);
+}
+
+TEST(TestCoreCompactTickData, ForgedThenGenuineCompactTickData)
+{
+    static TickData genuineTickData, forgedTickData;
+    static unsigned char genuineCompactTickData[MAX_COMPACT_TICK_DATA_SIZE], forgedCompactTickData[MAX_COMPACT_TICK_DATA_SIZE];
+    static TickDataReconstructionSlots<4> slots;
+    const unsigned long long timeout = 1000;
+
+    // Forged compact tick data of the same tick with transactions that are not pending anywhere
+    setRandomTickData(genuineTickData, 100, 3);
+    setRandomTickData(forgedTickData, 100, 3);
+    const unsigned int tick = genuineTickData.tick;
+    ASSERT_EQ(forgedTickData.tick, tick);
+    const CompactTickData* genuine = (const CompactTickData*)genuineCompactTickData;
+    const CompactTickData* forged = (const CompactTickData*)forgedCompactTickData;
+    const unsigned int genuineSize = encodeCompactTickData(genuineTickData, (CompactTickData*)genuineCompactTickData);
+    const unsigned int forgedSize = encodeCompactTickData(forgedTickData, (CompactTickData*)forgedCompactTickData);
+
+    // Forged data arrives first and claims the slot, its missing digests are never delivered
+    auto* slot = slots.claim(*forged, 5000, timeout);
+    ASSERT_NE(slot, nullptr);
+    ASSERT_TRUE(slot->reconstruction.begin(forged, forgedSize));
+    EXPECT_EQ(slot->reconstruction.missingTransactionCount(), 100);
+    EXPECT_EQ(slots.find(tick), slot);
+    EXPECT_EQ(slots.find(tick + 1), nullptr);
+
+    // Genuine data is ignored until the forged reconstruction has stalled
+    EXPECT_EQ(slots.claim(*genuine, 5000 + timeout, timeout), nullptr);
+    EXPECT_EQ(slots.takeStalledTick(5000 + timeout, timeout), 0);
+
+    // Stalled tick is reported once, so the full tick data can be requested
+    EXPECT_EQ(slots.takeStalledTick(5001 + timeout, timeout), tick);
+    EXPECT_EQ(slots.takeStalledTick(5001 + timeout, timeout), 0);
+
+    // Forged data received again does not restart its reconstruction, but genuine data replaces it
+    EXPECT_EQ(slots.claim(*forged, 5002 + timeout, timeout), nullptr);
+    slot = slots.claim(*genuine, 5002 + timeout, timeout);
+    ASSERT_NE(slot, nullptr);
+    ASSERT_TRUE(slot->reconstruction.begin(genuine, genuineSize));
+    EXPECT_EQ(slots.find(tick), slot);
+    for (unsigned int i = 0; i < 100; i++)
+        slot->reconstruction.addCandidate(genuineTickData.transactionDigests[i]);
+    EXPECT_EQ(slot->reconstruction.missingTransactionCount(), 0);
+    EXPECT_EQ(memcmp(&slot->reconstruction.tickData(), &genuineTickData, sizeof(TickData)), 0);
+
+    // Rebuilt tick data is kept and not reported as stalled, however old it is
+    EXPECT_EQ(slots.claim(*forged, 100000, timeout), nullptr);
+    EXPECT_EQ(slots.claim(*genuine, 100000, timeout), nullptr);
+    EXPECT_EQ(slots.takeStalledTick(100000, timeout), 0);
+
+    // Reconstruction ended because of an invalid signature frees the slot immediately
+    slot->reconstruction.end();
+    EXPECT_EQ(slots.find(tick), nullptr);
+    EXPECT_NE(slots.claim(*genuine, 100001, timeout), nullptr);
+}
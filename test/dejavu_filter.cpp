@@ -0,0 +1,84 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/network_core/dejavu_filter.h"
+
+#include <random>
+#include <vector>
+
+
+TEST(TestCoreDejavuFilter, RememberedWindow)
+{
+    constexpr unsigned int idsPerGeneration = 1000;
+    using Filter = DejavuFilter<idsPerGeneration>;
+    Filter filter;
+    ASSERT_TRUE(filter.init());
+
+    std::mt19937 gen32(42);
+    std::vector<unsigned int> ids;
+    for (unsigned int i = 0; i < 20 * idsPerGeneration; i++)
+    {
+        unsigned int id;
+        do
+        {
+            id = gen32();
+        } while (filter.contains(id));
+        filter.insert(id);
+        ids.push_back(id);
+
+        // the last (NUMBER_OF_SEARCHED_GENERATIONS - 1) full generations and the current one are remembered
+        const unsigned int numberOfIdsInCurrentGeneration = i % idsPerGeneration + 1;
+        const unsigned int numberOfRememberedIds = std::min<unsigned int>(i + 1, (Filter::NUMBER_OF_SEARCHED_GENERATIONS - 1) * idsPerGeneration + numberOfIdsInCurrentGeneration);
+        EXPECT_EQ(filter.rememberedCount(), numberOfRememberedIds);
+        EXPECT_EQ(filter.rotationCount(), i / idsPerGeneration);
+
+        if (i % 97 == 0)
+        {
+            for (unsigned int j = 0; j <= i; j++)
+            {
+                EXPECT_EQ(filter.contains(ids[j]), j > i - numberOfRememberedIds || i < numberOfRememberedIds);
+            }
+        }
+    }
+
+    EXPECT_EQ(filter.fillLevelPercent(), 100);
+    EXPECT_EQ(filter.falsePositiveRatePpm(), 3 * idsPerGeneration * 1000000ULL / (1ULL << 32));
+
+    filter.reset();
+    EXPECT_EQ(filter.rememberedCount(), 0);
+    EXPECT_EQ(filter.fillLevelPercent(), 0);
+    for (unsigned int id : ids)
+    {
+        EXPECT_FALSE(filter.contains(id));
+    }
+
+    filter.deinit();
+}
+
+TEST(TestCoreDejavuFilter, CollidingIds)
+{
+    DejavuFilter<1000> filter;
+    ASSERT_TRUE(filter.init());
+
+    // IDs with the same home slot
+    const unsigned long long tableSize = DejavuFilter<1000>::TABLE_SIZE;
+    for (unsigned int i = 0; i < 100; i++)
+    {
+        EXPECT_FALSE(filter.contains(5 + i * (unsigned int)tableSize));
+        filter.insert(5 + i * (unsigned int)tableSize);
+    }
+    for (unsigned int i = 0; i < 100; i++)
+    {
+        EXPECT_TRUE(filter.contains(5 + i * (unsigned int)tableSize));
+    }
+    EXPECT_FALSE(filter.contains(5 + 100 * (unsigned int)tableSize));
+
+    // ID 0 is stored as 1
+    EXPECT_FALSE(filter.contains(0));
+    filter.insert(0);
+    EXPECT_TRUE(filter.contains(0));
+    EXPECT_TRUE(filter.contains(1));
+
+    filter.deinit();
+}
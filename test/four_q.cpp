@@ -0,0 +1,140 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/four_q.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+
+static void initConstants()
+{
+#if defined (__AVX512F__) && !GENERIC_K12
+    initAVX512KangarooTwelveConstants();
+#endif
+#if defined (__AVX512F__)
+    initAVX512FourQConstants();
+#endif
+}
+
+struct SignedMessage
+{
+    m256i publicKey;
+    m256i digest;
+    unsigned char signature[64];
+};
+
+static std::vector<SignedMessage> generateSignedMessages(unsigned int count, unsigned int seedValue)
+{
+    std::mt19937_64 gen64(seedValue);
+    std::vector<SignedMessage> messages(count);
+    for (auto& message : messages)
+    {
+        unsigned char seed[56], subseed[32], privateKey[32];
+        for (int i = 0; i < 55; ++i)
+            seed[i] = 'a' + gen64() % 26;
+        seed[55] = 0;
+        EXPECT_TRUE(getSubseed(seed, subseed));
+        getPrivateKey(subseed, privateKey);
+        getPublicKey(privateKey, message.publicKey.m256i_u8);
+        for (int i = 0; i < 4; ++i)
+            message.digest.m256i_u64[i] = gen64();
+        sign(subseed, message.publicKey.m256i_u8, message.digest.m256i_u8, message.signature);
+    }
+    return messages;
+}
+
+static void verifyMessagesBatch(const std::vector<SignedMessage>& messages, bool* results)
+{
+    std::vector<const unsigned char*> publicKeys, digests, signatures;
+    for (const auto& message : messages)
+    {
+        publicKeys.push_back(message.publicKey.m256i_u8);
+        digests.push_back(message.digest.m256i_u8);
+        signatures.push_back(message.signature);
+    }
+    verifyBatch((unsigned int)messages.size(), publicKeys.data(), digests.data(), signatures.data(), results);
+}
+
+TEST(TestCoreFourQ, VerifyBatchMatchesVerify)
+{
+    initConstants();
+
+    std::mt19937_64 gen64(42);
+    for (unsigned int count : { 0u, 1u, 7u, 16u, 17u, 53u })
+    {
+        std::vector<SignedMessage> messages = generateSignedMessages(count, count);
+
+        // Corrupt about half of the messages in different ways
+        for (auto& message : messages)
+        {
+            switch (gen64() % 8)
+            {
+            case 0:
+                message.digest.m256i_u8[gen64() % 32] ^= 1 << (gen64() % 8);
+                break;
+            case 1:
+                message.signature[gen64() % 64] ^= 1 << (gen64() % 8);
+                break;
+            case 2:
+                message.publicKey.m256i_u8[gen64() % 32] ^= 1 << (gen64() % 8);
+                break;
+            case 3:
+                message.signature[63] = 1;
+                break;
+            }
+        }
+
+        std::unique_ptr<bool[]> results(new bool[count + 1]);
+        results[count] = true;
+        verifyMessagesBatch(messages, results.get());
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            EXPECT_EQ(results[i], verify(messages[i].publicKey.m256i_u8, messages[i].digest.m256i_u8, messages[i].signature));
+        }
+        EXPECT_TRUE(results[count]);
+    }
+
+    // All valid
+    std::vector<SignedMessage> messages = generateSignedMessages(2 * VERIFY_BATCH_SIZE, 1234);
+    bool results[2 * VERIFY_BATCH_SIZE];
+    verifyMessagesBatch(messages, results);
+    for (unsigned int i = 0; i < 2 * VERIFY_BATCH_SIZE; ++i)
+    {
+        EXPECT_TRUE(results[i]);
+    }
+}
+
+TEST(TestCoreFourQ, VerifyBatchBenchmark)
+{
+    initConstants();
+
+    constexpr unsigned int count = 4096;
+    std::vector<SignedMessage> messages = generateSignedMessages(count, 5678);
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    unsigned int validCount = 0;
+    for (const auto& message : messages)
+    {
+        validCount += verify(message.publicKey.m256i_u8, message.digest.m256i_u8, message.signature);
+    }
+    auto durationSingle = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime);
+    EXPECT_EQ(validCount, count);
+
+    std::unique_ptr<bool[]> results(new bool[count]);
+    startTime = std::chrono::high_resolution_clock::now();
+    verifyMessagesBatch(messages, results.get());
+    auto durationBatch = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime);
+    validCount = 0;
+    for (unsigned int i = 0; i < count; ++i)
+        validCount += results[i];
+    EXPECT_EQ(validCount, count);
+
+    std::cout << "verify(): " << count << " signatures in " << durationSingle.count() << " microseconds ("
+        << count * 1000000.0 / durationSingle.count() << " per second)" << std::endl;
+    std::cout << "verifyBatch(): " << count << " signatures in " << durationBatch.count() << " microseconds ("
+        << count * 1000000.0 / durationBatch.count() << " per second)" << std::endl;
+}
@@ -0,0 +1,158 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/kangaroo_twelve.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+
+static void KangarooTwelveWithLeafChainingValues(const unsigned char* input, unsigned int inputByteLen, unsigned char* output, unsigned int outputByteLen)
+{
+    const unsigned int numberOfFullLeaves = KangarooTwelveNumberOfFullLeaves(inputByteLen);
+    std::vector<unsigned char> chainingValues(numberOfFullLeaves * 32ULL + 1);
+    for (unsigned int i = 0; i < numberOfFullLeaves; i++)
+    {
+        KangarooTwelveLeafChainingValue(input + (i + 1ULL) * K12_chunkSize, chainingValues.data() + i * 32ULL);
+    }
+    KangarooTwelveFromLeafChainingValues(input, inputByteLen, chainingValues.data(), output, outputByteLen);
+}
+
+TEST(TestCoreKangarooTwelve, LeafChainingValuesMatchSerialHashing)
+{
+#if defined (__AVX512F__) && !GENERIC_K12
+    initAVX512KangarooTwelveConstants();
+#endif
+
+    std::mt19937_64 gen(42);
+    std::vector<unsigned char> input(20 * K12_chunkSize + 1000);
+    for (auto& byte : input)
+    {
+        byte = (unsigned char)gen();
+    }
+
+    // Lengths around chunk and rate boundaries, which are special cases of the tree hashing mode
+    std::vector<unsigned int> lengths = { 0, 1, 167, 168, 169, 8191, 8192, 8193 };
+    for (unsigned int chunks = 2; chunks <= 20; chunks++)
+    {
+        for (int delta : { -169, -168, -2, -1, 0, 1, 167, 168, 4096 })
+        {
+            lengths.push_back(chunks * K12_chunkSize + delta);
+        }
+    }
+    for (int i = 0; i < 50; i++)
+    {
+        lengths.push_back((unsigned int)(gen() % input.size()));
+    }
+
+    for (unsigned int length : lengths)
+    {
+        for (unsigned int outputLength : { 32u, 64u })
+        {
+            unsigned char expected[64], output[64];
+            KangarooTwelve(input.data(), length, expected, outputLength);
+            KangarooTwelveWithLeafChainingValues(input.data(), length, output, outputLength);
+            EXPECT_EQ(memcmp(expected, output, outputLength), 0) << "length " << length;
+        }
+    }
+}
+
+TEST(TestCoreKangarooTwelve, IncrementalLeafChainingValues)
+{
+#if defined (__AVX512F__) && !GENERIC_K12
+    initAVX512KangarooTwelveConstants();
+#endif
+
+    std::mt19937_64 gen(43);
+    const unsigned int inputSize = 300 * K12_chunkSize + 123;
+    const unsigned int numberOfFullLeaves = KangarooTwelveNumberOfFullLeaves(inputSize);
+    std::vector<unsigned char> input(inputSize);
+    for (auto& byte : input)
+    {
+        byte = (unsigned char)gen();
+    }
+
+    // Initial state: copy of leaves and chaining values of all leaves
+    std::vector<unsigned char> leafCopies(input.begin() + K12_chunkSize, input.begin() + (numberOfFullLeaves + 1ULL) * K12_chunkSize);
+    std::vector<unsigned char> chainingValues(numberOfFullLeaves * 32ULL);
+    for (unsigned int i = 0; i < numberOfFullLeaves; i++)
+    {
+        KangarooTwelveLeafChainingValue(input.data() + (i + 1ULL) * K12_chunkSize, chainingValues.data() + i * 32ULL);
+    }
+    EXPECT_EQ(KangarooTwelveUpdateLeafChainingValues(input.data(), leafCopies.data(), chainingValues.data(), 0, numberOfFullLeaves), 0u);
+
+    for (int round = 0; round < 20; round++)
+    {
+        // Change some bytes anywhere in the input, including first chunk and last leaf
+        std::vector<bool> leafChanged(numberOfFullLeaves, false);
+        const int numberOfChanges = (int)(gen() % 10);
+        for (int i = 0; i < numberOfChanges; i++)
+        {
+            const unsigned int offset = (unsigned int)(gen() % inputSize);
+            input[offset] ^= (unsigned char)(1 + gen() % 255);
+            if (offset >= K12_chunkSize && offset / K12_chunkSize - 1 < numberOfFullLeaves)
+            {
+                leafChanged[offset / K12_chunkSize - 1] = true;
+            }
+        }
+        unsigned int expectedNumberOfRehashedLeaves = 0;
+        for (bool changed : leafChanged)
+        {
+            expectedNumberOfRehashedLeaves += changed;
+        }
+
+        // Update in two ranges, as done by parts of a parallel job
+        const unsigned int split = (unsigned int)(gen() % numberOfFullLeaves);
+        unsigned int numberOfRehashedLeaves = KangarooTwelveUpdateLeafChainingValues(input.data(), leafCopies.data(), chainingValues.data(), 0, split);
+        numberOfRehashedLeaves += KangarooTwelveUpdateLeafChainingValues(input.data(), leafCopies.data(), chainingValues.data(), split, numberOfFullLeaves - split);
+        EXPECT_EQ(numberOfRehashedLeaves, expectedNumberOfRehashedLeaves);
+
+        unsigned char expected[32], output[32];
+        KangarooTwelve(input.data(), inputSize, expected, 32);
+        KangarooTwelveFromLeafChainingValues(input.data(), inputSize, chainingValues.data(), output, 32);
+        EXPECT_EQ(memcmp(expected, output, 32), 0);
+    }
+}
+
+TEST(TestCoreKangarooTwelve, IncrementalDigestBenchmark)
+{
+#if defined (__AVX512F__) && !GENERIC_K12
+    initAVX512KangarooTwelveConstants();
+#endif
+
+    std::mt19937_64 gen(44);
+    const unsigned int inputSize = 64 * 1024 * 1024;
+    const unsigned int numberOfFullLeaves = KangarooTwelveNumberOfFullLeaves(inputSize);
+    std::vector<unsigned char> input(inputSize);
+    for (auto& byte : input)
+    {
+        byte = (unsigned char)gen();
+    }
+    std::vector<unsigned char> leafCopies(numberOfFullLeaves * (unsigned long long)K12_chunkSize, 0);
+    std::vector<unsigned char> chainingValues(numberOfFullLeaves * 32ULL);
+    unsigned char output[32];
+    for (unsigned int i = 0; i < numberOfFullLeaves; i++)
+    {
+        leafCopies[i * (unsigned long long)K12_chunkSize] = ~input[(i + 1ULL) * K12_chunkSize];
+    }
+    KangarooTwelveUpdateLeafChainingValues(input.data(), leafCopies.data(), chainingValues.data(), 0, numberOfFullLeaves);
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    KangarooTwelve(input.data(), inputSize, output, 32);
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    // Typical procedure call changing a few bytes of the state
+    for (int i = 0; i < 16; i++)
+    {
+        input[gen() % inputSize]++;
+    }
+    KangarooTwelveUpdateLeafChainingValues(input.data(), leafCopies.data(), chainingValues.data(), 0, numberOfFullLeaves);
+    KangarooTwelveFromLeafChainingValues(input.data(), inputSize, chainingValues.data(), output, 32);
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    std::cout << "64 MB state with 16 changed bytes: full digest " << std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count()
+        << " us, incremental digest " << std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() << " us" << std::endl;
+}
@@ -0,0 +1,510 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#define system qubicSystemStruct
+#define time qubicTime
+
+#include "../src/public_settings.h"
+#undef MAX_NUMBER_OF_TICKS_PER_EPOCH
+#define MAX_NUMBER_OF_TICKS_PER_EPOCH 50
+#include "../src/private_settings.h"
+#undef LOG_QU_TRANSFERS
+#define LOG_QU_TRANSFERS 1
+#undef LOG_BURNINGS
+#define LOG_BURNINGS 1
+#undef LOG_ENTITY_INDEX
+#define LOG_ENTITY_INDEX 1
+#define LOG_BUFFER_SIZE 0x1000000ULL
+#define LOG_ENTITY_INDEX_POSTINGS 0x1000ULL
+#define LOG_ENTITY_INDEX_BUCKETS 0x100ULL
+
+#include "../src/text_output.h"
+#include "../src/logging.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+
+struct TestBurning
+{
+    m256i sourcePublicKey;
+    long long amount;
+
+    char _terminator;
+};
+
+class LoggingTest : public ::testing::Test
+{
+protected:
+    static void SetUpTestSuite()
+    {
+        ASSERT_TRUE(logger.initLogging());
+        ASSERT_TRUE(responseQueue.init());
+    }
+
+    static void TearDownTestSuite()
+    {
+        responseQueue.deinit();
+        logger.deinitLogging();
+    }
+
+    void SetUp() override
+    {
+        system.epoch = 100;
+        system.initialTick = 1000;
+        system.tick = 1000;
+        logger.reset(system.initialTick);
+        logger.registerNewTx(system.tick, 0);
+        responseQueue.reset();
+        numberOfPostings = 0;
+        postings.clear();
+    }
+
+    // Log QU transfer and remember the postings it adds to the entity index
+    unsigned long long logTransfer(const m256i& source, const m256i& destination, long long amount)
+    {
+        QuTransfer transfer;
+        transfer.sourcePublicKey = source;
+        transfer.destinationPublicKey = destination;
+        transfer.amount = amount;
+        const unsigned long long id = logger.logId;
+        logger.logQuTransfer(transfer);
+        postings.push_back({ source, id, numberOfPostings++ });
+        if (destination != source)
+            postings.push_back({ destination, id, numberOfPostings++ });
+        return id;
+    }
+
+    unsigned long long logBurning(const m256i& source, long long amount)
+    {
+        TestBurning burning;
+        burning.sourcePublicKey = source;
+        burning.amount = amount;
+        const unsigned long long id = logger.logId;
+        logger.logBurning(burning);
+        postings.push_back({ source, id, numberOfPostings++ });
+        return id;
+    }
+
+    // Reference: IDs of the logs of entity in [fromLogId, toLogId] whose postings have not been evicted, newest first
+    std::vector<unsigned long long> expectedLogIds(const m256i& publicKey, unsigned long long fromLogId, unsigned long long toLogId) const
+    {
+        std::vector<unsigned long long> logIds;
+        for (auto it = postings.rbegin(); it != postings.rend(); ++it)
+        {
+            if (numberOfPostings - it->position > LOG_ENTITY_INDEX_POSTINGS)
+                break;
+            if (it->publicKey == publicKey && it->logId >= fromLogId && it->logId <= toLogId)
+                logIds.push_back(it->logId);
+        }
+        return logIds;
+    }
+
+    struct Posting
+    {
+        m256i publicKey;
+        unsigned long long logId;
+        unsigned long long position;
+    };
+    std::vector<Posting> postings;
+    unsigned long long numberOfPostings;
+};
+
+// Send RequestLogIdsByEntity and return the IDs of the responded ranges (newest first) and the number of ranges
+static std::vector<unsigned long long> requestLogIdsByEntity(const m256i& publicKey, long long fromLogId, long long toLogId, unsigned int* numberOfRanges = nullptr)
+{
+    struct
+    {
+        RequestResponseHeader header;
+        RequestLogIdsByEntity payload;
+    } request;
+    request.header.checkAndSetSize(sizeof(request));
+    request.header.setType(RequestLogIdsByEntity::type);
+    request.header.setDejavu(777);
+    for (unsigned int i = 0; i < 4; i++)
+        request.payload.passcode[i] = logReaderPasscodes[i];
+    request.payload.publicKey = publicKey;
+    request.payload.fromLogId = fromLogId;
+    request.payload.toLogId = toLogId;
+    qLogger::processRequestLogIdsByEntity(nullptr, &request.header);
+
+    std::vector<unsigned long long> logIds;
+    Peer* peer;
+    RequestResponseHeader* response = responseQueue.dequeue(peer);
+    EXPECT_NE(response, nullptr);
+    if (!response)
+        return logIds;
+    EXPECT_EQ(response->type(), ResponseLogIdsByEntity::type);
+    EXPECT_EQ(response->dejavu(), 777);
+    const unsigned int payloadSize = response->size() - sizeof(RequestResponseHeader);
+    EXPECT_EQ(payloadSize % sizeof(ResponseLogIdsByEntity::LogIdRange), 0);
+    const auto* ranges = response->getPayload<ResponseLogIdsByEntity::LogIdRange>();
+    const unsigned int count = payloadSize / sizeof(ResponseLogIdsByEntity::LogIdRange);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        EXPECT_GT(ranges[i].length, 0);
+        // Ranges are maximal and ordered newest first
+        if (i > 0)
+            EXPECT_LT(ranges[i].fromLogId + ranges[i].length, ranges[i - 1].fromLogId);
+        for (long long id = ranges[i].fromLogId + ranges[i].length - 1; id >= ranges[i].fromLogId; id--)
+            logIds.push_back(id);
+    }
+    responseQueue.release();
+    EXPECT_EQ(responseQueue.dequeue(peer), nullptr);
+    if (numberOfRanges)
+        *numberOfRanges = count;
+    return logIds;
+}
+
+// Request all ranges of [fromLogId, toLogId] with as many RequestLogIdsByEntity as needed, newest first
+static std::vector<unsigned long long> requestAllLogIdsByEntity(const m256i& publicKey, long long fromLogId, long long toLogId)
+{
+    std::vector<unsigned long long> logIds;
+    while (true)
+    {
+        unsigned int numberOfRanges = 0;
+        const std::vector<unsigned long long> newLogIds = requestLogIdsByEntity(publicKey, fromLogId, toLogId, &numberOfRanges);
+        logIds.insert(logIds.end(), newLogIds.begin(), newLogIds.end());
+        if (numberOfRanges < LOG_ENTITY_MAX_RANGES_PER_RESPONSE)
+            return logIds;
+        toLogId = newLogIds.back() - 1;
+    }
+}
+
+TEST_F(LoggingTest, LogIdsByEntity)
+{
+    std::mt19937_64 gen64(42);
+
+    // Entities sharing a bucket of the entity index, so the index has to check the entity in the log
+    m256i entities[5];
+    for (auto& entity : entities)
+    {
+        entity = m256i(gen64(), gen64(), gen64(), gen64());
+        entity.m256i_u32[0] = 17;
+    }
+    m256i otherEntity(gen64(), gen64(), gen64(), gen64());
+
+    // Transfers and burnings over several ticks, with runs of consecutive logs of the same entity
+    for (unsigned int tick = 0; tick < 20; tick++)
+    {
+        system.tick = system.initialTick + tick;
+        logger.registerNewTx(system.tick, tick % 3);
+        for (unsigned int i = 0; i < 40; i++)
+        {
+            const unsigned int source = (unsigned int)(gen64() % 5);
+            switch (gen64() % 4)
+            {
+            case 0:
+                logBurning(entities[source], 1);
+                break;
+            case 1:
+                logTransfer(entities[source], entities[source], 1);
+                break;
+            case 2:
+                logTransfer(entities[source], otherEntity, 1);
+                break;
+            default:
+                logTransfer(entities[source], entities[gen64() % 5], 1);
+            }
+        }
+    }
+    ASSERT_LE(numberOfPostings, LOG_ENTITY_INDEX_POSTINGS);
+
+    for (const m256i& entity : entities)
+    {
+        EXPECT_EQ(requestLogIdsByEntity(entity, 0, -1), expectedLogIds(entity, 0, logger.logId - 1));
+        EXPECT_EQ(requestLogIdsByEntity(entity, 100, 500), expectedLogIds(entity, 100, 500));
+        EXPECT_EQ(requestLogIdsByEntity(entity, 300, 300), expectedLogIds(entity, 300, 300));
+    }
+    EXPECT_EQ(requestLogIdsByEntity(otherEntity, 0, -1), expectedLogIds(otherEntity, 0, logger.logId - 1));
+
+    // Unknown entities, in a used and in an unused bucket
+    m256i unknownEntity(gen64(), gen64(), gen64(), gen64());
+    unknownEntity.m256i_u32[0] = 17;
+    EXPECT_TRUE(requestLogIdsByEntity(unknownEntity, 0, -1).empty());
+    unknownEntity.m256i_u32[0] = 18;
+    EXPECT_TRUE(requestLogIdsByEntity(unknownEntity, 0, -1).empty());
+    EXPECT_TRUE(requestLogIdsByEntity(m256i(0, 0, 0, 0), 0, -1).empty());
+}
+
+TEST_F(LoggingTest, LogIdsByEntityAfterEviction)
+{
+    std::mt19937_64 gen64(123);
+    m256i entities[3];
+    for (auto& entity : entities)
+        entity = m256i(gen64(), gen64(), gen64(), gen64());
+
+    // Many more postings than the index keeps, so the oldest ones are overwritten in the ring
+    for (unsigned int tick = 0; tick < 10; tick++)
+    {
+        system.tick = system.initialTick + tick;
+        for (unsigned int i = 0; i < LOG_ENTITY_INDEX_POSTINGS / 4; i++)
+        {
+            const unsigned int source = (unsigned int)(gen64() % 3);
+            logTransfer(entities[source], entities[(source + 1 + gen64() % 2) % 3], 1);
+        }
+    }
+    ASSERT_GT(numberOfPostings, 2 * LOG_ENTITY_INDEX_POSTINGS);
+
+    for (const m256i& entity : entities)
+    {
+        const std::vector<unsigned long long> expected = expectedLogIds(entity, 0, logger.logId - 1);
+        EXPECT_FALSE(expected.empty());
+        EXPECT_GT(expected.back(), 0);
+        EXPECT_EQ(requestAllLogIdsByEntity(entity, 0, -1), expected);
+
+        // Range that has been evicted completely
+        EXPECT_TRUE(requestLogIdsByEntity(entity, 0, 100).empty());
+    }
+}
+
+TEST_F(LoggingTest, LogIdsByEntityContinuation)
+{
+    // Every second log involves the entity, so each log is a range of its own
+    const m256i entity(1, 2, 3, 4), otherEntity(5, 6, 7, 8), thirdEntity(9, 10, 11, 12);
+    for (unsigned int i = 0; i < LOG_ENTITY_MAX_RANGES_PER_RESPONSE + 50; i++)
+    {
+        logTransfer(entity, otherEntity, 1);
+        logTransfer(otherEntity, thirdEntity, 1);
+    }
+    const std::vector<unsigned long long> expected = expectedLogIds(entity, 0, logger.logId - 1);
+
+    // First response is full, the rest is requested with toLogId below its oldest range
+    unsigned int numberOfRanges = 0;
+    std::vector<unsigned long long> logIds = requestLogIdsByEntity(entity, 0, -1, &numberOfRanges);
+    EXPECT_EQ(numberOfRanges, LOG_ENTITY_MAX_RANGES_PER_RESPONSE);
+    ASSERT_FALSE(logIds.empty());
+    const std::vector<unsigned long long> rest = requestLogIdsByEntity(entity, 0, logIds.back() - 1, &numberOfRanges);
+    EXPECT_EQ(numberOfRanges, 50);
+    logIds.insert(logIds.end(), rest.begin(), rest.end());
+    EXPECT_EQ(logIds, expected);
+}
+
+class LogSubscriptionTest : public LoggingTest
+{
+protected:
+    static void SetUpTestSuite()
+    {
+        LoggingTest::SetUpTestSuite();
+        ASSERT_TRUE(subscriber.sendQueue.init());
+    }
+
+    static void TearDownTestSuite()
+    {
+        subscriber.sendQueue.deinit();
+        LoggingTest::TearDownTestSuite();
+    }
+
+    void SetUp() override
+    {
+        LoggingTest::SetUp();
+        qLogger::cancelLogSubscription(&subscriber);
+        subscriber.tcp4Protocol = (EFI_TCP4_PROTOCOL*)&subscriber;
+        subscriber.isConnectedAccepted = TRUE;
+        subscriber.isClosing = FALSE;
+        subscriber.sendQueue.reset();
+    }
+
+    void TearDown() override
+    {
+        qLogger::cancelLogSubscription(&subscriber);
+    }
+
+    // Log transfers and burnings in the given number of ticks, starting with system.tick, which is incremented
+    void logTicks(unsigned int numberOfTicks, unsigned int logsPerTick)
+    {
+        const m256i entity(1, 2, 3, 4), otherEntity(5, 6, 7, 8);
+        for (unsigned int tick = 0; tick < numberOfTicks; tick++)
+        {
+            logger.registerNewTx(system.tick, 0);
+            for (unsigned int i = 0; i < logsPerTick; i++)
+            {
+                if (i % 3 == 2)
+                    logBurning(entity, i);
+                else
+                    logTransfer(entity, otherEntity, i);
+            }
+            system.tick++;
+        }
+    }
+
+    // Send SubscribeLog of subscriber and return whether it has been answered by an empty RespondLog (rejected or canceled)
+    static bool subscribe(long long fromLogId, unsigned long long eventTypeMask)
+    {
+        struct
+        {
+            RequestResponseHeader header;
+            SubscribeLog payload;
+        } request;
+        request.header.checkAndSetSize(sizeof(request));
+        request.header.setType(SubscribeLog::type);
+        request.header.setDejavu(subscriptionDejavu);
+        for (unsigned int i = 0; i < 4; i++)
+            request.payload.passcode[i] = logReaderPasscodes[i];
+        request.payload.fromLogId = fromLogId;
+        request.payload.eventTypeMask = eventTypeMask;
+        qLogger::processSubscribeLog(&subscriber, &request.header);
+
+        Peer* peer;
+        RequestResponseHeader* response = responseQueue.dequeue(peer);
+        if (!response)
+            return false;
+        EXPECT_EQ(peer, &subscriber);
+        EXPECT_EQ(response->type(), RespondLog::type);
+        EXPECT_EQ(response->dejavu(), subscriptionDejavu);
+        EXPECT_EQ(response->size(), sizeof(RequestResponseHeader));
+        responseQueue.release();
+        return true;
+    }
+
+    struct PushedLogs
+    {
+        std::vector<unsigned long long> logIds;
+        unsigned int numberOfMessages = 0;
+        bool ended = false; // empty RespondLog received
+    };
+
+    // Push logs to subscribers and take the messages sent to subscriber, checking that each has the logs of one tick
+    static PushedLogs pushLogs()
+    {
+        qLogger::pushLogsToSubscribers();
+
+        PushedLogs pushedLogs;
+        std::vector<char> transmissionBuffer(BUFFER_SIZE);
+        const unsigned int transmissionSize = subscriber.sendQueue.takeForTransmission(transmissionBuffer.data(), BUFFER_SIZE, BUFFER_SIZE);
+        EXPECT_EQ(subscriber.sendQueue.size(), 0);
+        unsigned int offset = 0;
+        unsigned int previousTick = 0;
+        while (offset < transmissionSize)
+        {
+            const RequestResponseHeader* message = (const RequestResponseHeader*)(transmissionBuffer.data() + offset);
+            EXPECT_EQ(message->type(), RespondLog::type);
+            EXPECT_EQ(message->dejavu(), subscriptionDejavu);
+            EXPECT_FALSE(pushedLogs.ended);
+            if (message->size() == sizeof(RequestResponseHeader))
+                pushedLogs.ended = true;
+            else
+                pushedLogs.numberOfMessages++;
+
+            const char* log = (const char*)message + sizeof(RequestResponseHeader);
+            const unsigned int tick = qLogger::getLogTick(log);
+            if (message->size() > sizeof(RequestResponseHeader))
+            {
+                EXPECT_GT(tick, previousTick);
+                EXPECT_LT(tick, system.tick);
+                previousTick = tick;
+            }
+            while (log < (const char*)message + message->size())
+            {
+                const unsigned long long logId = *(const unsigned long long*)(log + 10);
+                EXPECT_TRUE(qLogger::verifyLog(log, logId));
+                EXPECT_EQ(qLogger::getLogTick(log), tick);
+                if (!pushedLogs.logIds.empty())
+                    EXPECT_GT(logId, pushedLogs.logIds.back());
+                pushedLogs.logIds.push_back(logId);
+                log += LOG_HEADER_SIZE + qLogger::getLogSize(log);
+            }
+            EXPECT_EQ(log, (const char*)message + message->size());
+            offset += message->size();
+        }
+        return pushedLogs;
+    }
+
+    static std::vector<unsigned long long> logIdRange(unsigned long long fromLogId, unsigned long long toLogId)
+    {
+        std::vector<unsigned long long> logIds;
+        for (unsigned long long logId = fromLogId; logId <= toLogId; logId++)
+            logIds.push_back(logId);
+        return logIds;
+    }
+
+    inline static Peer subscriber;
+    static constexpr unsigned int subscriptionDejavu = 0x12345678;
+};
+
+TEST_F(LogSubscriptionTest, PushLogsOfProcessedTicksInOrder)
+{
+    // 3 processed ticks with 10 logs each, system.tick has logs too but is still being processed
+    logTicks(3, 10);
+    const unsigned long long firstLogIdOfCurrentTick = logger.logId;
+    logTicks(1, 10);
+    system.tick--;
+
+    EXPECT_FALSE(subscribe(0, 0xFFFFFFFFFFFFFFFFULL));
+    EXPECT_EQ(qLogger::numberOfLogSubscriptions(), 1);
+    PushedLogs pushedLogs = pushLogs();
+    EXPECT_FALSE(pushedLogs.ended);
+    EXPECT_EQ(pushedLogs.numberOfMessages, 3);
+    EXPECT_EQ(pushedLogs.logIds, logIdRange(0, firstLogIdOfCurrentTick - 1));
+
+    // Nothing new
+    pushedLogs = pushLogs();
+    EXPECT_EQ(pushedLogs.numberOfMessages, 0);
+
+    // Current tick is processed
+    system.tick++;
+    pushedLogs = pushLogs();
+    EXPECT_EQ(pushedLogs.numberOfMessages, 1);
+    EXPECT_EQ(pushedLogs.logIds, logIdRange(firstLogIdOfCurrentTick, logger.logId - 1));
+
+    // Logs appended after subscribing only, selected by type
+    EXPECT_FALSE(subscribe(-1, qLogger::getLogTypeMaskBit(BURNING)));
+    const unsigned long long fromLogId = logger.logId;
+    logTicks(2, 6);
+    pushedLogs = pushLogs();
+    EXPECT_EQ(pushedLogs.numberOfMessages, 2);
+    std::vector<unsigned long long> burnings;
+    for (unsigned long long logId = fromLogId; logId < logger.logId; logId++)
+    {
+        if ((logId - fromLogId) % 3 == 2)
+            burnings.push_back(logId);
+    }
+    EXPECT_EQ(pushedLogs.logIds, burnings);
+    EXPECT_EQ(qLogger::numberOfLogSubscriptions(), 1);
+}
+
+TEST_F(LogSubscriptionTest, CancelAndRejectSubscription)
+{
+    logTicks(2, 5);
+
+    // Mask 0 cancels
+    EXPECT_FALSE(subscribe(0, 0xFFFFFFFFFFFFFFFFULL));
+    EXPECT_TRUE(subscribe(0, 0));
+    EXPECT_EQ(qLogger::numberOfLogSubscriptions(), 0);
+    PushedLogs pushedLogs = pushLogs();
+    EXPECT_EQ(pushedLogs.numberOfMessages, 0);
+    EXPECT_FALSE(pushedLogs.ended);
+
+    // First log is not available anymore
+    *(logger.logBuffer + qLogger::logBuf.getIndex(0) + LOG_HEADER_SIZE) ^= 1;
+    EXPECT_TRUE(subscribe(0, 0xFFFFFFFFFFFFFFFFULL));
+    EXPECT_EQ(qLogger::numberOfLogSubscriptions(), 0);
+}
+
+TEST_F(LogSubscriptionTest, EndSubscriptionWithConnection)
+{
+    logTicks(2, 5);
+    EXPECT_FALSE(subscribe(0, 0xFFFFFFFFFFFFFFFFULL));
+    EXPECT_EQ(qLogger::numberOfLogSubscriptions(), 1);
+
+    subscriber.isClosing = TRUE;
+    PushedLogs pushedLogs = pushLogs();
+    EXPECT_EQ(pushedLogs.numberOfMessages, 0);
+    EXPECT_FALSE(pushedLogs.ended);
+    EXPECT_EQ(qLogger::numberOfLogSubscriptions(), 0);
+}
+
+TEST_F(LogSubscriptionTest, EndSubscriptionIfLogIsOverwritten)
+{
+    logTicks(3, 10);
+    EXPECT_FALSE(subscribe(0, 0xFFFFFFFFFFFFFFFFULL));
+
+    // Log in the middle of the second tick does not match its digest anymore, so it cannot be pushed
+    *(logger.logBuffer + qLogger::logBuf.getIndex(15) + LOG_HEADER_SIZE) ^= 1;
+    PushedLogs pushedLogs = pushLogs();
+    EXPECT_TRUE(pushedLogs.ended);
+    EXPECT_EQ(pushedLogs.logIds, logIdRange(0, 14));
+    EXPECT_EQ(qLogger::numberOfLogSubscriptions(), 0);
+}
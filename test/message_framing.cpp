@@ -0,0 +1,172 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/network_core/message_framing.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+
+static constexpr unsigned int receiveBufferSize = 4 * 1024 * 1024;
+
+// Generate stream of numberOfMessages messages with random size. The type of each message is its index (mod 256).
+static std::vector<unsigned char> generateMessageStream(unsigned int numberOfMessages, unsigned int maxPayloadSize, std::vector<unsigned int>& messageSizes)
+{
+    std::mt19937_64 gen64(numberOfMessages);
+    std::vector<unsigned char> stream;
+    messageSizes.clear();
+    for (unsigned int i = 0; i < numberOfMessages; ++i)
+    {
+        const unsigned int size = sizeof(RequestResponseHeader) + (unsigned int)(gen64() % (maxPayloadSize + 1));
+        RequestResponseHeader header;
+        header.checkAndSetSize(size);
+        header.setType((unsigned char)i);
+        header.setDejavu(i);
+        const size_t offset = stream.size();
+        stream.resize(offset + size);
+        memcpy(&stream[offset], &header, sizeof(header));
+        for (unsigned int j = sizeof(header); j < size; ++j)
+            stream[offset + j] = (unsigned char)(i + j);
+        messageSizes.push_back(size);
+    }
+    return stream;
+}
+
+// Feed stream in chunks of random size to the framing code, as done in peerReceiveAndTransmit().
+// Returns number of messages read or -1 on error.
+static long long feedStream(const std::vector<unsigned char>& stream, const std::vector<unsigned int>& messageSizes, unsigned char* receiveBuffer, unsigned int maxChunkSize, bool checkContent)
+{
+    std::mt19937_64 gen64(maxChunkSize);
+    unsigned int receivedDataSize = 0;
+    size_t streamOffset = 0;
+    long long numberOfMessages = 0;
+    while (streamOffset < stream.size())
+    {
+        // Receive
+        unsigned int chunkSize = 1 + (unsigned int)(gen64() % maxChunkSize);
+        if (chunkSize > stream.size() - streamOffset)
+            chunkSize = (unsigned int)(stream.size() - streamOffset);
+        if (chunkSize > receiveBufferSize - receivedDataSize)
+            chunkSize = receiveBufferSize - receivedDataSize;
+        memcpy(receiveBuffer + receivedDataSize, &stream[streamOffset], chunkSize);
+        streamOffset += chunkSize;
+        receivedDataSize += chunkSize;
+
+        // Read all complete messages
+        unsigned int readOffset = 0;
+        bool protocolViolation;
+        RequestResponseHeader* header;
+        while (header = readReceivedMessage(receiveBuffer, receivedDataSize, readOffset, protocolViolation))
+        {
+            if (checkContent)
+            {
+                const unsigned int i = (unsigned int)numberOfMessages;
+                if (header->size() != messageSizes[i] || header->type() != (unsigned char)i || header->dejavu() != i)
+                    return -1;
+                for (unsigned int j = sizeof(RequestResponseHeader); j < header->size(); ++j)
+                    if (((unsigned char*)header)[j] != (unsigned char)(i + j))
+                        return -1;
+            }
+            ++numberOfMessages;
+        }
+        if (protocolViolation)
+            return -1;
+        receivedDataSize = compactReceiveBuffer(receiveBuffer, receivedDataSize, readOffset);
+    }
+    return (receivedDataSize == 0) ? numberOfMessages : -1;
+}
+
+// Previous implementation for comparison: move rest of buffer to front after each message
+static long long feedStreamMoveAfterEachMessage(const std::vector<unsigned char>& stream, unsigned char* receiveBuffer, unsigned int maxChunkSize)
+{
+    std::mt19937_64 gen64(maxChunkSize);
+    unsigned int receivedDataSize = 0;
+    size_t streamOffset = 0;
+    long long numberOfMessages = 0;
+    while (streamOffset < stream.size())
+    {
+        unsigned int chunkSize = 1 + (unsigned int)(gen64() % maxChunkSize);
+        if (chunkSize > stream.size() - streamOffset)
+            chunkSize = (unsigned int)(stream.size() - streamOffset);
+        if (chunkSize > receiveBufferSize - receivedDataSize)
+            chunkSize = receiveBufferSize - receivedDataSize;
+        memcpy(receiveBuffer + receivedDataSize, &stream[streamOffset], chunkSize);
+        streamOffset += chunkSize;
+        receivedDataSize += chunkSize;
+
+        while (receivedDataSize >= sizeof(RequestResponseHeader))
+        {
+            RequestResponseHeader* header = (RequestResponseHeader*)receiveBuffer;
+            if (header->size() < sizeof(RequestResponseHeader))
+                return -1;
+            if (receivedDataSize < header->size())
+                break;
+            ++numberOfMessages;
+            receivedDataSize -= header->size();
+            copyMem(receiveBuffer, receiveBuffer + header->size(), receivedDataSize);
+        }
+    }
+    return (receivedDataSize == 0) ? numberOfMessages : -1;
+}
+
+TEST(TestCoreMessageFraming, ReadMessages)
+{
+    std::vector<unsigned char> receiveBuffer(receiveBufferSize);
+    std::vector<unsigned int> messageSizes;
+    std::vector<unsigned char> stream = generateMessageStream(2000, 3000, messageSizes);
+    for (unsigned int maxChunkSize : { 1u, 7u, 100u, 5000u, 100000u, receiveBufferSize })
+    {
+        EXPECT_EQ(feedStream(stream, messageSizes, receiveBuffer.data(), maxChunkSize, true), 2000);
+    }
+}
+
+TEST(TestCoreMessageFraming, ProtocolViolation)
+{
+    std::vector<unsigned char> receiveBuffer(receiveBufferSize);
+    std::vector<unsigned int> messageSizes;
+    std::vector<unsigned char> stream = generateMessageStream(10, 100, messageSizes);
+    memcpy(receiveBuffer.data(), stream.data(), stream.size());
+
+    // Break size of 4th message
+    unsigned int offset = messageSizes[0] + messageSizes[1] + messageSizes[2];
+    ((RequestResponseHeader*)&receiveBuffer[offset])->checkAndSetSize(sizeof(RequestResponseHeader) - 1);
+
+    unsigned int readOffset = 0;
+    bool protocolViolation;
+    for (int i = 0; i < 3; ++i)
+    {
+        EXPECT_NE(readReceivedMessage(receiveBuffer.data(), (unsigned int)stream.size(), readOffset, protocolViolation), nullptr);
+        EXPECT_FALSE(protocolViolation);
+    }
+    EXPECT_EQ(readOffset, offset);
+    EXPECT_EQ(readReceivedMessage(receiveBuffer.data(), (unsigned int)stream.size(), readOffset, protocolViolation), nullptr);
+    EXPECT_TRUE(protocolViolation);
+    EXPECT_EQ(readOffset, offset);
+}
+
+TEST(TestCoreMessageFraming, Benchmark)
+{
+    std::vector<unsigned char> receiveBuffer(receiveBufferSize);
+    std::vector<unsigned int> messageSizes;
+
+    // 10k small packets of the size of ticks and transactions
+    std::vector<unsigned char> stream = generateMessageStream(10000, 400, messageSizes);
+
+    for (unsigned int maxChunkSize : { 1500u, 65536u, receiveBufferSize })
+    {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        EXPECT_EQ(feedStream(stream, messageSizes, receiveBuffer.data(), maxChunkSize, false), 10000);
+        auto durationReadCursor = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime);
+
+        startTime = std::chrono::high_resolution_clock::now();
+        EXPECT_EQ(feedStreamMoveAfterEachMessage(stream, receiveBuffer.data(), maxChunkSize), 10000);
+        auto durationMoveAfterEach = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime);
+
+        std::cout << "10000 messages (" << stream.size() << " bytes) received in chunks of up to " << maxChunkSize << " bytes: "
+            << durationReadCursor.count() << " microseconds with read cursor, "
+            << durationMoveAfterEach.count() << " microseconds with moving rest after each message" << std::endl;
+    }
+}
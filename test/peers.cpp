@@ -0,0 +1,196 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#define system qubicSystemStruct
+
+#include "../src/private_settings.h"
+#include "../src/text_output.h"
+#include "../src/network_core/peers.h"
+
+
+static unsigned int numberOfConfigureCalls = 0;
+
+static EFI_STATUS __cdecl configureTcp4(void* This, EFI_TCP4_CONFIG_DATA* TcpConfigData)
+{
+    EXPECT_EQ(TcpConfigData, nullptr);
+    numberOfConfigureCalls++;
+    return EFI_SUCCESS;
+}
+
+static EFI_TCP4_PROTOCOL tcp4Protocol;
+
+struct TestMessage
+{
+    RequestResponseHeader header;
+    unsigned char payload[1000000];
+
+    void set(unsigned char type)
+    {
+        header.checkAndSetSize(sizeof(*this));
+        header.setType(type);
+        header.setDejavu(0);
+        setMem(payload, sizeof(payload), 0);
+    }
+};
+
+static TestMessage testMessage;
+static char transmissionBuffer[BUFFER_SIZE];
+
+// Connected peer that is transmitting, so closing does not destroy the connection yet
+static void connectPeer(Peer& peer)
+{
+    tcp4Protocol.Configure = configureTcp4;
+    peer.tcp4Protocol = &tcp4Protocol;
+    peer.isConnectedAccepted = TRUE;
+    peer.exchangedPublicPeers = TRUE;
+    peer.isTransmitting = TRUE;
+    peer.isClosing = FALSE;
+    peer.sendQueue.reset();
+}
+
+// Push messages of type until the queue of its priority has no space for another one, return number of messages
+static unsigned int fillSendQueue(Peer& peer, unsigned char type)
+{
+    testMessage.set(type);
+    unsigned int numberOfMessages = 0;
+    while (hasSendQueueSpace(&peer, &testMessage.header))
+    {
+        push(&peer, &testMessage.header);
+        numberOfMessages++;
+    }
+    return numberOfMessages;
+}
+
+TEST(TestCorePeers, DropGossipIfSendQueueIsFull)
+{
+    Peer& peer = peers[0];
+    EXPECT_TRUE(peer.sendQueue.init());
+
+    for (unsigned int priority = 0; priority < NUMBER_OF_SEND_PRIORITIES; priority++)
+    {
+        connectPeer(peer);
+        numberOfConfigureCalls = 0;
+
+        // Fill the queue of priority, which does not affect the other queues
+        const unsigned char type = (priority == SEND_PRIORITY_CONSENSUS) ? BroadcastTick::type : (priority == SEND_PRIORITY_TRANSACTIONS) ? BROADCAST_TRANSACTION : EndResponse::type;
+        ASSERT_EQ(getSendPriority(type), priority);
+        typedef decltype(peer.sendQueue) PeerSendQueue;
+        const unsigned int regionSize = (priority == SEND_PRIORITY_CONSENSUS) ? PeerSendQueue::CONSENSUS_REGION_SIZE : (priority == SEND_PRIORITY_TRANSACTIONS) ? PeerSendQueue::TRANSACTIONS_REGION_SIZE : PeerSendQueue::BULK_REGION_SIZE;
+        const unsigned int numberOfMessages = fillSendQueue(peer, type);
+        EXPECT_EQ(numberOfMessages, regionSize / sizeof(TestMessage));
+        EXPECT_EQ(peer.sendQueue.size(), numberOfMessages * sizeof(TestMessage));
+        EXPECT_EQ(peer.sendQueue.droppedCount(priority), 0);
+
+        // Message that does not fit anymore is dropped, but the connection is kept
+        push(&peer, &testMessage.header);
+        EXPECT_FALSE(peer.isClosing);
+        EXPECT_EQ(numberOfConfigureCalls, 0);
+        EXPECT_EQ(peer.sendQueue.size(), numberOfMessages * sizeof(TestMessage));
+        EXPECT_EQ(peer.sendQueue.droppedCount(priority), 1);
+
+        // Gossip is not given to the peer with the full queue, but to the other one
+        connectPeer(peers[1]);
+        EXPECT_TRUE(peers[1].sendQueue.init());
+        for (unsigned int i = 0; i < 3; i++)
+        {
+            pushToAny(&testMessage.header);
+        }
+        pushToSeveral(&testMessage.header);
+        EXPECT_EQ(peer.sendQueue.size(), numberOfMessages * sizeof(TestMessage));
+        EXPECT_EQ(peers[1].sendQueue.size(), 4 * sizeof(TestMessage));
+        peers[1].sendQueue.deinit();
+        peers[1].tcp4Protocol = NULL;
+    }
+
+    // Reset clears counter of dropped messages
+    peer.sendQueue.reset();
+    for (unsigned int priority = 0; priority < NUMBER_OF_SEND_PRIORITIES; priority++)
+    {
+        EXPECT_EQ(peer.sendQueue.droppedCount(priority), 0);
+    }
+
+    peer.sendQueue.deinit();
+    peer.tcp4Protocol = NULL;
+}
+
+TEST(TestCorePeers, ResponseWaitsForSendQueueSpace)
+{
+    Peer& peer = peers[0];
+    EXPECT_TRUE(peer.sendQueue.init());
+    EXPECT_TRUE(responseQueue.init());
+    connectPeer(peer);
+    numberOfConfigureCalls = 0;
+    frequency = 1000000;
+
+    const unsigned int numberOfMessages = fillSendQueue(peer, EndResponse::type);
+    EXPECT_TRUE(responseQueue.enqueue(&peer, &testMessage.header));
+
+    // Response stays in response queue while send queue is full
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        pushResponses();
+        EXPECT_EQ(responseQueue.waitingLength(), 1);
+        EXPECT_EQ(peer.sendQueue.size(), numberOfMessages * sizeof(TestMessage));
+    }
+
+    // After transmission of one message, the response is moved to the send queue
+    EXPECT_EQ(peer.sendQueue.takeForTransmission(transmissionBuffer, sizeof(transmissionBuffer), sizeof(TestMessage)), sizeof(TestMessage));
+    pushResponses();
+    EXPECT_EQ(responseQueue.waitingLength(), 0);
+    EXPECT_EQ(peer.sendQueue.size(), numberOfMessages * sizeof(TestMessage));
+    EXPECT_EQ(peer.sendQueue.droppedCount(SEND_PRIORITY_BULK), 0);
+    EXPECT_FALSE(peer.isClosing);
+
+    // Response to peer that does not take any data is held back for MAX_RESPONSE_BLOCKING_TIME, then peer is closed
+    EXPECT_TRUE(responseQueue.enqueue(&peer, &testMessage.header));
+    const unsigned long long startTick = __rdtsc();
+    while (responseQueue.waitingLength())
+    {
+        pushResponses();
+        if (responseQueue.waitingLength())
+        {
+            EXPECT_FALSE(peer.isClosing);
+        }
+    }
+    EXPECT_GE((__rdtsc() - startTick) * 1000, MAX_RESPONSE_BLOCKING_TIME * frequency);
+    EXPECT_TRUE(peer.isClosing);
+    EXPECT_EQ(numberOfConfigureCalls, 1);
+    EXPECT_EQ(peer.sendQueue.size(), numberOfMessages * sizeof(TestMessage));
+
+    responseQueue.deinit();
+    peer.sendQueue.deinit();
+    peer.tcp4Protocol = NULL;
+}
+
+TEST(TestCorePeers, SolicitedTransactionsAreAdmittedAsConsensus)
+{
+    RequestResponseHeader header;
+    header.checkAndSetSize(sizeof(header));
+    header.setType(BROADCAST_TRANSACTION);
+    header.setDejavu(12345);
+    EXPECT_EQ(getReceivedAdmissionClass(&header), ADMISSION_CLASS_TRANSACTIONS);
+
+    // Transactions answering a request of this node
+    registerSolicitedTransactionsDejavu(12345);
+    EXPECT_EQ(getReceivedAdmissionClass(&header), ADMISSION_CLASS_CONSENSUS);
+
+    // Other messages with the same dejavu and transactions without dejavu are not affected
+    header.setType(RequestComputors::type);
+    EXPECT_EQ(getReceivedAdmissionClass(&header), ADMISSION_CLASS_CONSENSUS);
+    header.setType(REQUEST_CURRENT_TICK_INFO);
+    EXPECT_EQ(getReceivedAdmissionClass(&header), ADMISSION_CLASS_QUERIES);
+    header.setType(BROADCAST_TRANSACTION);
+    header.setDejavu(0);
+    EXPECT_EQ(getReceivedAdmissionClass(&header), ADMISSION_CLASS_TRANSACTIONS);
+
+    // Only the last requests are remembered
+    header.setDejavu(12345);
+    for (unsigned int i = 1; i < NUMBER_OF_SOLICITED_TRANSACTIONS_REQUESTS; i++)
+    {
+        registerSolicitedTransactionsDejavu(i);
+        EXPECT_EQ(getReceivedAdmissionClass(&header), ADMISSION_CLASS_CONSENSUS);
+    }
+    registerSolicitedTransactionsDejavu(NUMBER_OF_SOLICITED_TRANSACTIONS_REQUESTS);
+    EXPECT_EQ(getReceivedAdmissionClass(&header), ADMISSION_CLASS_TRANSACTIONS);
+}
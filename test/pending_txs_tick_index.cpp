@@ -0,0 +1,96 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/public_settings.h"
+#undef MAX_NUMBER_OF_TICKS_PER_EPOCH
+#define MAX_NUMBER_OF_TICKS_PER_EPOCH 50
+#include "../src/pending_txs_tick_index.h"
+
+#include <random>
+#include <vector>
+#include <set>
+
+
+static constexpr unsigned int numberOfSlots = 1000;
+
+static std::set<unsigned int> getSlotsOfTick(const PendingTransactionTickIndex& index, unsigned int tick)
+{
+    std::set<unsigned int> slots;
+    for (unsigned int slot = index.first(tick); slot != PendingTransactionTickIndex::NO_SLOT; slot = index.next(slot))
+    {
+        EXPECT_TRUE(slots.insert(slot).second);
+    }
+    EXPECT_EQ(slots.size(), index.count(tick));
+    return slots;
+}
+
+static void checkIndex(const PendingTransactionTickIndex& index, const std::vector<unsigned int>& slotTicks, unsigned int initialTick)
+{
+    for (unsigned int tick = initialTick - 5; tick < initialTick + MAX_NUMBER_OF_TICKS_PER_EPOCH + 5; ++tick)
+    {
+        std::set<unsigned int> expectedSlots;
+        if (tick >= initialTick && tick < initialTick + MAX_NUMBER_OF_TICKS_PER_EPOCH)
+        {
+            for (unsigned int slot = 0; slot < numberOfSlots; ++slot)
+            {
+                if (slotTicks[slot] == tick)
+                    expectedSlots.insert(slot);
+            }
+        }
+        EXPECT_EQ(getSlotsOfTick(index, tick), expectedSlots);
+
+        unsigned int expectedCountAfter = 0;
+        for (unsigned int slot = 0; slot < numberOfSlots; ++slot)
+        {
+            if (slotTicks[slot] > tick && slotTicks[slot] >= initialTick && slotTicks[slot] < initialTick + MAX_NUMBER_OF_TICKS_PER_EPOCH)
+                ++expectedCountAfter;
+        }
+        EXPECT_EQ(index.countAfter(tick), expectedCountAfter);
+    }
+}
+
+TEST(TestCorePendingTransactionTickIndex, AddRemoveRandom)
+{
+    static PendingTransactionTickIndex index;
+    ASSERT_TRUE(index.init(numberOfSlots));
+
+    std::mt19937_64 gen64(42);
+    for (unsigned int initialTick : { 1000u, 123456u })
+    {
+        // Same as pool slots are cleared in beginEpoch()
+        std::vector<unsigned int> slotTicks(numberOfSlots, 0);
+        index.reset(initialTick);
+        checkIndex(index, slotTicks, initialTick);
+
+        for (int i = 0; i < 20000; ++i)
+        {
+            // Overwrite slot with transaction of higher tick, as in processBroadcastTransaction()
+            const unsigned int slot = gen64() % numberOfSlots;
+            const unsigned int tick = initialTick - 3 + (gen64() % (MAX_NUMBER_OF_TICKS_PER_EPOCH + 6));
+            if (slotTicks[slot] < tick)
+            {
+                index.remove(slot, slotTicks[slot]);
+                slotTicks[slot] = tick;
+                index.add(slot, tick);
+            }
+
+            // Pool is cleared from time to time in real use because of the tick condition
+            if (i % 5000 == 4999)
+            {
+                checkIndex(index, slotTicks, initialTick);
+                for (unsigned int s = 0; s < numberOfSlots; ++s)
+                {
+                    if (gen64() % 2)
+                    {
+                        index.remove(s, slotTicks[s]);
+                        slotTicks[s] = 0;
+                    }
+                }
+                checkIndex(index, slotTicks, initialTick);
+            }
+        }
+    }
+
+    index.deinit();
+}
@@ -2,6 +2,7 @@
 
 #include "gtest/gtest.h"
 #include "../src/platform/read_write_lock.h"
+#include "../src/platform/sequence_lock.h"
 #include "../src/platform/stack_size_tracker.h"
 #include "../src/platform/custom_stack.h"
 
@@ -98,6 +99,29 @@ void testStackSizeTrackerKeepSize()
 }
 
 
+TEST(TestCoreSequenceLock, SimpleSingleThread)
+{
+    SequenceLock l;
+    l.reset();
+
+    // Read without concurrent write succeeds
+    long long sequence = l.beginRead();
+    EXPECT_TRUE(l.endRead(sequence));
+    EXPECT_EQ(l.retryCount(), 0);
+
+    // Read with write in between fails
+    sequence = l.beginRead();
+    l.beginWrite();
+    l.endWrite();
+    EXPECT_FALSE(l.endRead(sequence));
+    EXPECT_EQ(l.retryCount(), 1);
+
+    // Read after write succeeds again
+    sequence = l.beginRead();
+    EXPECT_TRUE(l.endRead(sequence));
+    EXPECT_EQ(l.retryCount(), 1);
+}
+
 TEST(TestCoreStackSizeTracker, SimpleTest)
 {
     // Return uninit if not not both functions are called
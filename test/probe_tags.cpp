@@ -0,0 +1,105 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/probe_tags.h"
+
+#include <random>
+
+
+static constexpr unsigned int capacity = 256;
+
+// Reference: linear probing over all slots
+static unsigned int nextCandidateScalar(const unsigned char* tags, unsigned int slot, unsigned char tag)
+{
+    for (unsigned int i = 0; i < capacity; i++)
+    {
+        if (!tags[slot] || tags[slot] == tag)
+        {
+            return slot;
+        }
+        slot = (slot + 1) & (capacity - 1);
+    }
+    return ProbeTags<capacity>::NO_SLOT;
+}
+
+TEST(TestCoreProbeTags, TagOf)
+{
+    m256i key = m256i(0, 0, 0, 0);
+    EXPECT_EQ(ProbeTags<capacity>::tagOf(key), 1);
+    key.m256i_u8[4] = 200;
+    EXPECT_EQ(ProbeTags<capacity>::tagOf(key), 200);
+    key.m256i_u8[0] = 17;
+    EXPECT_EQ(ProbeTags<capacity>::tagOf(key), 200);
+}
+
+TEST(TestCoreProbeTags, NextCandidate)
+{
+    ProbeTags<capacity> probeTags;
+    EXPECT_TRUE(probeTags.init());
+
+    std::mt19937_64 gen64(42);
+    m256i keys[capacity];
+    for (int round = 0; round < 200; round++)
+    {
+        // Fill with increasing load, so both long runs without candidates and the full hash map are tested
+        const unsigned int numberOfFilledSlots = round * capacity / 199;
+        probeTags.clear(0, capacity);
+        for (unsigned int i = 0; i < capacity; i++)
+        {
+            keys[i] = m256i(0, 0, 0, 0);
+        }
+        for (unsigned int i = 0; i < numberOfFilledSlots; i++)
+        {
+            const unsigned int slot = gen64() % capacity;
+            keys[slot] = m256i(gen64(), gen64(), gen64(), gen64());
+            probeTags.set(slot, keys[slot]);
+        }
+
+        for (unsigned int slot = 0; slot < capacity; slot++)
+        {
+            const unsigned char tag = (unsigned char)gen64();
+            EXPECT_EQ(probeTags.nextCandidate(slot, tag), nextCandidateScalar(probeTags.data(), slot, tag));
+            EXPECT_EQ(probeTags.nextCandidate(slot, 0), nextCandidateScalar(probeTags.data(), slot, 0));
+        }
+
+        // rebuild() yields the same tags
+        unsigned char tags[capacity];
+        memcpy(tags, probeTags.data(), capacity);
+        probeTags.rebuild(keys, sizeof(m256i));
+        EXPECT_EQ(memcmp(tags, probeTags.data(), capacity), 0);
+    }
+
+    // Full hash map without matching tag
+    m256i key = m256i(0, 0, 0, 0);
+    key.m256i_u8[4] = 5;
+    for (unsigned int slot = 0; slot < capacity; slot++)
+    {
+        probeTags.set(slot, key);
+    }
+    EXPECT_EQ(probeTags.nextCandidate(100, 6), probeTags.NO_SLOT);
+    EXPECT_EQ(probeTags.nextCandidate(100, 5), 100);
+
+    probeTags.deinit();
+}
+
+TEST(TestCoreProbeTags, Statistics)
+{
+    ProbeTags<capacity> probeTags;
+    EXPECT_TRUE(probeTags.init());
+    EXPECT_EQ(probeTags.probeCount(), 0);
+    EXPECT_EQ(probeTags.averageProbeLengthTimes100(), 0);
+
+    probeTags.countProbe(10, 10, 1);
+    probeTags.countProbe(250, 3, 2); // wraps around: 10 slots
+    EXPECT_EQ(probeTags.probeCount(), 2);
+    EXPECT_EQ(probeTags.averageProbeLengthTimes100(), 550);
+    EXPECT_EQ(probeTags.averageKeyComparisonsTimes100(), 150);
+    EXPECT_EQ(probeTags.maxProbeLengthSlots(), 10);
+
+    probeTags.resetStatistics();
+    EXPECT_EQ(probeTags.probeCount(), 0);
+    EXPECT_EQ(probeTags.maxProbeLengthSlots(), 0);
+
+    probeTags.deinit();
+}
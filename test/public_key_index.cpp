@@ -0,0 +1,130 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/public_key_index.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+
+static int linearSearch(const std::vector<m256i>& publicKeys, const m256i& publicKey)
+{
+    for (unsigned int i = 0; i < publicKeys.size(); i++)
+    {
+        if (publicKeys[i] == publicKey)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static m256i randomPublicKey(std::mt19937_64& gen)
+{
+    return m256i(gen(), gen(), gen(), gen());
+}
+
+static PublicKeyIndex<2048> testIndex;
+
+TEST(TestCorePublicKeyIndex, EmptyIndex)
+{
+    std::mt19937_64 gen(42);
+    static PublicKeyIndex<64> emptyIndex;
+    for (int i = 0; i < 100; i++)
+    {
+        EXPECT_EQ(emptyIndex.find(randomPublicKey(gen)), -1);
+    }
+    EXPECT_EQ(emptyIndex.find(m256i(0, 0, 0, 0)), -1);
+}
+
+TEST(TestCorePublicKeyIndex, MatchesLinearSearch)
+{
+    std::mt19937_64 gen(123);
+    for (unsigned int count : { 0u, 1u, 10u, 676u, 1024u })
+    {
+        std::vector<m256i> publicKeys(count);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            publicKeys[i] = randomPublicKey(gen);
+            if (i % 7 == 3)
+            {
+                // Same hash slot as another key
+                publicKeys[i].m256i_u32[0] = publicKeys[i / 2].m256i_u32[0];
+            }
+            if (i % 11 == 5)
+            {
+                // Duplicate key
+                publicKeys[i] = publicKeys[i / 3];
+            }
+        }
+        testIndex.build(publicKeys.data(), count);
+
+        for (unsigned int i = 0; i < count; i++)
+        {
+            EXPECT_EQ(testIndex.find(publicKeys[i]), linearSearch(publicKeys, publicKeys[i]));
+        }
+        for (int i = 0; i < 1000; i++)
+        {
+            const m256i publicKey = randomPublicKey(gen);
+            EXPECT_EQ(testIndex.find(publicKey), linearSearch(publicKeys, publicKey));
+        }
+    }
+}
+
+TEST(TestCorePublicKeyIndex, Rebuild)
+{
+    std::mt19937_64 gen(7);
+    std::vector<m256i> oldPublicKeys(676), newPublicKeys(676);
+    for (unsigned int i = 0; i < 676; i++)
+    {
+        oldPublicKeys[i] = randomPublicKey(gen);
+    }
+    for (unsigned int i = 0; i < 676; i++)
+    {
+        newPublicKeys[i] = (i < 300) ? oldPublicKeys[675 - i] : randomPublicKey(gen);
+    }
+
+    testIndex.build(oldPublicKeys.data(), 676);
+    testIndex.build(newPublicKeys.data(), 676);
+    for (unsigned int i = 0; i < 676; i++)
+    {
+        EXPECT_EQ(testIndex.find(oldPublicKeys[i]), linearSearch(newPublicKeys, oldPublicKeys[i]));
+        EXPECT_EQ(testIndex.find(newPublicKeys[i]), (int)i);
+    }
+}
+
+TEST(TestCorePublicKeyIndex, Benchmark)
+{
+    std::mt19937_64 gen(99);
+    std::vector<m256i> publicKeys(676), queries(100000);
+    for (unsigned int i = 0; i < 676; i++)
+    {
+        publicKeys[i] = randomPublicKey(gen);
+    }
+    for (unsigned int i = 0; i < queries.size(); i++)
+    {
+        // Most queries are not in the list (transactions of non-computors)
+        queries[i] = (i % 8 == 0) ? publicKeys[gen() % 676] : randomPublicKey(gen);
+    }
+    testIndex.build(publicKeys.data(), 676);
+
+    long long linearSum = 0, indexSum = 0;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (const m256i& query : queries)
+    {
+        linearSum += linearSearch(publicKeys, query);
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (const m256i& query : queries)
+    {
+        indexSum += testIndex.find(query);
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    EXPECT_EQ(linearSum, indexSum);
+
+    std::cout << "Linear search: " << std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count() << " us, "
+        << "hash index: " << std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() << " us for "
+        << queries.size() << " lookups" << std::endl;
+}
@@ -0,0 +1,235 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/network_core/request_queue.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+struct TestPeer
+{
+    unsigned int id;
+};
+
+struct TestRequest
+{
+    RequestResponseHeader header;
+    unsigned int producer;
+    unsigned int number;
+    unsigned char payload[1000];
+
+    void set(unsigned int producer, unsigned int number, unsigned int payloadSize)
+    {
+        this->producer = producer;
+        this->number = number;
+        for (unsigned int i = 0; i < payloadSize; ++i)
+            payload[i] = (unsigned char)(producer + number + i);
+        header.checkAndSetSize(sizeof(RequestResponseHeader) + 8 + payloadSize);
+        header.setType((unsigned char)(number % 3));
+        header.setDejavu(0);
+    }
+
+    bool check() const
+    {
+        const unsigned int payloadSize = header.size() - sizeof(RequestResponseHeader) - 8;
+        if (header.type() != number % 3)
+            return false;
+        for (unsigned int i = 0; i < payloadSize; ++i)
+            if (payload[i] != (unsigned char)(producer + number + i))
+                return false;
+        return true;
+    }
+};
+
+typedef RequestQueue<TestPeer, 65536, 64, sizeof(TestRequest)> TestRequestQueue;
+
+TEST(TestCoreRequestQueue, EnqueueDequeueSingleThread)
+{
+    static TestRequestQueue queue;
+    EXPECT_TRUE(queue.init());
+    TestPeer peers[2] = { { 0 }, { 1 } };
+    TestRequest request;
+    std::mt19937_64 gen64(42);
+
+    long long position;
+    TestPeer* peer;
+    EXPECT_TRUE(queue.isEmpty());
+    EXPECT_EQ(queue.dequeue(position, peer), nullptr);
+    EXPECT_EQ(queue.filledBufferSize(), 0);
+
+    // Fill queue until it is full (number of slots or buffer size), then process in FIFO order
+    unsigned int enqueued = 0, dequeued = 0;
+    for (int round = 0; round < 200; ++round)
+    {
+        const unsigned int toEnqueue = gen64() % 100;
+        for (unsigned int i = 0; i < toEnqueue; ++i)
+        {
+            request.set(0, enqueued, (unsigned int)(gen64() % sizeof(request.payload)));
+            if (!queue.enqueue(&peers[enqueued % 2], &request.header))
+                break;
+            ++enqueued;
+        }
+        EXPECT_LE(enqueued - dequeued, 64u);
+        EXPECT_EQ(queue.waitingLength(), enqueued - dequeued);
+
+        const unsigned int toDequeue = gen64() % 100;
+        for (unsigned int i = 0; i < toDequeue; ++i)
+        {
+            // Dequeue only if type matches next request
+            const unsigned char type = (unsigned char)(gen64() % 3);
+            RequestResponseHeader* header = queue.dequeueIfType(position, peer, type);
+            if (dequeued == enqueued)
+            {
+                EXPECT_EQ(header, nullptr);
+                break;
+            }
+            if (type != dequeued % 3)
+            {
+                EXPECT_EQ(header, nullptr);
+                header = queue.dequeue(position, peer);
+            }
+            ASSERT_NE(header, nullptr);
+            const TestRequest* dequeuedRequest = (const TestRequest*)header;
+            EXPECT_EQ(dequeuedRequest->number, dequeued);
+            EXPECT_TRUE(dequeuedRequest->check());
+            EXPECT_EQ(peer->id, dequeued % 2);
+            EXPECT_EQ(position, (long long)dequeued);
+            queue.release(position);
+            ++dequeued;
+        }
+    }
+    EXPECT_EQ(queue.enqueuedCount(), enqueued);
+    EXPECT_EQ(queue.dequeuedCount(), dequeued);
+    EXPECT_EQ(queue.failedClaimCount(), 0);
+    EXPECT_EQ(queue.contendedEnqueueCount(), 0);
+
+    queue.deinit();
+}
+
+TEST(TestCoreRequestQueue, ReleaseOutOfOrder)
+{
+    static TestRequestQueue queue;
+    EXPECT_TRUE(queue.init());
+    TestPeer peer0 = { 0 };
+    TestRequest request;
+
+    // Enqueue until buffer is full
+    unsigned int enqueued = 0;
+    request.set(0, 0, sizeof(request.payload));
+    while (queue.enqueue(&peer0, &request.header))
+        request.set(0, ++enqueued, sizeof(request.payload));
+    EXPECT_GT(enqueued, 10u);
+
+    // Claim all, release all but first -> no space can be reclaimed
+    std::vector<long long> positions(enqueued);
+    TestPeer* peer;
+    for (unsigned int i = 0; i < enqueued; ++i)
+    {
+        ASSERT_NE(queue.dequeue(positions[i], peer), nullptr);
+    }
+    for (unsigned int i = 1; i < enqueued; ++i)
+    {
+        queue.release(positions[i]);
+    }
+    EXPECT_FALSE(queue.enqueue(&peer0, &request.header));
+
+    // Release first -> all space can be reclaimed
+    queue.release(positions[0]);
+    EXPECT_TRUE(queue.enqueue(&peer0, &request.header));
+    EXPECT_EQ(queue.waitingLength(), 1);
+
+    queue.deinit();
+}
+
+static void runStressTest(unsigned int numberOfProducers, unsigned int numberOfConsumers, unsigned int requestsPerProducer)
+{
+    static TestRequestQueue queue;
+    EXPECT_TRUE(queue.init());
+    std::vector<TestPeer> peers(numberOfProducers);
+    std::vector<std::vector<unsigned char>> received(numberOfProducers, std::vector<unsigned char>(requestsPerProducer, 0));
+    volatile bool producersDone = false;
+    volatile long long fullQueueCount = 0;
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::thread> consumers;
+    for (unsigned int c = 0; c < numberOfConsumers; ++c)
+    {
+        consumers.emplace_back([&]()
+            {
+                long long position;
+                TestPeer* peer;
+                while (true)
+                {
+                    RequestResponseHeader* header = queue.dequeue(position, peer);
+                    if (!header)
+                    {
+                        if (producersDone && queue.isEmpty())
+                            break;
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    const TestRequest* request = (const TestRequest*)header;
+                    EXPECT_TRUE(request->check());
+                    EXPECT_EQ(peer->id, request->producer);
+                    received[request->producer][request->number]++;
+                    queue.release(position);
+                }
+            });
+    }
+
+    std::vector<std::thread> producers;
+    for (unsigned int p = 0; p < numberOfProducers; ++p)
+    {
+        peers[p].id = p;
+        producers.emplace_back([&, p]()
+            {
+                std::mt19937_64 gen64(p);
+                TestRequest request;
+                for (unsigned int i = 0; i < requestsPerProducer; ++i)
+                {
+                    request.set(p, i, (unsigned int)(gen64() % 200));
+                    while (!queue.enqueue(&peers[p], &request.header))
+                    {
+                        _InterlockedIncrement64(&fullQueueCount);
+                        std::this_thread::yield();
+                    }
+                }
+            });
+    }
+
+    for (auto& producer : producers)
+        producer.join();
+    producersDone = true;
+    for (auto& consumer : consumers)
+        consumer.join();
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime);
+
+    for (unsigned int p = 0; p < numberOfProducers; ++p)
+        for (unsigned int i = 0; i < requestsPerProducer; ++i)
+            EXPECT_EQ(received[p][i], 1);
+    EXPECT_EQ(queue.enqueuedCount(), (long long)numberOfProducers * requestsPerProducer);
+    EXPECT_EQ(queue.dequeuedCount(), (long long)numberOfProducers * requestsPerProducer);
+    EXPECT_TRUE(queue.isEmpty());
+
+    std::cout << numberOfProducers << " producers, " << numberOfConsumers << " consumers: "
+        << queue.dequeuedCount() << " requests in " << duration.count() << " microseconds, "
+        << queue.failedClaimCount() << " failed claims, " << queue.contendedEnqueueCount() << " contended enqueues, "
+        << fullQueueCount << " times queue full" << std::endl;
+
+    queue.deinit();
+}
+
+TEST(TestCoreRequestQueue, StressTest)
+{
+    runStressTest(1, 1, 100000);
+    runStressTest(1, 4, 100000);
+    runStressTest(2, 8, 50000);
+    runStressTest(4, 4, 25000);
+}
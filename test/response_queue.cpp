@@ -0,0 +1,246 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/network_core/response_queue.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+struct TestPeer
+{
+    unsigned int id;
+};
+
+struct TestResponse
+{
+    RequestResponseHeader header;
+    unsigned int producer;
+    unsigned int number;
+    unsigned char payload[1000];
+
+    void set(unsigned int producer, unsigned int number, unsigned int payloadSize)
+    {
+        this->producer = producer;
+        this->number = number;
+        for (unsigned int i = 0; i < payloadSize; ++i)
+            payload[i] = (unsigned char)(producer + number + i);
+        header.checkAndSetSize(sizeof(RequestResponseHeader) + 8 + payloadSize);
+        header.setType((unsigned char)(number % 3));
+        header.setDejavu(number);
+    }
+
+    bool check() const
+    {
+        const unsigned int payloadSize = header.size() - sizeof(RequestResponseHeader) - 8;
+        if (header.type() != number % 3 || header.dejavu() != number)
+            return false;
+        for (unsigned int i = 0; i < payloadSize; ++i)
+            if (payload[i] != (unsigned char)(producer + number + i))
+                return false;
+        return true;
+    }
+};
+
+typedef ResponseQueue<TestPeer, 65536, sizeof(TestResponse)> TestResponseQueue;
+
+TEST(TestCoreResponseQueue, EnqueueDequeueSingleThread)
+{
+    static TestResponseQueue queue;
+    EXPECT_TRUE(queue.init());
+    TestPeer peers[2] = { { 0 }, { 1 } };
+    TestResponse response;
+    std::mt19937_64 gen64(42);
+
+    TestPeer* peer;
+    EXPECT_EQ(queue.dequeue(peer), nullptr);
+    EXPECT_EQ(queue.filledBufferSize(), 0);
+
+    // Fill queue until it is full, then process in FIFO order (wrapping around the end of the buffer many times)
+    unsigned int enqueued = 0, dequeued = 0, rejected = 0;
+    for (int round = 0; round < 1000; ++round)
+    {
+        const unsigned int toEnqueue = gen64() % 100;
+        for (unsigned int i = 0; i < toEnqueue; ++i)
+        {
+            response.set(0, enqueued, (unsigned int)(gen64() % sizeof(response.payload)));
+            if (!queue.enqueue(&peers[enqueued % 2], &response.header))
+            {
+                ++rejected;
+                break;
+            }
+            ++enqueued;
+        }
+        EXPECT_LE(queue.filledBufferSize(), 65536);
+        EXPECT_EQ(queue.waitingLength(), enqueued - dequeued);
+
+        const unsigned int toDequeue = gen64() % 100;
+        for (unsigned int i = 0; i < toDequeue; ++i)
+        {
+            RequestResponseHeader* header = queue.dequeue(peer);
+            if (dequeued == enqueued)
+            {
+                EXPECT_EQ(header, nullptr);
+                break;
+            }
+            ASSERT_NE(header, nullptr);
+            const TestResponse* dequeuedResponse = (const TestResponse*)header;
+            EXPECT_EQ(dequeuedResponse->number, dequeued);
+            EXPECT_TRUE(dequeuedResponse->check());
+            EXPECT_EQ(peer->id, dequeued % 2);
+            queue.release();
+            ++dequeued;
+        }
+    }
+    EXPECT_GT(rejected, 10u);
+    EXPECT_EQ(queue.enqueuedCount(), enqueued);
+    EXPECT_EQ(queue.rejectedCount(), rejected);
+    EXPECT_EQ(queue.failedReservationCount(), 0);
+
+    queue.deinit();
+}
+
+TEST(TestCoreResponseQueue, UnpublishedResponseBlocksLaterOnes)
+{
+    static TestResponseQueue queue;
+    EXPECT_TRUE(queue.init());
+    TestPeer peer0 = { 0 };
+    TestResponse response;
+
+    // Reserve first, enqueue second -> second is not available before first is published
+    long long position;
+    RequestResponseHeader* reserved = queue.reserve(&peer0, sizeof(RequestResponseHeader) + 8, position);
+    ASSERT_NE(reserved, nullptr);
+    response.set(0, 1, 10);
+    EXPECT_TRUE(queue.enqueue(&peer0, &response.header));
+    EXPECT_EQ(queue.waitingLength(), 2);
+
+    TestPeer* peer;
+    EXPECT_EQ(queue.dequeue(peer), nullptr);
+
+    response.set(0, 0, 0);
+    copyMem(reserved, &response, sizeof(RequestResponseHeader) + 8);
+    queue.publish(position);
+    for (unsigned int number = 0; number < 2; ++number)
+    {
+        const TestResponse* dequeuedResponse = (const TestResponse*)queue.dequeue(peer);
+        ASSERT_NE(dequeuedResponse, nullptr);
+        EXPECT_EQ(dequeuedResponse->number, number);
+        EXPECT_TRUE(dequeuedResponse->check());
+        queue.release();
+    }
+    EXPECT_EQ(queue.dequeue(peer), nullptr);
+    EXPECT_EQ(queue.waitingLength(), 0);
+
+    queue.deinit();
+}
+
+TEST(TestCoreResponseQueue, StalePayloadIsNotMistakenForEntryHeader)
+{
+    static TestResponseQueue queue;
+    EXPECT_TRUE(queue.init());
+    TestPeer peer0 = { 0 };
+    std::mt19937_64 gen64(42);
+
+    // Fill the payloads with the positions that entry headers at the same offset have in the next round through the
+    // buffer, like a peer may do to make the consumer take a response that is still being written
+    static constexpr long long entryHeaderSize = 32;
+    for (unsigned int i = 0; i < 1000; ++i)
+    {
+        const unsigned int size = sizeof(RequestResponseHeader) + 8 + (unsigned int)(gen64() % (sizeof(TestResponse::payload) + 1));
+        long long position;
+        char* reserved = (char*)queue.reserve(&peer0, size, position);
+        ASSERT_NE(reserved, nullptr);
+
+        TestPeer* peer;
+        EXPECT_EQ(queue.dequeue(peer), nullptr);
+
+        for (unsigned int offset = 8; offset + 8 <= size; offset += 8)
+            *(long long*)(reserved + offset) = position + entryHeaderSize + offset + 65536;
+        queue.publish(position);
+        EXPECT_EQ((char*)queue.dequeue(peer), reserved);
+        EXPECT_EQ(peer, &peer0);
+        queue.release();
+    }
+    EXPECT_EQ(queue.filledBufferSize(), 0);
+
+    queue.deinit();
+}
+
+static void runStressTest(unsigned int numberOfProducers, unsigned int responsesPerProducer)
+{
+    static TestResponseQueue queue;
+    EXPECT_TRUE(queue.init());
+    std::vector<TestPeer> peers(numberOfProducers);
+    volatile long long fullQueueCount = 0;
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::thread> producers;
+    for (unsigned int p = 0; p < numberOfProducers; ++p)
+    {
+        peers[p].id = p;
+        producers.emplace_back([&, p]()
+            {
+                std::mt19937_64 gen64(p);
+                TestResponse response;
+                for (unsigned int i = 0; i < responsesPerProducer; ++i)
+                {
+                    response.set(p, i, (unsigned int)(gen64() % 200));
+                    while (!queue.enqueue(&peers[p], &response.header))
+                    {
+                        _InterlockedIncrement64(&fullQueueCount);
+                        std::this_thread::yield();
+                    }
+                }
+            });
+    }
+
+    // Single consumer: responses of each producer arrive in order
+    std::vector<unsigned int> nextNumber(numberOfProducers, 0);
+    unsigned long long numberOfResponses = 0;
+    while (numberOfResponses < (unsigned long long)numberOfProducers * responsesPerProducer)
+    {
+        TestPeer* peer;
+        const TestResponse* response = (const TestResponse*)queue.dequeue(peer);
+        if (!response)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        EXPECT_TRUE(response->check());
+        EXPECT_EQ(peer->id, response->producer);
+        EXPECT_EQ(response->number, nextNumber[response->producer]);
+        nextNumber[response->producer] = response->number + 1;
+        queue.release();
+        ++numberOfResponses;
+    }
+
+    for (auto& producer : producers)
+        producer.join();
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime);
+
+    TestPeer* peer;
+    EXPECT_EQ(queue.dequeue(peer), nullptr);
+    EXPECT_EQ(queue.waitingLength(), 0);
+    EXPECT_EQ(queue.filledBufferSize(), 0);
+    EXPECT_EQ(queue.enqueuedCount(), (long long)numberOfProducers * responsesPerProducer);
+
+    std::cout << numberOfProducers << " producers: " << numberOfResponses << " responses in " << duration.count() << " microseconds, "
+        << queue.failedReservationCount() << " failed reservations, " << fullQueueCount << " times queue full, "
+        << queue.averageEnqueueTicks() << " ticks average enqueue latency" << std::endl;
+
+    queue.deinit();
+}
+
+TEST(TestCoreResponseQueue, StressTest)
+{
+    runStressTest(1, 100000);
+    runStressTest(4, 25000);
+    runStressTest(8, 20000);
+}
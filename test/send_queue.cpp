@@ -0,0 +1,184 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/network_core/send_queue.h"
+#include "../src/network_messages/common_response.h"
+
+#include <random>
+#include <vector>
+
+
+struct TestMessage
+{
+    RequestResponseHeader header;
+    unsigned int number;
+    unsigned char payload[3000];
+
+    void set(unsigned char type, unsigned int number, unsigned int payloadSize)
+    {
+        this->number = number;
+        for (unsigned int i = 0; i < payloadSize; ++i)
+            payload[i] = (unsigned char)(number + i);
+        header.checkAndSetSize(sizeof(RequestResponseHeader) + 4 + payloadSize);
+        header.setType(type);
+        header.setDejavu(0);
+    }
+
+    bool check() const
+    {
+        const unsigned int payloadSize = header.size() - sizeof(RequestResponseHeader) - 4;
+        for (unsigned int i = 0; i < payloadSize; ++i)
+            if (payload[i] != (unsigned char)(number + i))
+                return false;
+        return true;
+    }
+};
+
+typedef SendQueue<65536, sizeof(TestMessage)> TestSendQueue;
+
+// Split transmitted data into messages
+static std::vector<const TestMessage*> splitTransmission(const char* transmission, unsigned int size)
+{
+    std::vector<const TestMessage*> messages;
+    unsigned int offset = 0;
+    while (offset < size)
+    {
+        const TestMessage* message = (const TestMessage*)(transmission + offset);
+        EXPECT_TRUE(message->check());
+        messages.push_back(message);
+        offset += message->header.size();
+    }
+    EXPECT_EQ(offset, size);
+    return messages;
+}
+
+TEST(TestCoreSendQueue, SendPriorities)
+{
+    EXPECT_EQ(getSendPriority(BroadcastTick::type), SEND_PRIORITY_CONSENSUS);
+    EXPECT_EQ(getSendPriority(BroadcastFutureTickData::type), SEND_PRIORITY_CONSENSUS);
+    EXPECT_EQ(getSendPriority(RequestQuorumTick::type), SEND_PRIORITY_CONSENSUS);
+    EXPECT_EQ(getSendPriority(ExchangePublicPeers::type), SEND_PRIORITY_CONSENSUS);
+    EXPECT_EQ(getSendPriority(BROADCAST_TRANSACTION), SEND_PRIORITY_TRANSACTIONS);
+    EXPECT_EQ(getSendPriority(EndResponse::type), SEND_PRIORITY_BULK);
+    EXPECT_EQ(getSendPriority(45), SEND_PRIORITY_BULK); // RespondLog
+}
+
+TEST(TestCoreSendQueue, HigherPriorityFirst)
+{
+    static TestSendQueue queue;
+    static char transmission[65536];
+    EXPECT_TRUE(queue.init());
+    TestMessage message;
+
+    // Add bulk messages first, consensus messages last
+    unsigned int number = 0;
+    for (unsigned int priority = NUMBER_OF_SEND_PRIORITIES; priority-- > 0; )
+    {
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+            message.set((unsigned char)priority, number++, 100 + i);
+            EXPECT_TRUE(queue.add(priority, &message.header));
+        }
+    }
+    EXPECT_EQ(queue.size(SEND_PRIORITY_CONSENSUS), 3 * (sizeof(RequestResponseHeader) + 4) + 100 + 101 + 102);
+
+    // Consensus messages are transmitted first, each priority in FIFO order
+    const unsigned int size = queue.takeForTransmission(transmission, sizeof(transmission), 65536);
+    std::vector<const TestMessage*> messages = splitTransmission(transmission, size);
+    ASSERT_EQ(messages.size(), 9);
+    const unsigned int expectedNumbers[9] = { 6, 7, 8, 3, 4, 5, 0, 1, 2 };
+    for (unsigned int i = 0; i < 9; ++i)
+    {
+        EXPECT_EQ(messages[i]->number, expectedNumbers[i]);
+    }
+    EXPECT_EQ(queue.size(), 0);
+
+    queue.deinit();
+}
+
+TEST(TestCoreSendQueue, LimitBulkPerTransmission)
+{
+    static TestSendQueue queue;
+    static char transmission[65536];
+    EXPECT_TRUE(queue.init());
+    TestMessage message;
+
+    for (unsigned int i = 0; i < 10; ++i)
+    {
+        message.set(0, i, 1000 - 8 - 4);
+        EXPECT_TRUE(queue.add(SEND_PRIORITY_BULK, &message.header));
+    }
+
+    // Only 2 bulk messages fit into 2500 bytes, but all consensus messages are taken
+    message.set(0, 100, 10);
+    EXPECT_TRUE(queue.add(SEND_PRIORITY_CONSENSUS, &message.header));
+    unsigned int size = queue.takeForTransmission(transmission, sizeof(transmission), 2500);
+    std::vector<const TestMessage*> messages = splitTransmission(transmission, size);
+    ASSERT_EQ(messages.size(), 3);
+    EXPECT_EQ(messages[0]->number, 100);
+    EXPECT_EQ(messages[1]->number, 0);
+    EXPECT_EQ(messages[2]->number, 1);
+    EXPECT_EQ(queue.size(), 8000);
+
+    // At least one bulk message is taken even if it exceeds the limit
+    size = queue.takeForTransmission(transmission, sizeof(transmission), 500);
+    messages = splitTransmission(transmission, size);
+    ASSERT_EQ(messages.size(), 1);
+    EXPECT_EQ(messages[0]->number, 2);
+
+    // Transmission buffer size is respected
+    size = queue.takeForTransmission(transmission, 3999, 65536);
+    messages = splitTransmission(transmission, size);
+    ASSERT_EQ(messages.size(), 3);
+    EXPECT_EQ(messages[2]->number, 5);
+    EXPECT_EQ(queue.size(), 4000);
+
+    queue.deinit();
+}
+
+TEST(TestCoreSendQueue, DropWhenFullAndReuseSpace)
+{
+    static TestSendQueue queue;
+    static char transmission[65536];
+    EXPECT_TRUE(queue.init());
+    TestMessage message;
+    std::mt19937_64 gen64(42);
+
+    // Fill and drain queues in random steps, checking FIFO order and that only full queues drop messages
+    unsigned int added[NUMBER_OF_SEND_PRIORITIES] = { 0 }, taken[NUMBER_OF_SEND_PRIORITIES] = { 0 };
+    unsigned long long dropped[NUMBER_OF_SEND_PRIORITIES] = { 0 };
+    for (int round = 0; round < 1000; ++round)
+    {
+        const unsigned int toAdd = (unsigned int)(gen64() % 30);
+        for (unsigned int i = 0; i < toAdd; ++i)
+        {
+            const unsigned int priority = (unsigned int)(gen64() % NUMBER_OF_SEND_PRIORITIES);
+            const unsigned int payloadSize = (unsigned int)(gen64() % sizeof(message.payload));
+            const unsigned int regionSize = (priority == SEND_PRIORITY_BULK) ? TestSendQueue::BULK_REGION_SIZE : TestSendQueue::CONSENSUS_REGION_SIZE;
+            const bool fits = queue.size(priority) + sizeof(RequestResponseHeader) + 4 + payloadSize <= regionSize;
+            message.set((unsigned char)priority, priority * 1000000 + added[priority], payloadSize);
+            EXPECT_EQ(queue.add(priority, &message.header), fits);
+            if (fits)
+                ++added[priority];
+            else
+                ++dropped[priority];
+        }
+
+        const unsigned int size = queue.takeForTransmission(transmission, (unsigned int)(gen64() % sizeof(transmission)), 10000);
+        for (const TestMessage* takenMessage : splitTransmission(transmission, size))
+        {
+            const unsigned int priority = takenMessage->number / 1000000;
+            EXPECT_EQ(takenMessage->number % 1000000, taken[priority]);
+            ++taken[priority];
+        }
+    }
+    for (unsigned int priority = 0; priority < NUMBER_OF_SEND_PRIORITIES; ++priority)
+    {
+        EXPECT_GT(dropped[priority], 0);
+        EXPECT_EQ(queue.droppedCount(priority), dropped[priority]);
+        EXPECT_GT(taken[priority], 100);
+    }
+
+    queue.deinit();
+}
@@ -6,8 +6,11 @@
 
 #include "../src/spectrum.h"
 
+#include <atomic>
 #include <chrono>
 #include <random>
+#include <thread>
+#include <vector>
 
 static bool transfer(const m256i& src, const m256i& dst, long long amount)
 {
@@ -77,6 +80,16 @@ static SpectrumInfo checkAndGetInfo()
     EXPECT_LE((unsigned long long)si.totalAmount, MAX_SUPPLY);
     EXPECT_EQ(si.totalAmount, spectrumInfo.totalAmount);
     EXPECT_EQ(si.numberOfEntities, spectrumInfo.numberOfEntities);
+
+    // Continuously updated entity category populations match counting from scratch
+    unsigned int populations[entityCategoryCount];
+    countEntityCategoryPopulations(populations);
+    for (int i = 0; i < entityCategoryCount; ++i)
+        EXPECT_EQ(populations[i], entityCategoryPopulations[i]);
+
+    // Probe tags match public keys
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
+        EXPECT_EQ(spectrumProbeTags.data()[i], isZero(spectrum[i].publicKey) ? 0 : spectrumProbeTags.tagOf(spectrum[i].publicKey));
     return si;
 }
 
@@ -143,7 +156,9 @@ struct SpectrumTest
     void clearSpectrum()
     {
         memset(spectrum, 0, spectrumSizeInBytes);
+        rebuildSpectrumBalances();
         updateSpectrumInfo();
+        updateAndAnalzeEntityCategoryPopulations();
     }
 
     void beforeAntiDust()
@@ -214,6 +229,37 @@ void SpectrumTest::dust_attack(unsigned int transferMinAmount, unsigned int tran
     }
 }
 
+// Helper threads working on the parallel jobs as long as the object exists, as the request processors do in the node
+class ParallelJobHelpers
+{
+public:
+    ParallelJobHelpers(unsigned int numberOfThreads = 3)
+    {
+        for (unsigned int i = 0; i < numberOfThreads; ++i)
+            threads.emplace_back(&ParallelJobHelpers::run, this);
+    }
+
+    ~ParallelJobHelpers()
+    {
+        stop = true;
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+private:
+    void run()
+    {
+        while (!stop)
+        {
+            parallelJob.help();
+            _mm_pause();
+        }
+    }
+
+    std::atomic<bool> stop = false;
+    std::vector<std::thread> threads;
+};
+
 TEST(TestCoreSpectrum, AntiDustFile)
 {
     SpectrumTest test;
@@ -311,3 +357,580 @@ TEST(TestCoreSpectrum, AntiDustEdgeCaseHugeBinZeroBalance)
     test.afterAntiDust();
 }
 
+static void fillSpectrumWithRandomDust(SpectrumTest& test)
+{
+    test.rnd64.seed(42);
+    test.clearSpectrum();
+    for (unsigned long long i = 0; i < SPECTRUM_CAPACITY / 2; ++i)
+    {
+        const unsigned long long amount = 1 + test.rnd64() % ((test.rnd64() & 1) ? 100 : 100000);
+        increaseEnergy(m256i(i, test.rnd64(), 2, 3), amount);
+        spectrumInfo.totalAmount += amount;
+    }
+}
+
+TEST(TestCoreSpectrum, AntiDustFusedWithReorganization)
+{
+    SpectrumTest test(42);
+    const unsigned long long burnAllThreshold = 63, burnHalfThreshold = 127;
+
+    // Reference: burn in separate passes as before, then reorganize
+    fillSpectrumWithRandomDust(test);
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
+    {
+        const unsigned long long balance = spectrum[i].incomingAmount - spectrum[i].outgoingAmount;
+        if (balance <= burnAllThreshold && balance)
+            spectrum[i].outgoingAmount = spectrum[i].incomingAmount;
+    }
+    unsigned int countBurnCandidates = 0;
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
+    {
+        const unsigned long long balance = spectrum[i].incomingAmount - spectrum[i].outgoingAmount;
+        if (balance <= burnHalfThreshold && balance && (++countBurnCandidates & 1))
+            spectrum[i].outgoingAmount = spectrum[i].incomingAmount;
+    }
+    reorganizeSpectrum();
+    const m256i referenceDigest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
+    const SpectrumInfo referenceInfo = spectrumInfo;
+
+    // Burning fused into reorganization (the digest tree covers the whole spectrum, so equal root digests mean
+    // equal spectrum content)
+    fillSpectrumWithRandomDust(test);
+    reorganizeSpectrum(burnAllThreshold, burnHalfThreshold);
+    EXPECT_EQ(spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1], referenceDigest);
+    EXPECT_EQ(spectrumInfo.numberOfEntities, referenceInfo.numberOfEntities);
+    EXPECT_EQ(spectrumInfo.totalAmount, referenceInfo.totalAmount);
+    checkAndGetInfo();
+}
+
+// Reorganization as implemented before parallelization: reinsert all entities into empty reorgBuffer in index order
+static void reorganizeSpectrumSerially()
+{
+    ::Entity* reorgSpectrum = (::Entity*)reorgBuffer;
+    setMem(reorgSpectrum, SPECTRUM_CAPACITY * sizeof(::Entity), 0);
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
+    {
+        if (spectrum[i].incomingAmount - spectrum[i].outgoingAmount)
+        {
+            unsigned int index = spectrum[i].publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
+            while (!isZero(reorgSpectrum[index].publicKey))
+                index = (index + 1) & (SPECTRUM_CAPACITY - 1);
+            copyMem(&reorgSpectrum[index], &spectrum[i], sizeof(::Entity));
+        }
+    }
+    copyMem(spectrum, reorgSpectrum, SPECTRUM_CAPACITY * sizeof(::Entity));
+    rebuildSpectrumBalances();
+    rebuildSpectrumDigests();
+    updateSpectrumInfo();
+    updateAndAnalzeEntityCategoryPopulations();
+}
+
+static void fillSpectrumWithZeroBalancesAndWrappingCluster(SpectrumTest& test)
+{
+    test.rnd64.seed(123);
+    test.clearSpectrum();
+
+    // Cluster wrapping around the end of the hash map
+    for (unsigned long long i = 0; i < 100; ++i)
+    {
+        const unsigned long long amount = 1 + test.rnd64() % 1000;
+        increaseEnergy(m256i((i << 32) | (SPECTRUM_CAPACITY - 1 - test.rnd64() % 20), 1, 2, 3), amount);
+        spectrumInfo.totalAmount += amount;
+    }
+
+    // Long clusters with many entities without balance
+    for (unsigned long long i = 0; i < SPECTRUM_CAPACITY / 2 + SPECTRUM_CAPACITY / 8; ++i)
+    {
+        const m256i id(test.rnd64(), test.rnd64(), 2, 3);
+        const unsigned long long amount = 1 + test.rnd64() % 1000;
+        increaseEnergy(id, amount);
+        if (test.rnd64() % 3 == 0)
+            decreaseEnergy(spectrumIndex(id), amount);
+        else
+            spectrumInfo.totalAmount += amount;
+    }
+}
+
+TEST(TestCoreSpectrum, ParallelReorganization)
+{
+    SpectrumTest test(42);
+
+    ParallelJobHelpers helpers;
+
+    fillSpectrumWithZeroBalancesAndWrappingCluster(test);
+    EXPECT_FALSE(isZero(spectrum[0].publicKey));
+    EXPECT_FALSE(isZero(spectrum[SPECTRUM_CAPACITY - 1].publicKey));
+    auto t0 = std::chrono::steady_clock::now();
+    reorganizeSpectrumSerially();
+    auto t1 = std::chrono::steady_clock::now();
+    const m256i referenceDigest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
+    const SpectrumInfo referenceInfo = spectrumInfo;
+
+    fillSpectrumWithZeroBalancesAndWrappingCluster(test);
+    const unsigned long long prepareTicks = spectrumReorgPrepareExecutionTicks, relocateTicks = spectrumReorgRelocateExecutionTicks;
+    auto t2 = std::chrono::steady_clock::now();
+    reorganizeSpectrum();
+    auto t3 = std::chrono::steady_clock::now();
+    EXPECT_EQ(spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1], referenceDigest);
+    EXPECT_EQ(spectrumInfo.numberOfEntities, referenceInfo.numberOfEntities);
+    EXPECT_EQ(spectrumInfo.totalAmount, referenceInfo.totalAmount);
+    checkAndGetInfo();
+
+    std::cout << "Spectrum reorganization with digests: serial " << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count()
+        << " ms, parallel in-place " << std::chrono::duration_cast<std::chrono::milliseconds>(t3 - t2).count()
+        << " ms (" << spectrumReorgPrepareExecutionTicks - prepareTicks << " ticks preparing, "
+        << spectrumReorgRelocateExecutionTicks - relocateTicks << " ticks relocating)" << std::endl;
+}
+
+TEST(TestCoreSpectrum, BatchedLookup)
+{
+    SpectrumTest test(42);
+
+    // Populate spectrum up to the anti-dust limit
+    while (spectrumInfo.numberOfEntities < (SPECTRUM_CAPACITY / 2) + (SPECTRUM_CAPACITY / 4) - 1)
+    {
+        increaseEnergy(m256i(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64()), 1 + test.rnd64() % 1000);
+    }
+
+    // Sources and destinations of a full tick: existing entities, unknown entities, and missing transactions
+    constexpr unsigned int count = NUMBER_OF_TRANSACTIONS_PER_TICK * 2;
+    std::vector<m256i> keys(count);
+    std::vector<const m256i*> keyPointers(count);
+    std::vector<int> batchIndices(count), singleIndices(count);
+    long long batchMicroseconds = 0, singleMicroseconds = 0;
+    for (int round = 0; round < 100; ++round)
+    {
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            const unsigned int slot = test.rnd64() & (SPECTRUM_CAPACITY - 1);
+            keys[i] = (i % 4 == 3 || isZero(spectrum[slot].publicKey)) ? m256i(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64()) : spectrum[slot].publicKey;
+            keyPointers[i] = (i % 64 == 5) ? nullptr : &keys[i];
+        }
+
+        // Alternate order of measurements, so none of them profits from lines cached by the other one
+        auto t0 = std::chrono::steady_clock::now();
+        if (round & 1)
+        {
+            spectrumIndices(keyPointers.data(), count, batchIndices.data());
+        }
+        else
+        {
+            for (unsigned int i = 0; i < count; ++i)
+                singleIndices[i] = keyPointers[i] ? spectrumIndex(*keyPointers[i]) : -1;
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        if (round & 1)
+        {
+            for (unsigned int i = 0; i < count; ++i)
+                singleIndices[i] = keyPointers[i] ? spectrumIndex(*keyPointers[i]) : -1;
+        }
+        else
+        {
+            spectrumIndices(keyPointers.data(), count, batchIndices.data());
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        const long long firstMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+        const long long secondMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+        batchMicroseconds += (round & 1) ? firstMicroseconds : secondMicroseconds;
+        singleMicroseconds += (round & 1) ? secondMicroseconds : firstMicroseconds;
+
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            EXPECT_EQ(batchIndices[i], singleIndices[i]);
+            if (keyPointers[i])
+            {
+                EXPECT_EQ(spectrumIndex(*keyPointers[i], batchIndices[i]), singleIndices[i]);
+            }
+        }
+    }
+    std::cout << "Looking up " << count << " sources and destinations: one by one " << singleMicroseconds / 100
+        << " us, batched with prefetching " << batchMicroseconds / 100 << " us" << std::endl;
+
+    // A cached index that is not valid anymore (for example, because the entity has been moved) is detected
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        if (singleIndices[i] >= 0)
+        {
+            EXPECT_EQ(spectrumIndex(keys[i], (singleIndices[i] + 1) & (SPECTRUM_CAPACITY - 1)), singleIndices[i]);
+        }
+    }
+
+    // increaseEnergy() with a valid or invalid cached index changes the same entity as without
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        if (singleIndices[i] >= 0)
+        {
+            const long long balance = energy(singleIndices[i]);
+            increaseEnergy(keys[i], 10, (i % 2) ? singleIndices[i] : (singleIndices[i] + 1) & (SPECTRUM_CAPACITY - 1));
+            EXPECT_EQ(spectrumIndex(keys[i]), singleIndices[i]);
+            EXPECT_EQ(energy(singleIndices[i]), balance + 10);
+        }
+    }
+    const m256i newKey(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64());
+    increaseEnergy(newKey, 10, singleIndices[0]);
+    ASSERT_GE(spectrumIndex(newKey), 0);
+    EXPECT_EQ(energy(spectrumIndex(newKey)), 10);
+}
+
+TEST(TestCoreSpectrum, HotBalanceColumnScan)
+{
+    SpectrumTest test(42);
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY / 2; ++i)
+    {
+        const m256i id(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64());
+        increaseEnergy(id, 1 + test.rnd64() % 1000000);
+        if (i % 16 == 0)
+            decreaseEnergy(spectrumIndex(id), 1 + test.rnd64() % 1000);
+    }
+
+    // Balance column is consistent with entities
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; ++i)
+        EXPECT_EQ(spectrumBalances[i], spectrum[i].incomingAmount - spectrum[i].outgoingAmount);
+
+    // Compare full scan throughput of the 64-byte entities and the balance column
+    unsigned long long entitySum = 0, columnSum = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int rep = 0; rep < 3; ++rep)
+        for (unsigned int i = 0; i < SPECTRUM_CAPACITY; ++i)
+            entitySum += spectrum[i].incomingAmount - spectrum[i].outgoingAmount;
+    auto t1 = std::chrono::steady_clock::now();
+    for (int rep = 0; rep < 3; ++rep)
+        for (unsigned int i = 0; i < SPECTRUM_CAPACITY; ++i)
+            columnSum += spectrumBalances[i];
+    auto t2 = std::chrono::steady_clock::now();
+    EXPECT_EQ(entitySum, columnSum);
+
+    SpectrumInfo si;
+    updateSpectrumInfo(si);
+    auto t3 = std::chrono::steady_clock::now();
+    unsigned int populations[entityCategoryCount];
+    countEntityCategoryPopulations(populations);
+    auto t4 = std::chrono::steady_clock::now();
+    EXPECT_EQ(si.totalAmount, columnSum / 3);
+    for (int i = 0; i < entityCategoryCount; ++i)
+        EXPECT_EQ(populations[i], entityCategoryPopulations[i]);
+
+    const double entityMilliseconds = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count() / 3000.0;
+    const double columnMilliseconds = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() / 3000.0;
+    std::cout << "Full balance scan: entities " << entityMilliseconds << " ms (" << spectrumSizeInBytes / 1000.0 / entityMilliseconds << " MB/s), balance column "
+        << columnMilliseconds << " ms (" << spectrumBalancesSizeInBytes / 1000.0 / columnMilliseconds << " MB/s); updateSpectrumInfo() "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(t3 - t2).count() << " ms, countEntityCategoryPopulations() "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(t4 - t3).count() << " ms" << std::endl;
+}
+
+// Reference: linear probing comparing the key of every slot
+static int findSpectrumIndexWithoutTags(const m256i& publicKey, unsigned int& keyComparisons)
+{
+    unsigned int index = publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
+    for (keyComparisons = 1; ; keyComparisons++)
+    {
+        if (spectrum[index].publicKey == publicKey)
+            return index;
+        if (isZero(spectrum[index].publicKey))
+            return -1;
+        index = (index + 1) & (SPECTRUM_CAPACITY - 1);
+    }
+}
+
+TEST(TestCoreSpectrum, TaggedProbing)
+{
+    SpectrumTest test(42);
+
+    // Populate spectrum up to the anti-dust limit, where probe sequences are longest
+    std::vector<m256i> existingKeys;
+    while (spectrumInfo.numberOfEntities < (SPECTRUM_CAPACITY / 2) + (SPECTRUM_CAPACITY / 4) - 1)
+    {
+        const m256i id(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64());
+        increaseEnergy(id, 1 + test.rnd64() % 1000);
+        if (existingKeys.size() < 1000000 && (test.rnd64() & 7) == 0)
+            existingKeys.push_back(id);
+    }
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
+        EXPECT_EQ(spectrumProbeTags.data()[i], isZero(spectrum[i].publicKey) ? 0 : spectrumProbeTags.tagOf(spectrum[i].publicKey));
+
+    // Half of the lookups are for unknown entities, which have to probe up to the next empty slot
+    std::vector<m256i> keys(existingKeys.size() * 2);
+    for (size_t i = 0; i < keys.size(); ++i)
+        keys[i] = (i & 1) ? m256i(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64()) : existingKeys[i / 2];
+    std::vector<int> taggedIndices(keys.size()), untaggedIndices(keys.size());
+
+    unsigned long long untaggedKeyComparisons = 0, untaggedExistingKeyComparisons = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        unsigned int keyComparisons;
+        untaggedIndices[i] = findSpectrumIndexWithoutTags(keys[i], keyComparisons);
+        untaggedKeyComparisons += keyComparisons;
+        if ((i & 1) == 0)
+            untaggedExistingKeyComparisons += keyComparisons;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    spectrumProbeTags.resetStatistics();
+    for (size_t i = 0; i < keys.size(); ++i)
+        taggedIndices[i] = findSpectrumIndex(keys[i]);
+    auto t2 = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        EXPECT_EQ(taggedIndices[i], untaggedIndices[i]);
+        EXPECT_EQ(taggedIndices[i] >= 0, (i & 1) == 0);
+    }
+
+    // Lookups of readers are not counted, updates of the writer are
+    EXPECT_EQ(spectrumProbeTags.probeCount(), 0);
+    for (const m256i& id : existingKeys)
+        increaseEnergy(id, 1);
+    EXPECT_EQ(spectrumProbeTags.probeCount(), existingKeys.size());
+    EXPECT_LT(spectrumProbeTags.averageKeyComparisonsTimes100(), untaggedExistingKeyComparisons * 100 / existingKeys.size());
+
+    std::cout << keys.size() << " lookups at 75% load: without tags " << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count()
+        << " ms (" << untaggedKeyComparisons / (double)keys.size() << " key compares per lookup), with tags "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << " ms; updates of existing entities: without tags "
+        << untaggedExistingKeyComparisons / (double)existingKeys.size() << " key compares, with tags "
+        << spectrumProbeTags.averageKeyComparisonsTimes100() / 100.0 << " key compares, "
+        << spectrumProbeTags.averageProbeLengthTimes100() / 100.0 << " slots per update, max "
+        << spectrumProbeTags.maxProbeLengthSlots() << " slots" << std::endl;
+
+    // Tags stay consistent when the spectrum is reorganized
+    increaseEnergy(m256i(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64()), 1);
+    increaseEnergy(m256i(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64()), 1);
+    EXPECT_LT(spectrumInfo.numberOfEntities, (SPECTRUM_CAPACITY / 2) + (SPECTRUM_CAPACITY / 4) - 1);
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
+        EXPECT_EQ(spectrumProbeTags.data()[i], isZero(spectrum[i].publicKey) ? 0 : spectrumProbeTags.tagOf(spectrum[i].publicKey));
+}
+
+TEST(TestCoreSpectrum, MultiLaneKangarooTwelve64To32)
+{
+    std::mt19937_64 rnd64(42);
+    unsigned long long inputs[8][8], outputs[8][4], expectedOutputs[8][4];
+    const void* inputPointers[8];
+    void* outputPointers[8];
+    for (int test = 0; test < 1000; ++test)
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            for (int j = 0; j < 8; ++j)
+                inputs[i][j] = rnd64();
+            KangarooTwelve64To32(inputs[i], expectedOutputs[i]);
+            inputPointers[i] = inputs[i];
+            outputPointers[i] = outputs[i];
+        }
+
+        memset(outputs, 0, sizeof(outputs));
+        KangarooTwelve64To32x4(inputPointers, outputPointers);
+        KangarooTwelve64To32x4(inputPointers + 4, outputPointers + 4);
+        EXPECT_EQ(memcmp(outputs, expectedOutputs, sizeof(outputs)), 0);
+
+        memset(outputs, 0, sizeof(outputs));
+        KangarooTwelve64To32Lanes(inputPointers, outputPointers);
+        if (K12_64To32_LANES == 4)
+            KangarooTwelve64To32Lanes(inputPointers + 4, outputPointers + 4);
+        EXPECT_EQ(memcmp(outputs, expectedOutputs, sizeof(outputs)), 0);
+    }
+}
+
+// Compute digest tree with one KangarooTwelve64To32 call per node (reference implementation)
+static void computeSpectrumDigestsSerially(m256i* digests)
+{
+    unsigned int digestIndex;
+    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
+    {
+        KangarooTwelve64To32(&spectrum[digestIndex], &digests[digestIndex]);
+    }
+    unsigned int previousLevelBeginning = 0;
+    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
+    while (numberOfLeafs > 1)
+    {
+        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+        {
+            KangarooTwelve64To32(&digests[previousLevelBeginning + i], &digests[digestIndex++]);
+        }
+
+        previousLevelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+    }
+}
+
+TEST(TestCoreSpectrum, SpectrumDigests)
+{
+    SpectrumTest test;
+    m256i* referenceDigests = nullptr;
+    ASSERT_TRUE(allocatePool(spectrumDigestsSizeInByte, (void**)&referenceDigests));
+
+    ParallelJobHelpers helpers;
+
+    // Fill half of the spectrum
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY / 2; ++i)
+    {
+        increaseEnergy(m256i(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64()), test.rnd64() % 1000000 + 1);
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    computeSpectrumDigestsSerially(referenceDigests);
+    auto t1 = std::chrono::steady_clock::now();
+    rebuildSpectrumDigests();
+    auto t2 = std::chrono::steady_clock::now();
+    EXPECT_EQ(memcmp(referenceDigests, spectrumDigests, spectrumDigestsSizeInByte), 0);
+    std::cout << "Full rebuild: serial " << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count()
+        << " ms, multi-lane/parallel " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << " ms" << std::endl;
+
+    // Change 0.1%, 1%, 10%, and 100% of the leaves and compare incremental update with full rebuild
+    for (double churnPercent : { 0.1, 1.0, 10.0, 100.0 })
+    {
+        const unsigned int changedLeaves = (unsigned int)(SPECTRUM_CAPACITY * churnPercent / 100);
+        for (unsigned int i = 0; i < changedLeaves; ++i)
+        {
+            const unsigned int index = (changedLeaves == SPECTRUM_CAPACITY) ? i : (unsigned int)(test.rnd64() & (SPECTRUM_CAPACITY - 1));
+            spectrum[index].incomingAmount += 1;
+            spectrum[index].latestIncomingTransferTick = ++system.tick;
+            markSpectrumLeafChanged(index);
+        }
+
+        t0 = std::chrono::steady_clock::now();
+        updateSpectrumDigests();
+        t1 = std::chrono::steady_clock::now();
+        computeSpectrumDigestsSerially(referenceDigests);
+        t2 = std::chrono::steady_clock::now();
+        EXPECT_EQ(memcmp(referenceDigests, spectrumDigests, spectrumDigestsSizeInByte), 0);
+        for (unsigned int i = 0; i < SPECTRUM_CAPACITY / 64; ++i)
+            EXPECT_EQ(spectrumChangeFlags[i], 0);
+        for (unsigned int i = 0; i < SPECTRUM_CAPACITY / 128; ++i)
+            EXPECT_EQ(spectrumChangeFlagsNextLevel[i], 0);
+        rebuildSpectrumDigests();
+        auto t3 = std::chrono::steady_clock::now();
+        EXPECT_EQ(memcmp(referenceDigests, spectrumDigests, spectrumDigestsSizeInByte), 0);
+
+        std::cout << churnPercent << "% leaf churn: dirty-only update " << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count()
+            << " ms, full rebuild " << std::chrono::duration_cast<std::chrono::milliseconds>(t3 - t2).count()
+            << " ms, serial full rebuild " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << " ms" << std::endl;
+    }
+    freePool(referenceDigests);
+}
+
+TEST(TestCoreSpectrum, SpectrumDigestsIndependentOfThreadCount)
+{
+    SpectrumTest test;
+    const unsigned long long seed = test.rnd64();
+    m256i* referenceDigests = nullptr;
+    m256i* rebuiltDigests = nullptr;
+    ASSERT_TRUE(allocatePool(spectrumDigestsSizeInByte, (void**)&referenceDigests));
+    ASSERT_TRUE(allocatePool(spectrumDigestsSizeInByte, (void**)&rebuiltDigests));
+
+    // Same updates with different numbers of helper threads, batches below and above the limit of the list of
+    // changed leaves (so both update paths are used)
+    const unsigned int changedLeavesPerRound[] = { 1, 1000, MAX_NUMBER_OF_CHANGED_SPECTRUM_LEAVES, MAX_NUMBER_OF_CHANGED_SPECTRUM_LEAVES + 1000 };
+    std::vector<m256i> referenceRootDigests;
+    for (unsigned int numberOfHelpers : { 0, 1, 3 })
+    {
+        ParallelJobHelpers helpers(numberOfHelpers);
+        std::mt19937_64 rnd64(seed);
+        test.clearSpectrum();
+        std::vector<m256i> ids(SPECTRUM_CAPACITY / 16);
+        for (auto& id : ids)
+        {
+            id = m256i(rnd64(), rnd64(), rnd64(), rnd64());
+            increaseEnergy(id, rnd64() % 1000000 + 1);
+        }
+        rebuildSpectrumDigests();
+
+        std::vector<m256i> rootDigests;
+        for (unsigned int changedLeaves : changedLeavesPerRound)
+        {
+            // Random balance changes of existing entities and new entities
+            for (unsigned int i = 0; i < changedLeaves; ++i)
+            {
+                const m256i& id = ids[rnd64() % ids.size()];
+                if (rnd64() % 2)
+                    increaseEnergy(id, rnd64() % 1000 + 1);
+                else
+                    decreaseEnergy(spectrumIndex(id), 1);
+                if (rnd64() % 8 == 0)
+                    increaseEnergy(m256i(rnd64(), rnd64(), rnd64(), rnd64()), 1);
+            }
+            updateSpectrumDigests();
+            rootDigests.push_back(spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1]);
+
+            // Incremental update yields the same tree as a full rebuild
+            copyMem(rebuiltDigests, spectrumDigests, spectrumDigestsSizeInByte);
+            rebuildSpectrumDigests();
+            EXPECT_EQ(memcmp(rebuiltDigests, spectrumDigests, spectrumDigestsSizeInByte), 0) << numberOfHelpers << " helpers, " << changedLeaves << " changed leaves";
+        }
+
+        if (referenceRootDigests.empty())
+        {
+            referenceRootDigests = rootDigests;
+            copyMem(referenceDigests, spectrumDigests, spectrumDigestsSizeInByte);
+        }
+        else
+        {
+            EXPECT_EQ(rootDigests, referenceRootDigests) << numberOfHelpers << " helpers";
+            EXPECT_EQ(memcmp(referenceDigests, spectrumDigests, spectrumDigestsSizeInByte), 0) << numberOfHelpers << " helpers";
+        }
+    }
+
+    freePool(rebuiltDigests);
+    freePool(referenceDigests);
+}
+
+TEST(TestCoreSpectrum, ConcurrentReadersAndWriter)
+{
+    SpectrumTest test(42);
+
+    // Entities that keep a balance and must always be found by the readers
+    std::vector<m256i> knownIds(10000);
+    for (auto& id : knownIds)
+    {
+        id = m256i(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64());
+        increaseEnergy(id, 1000);
+    }
+
+    // Readers look up entities while the writer adds entities and moves them by reorganizing the spectrum
+    volatile bool stopReaders = false;
+    std::atomic<unsigned long long> lookups = 0, failedLookups = 0;
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; ++i)
+    {
+        readers.emplace_back([&, i]()
+            {
+                unsigned long long localLookups = 0, localFailedLookups = 0;
+                for (unsigned int j = i; !stopReaders; j = (j + 1) % knownIds.size())
+                {
+                    // Look up and compare in the same read section, the entity may be moved right after it
+                    bool found;
+                    long long sequence;
+                    do
+                    {
+                        sequence = spectrumSeqLock.beginRead();
+                        const int index = findSpectrumIndex(knownIds[j]);
+                        found = index >= 0 && spectrum[index].publicKey == knownIds[j];
+                    } while (!spectrumSeqLock.endRead(sequence));
+                    if (!found)
+                        ++localFailedLookups;
+                    ++localLookups;
+                }
+                lookups += localLookups;
+                failedLookups += localFailedLookups;
+            });
+    }
+
+    const long long retriesBefore = spectrumSeqLock.retryCount();
+    for (int round = 0; round < 3; ++round)
+    {
+        for (unsigned int i = 0; i < 50000; ++i)
+        {
+            const m256i id(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64());
+            increaseEnergy(id, 1);
+            decreaseEnergy(spectrumIndex(id), 1);
+        }
+        beginSpectrumChange();
+        reorganizeSpectrum();
+        endSpectrumChange();
+    }
+
+    stopReaders = true;
+    for (auto& reader : readers)
+        reader.join();
+    EXPECT_GT(lookups, 0);
+    EXPECT_EQ(failedLookups, 0);
+    std::cout << lookups << " concurrent lookups, " << spectrumSeqLock.retryCount() - retriesBefore << " read retries" << std::endl;
+}
@@ -11,7 +11,8 @@ void setMem(void* buffer, unsigned long long size, unsigned char value)
 
 void copyMem(void* destination, const void* source, unsigned long long length)
 {
-    memcpy(destination, source, length);
+    // like UEFI's CopyMem(), support overlapping buffers
+    memmove(destination, source, length);
 }
 
 bool allocatePool(unsigned long long size, void** buffer)